@@ -1,5 +1,10 @@
 #define PI 3.14159265358979f
 
+// rebuilds a model matrix from its top 3 rows
+mat4 getModelMatrix(vec4 row0, vec4 row1, vec4 row2) {
+    return transpose(mat4(row0, row1, row2, vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+}
+
 vec4 getPos(mat4 proj, mat4 view, mat4 model, vec3 pos) {
     return proj * view * model * vec4(pos, 1.0f);
 }
@@ -14,6 +19,18 @@ vec3 getViewDir(mat4 iview, mat4 model, vec3 pos) {
     return normalize(worldCamPos - fragPos);
 }
 
+// unfolds a direction that was octahedral encoded into the -1 to 1 range
+vec3 decodeOctahedral(vec2 e) {
+    vec3 dir = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+
+    // directions in the lower half were folded over the diagonals
+    float t = max(-dir.z, 0.0f);
+    dir.x += (dir.x >= 0.0f) ? -t : t;
+    dir.y += (dir.y >= 0.0f) ? -t : t;
+
+    return normalize(dir);
+}
+
 vec3 getNonParalellTangent(vec3 normal) {
     // find a new tangent to use that wont be parallel to the normal
     vec3 nonParallel = vec3(1.0f, 0.0f, 0.0f);
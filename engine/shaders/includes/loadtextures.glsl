@@ -21,7 +21,9 @@ void getTextures(TexIndices texIndices, vec2 uv, mat3 tbn, out vec4 albedo, out
     }
 
     if (normalExists) {
-        normal = (texture(texSamplers[texIndices.normal], uv).rgb * 2.0f - 1.0f);
+        // only xy is stored for compressed normal maps
+        vec2 xy = texture(texSamplers[texIndices.normal], uv).rg * 2.0f - 1.0f;
+        normal = vec3(xy, sqrt(max(1.0f - dot(xy, xy), 0.0f)));
         normal = normalize(tbn * normal);
     }
 
@@ -1,18 +1,27 @@
-struct Vertex {
-    vec3 pos;
-    vec2 tex;
-    vec3 normal;
-    vec3 tangent;
+// a vertex of the attribute stream, read as words to avoid 16 bit storage
+// the first two words are the octahedral normal and tangent as snorm16 pairs, the last is the uv as a half float pair
+struct VertexAttributes {
+    uint normal;
+    uint tangent;
+    uint tex;
 };
 
-layout(buffer_reference) readonly buffer VertBuffer {
-    Vertex vertices[];
+layout(buffer_reference) readonly buffer AttributeBuffer {
+    VertexAttributes attributes[];
 };
 
+// 16 bit indices are packed two to a word
 layout(buffer_reference) readonly buffer IndexBuffer {
     uint indices[];
 };
 
+uint getIndex(IndexBuffer indexBuffer, uint index, bool index16) {
+    if (!index16) return indexBuffer.indices[index];
+
+    uint word = indexBuffer.indices[index / 2];
+    return ((index % 2) == 0) ? (word & 0xFFFFu) : (word >> 16);
+}
+
 // barycentric interpolation for vec2 and vec3
 #define BARYCENTRIC(type)                                                 \
     type barycentric##type(type b1, type b2, type b3, float u, float v) { \
@@ -13,6 +13,9 @@ struct PrimaryPayload {
     vec3 throughput;
 
     uint rec;
+
+    // the angle a pixel covers, used to filter the skybox
+    float spread;
 };
 
 struct ShadowPayload {
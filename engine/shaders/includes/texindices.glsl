@@ -6,7 +6,8 @@ struct TexIndices {
     int normal;
     int emissive;
     int occlusion;
+    uint index16;
 
-    uint64_t vertexAddress;
+    uint64_t attributeAddress;
     uint64_t indexAddress;
 };
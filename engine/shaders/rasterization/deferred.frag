@@ -8,11 +8,13 @@ layout(set = 0, binding = 0) uniform sampler2D texSamplers[];
 
 layout(set = 1, binding = 0) readonly buffer TexIndexBuffer {
     TexIndices texIndices[];
-};
+}
+texIndexBuffers[];
 
 layout(location = 0) in vec2 inTexCoord;
 layout(location = 1) in mat3 inTBN;  // uses locations 1, 2 and 3
 layout(location = 4) flat in uint inObjectIndex;
+layout(location = 5) flat in int inFrame;
 
 layout(location = 0) out vec4 outAlbedo;
 layout(location = 1) out vec4 outMetallicRoughness;
@@ -29,7 +31,7 @@ void main() {
     vec3 emissive;
     float occlusion;
 
-    getTextures(texIndices[inObjectIndex], inTexCoord, inTBN, albedo, metallicRoughness, normal, emissive, occlusion);
+    getTextures(texIndexBuffers[inFrame].texIndices[inObjectIndex], inTexCoord, inTBN, albedo, metallicRoughness, normal, emissive, occlusion);
 
     // discard if translucent
     if (albedo.a < 0.95f) discard;
@@ -5,11 +5,10 @@
 
 layout(location = 0) in vec3 inPosition;
 
-// individual rows of the instanced model matrix
+// the top 3 rows of the instanced model matrix
 layout(location = 1) in vec4 inModel1;
 layout(location = 2) in vec4 inModel2;
 layout(location = 3) in vec4 inModel3;
-layout(location = 4) in vec4 inModel4;
 
 layout(location = 0) out uint outDiscard;
 
@@ -37,7 +36,7 @@ void main() {
         return;
     }
 
-    mat4 model = mat4(inModel1, inModel2, inModel3, inModel4);
+    mat4 model = getModelMatrix(inModel1, inModel2, inModel3);
     gl_Position = getPos(lssbo[frame].lights[lightIndex].vp, model, inPosition);
 
     outDiscard = 0;
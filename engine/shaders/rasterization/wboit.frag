@@ -19,7 +19,8 @@ lssbo[];
 #include "../includes/texindices.glsl"
 layout(set = 5, binding = 0) readonly buffer TexIndexBuffer {
     TexIndices texIndices[];
-};
+}
+texIndexBuffers[];
 
 layout(location = 0) in vec2 inTexCoord;
 layout(location = 1) in vec3 inFragPos;
@@ -55,7 +56,7 @@ void main() {
     vec3 emissive;
     float occlusion;
 
-    getTextures(texIndices[inObjectIndex], inTexCoord, inTBN, albedo, metallicRoughness, normal, emissive, occlusion);
+    getTextures(texIndexBuffers[inFrame].texIndices[inObjectIndex], inTexCoord, inTBN, albedo, metallicRoughness, normal, emissive, occlusion);
 
     // discard if opaque
     if (albedo.a >= 0.95f) discard;
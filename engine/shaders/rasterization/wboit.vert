@@ -3,16 +3,17 @@
 #extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 inPosition;
+
+// the normal and tangent are octahedral encoded
 layout(location = 1) in vec2 inTexCoord;
-layout(location = 2) in vec3 inNormal;
-layout(location = 3) in vec3 inTangent;
+layout(location = 2) in vec2 inNormal;
+layout(location = 3) in vec2 inTangent;
 
 // per-instance data
 layout(location = 4) in vec4 inModel1;
 layout(location = 5) in vec4 inModel2;
 layout(location = 6) in vec4 inModel3;
-layout(location = 7) in vec4 inModel4;
-layout(location = 8) in uint inObjectIndex;
+layout(location = 7) in uint inObjectIndex;
 
 layout(location = 0) out vec2 outTexCoord;
 layout(location = 1) out vec3 outFragPos;
@@ -43,11 +44,11 @@ void main() {
     mat4 iproj = CamUBO[frame].iproj;
     mat4 iview = CamUBO[frame].iview;
 
-    mat4 model = mat4(inModel1, inModel2, inModel3, inModel4);
+    mat4 model = getModelMatrix(inModel1, inModel2, inModel3);
 
     vec3 viewDir = getViewDir(iview, model, inPosition);
     gl_Position = getPos(proj, view, model, inPosition);
-    outTBN = getTBN(inTangent, model, inNormal);
+    outTBN = getTBN(decodeOctahedral(inTangent), model, decodeOctahedral(inNormal));
 
     outTexCoord = inTexCoord;
     outFragPos = vec3(model * vec4(inPosition, 1.0f));
@@ -3,7 +3,8 @@
 #include <string>
 
 namespace cfg {
-constexpr uint32_t MAX_OBJECTS = 5000;
+// the texture descriptors have room for at least this many, so models loaded at runtime can add theirs
+constexpr uint32_t MAX_TEXTURES = 1024;
 
 constexpr uint32_t MAX_LIGHTS = 100;
 constexpr uint32_t LIGHTS_PER_BATCH = 4;
@@ -14,6 +15,9 @@ constexpr uint32_t MAX_RAY_RECURSION = 5;
 constexpr float NEAR_PLANE = 0.1f;
 constexpr float FAR_PLANE = 100.0f;
 
+// a coarser level of detail is used once its error covers fewer pixels than this
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+
 constexpr uint32_t SCREEN_WIDTH = 2560;
 constexpr uint32_t SCREEN_HEIGHT = 1600;
 
@@ -28,4 +32,7 @@ const std::string MODEL_DIR = SOURCE_DIR + "/assets/models/";
 const std::string SKYBOX_DIR = SOURCE_DIR + "/assets/skyboxes/";
 const std::string NOISE_DIR = SOURCE_DIR + "/assets/noise/";
 const std::string FONT_DIR = SOURCE_DIR + "/assets/fonts/";
+const std::string SCENE_DIR = SOURCE_DIR + "/assets/scenes/";
+const std::string CACHE_DIR = SOURCE_DIR + "/assets/cache/";
+const std::string PACK_DIR = SOURCE_DIR + "/assets/packs/";
 }  // namespace cfg
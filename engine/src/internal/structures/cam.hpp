@@ -8,5 +8,8 @@ struct CamMatrices {
     dml::mat4 proj{};
     dml::mat4 iview{};
     dml::mat4 iproj{};
+
+    // the depth pyramid was built with the last frame's matrices
+    dml::mat4 prevViewProj{};
 };
 }  // namespace cam
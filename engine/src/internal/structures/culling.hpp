@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace culling {
+// the views that meshlets are culled for
+// every view has its own region of the frame's draw buffer
+constexpr uint32_t CAMERA_VIEW = 0;
+constexpr uint32_t SHADOW_VIEW = 1;
+constexpr uint32_t VIEW_COUNT = 2;
+
+// the camera's meshlets that were hidden in the last frame's depth are culled again once the depth pyramid is rebuilt
+// the ones that turn out to be visible are drawn from a region after the views, so they dont pop in a frame late
+constexpr uint32_t LATE_REGION = VIEW_COUNT;
+constexpr uint32_t DRAW_REGION_COUNT = VIEW_COUNT + 1;
+
+// the camera is culled in two phases, the shadows only in the first
+constexpr uint32_t EARLY_PHASE = 0;
+constexpr uint32_t LATE_PHASE = 1;
+
+// the levels of the depth pyramid come first in its descriptors, and the deferred depth of each frame follows them
+constexpr uint32_t MAX_PYRAMID_LEVELS = 16;
+
+// a region has a list of draws per index type, in the order of scene::INDEX_TYPES
+// the draw counts of the lists are at the start of a region, and the lists follow them
+constexpr uint32_t DRAW_LIST_COUNT = 2;
+constexpr VkDeviceSize DRAW_COUNT_SIZE = 16;
+
+// an object as seen by the cull shader
+// each meshlet of each object is one item of the cull dispatch
+struct CullObject {
+    uint32_t firstItem = 0;
+    uint32_t meshletOffset = 0;
+    uint32_t meshletCount = 0;
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+    uint32_t drawList = 0;
+};
+}  // namespace culling
@@ -1,17 +1,153 @@
 #pragma once
 
-#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 
-#include "../../config.hpp"
 #include "../../libraries/dml.hpp"
 
 namespace instancing {
+// the top 3 rows of an affine matrix, laid out like VkTransformMatrixKHR
+struct Transform {
+    float m[3][4];  // [row][col]
+};
+
+// uploaded as is, the transforms are gathered into the order the instances are drawn in
 struct ObjectInstance {
-    dml::mat4 model{};
-    uint32_t objectIndex = 0;
+    Transform transform{};
+    uint32_t meshIndex = 0;  // into the scene's meshes, which is also its tex indices
+};
+
+// a run of instance slots that changed, so only they have to be uploaded
+struct SlotRange {
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+// sorts the ranges and joins the ones that overlap or are closer than the gap
+// writing a few unchanged slots is cheaper than splitting the upload
+inline void mergeRanges(std::vector<SlotRange>& ranges, uint32_t gap = 0) {
+    if (ranges.size() < 2) return;
+    std::sort(ranges.begin(), ranges.end(), [](const SlotRange& a, const SlotRange& b) { return a.first < b.first; });
+
+    size_t merged = 0;
+    for (size_t i = 1; i < ranges.size(); i++) {
+        SlotRange& last = ranges[merged];
+        uint32_t end = last.first + last.count;
+
+        if (ranges[i].first <= end + gap) {
+            last.count = std::max(end, ranges[i].first + ranges[i].count) - last.first;
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+
+    ranges.resize(merged + 1);
+}
+
+// instance flags
+constexpr uint32_t INSTANCE_COPY = 1 << 0;  // placed by copyModel, so removed when the objects are reset
+
+constexpr uint32_t INVALID_HANDLE = UINT32_MAX;
+
+// refers to the instances placed with a model for as long as they exist, however theyre moved around in the store
+// the generation stops a handle from referring to whatever reuses its slot once its destroyed
+struct InstanceHandle {
+    uint32_t index = INVALID_HANDLE;
+    uint32_t generation = 0;
+
+    [[nodiscard]] bool valid() const noexcept { return index != INVALID_HANDLE; }
 };
 
-struct ObjectInstanceData {
-    std::array<ObjectInstance, cfg::MAX_OBJECTS> object{};
+struct HandleSlot {
+    uint32_t generation = 0;
+    std::vector<uint32_t> instances;  // into the store, empty once the handle is destroyed
 };
+
+// every instance in the scene, with an array per field
+// the transforms, meshes and flags are read every frame, the rest only when an instance is moved
+struct InstanceStore {
+    std::vector<Transform> transforms;
+    std::vector<uint32_t> meshIds;
+    std::vector<uint32_t> flags;
+
+    std::vector<uint32_t> models;  // the loaded model it was placed from
+    std::vector<int32_t> nodes;    // the flattened node that places it in the model, -1 if no node does
+    std::vector<dml::mat4> placements;
+    std::vector<dml::mat4> instanceMatrices;  // relative to the node, from EXT_mesh_gpu_instancing
+
+    // where each instance is referred to from, so they can be updated when its moved
+    std::vector<uint32_t> handles;      // the handle slot that owns it
+    std::vector<uint32_t> handleSlots;  // where it is in its handle's instances
+    std::vector<uint32_t> bucketSlots;  // where it is in its mesh's instances
+
+    [[nodiscard]] size_t size() const noexcept { return transforms.size(); }
+
+    void reserve(size_t count) {
+        transforms.reserve(count);
+        meshIds.reserve(count);
+        flags.reserve(count);
+        models.reserve(count);
+        nodes.reserve(count);
+        placements.reserve(count);
+        instanceMatrices.reserve(count);
+        handles.reserve(count);
+        handleSlots.reserve(count);
+        bucketSlots.reserve(count);
+    }
+
+    // moves the last instance over the removed one, so nothing else moves
+    void swapRemove(size_t index) {
+        size_t last = size() - 1;
+        if (index != last) {
+            transforms[index] = transforms[last];
+            meshIds[index] = meshIds[last];
+            flags[index] = flags[last];
+            models[index] = models[last];
+            nodes[index] = nodes[last];
+            placements[index] = placements[last];
+            instanceMatrices[index] = instanceMatrices[last];
+            handles[index] = handles[last];
+            handleSlots[index] = handleSlots[last];
+            bucketSlots[index] = bucketSlots[last];
+        }
+
+        transforms.pop_back();
+        meshIds.pop_back();
+        flags.pop_back();
+        models.pop_back();
+        nodes.pop_back();
+        placements.pop_back();
+        instanceMatrices.pop_back();
+        handles.pop_back();
+        handleSlots.pop_back();
+        bucketSlots.pop_back();
+    }
+};
+
+[[nodiscard]] inline Transform toTransform(const dml::mat4& m) noexcept {
+    Transform t{};
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 4; col++) {
+            t.m[row][col] = m.m[col][row];
+        }
+    }
+
+    return t;
+}
+
+[[nodiscard]] inline dml::vec3 transformPoint(const Transform& t, const dml::vec3& p) noexcept {
+    return {t.m[0][0] * p.x + t.m[0][1] * p.y + t.m[0][2] * p.z + t.m[0][3], t.m[1][0] * p.x + t.m[1][1] * p.y + t.m[1][2] * p.z + t.m[1][3],
+            t.m[2][0] * p.x + t.m[2][1] * p.y + t.m[2][2] * p.z + t.m[2][3]};
+}
+
+// the largest scale along any axis
+[[nodiscard]] inline float getMaxScale(const Transform& t) noexcept {
+    float scale = 0.0f;
+    for (int col = 0; col < 3; col++) {
+        scale = std::max(scale, dml::vec3(t.m[0][col], t.m[1][col], t.m[2][col]).length());
+    }
+
+    return scale;
+}
 }  // namespace instancing
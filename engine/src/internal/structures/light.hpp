@@ -1,8 +1,5 @@
 #pragma once
 
-#include <array>
-
-#include "../../config.hpp"
 #include "../../libraries/dml.hpp"
 
 namespace light {
@@ -20,8 +17,4 @@ struct LightDataObject {
     float linearAttenuation = 0.1f;
     float quadraticAttenuation = 0.032f;
 };
-
-struct RawLights {
-    std::array<LightDataObject, cfg::MAX_LIGHTS> raw{};
-};
 }  // namespace light
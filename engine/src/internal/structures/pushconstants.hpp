@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vulkan/vulkan.h>
+
 namespace pushconstants {
 struct FramePushConst {
     int frame;
@@ -24,6 +26,35 @@ struct ShadowPushConst {
     int lightsPerBatch;
 };
 
+struct CullPushConst {
+    VkDeviceAddress meshlets;
+    VkDeviceAddress objects;
+    VkDeviceAddress instances;
+    VkDeviceAddress draws;     // the region of the view being culled
+    VkDeviceAddress occluded;  // the camera's meshlets that the early phase found hidden
+
+    uint32_t itemCount;
+    uint32_t objectCount;
+    uint32_t instanceStride;  // in floats
+
+    int frame;
+    int batch;  // -1 culls for the camera
+    int lightCount;
+    int lightsPerBatch;
+
+    uint32_t phase;
+    uint32_t pyramidLevels;  // 0 if the meshlets arent tested against the depth pyramid
+    uint32_t depthWidth;
+    uint32_t depthHeight;
+};
+
+struct PyramidPushConst {
+    int source;  // into the pyramid sources, either the level before or the deferred depth
+    int level;
+    uint32_t width;  // of the level being written
+    uint32_t height;
+};
+
 struct ObjectPushConst {
     int bitfield;  // bitfield of which textures exist
     int start;     // starting index of the textures in the texture array
@@ -16,6 +16,15 @@ struct TLAS {
     vkh::BufferObj buffer{};
     vkh::BufferObj instanceBuffer{};
     vkh::BufferObj scratchBuffer{};
+
+    uint32_t capacity = 0;  // the most instances it can be rebuilt with
+
+    // set when the instances changed since it was built, so its rebuilt when its frame comes around
+    bool rebuildPending = false;
+
+    // set when the frame has a build or update to record before its rays are traced
+    bool buildPending = false;
+    VkAccelerationStructureBuildRangeInfoKHR buildRange{};
 };
 
 struct SBT {
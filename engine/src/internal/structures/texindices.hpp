@@ -2,10 +2,6 @@
 
 #include <vulkan/vulkan.h>
 
-#include <array>
-
-#include "../../config.hpp"
-
 namespace texindices {
 struct TexIndexObj {
     int albedoIndex = -1;
@@ -13,12 +9,9 @@ struct TexIndexObj {
     int normalIndex = -1;
     int emissiveIndex = -1;
     int occlusionIndex = -1;
+    uint32_t index16 = 0;  // 1 if the indices are 16 bit
 
-    VkDeviceAddress vertAddr = 0;
+    VkDeviceAddress attrAddr = 0;
     VkDeviceAddress indAddr = 0;
 };
-
-struct TexIndices {
-    std::array<TexIndexObj, cfg::MAX_OBJECTS> indices{};
-};
 }  // namespace texindices
@@ -1,69 +1,231 @@
 #include "vk-buffers.hpp"
 
+#include <algorithm>
+
 namespace buffers {
-void VkBuffers::init(VkhCommandPool commandPool, VkQueue gQueue, bool rtEnabled, uint32_t maxFrames, const scene::VkScene *scene) {
+void VkBuffers::init(bool rtEnabled, bool meshletCulling, uint32_t maxFrames, const scene::VkScene *scene, uploads::VkUploads *uploads) {
     m_scene = scene;
+    m_uploads = uploads;
 
-    m_commandPool = commandPool;
-    m_gQueue = gQueue;
     m_rtEnabled = rtEnabled;
+    m_meshletCulling = meshletCulling;
     m_maxFrames = maxFrames;
 }
 
 void VkBuffers::createBuffers(uint32_t currentFrame) {
     m_lightBuffers.resize(m_maxFrames);
-    m_objInstanceBuffers.resize(m_maxFrames);
+    m_lightCapacities.resize(m_maxFrames);
+    m_texIndicesBuffers.resize(m_maxFrames);
+    m_texIndicesCapacities.resize(m_maxFrames);
     m_camBuffers.resize(m_maxFrames);
+    m_frameUploads.resize(m_maxFrames);
 
-    for (size_t i = 0; i < m_maxFrames; i++) {
-        vkh::createHostVisibleBuffer(m_lightBuffers[i], sizeof(light::RawLights), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-        vkh::createHostVisibleBuffer(m_objInstanceBuffers[i], sizeof(instancing::ObjectInstanceData), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-        vkh::createHostVisibleBuffer(m_camBuffers[i], sizeof(cam::CamMatrices), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    for (uint32_t i = 0; i < m_maxFrames; i++) {
+        createLightBuffer(i);
+        createTexIndicesBuffer(i);
+        vkh::createMappedBuffer(m_camBuffers[i], sizeof(cam::CamMatrices), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
     }
 
-    // indirect commands buffer
-    vkh::createDeviceLocalBuffer(m_sceneIndirectBuffer, m_scene->getUniqueObjectCount() * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-    updateSceneIndirectCommandsBuffer();
-
-    // create texindices buffer
-    vkh::createDeviceLocalBuffer(m_texIndicesBuffer, sizeof(texindices::TexIndices), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-    createTexIndicesBuffer();
-
+    updateDrawBuffers();
     update(currentFrame);
 }
 
-void VkBuffers::update(uint32_t currentFrame) {
-    const cam::CamMatrices *camMatrices = m_scene->getCamMatrices();
-    const light::LightDataObject *lightData = m_scene->getRawLightData();
+bool VkBuffers::update(uint32_t currentFrame) {
+    FrameUploads &uploads = m_frameUploads[currentFrame];
+    size_t lightCount = m_scene->getLightCount();
+
+    // each frame only reads its own light buffer, so its moved to a bigger one when the frame comes around
+    bool lightsMoved = lightCount > m_lightCapacities[currentFrame];
+    if (lightsMoved) createLightBuffer(currentFrame);
+
+    if (lightCount > 0 && uploads.lightVersion != m_scene->getLightVersion()) {
+        vkh::writeBuffer(m_lightBuffers[currentFrame], m_scene->getRawLightData(), sizeof(light::LightDataObject) * lightCount);
+    }
+
+    uploads.lightVersion = m_scene->getLightVersion();
+
+    // the tex indices are moved the same way, so a model being added never waits on the frames in flight
+    size_t meshCount = m_scene->getMeshCount();
+    bool texIndicesMoved = meshCount > m_texIndicesCapacities[currentFrame];
+    if (texIndicesMoved) createTexIndicesBuffer(currentFrame);
+
+    // staged, so the copy is made at the start of the frame
+    if (meshCount > 0 && uploads.texIndexVersion != m_scene->getTexIndexVersion()) {
+        m_uploads->stage(m_texIndicesBuffers[currentFrame], m_scene->getTexIndices(), sizeof(texindices::TexIndexObj) * meshCount);
+    }
+
+    uploads.texIndexVersion = m_scene->getTexIndexVersion();
+    bool buffersMoved = lightsMoved || texIndicesMoved;
+
+    vkh::writeBuffer(m_camBuffers[currentFrame], m_scene->getCamMatrices(), sizeof(cam::CamMatrices));
+
+    // which instances are visible changes with the camera, so the culled draws and instances are written whole
+    if (m_scene->cullsInstances()) {
+        if (uploads.cullVersion != m_scene->getCullVersion()) {
+            size_t viewCommandCount = m_scene->getViewCommandTotal();
+            if (viewCommandCount > 0) vkh::writeBuffer(m_sceneIndirectBuffers[currentFrame], m_scene->getViewCommands(), sizeof(VkDrawIndexedIndirectCommand) * viewCommandCount);
+
+            size_t viewInstanceCount = m_scene->getViewInstanceCount();
+            if (viewInstanceCount > 0) vkh::writeBuffer(m_objInstanceBuffers[currentFrame], m_scene->getViewInstances(), sizeof(instancing::ObjectInstance) * viewInstanceCount);
+        }
+
+        uploads.cullVersion = m_scene->getCullVersion();
+        return buffersMoved;
+    }
+
+    // the draws change with the levels of detail
+    size_t commandCount = m_scene->getIndirectCommandCount(0) + m_scene->getIndirectCommandCount(1);
+    if (commandCount > 0 && uploads.drawVersion != m_scene->getDrawVersion()) {
+        vkh::writeBuffer(m_sceneIndirectBuffers[currentFrame], m_scene->getSceneIndirectCommands(), sizeof(VkDrawIndexedIndirectCommand) * commandCount);
+    }
+
+    uploads.drawVersion = m_scene->getDrawVersion();
+
+    // the slots that changed are written to every frame, each one when it comes around
+    const std::vector<instancing::SlotRange> &changed = m_scene->getDirtyInstanceRanges();
+    for (FrameUploads &frame : m_frameUploads) {
+        frame.instanceRanges.insert(frame.instanceRanges.end(), changed.begin(), changed.end());
+    }
+
+    // ranges with only a few slots between them are written together
+    instancing::mergeRanges(uploads.instanceRanges, 16);
+
     const instancing::ObjectInstance *objectInstances = m_scene->getObjectInstances();
+    const culling::CullObject *cullObjects = m_scene->getCullObjects();
+    size_t objectCount = m_scene->getObjectCount();
 
-    size_t lightCount = m_scene->getLightCount();
+    for (const instancing::SlotRange &range : uploads.instanceRanges) {
+        // instances removed since the range was added dont have to be written
+        if (range.first >= objectCount) break;
+        size_t count = std::min<size_t>(range.count, objectCount - range.first);
+        if (count == 0) continue;
+
+        VkDeviceSize offset = range.first * sizeof(instancing::ObjectInstance);
+        vkh::writeBuffer(m_objInstanceBuffers[currentFrame], objectInstances + range.first, sizeof(instancing::ObjectInstance) * count, offset);
+
+        if (m_meshletCulling) {
+            offset = range.first * sizeof(culling::CullObject);
+            vkh::writeBuffer(m_cullObjectBuffers[currentFrame], cullObjects + range.first, sizeof(culling::CullObject) * count, offset);
+        }
+    }
+
+    uploads.instanceRanges.clear();
+    return buffersMoved;
+}
+
+void VkBuffers::updateDrawBuffers() {
+    size_t viewCount = m_scene->cullsInstances() ? culling::VIEW_COUNT : 1;
+
+    // indirect commands, with room for every level of every unique object
+    size_t commandCapacity = m_scene->getIndirectCommandCapacity() * viewCount;
+
+    if (m_sceneIndirectBuffers.empty() || commandCapacity > m_indirectCapacity) {
+        m_indirectCapacity = std::max({commandCapacity, m_indirectCapacity * 2, static_cast<size_t>(1)});
+
+        for (vkh::BufferObj &indirectBuffer : m_sceneIndirectBuffers) {
+            m_uploads->retire(indirectBuffer);
+        }
+
+        // each frame writes its own commands, so the new buffers dont need the old contents
+        m_sceneIndirectBuffers.clear();
+        m_sceneIndirectBuffers.resize(m_maxFrames);
+        for (vkh::BufferObj &indirectBuffer : m_sceneIndirectBuffers) {
+            vkh::createMappedBuffer(indirectBuffer, m_indirectCapacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+        }
+
+        for (FrameUploads &frame : m_frameUploads) {
+            frame.drawVersion = UINT64_MAX;
+            frame.cullVersion = UINT64_MAX;
+        }
+    }
+
+    // the instances are written every frame too, and are read through their buffer or its address rather than a descriptor
     size_t objectCount = m_scene->getObjectCount();
+    size_t instanceCount = objectCount * viewCount;
+
+    if (m_objInstanceBuffers.empty() || instanceCount > m_instanceCapacity) {
+        m_instanceCapacity = std::max({instanceCount, m_instanceCapacity * 2, static_cast<size_t>(1)});
+
+        for (vkh::BufferObj &instanceBuffer : m_objInstanceBuffers) {
+            m_uploads->retire(instanceBuffer);
+        }
 
-    if (lightCount > 0) {
-        vkh::writeBuffer(m_lightBuffers[currentFrame].mem, lightData, sizeof(light::LightDataObject) * lightCount);
+        for (vkh::BufferObj &cullObjectBuffer : m_cullObjectBuffers) {
+            m_uploads->retire(cullObjectBuffer);
+        }
+
+        // the cull shader reads the instances through their address
+        VkBufferUsageFlags instanceU = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | (m_meshletCulling ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
+        VkMemoryAllocateFlags instanceM = m_meshletCulling ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+
+        m_objInstanceBuffers.clear();
+        m_objInstanceBuffers.resize(m_maxFrames);
+        for (vkh::BufferObj &instanceBuffer : m_objInstanceBuffers) {
+            vkh::createMappedBuffer(instanceBuffer, m_instanceCapacity * sizeof(instancing::ObjectInstance), instanceU, instanceM);
+        }
+
+        if (m_meshletCulling) {
+            VkBufferUsageFlags cullObjectU = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+            m_cullObjectBuffers.clear();
+            m_cullObjectBuffers.resize(m_maxFrames);
+
+            for (vkh::BufferObj &cullObjectBuffer : m_cullObjectBuffers) {
+                vkh::createMappedBuffer(cullObjectBuffer, m_instanceCapacity * sizeof(culling::CullObject), cullObjectU, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+            }
+        }
+
+        // the new buffers are empty, so every slot is written to them
+        for (FrameUploads &frame : m_frameUploads) {
+            frame.instanceRanges.assign(1, {0, static_cast<uint32_t>(objectCount)});
+            frame.cullVersion = UINT64_MAX;
+        }
     }
 
-    vkh::writeBuffer(m_camBuffers[currentFrame].mem, camMatrices, sizeof(cam::CamMatrices));
-    vkh::writeBuffer(m_objInstanceBuffers[currentFrame].mem, objectInstances, sizeof(instancing::ObjectInstance) * objectCount);
+    if (!m_meshletCulling) return;
+
+    // the capacity covers the level of each object with the most meshlets, so it holds whatever levels are selected
+    size_t itemCount = m_scene->getMeshletItemCapacity();
+
+    // grow the draw buffers if every meshlet could no longer be drawn
+    if (m_drawBuffers.empty() || itemCount > m_drawCapacity) {
+        m_drawCapacity = std::max({itemCount, m_drawCapacity * 2, static_cast<size_t>(1)});
+
+        VkDeviceSize regionSize = culling::DRAW_COUNT_SIZE + (culling::DRAW_LIST_COUNT * m_drawCapacity * sizeof(VkDrawIndexedIndirectCommand));
+        m_drawRegionSize = (regionSize + culling::DRAW_COUNT_SIZE - 1) & ~(culling::DRAW_COUNT_SIZE - 1);
+
+        VkDeviceSize occludedListOffset = getOccludedListOffset();
+        VkDeviceSize occludedListSize = culling::DRAW_COUNT_SIZE + (m_drawCapacity * sizeof(uint32_t));
+
+        // frames in flight may still be reading from the old buffers, so theyre kept until those frames are done
+        for (vkh::BufferObj &drawBuffer : m_drawBuffers) {
+            m_uploads->retire(drawBuffer);
+        }
+
+        VkBufferUsageFlags drawU = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        m_drawBuffers.clear();
+        m_drawBuffers.resize(m_maxFrames);
+
+        for (vkh::BufferObj &drawBuffer : m_drawBuffers) {
+            vkh::createDeviceLocalBuffer(drawBuffer, occludedListOffset + occludedListSize, drawU, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+        }
+    }
 }
 
-void VkBuffers::createTexIndicesBuffer() {
-    const texindices::TexIndexObj *texIndices = m_scene->getTexIndices();
-    size_t size = sizeof(texindices::TexIndexObj) * m_scene->getObjectCount();
+void VkBuffers::createLightBuffer(uint32_t frame) {
+    m_lightCapacities[frame] = std::max({m_scene->getLightCount(), m_lightCapacities[frame] * 2, static_cast<size_t>(1)});
 
-    vkh::BufferObj stagingBuffer{};
-    vkh::createAndWriteHostBuffer(stagingBuffer, texIndices, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    vkh::copyBuffer(stagingBuffer.buf, m_texIndicesBuffer.buf, m_commandPool, m_gQueue, size);
+    // the fence of the frame has been waited on, so the old buffer isnt being read anymore
+    vkh::createMappedBuffer(m_lightBuffers[frame], m_lightCapacities[frame] * sizeof(light::LightDataObject), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    m_frameUploads[frame].lightVersion = UINT64_MAX;
 }
 
-void VkBuffers::updateSceneIndirectCommandsBuffer() {
-    const VkDrawIndexedIndirectCommand *indirectCommands = m_scene->getSceneIndirectCommands();
-    VkDeviceSize indirectBufferSize = m_scene->getUniqueObjectCount() * sizeof(VkDrawIndexedIndirectCommand);
+void VkBuffers::createTexIndicesBuffer(uint32_t frame) {
+    m_texIndicesCapacities[frame] = std::max({m_scene->getMeshCount(), m_texIndicesCapacities[frame] * 2, static_cast<size_t>(1)});
 
-    // create and copy staging buffer to the indirect commands buffer
-    vkh::BufferObj stagingBuffer{};
-    vkh::createAndWriteHostBuffer(stagingBuffer, indirectCommands, indirectBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    vkh::copyBuffer(stagingBuffer.buf, m_sceneIndirectBuffer.buf, m_commandPool, m_gQueue, indirectBufferSize);
+    // copies to the old buffer may still be staged, so its kept until theyve been made
+    m_uploads->retire(m_texIndicesBuffers[frame]);
+    m_texIndicesBuffers[frame] = {};
+    vkh::createDeviceLocalBuffer(m_texIndicesBuffers[frame], m_texIndicesCapacities[frame] * sizeof(texindices::TexIndexObj), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_frameUploads[frame].texIndexVersion = UINT64_MAX;
 }
 }  // namespace buffers
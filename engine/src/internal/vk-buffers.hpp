@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "internal/vk-scene.hpp"
+#include "internal/vk-uploads.hpp"
 #include "libraries/vkhelper.hpp"
 
 namespace buffers {
@@ -17,34 +18,73 @@ public:
     VkBuffers(VkBuffers&&) = delete;
     VkBuffers& operator=(VkBuffers&&) = delete;
 
-    void init(VkhCommandPool commandPool, VkQueue gQueue, bool rtEnabled, uint32_t maxFrames, const scene::VkScene* scene);
+    void init(bool rtEnabled, bool meshletCulling, uint32_t maxFrames, const scene::VkScene* scene, uploads::VkUploads* uploads);
     void createBuffers(uint32_t currentFrame);
 
-    void update(uint32_t currentFrame);
-    void createTexIndicesBuffer();
-    void updateSceneIndirectCommandsBuffer();
+    // only what changed since the frame was last drawn is written to its buffers
+    // returns true if the light or tex indices buffer of the frame was replaced, so its descriptors have to be rewritten
+    bool update(uint32_t currentFrame);
+    void updateDrawBuffers();
 
     // getters
-    [[nodiscard]] vkh::BufferObj getTexIndicesBuffer() const noexcept { return m_texIndicesBuffer; }
-    [[nodiscard]] VkBuffer getSceneIndirectCommandsBuffer() const noexcept { return m_sceneIndirectBuffer.buf.v(); }
+    [[nodiscard]] vkh::BufferObj getTexIndicesBuffer(uint32_t index) const noexcept { return m_texIndicesBuffers[index]; }
+    [[nodiscard]] VkBuffer getSceneIndirectCommandsBuffer(uint32_t index) const noexcept { return m_sceneIndirectBuffers[index].buf.v(); }
 
     [[nodiscard]] vkh::BufferObj getCamBuffer(uint32_t index) const noexcept { return m_camBuffers[index]; }
     [[nodiscard]] vkh::BufferObj getLightBuffer(uint32_t index) const noexcept { return m_lightBuffers[index]; }
     [[nodiscard]] vkh::BufferObj getObjectInstanceBuffer(uint32_t index) const noexcept { return m_objInstanceBuffers[index]; }
 
+    // meshlet culling
+    [[nodiscard]] vkh::BufferObj getCullObjectBuffer(uint32_t index) const noexcept { return m_cullObjectBuffers[index]; }
+    [[nodiscard]] vkh::BufferObj getDrawBuffer(uint32_t index) const noexcept { return m_drawBuffers[index]; }
+    [[nodiscard]] VkDeviceSize getDrawRegionOffset(uint32_t region) const noexcept { return region * m_drawRegionSize; }
+    [[nodiscard]] VkDeviceSize getOccludedListOffset() const noexcept { return culling::DRAW_REGION_COUNT * m_drawRegionSize; }
+
+private:
+    // what each frame in flight still has to write to its own copy of the buffers
+    struct FrameUploads {
+        std::vector<instancing::SlotRange> instanceRanges;
+        uint64_t lightVersion = UINT64_MAX;
+        uint64_t texIndexVersion = UINT64_MAX;
+        uint64_t drawVersion = UINT64_MAX;
+        uint64_t cullVersion = UINT64_MAX;
+    };
+
 private:
-    vkh::BufferObj m_texIndicesBuffer{};
-    vkh::BufferObj m_sceneIndirectBuffer{};
+    std::vector<vkh::BufferObj> m_texIndicesBuffers;
+    std::vector<size_t> m_texIndicesCapacities;
+
+    // the levels of detail are selected every frame, so the draws are written every frame too
+    // when the instances are culled, each view has its own draws and instances after those of the view before it
+    std::vector<vkh::BufferObj> m_sceneIndirectBuffers;
+    size_t m_indirectCapacity = 0;
 
     std::vector<vkh::BufferObj> m_camBuffers;
     std::vector<vkh::BufferObj> m_lightBuffers;
+    std::vector<size_t> m_lightCapacities;
+
+    // the instances and cull objects share a capacity, since theres one of each per object
     std::vector<vkh::BufferObj> m_objInstanceBuffers;
+    std::vector<vkh::BufferObj> m_cullObjectBuffers;
+    size_t m_instanceCapacity = 0;
+
+    // culled draws of each view and the late region, one buffer per frame
+    // the meshlets the camera found hidden by the last frame follow the regions, with their count in front of them
+    std::vector<vkh::BufferObj> m_drawBuffers;
+    VkDeviceSize m_drawRegionSize = 0;
+    size_t m_drawCapacity = 0;
+
+    std::vector<FrameUploads> m_frameUploads;
 
     const scene::VkScene* m_scene = nullptr;
+    uploads::VkUploads* m_uploads = nullptr;
 
-    VkhCommandPool m_commandPool{};
-    VkQueue m_gQueue{};
     bool m_rtEnabled = false;
+    bool m_meshletCulling = false;
     uint32_t m_maxFrames = 0;
+
+private:
+    void createLightBuffer(uint32_t frame);
+    void createTexIndicesBuffer(uint32_t frame);
 };
 }  // namespace buffers
@@ -1,6 +1,10 @@
 #include "vk-descriptorsets.hpp"
 
+#include <algorithm>
+
+#include "config.hpp"
 #include "libraries/vkhelper.hpp"
+#include "structures/culling.hpp"
 
 namespace descriptorsets {
 void VkDescriptorSets::init(bool rtEnabled, uint32_t maxFrames, VkDevice device, const scene::VkScene* scene, const textures::VkTextures* textures, const buffers::VkBuffers* buffers, const VkAccelerationStructureKHR* tlasData) {
@@ -12,21 +16,30 @@ void VkDescriptorSets::init(bool rtEnabled, uint32_t maxFrames, VkDevice device,
     m_textures = textures;
     m_buffers = buffers;
 
-    m_totalTextureCount = static_cast<uint32_t>(m_textures->getMeshTexCount());
+    // the textures of models loaded later are written into the same set
+    m_textureCapacity = std::max(static_cast<uint32_t>(m_textures->getMeshTexCount()), cfg::MAX_TEXTURES);
     createDescriptorSets();
     update(true, tlasData);
 }
 
 void VkDescriptorSets::update(bool updateLights, const VkAccelerationStructureKHR* tlasData) {
-    VkDescriptorBufferInfo texIndexInfo{};
-    texIndexInfo.buffer = m_buffers->getTexIndicesBuffer().buf.v();
-    texIndexInfo.offset = 0;
-    texIndexInfo.range = sizeof(texindices::TexIndices);
+    std::vector<VkDescriptorBufferInfo> texIndexInfos{};
+    texIndexInfos.reserve(m_maxFrames);
+
+    for (uint32_t i = 0; i < m_maxFrames; i++) {
+        VkDescriptorBufferInfo tinfo{};
+        tinfo.buffer = m_buffers->getTexIndicesBuffer(i).buf.v();
+        tinfo.offset = 0;
+        tinfo.range = VK_WHOLE_SIZE;
+        texIndexInfos.push_back(tinfo);
+    }
+
+    size_t textureCount = m_textures->getMeshTexCount();
 
     std::vector<VkDescriptorImageInfo> imageInfos;
-    imageInfos.reserve(m_totalTextureCount);
+    imageInfos.reserve(textureCount);
 
-    for (size_t i = 0; i < m_totalTextureCount; i++) {
+    for (size_t i = 0; i < textureCount; i++) {
         vkh::Texture tex = m_textures->getMeshTex(i);
         imageInfos.push_back(vkh::createDSImageInfo(tex.imageView, tex.sampler));
     }
@@ -38,7 +51,7 @@ void VkDescriptorSets::update(bool updateLights, const VkAccelerationStructureKH
             VkDescriptorBufferInfo linfo{};
             linfo.buffer = m_buffers->getLightBuffer(i).buf.v();
             linfo.offset = 0;
-            linfo.range = sizeof(light::RawLights);
+            linfo.range = VK_WHOLE_SIZE;
             lightBufferInfos.push_back(linfo);
         }
     }
@@ -61,6 +74,8 @@ void VkDescriptorSets::update(bool updateLights, const VkAccelerationStructureKH
     std::vector<VkDescriptorImageInfo> compositionPassImageInfo{};
     std::vector<VkDescriptorImageInfo> deferredImageInfo{};
     std::vector<VkDescriptorImageInfo> depthInfo{};
+    std::vector<VkDescriptorImageInfo> pyramidInfos{};
+    std::vector<VkDescriptorImageInfo> pyramidDepthInfos{};
 
     // raytracing
     std::vector<VkDescriptorImageInfo> rtTextures{};
@@ -114,6 +129,24 @@ void VkDescriptorSets::update(bool updateLights, const VkAccelerationStructureKH
             compositionPassImageInfo.push_back(vkh::createDSImageInfo(lightingT.imageView, lightingT.sampler));
             compositionPassImageInfo.push_back(vkh::createDSImageInfo(wboitT.imageView, wboitT.sampler));
         }
+
+        // the pyramid is only built when meshlets are culled
+        uint32_t pyramidLevels = m_textures->getDepthPyramidLevels();
+        if (pyramidLevels > 0) {
+            const vkh::Texture& pyramid = m_textures->getDepthPyramid();
+            pyramidInfos.reserve(pyramidLevels);
+            pyramidDepthInfos.reserve(m_maxFrames);
+
+            for (uint32_t i = 0; i < pyramidLevels; i++) {
+                pyramidInfos.push_back(vkh::createDSImageInfo(m_textures->getDepthPyramidView(i), pyramid.sampler, VK_IMAGE_LAYOUT_GENERAL));
+            }
+
+            // only read with texel fetches, so the sampler of the pyramid is used instead of the comparing one of the depth
+            for (size_t i = 0; i < m_maxFrames; i++) {
+                const vkh::Texture& deferredDepthT = m_textures->getDeferredDepthTex(i);
+                pyramidDepthInfos.push_back(vkh::createDSImageInfo(deferredDepthT.imageView, pyramid.sampler, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+            }
+        }
     }
 
     std::vector<VkWriteDescriptorSet> descriptorWrites{};
@@ -130,9 +163,19 @@ void VkDescriptorSets::update(bool updateLights, const VkAccelerationStructureKH
 
         descriptorWrites.push_back(vkh::createDSWrite(m_sets[CAMDEPTH].set, 0, m_sets[CAMDEPTH].bindings[0].descriptorType, depthInfo.data(), depthInfo.size()));
         descriptorWrites.push_back(vkh::createDSWrite(m_sets[COMPTEXTURES].set, 0, m_sets[COMPTEXTURES].bindings[0].descriptorType, compositionPassImageInfo.data(), compositionPassImageInfo.size()));
+
+        if (!pyramidInfos.empty()) {
+            descriptorWrites.push_back(vkh::createDSWrite(m_sets[PYRAMIDSOURCES].set, 0, m_sets[PYRAMIDSOURCES].bindings[0].descriptorType, pyramidInfos.data(), pyramidInfos.size()));
+            descriptorWrites.push_back(vkh::createDSWrite(m_sets[PYRAMIDLEVELS].set, 0, m_sets[PYRAMIDLEVELS].bindings[0].descriptorType, pyramidInfos.data(), pyramidInfos.size()));
+
+            // the depth follows the most levels the pyramid can have, so it doesnt move when the pyramid is resized
+            VkWriteDescriptorSet depthWrite = vkh::createDSWrite(m_sets[PYRAMIDSOURCES].set, 0, m_sets[PYRAMIDSOURCES].bindings[0].descriptorType, pyramidDepthInfos.data(), pyramidDepthInfos.size());
+            depthWrite.dstArrayElement = culling::MAX_PYRAMID_LEVELS;
+            descriptorWrites.push_back(depthWrite);
+        }
     }
 
-    descriptorWrites.push_back(vkh::createDSWrite(m_sets[TEXINDICES].set, 0, m_sets[TEXINDICES].bindings[0].descriptorType, texIndexInfo));
+    descriptorWrites.push_back(vkh::createDSWrite(m_sets[TEXINDICES].set, 0, m_sets[TEXINDICES].bindings[0].descriptorType, texIndexInfos.data(), texIndexInfos.size()));
     descriptorWrites.push_back(vkh::createDSWrite(m_sets[MATERIALTEXTURES].set, 0, m_sets[MATERIALTEXTURES].bindings[0].descriptorType, imageInfos.data(), imageInfos.size()));
     descriptorWrites.push_back(vkh::createDSWrite(m_sets[CAMDATA].set, 0, m_sets[CAMDATA].bindings[0].descriptorType, camBufferInfos.data(), camBufferInfos.size()));
     if (updateLights) descriptorWrites.push_back(vkh::createDSWrite(m_sets[LIGHTS].set, 0, m_sets[LIGHTS].bindings[0].descriptorType, lightBufferInfos.data(), lightBufferInfos.size()));
@@ -146,6 +189,60 @@ void VkDescriptorSets::updateLightDS() {
     vkUpdateDescriptorSets(m_device, 1, &dw, 0, nullptr);
 }
 
+void VkDescriptorSets::updateTexIndices(uint32_t frame) {
+    VkDescriptorBufferInfo tinfo{};
+    tinfo.buffer = m_buffers->getTexIndicesBuffer(frame).buf.v();
+    tinfo.offset = 0;
+    tinfo.range = VK_WHOLE_SIZE;
+
+    // like the light buffers, each frame in flight only uses its own descriptor
+    VkWriteDescriptorSet dw = vkh::createDSWrite(m_sets[TEXINDICES].set, 0, m_sets[TEXINDICES].bindings[0].descriptorType, &tinfo, 1);
+    dw.dstArrayElement = frame;
+    vkUpdateDescriptorSets(m_device, 1, &dw, 0, nullptr);
+}
+
+void VkDescriptorSets::updateLightBuffer(uint32_t frame) {
+    VkDescriptorBufferInfo linfo{};
+    linfo.buffer = m_buffers->getLightBuffer(frame).buf.v();
+    linfo.offset = 0;
+    linfo.range = VK_WHOLE_SIZE;
+
+    // the frames in flight only use their own descriptor, so the others are written without waiting
+    VkWriteDescriptorSet dw = vkh::createDSWrite(m_sets[LIGHTS].set, 0, m_sets[LIGHTS].bindings[0].descriptorType, &linfo, 1);
+    dw.dstArrayElement = frame;
+    vkUpdateDescriptorSets(m_device, 1, &dw, 0, nullptr);
+}
+
+void VkDescriptorSets::updateTLAS(uint32_t frame, const VkAccelerationStructureKHR* tlasData) {
+    VkWriteDescriptorSetAccelerationStructureKHR tlasInfo{};
+    tlasInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+    tlasInfo.pAccelerationStructures = tlasData + frame;
+    tlasInfo.accelerationStructureCount = 1;
+
+    // each frame traces against its own tlas, so only the frame's descriptor is rewritten
+    VkWriteDescriptorSet dw = vkh::createDSWrite(m_sets[TLAS].set, 0, m_sets[TLAS].bindings[0].descriptorType, &tlasInfo, 1);
+    dw.dstArrayElement = frame;
+    vkUpdateDescriptorSets(m_device, 1, &dw, 0, nullptr);
+}
+
+void VkDescriptorSets::addMeshTextures(size_t first) {
+    size_t textureCount = m_textures->getMeshTexCount();
+    if (first >= textureCount) return;
+
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    imageInfos.reserve(textureCount - first);
+
+    for (size_t i = first; i < textureCount; i++) {
+        vkh::Texture tex = m_textures->getMeshTex(i);
+        imageInfos.push_back(vkh::createDSImageInfo(tex.imageView, tex.sampler));
+    }
+
+    // the new descriptors arent used by any frame in flight, so theyre written without waiting
+    VkWriteDescriptorSet dw = vkh::createDSWrite(m_sets[MATERIALTEXTURES].set, 0, m_sets[MATERIALTEXTURES].bindings[0].descriptorType, imageInfos.data(), imageInfos.size());
+    dw.dstArrayElement = static_cast<uint32_t>(first);
+    vkUpdateDescriptorSets(m_device, 1, &dw, 0, nullptr);
+}
+
 std::vector<VkDescriptorSetLayout> VkDescriptorSets::getLayouts(PASSES pass) const {
     const std::vector<SET> setTypes = m_passSets.at(pass);
 
@@ -208,9 +305,9 @@ void VkDescriptorSets::initDSInfo() {
         camSS = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
     } else {
         textursSS = VK_SHADER_STAGE_FRAGMENT_BIT;
-        lightDataSS = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        lightDataSS = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
         skyboxSS = VK_SHADER_STAGE_FRAGMENT_BIT;
-        camSS = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        camSS = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
     }
 
     uint32_t deferredColorCount = static_cast<uint32_t>(m_textures->getDeferredColorCount());
@@ -218,14 +315,16 @@ void VkDescriptorSets::initDSInfo() {
     createDescriptorInfo(m_sets[RT], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_FRAGMENT_BIT, 0, m_maxFrames * 2);
     createDescriptorInfo(m_sets[TLAS], VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, m_maxFrames);
 
-    createDescriptorInfo(m_sets[TEXINDICES], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, textursSS, 0, cfg::MAX_OBJECTS);
-    createDescriptorInfo(m_sets[MATERIALTEXTURES], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textursSS, 0, m_totalTextureCount);
+    createDescriptorInfo(m_sets[TEXINDICES], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, textursSS, 0, m_maxFrames);
+    createDescriptorInfo(m_sets[MATERIALTEXTURES], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textursSS, 0, m_textureCapacity);
     createDescriptorInfo(m_sets[CAMDATA], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, camSS, 0, m_maxFrames);
     createDescriptorInfo(m_sets[LIGHTS], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, lightDataSS, 0, m_maxFrames);
     createDescriptorInfo(m_sets[DEFERRED], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, deferredColorCount);
     createDescriptorInfo(m_sets[SHADOWMAP], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0, cfg::MAX_LIGHTS * m_maxFrames);
     createDescriptorInfo(m_sets[CAMDEPTH], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0, m_maxFrames);
     createDescriptorInfo(m_sets[COMPTEXTURES], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0, m_maxFrames * 2);
+    createDescriptorInfo(m_sets[PYRAMIDSOURCES], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0, culling::MAX_PYRAMID_LEVELS + m_maxFrames);
+    createDescriptorInfo(m_sets[PYRAMIDLEVELS], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0, culling::MAX_PYRAMID_LEVELS);
 
     createDescriptorInfo(m_sets[KNOWN], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, skyboxSS, 0, 1);
 }
@@ -241,6 +340,8 @@ void VkDescriptorSets::createDescriptorSets() {
         createDescriptorSet(m_sets[SHADOWMAP], true);
         createDescriptorSet(m_sets[CAMDEPTH], true);
         createDescriptorSet(m_sets[COMPTEXTURES], true);
+        createDescriptorSet(m_sets[PYRAMIDSOURCES], true);
+        createDescriptorSet(m_sets[PYRAMIDLEVELS], true);
     }
 
     createDescriptorSet(m_sets[TEXINDICES], true);
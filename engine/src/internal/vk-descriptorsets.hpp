@@ -18,7 +18,9 @@ enum class PASSES {
     SKYBOX,
     WBOIT,
     COMP,
-    RT
+    RT,
+    CULL,
+    DEPTHPYRAMID
 };
 
 class VkDescriptorSets {
@@ -34,9 +36,16 @@ public:
     void update(bool updateLights, const VkAccelerationStructureKHR* tlasData);
     void updateLightDS();
 
+    // rewrite the descriptors of buffers that were moved when they grew
+    void updateTexIndices(uint32_t frame);
+    void updateLightBuffer(uint32_t frame);
+    void updateTLAS(uint32_t frame, const VkAccelerationStructureKHR* tlasData);
+    void addMeshTextures(size_t first);
+
     // getters
     [[nodiscard]] std::vector<VkDescriptorSetLayout> getLayouts(PASSES pass) const;
     [[nodiscard]] std::vector<VkDescriptorSet> getSets(PASSES pass) const;
+    [[nodiscard]] uint32_t getTextureCapacity() const noexcept { return m_textureCapacity; }
 
     // shadow infos
     void clearShadowInfos() {
@@ -57,6 +66,8 @@ private:
         CAMDATA,
         LIGHTS,
         COMPTEXTURES,
+        PYRAMIDSOURCES,
+        PYRAMIDLEVELS,
         KNOWN
     };
 
@@ -69,11 +80,13 @@ private:
         {PASSES::WBOIT, {MATERIALTEXTURES, LIGHTS, SHADOWMAP, CAMDATA, CAMDEPTH, TEXINDICES}},
         {PASSES::COMP, {RT, COMPTEXTURES}},
         {PASSES::RT, {MATERIALTEXTURES, LIGHTS, KNOWN, CAMDATA, RT, TLAS, TEXINDICES}},
+        {PASSES::CULL, {CAMDATA, LIGHTS, PYRAMIDSOURCES}},
+        {PASSES::DEPTHPYRAMID, {PYRAMIDSOURCES, PYRAMIDLEVELS}},
     };
 
-    std::array<desc::DescriptorSet, 11> m_sets{};
+    std::array<desc::DescriptorSet, 13> m_sets{};
     std::vector<VkDescriptorImageInfo> m_shadowInfos;
-    uint32_t m_totalTextureCount = 0;
+    uint32_t m_textureCapacity = 0;
 
     const scene::VkScene* m_scene = nullptr;
     const textures::VkTextures* m_textures = nullptr;
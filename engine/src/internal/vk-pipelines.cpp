@@ -1,9 +1,9 @@
 #include "vk-pipelines.hpp"
 
 #include <cstddef>
-#include <fstream>
 
 #include "config.hpp"
+#include "libraries/packfile.hpp"
 #include "structures/pushconstants.hpp"
 
 namespace pipelines {
@@ -30,60 +30,62 @@ void VkPipelines::createPipelines(bool createShadow) {
         }
 
         createWBOITPipeline();
+        createCullPipeline();
+        createDepthPyramidPipeline();
     }
 
     createCompositionPipeline();
 }
 
-std::vector<char> VkPipelines::readFile(const std::string& filename) const {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);  // ate means start reading at the end of the file and binary means read the file as binary
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filename);
+VkhShaderModule VkPipelines::createShaderMod(const std::string& name) const {
+    std::string path = cfg::SHADER_DIR + name + std::string(".spv");
+
+    mappedfile::MappedFile file;
+    if (!packfile::openMapped(file, path)) {
+        throw std::runtime_error("Failed to open file: " + path);
     }
-    size_t fileSize = static_cast<size_t>(file.tellg());  // tellg gets the position of the read/write head
-    std::vector<char> buffer(fileSize);
-    file.seekg(0);  // seekg sets the position of the read/write head
-    file.read(buffer.data(), fileSize);
-    file.close();
-    return buffer;
-}
 
-VkhShaderModule VkPipelines::createShaderMod(const std::string& name) const {
-    std::vector<char> shaderCode = readFile(cfg::SHADER_DIR + name + std::string(".spv"));
-    return vkh::createShaderModule(shaderCode);
+    return vkh::createShaderModule({file.data(), file.size()});
 }
 
 void VkPipelines::getObjectVertInputAttrDescriptions() {
-    const std::array<VkFormat, 4> formats = {
-        VK_FORMAT_R32G32B32_SFLOAT,
-        VK_FORMAT_R32G32_SFLOAT,
-        VK_FORMAT_R32G32B32_SFLOAT,
-        VK_FORMAT_R32G32B32_SFLOAT};
-
-    const std::array<size_t, 4> offsets = {
-        offsetof(dvl::Vertex, pos),
-        offsetof(dvl::Vertex, tex),
-        offsetof(dvl::Vertex, normal),
-        offsetof(dvl::Vertex, tangent)};
+    // binding 0 is the position stream, binding 1 is the attribute stream and binding 2 is the instances
+    m_objectInputBindDesc[0] = vkh::vertInputBindDesc(0, sizeof(dvl::PackedPosition), VK_VERTEX_INPUT_RATE_VERTEX);
+    m_objectInputBindDesc[1] = vkh::vertInputBindDesc(1, sizeof(dvl::PackedAttributes), VK_VERTEX_INPUT_RATE_VERTEX);
+    m_objectInputBindDesc[2] = vkh::vertInputBindDesc(2, sizeof(instancing::ObjectInstance), VK_VERTEX_INPUT_RATE_INSTANCE);
+
+    m_objectInputAttrDesc[0] = vkh::vertInputAttrDesc(VK_FORMAT_R32G32B32_SFLOAT, 0, 0, 0);
+
+    // the normal and tangent are unpacked to -1 to 1, and decoded in the vertex shader
+    const std::array<VkFormat, 3> formats = {
+        VK_FORMAT_R16G16_SFLOAT,
+        VK_FORMAT_R16G16_SNORM,
+        VK_FORMAT_R16G16_SNORM};
+
+    const std::array<size_t, 3> offsets = {
+        offsetof(dvl::PackedAttributes, tex),
+        offsetof(dvl::PackedAttributes, normal),
+        offsetof(dvl::PackedAttributes, tangent)};
 
     for (uint32_t i = 0; i < formats.size(); i++) {
-        m_objectInputAttrDesc[i] = vkh::vertInputAttrDesc(formats[i], 0, i, offsets[i]);
+        m_objectInputAttrDesc[i + 1] = vkh::vertInputAttrDesc(formats[i], 1, i + 1, offsets[i]);
     }
 
-    // pass the model matrix as a per-instance data
-    // seperate the matrix into 4 vec4's so it can be quickly passed and processed
-    for (uint32_t i = 0; i < 4; i++) {
+    // pass the transform as a per-instance data
+    // its the top 3 rows of the model matrix, so its passed as 3 vec4's
+    for (uint32_t i = 0; i < 3; i++) {
         uint32_t index = 4 + i;
-        size_t offset = offsetof(instancing::ObjectInstance, model) + sizeof(float) * 4 * i;
+        size_t offset = offsetof(instancing::ObjectInstance, transform) + sizeof(float) * 4 * i;
 
-        m_objectInputAttrDesc[index] = vkh::vertInputAttrDesc(VK_FORMAT_R32G32B32A32_SFLOAT, 1, index, offset);
+        m_objectInputAttrDesc[index] = vkh::vertInputAttrDesc(VK_FORMAT_R32G32B32A32_SFLOAT, 2, index, offset);
     }
 
-    m_objectInputAttrDesc[8] = vkh::vertInputAttrDesc(VK_FORMAT_R32_UINT, 1, 8, offsetof(instancing::ObjectInstance, objectIndex));
+    m_objectInputAttrDesc[7] = vkh::vertInputAttrDesc(VK_FORMAT_R32_UINT, 2, 7, offsetof(instancing::ObjectInstance, meshIndex));
 }
 
 void VkPipelines::createDeferredPipeline() {
     m_deferredPipeline.reset();
+    m_deferredLateRenderPass.reset();
 
     VkhShaderModule vertShaderModule = createShaderMod("deferred.vert");
     VkhShaderModule fragShaderModule = createShaderMod("deferred.frag");
@@ -92,11 +94,7 @@ void VkPipelines::createDeferredPipeline() {
     VkPipelineShaderStageCreateInfo fragStage = vkh::createShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderModule);
     std::array<VkPipelineShaderStageCreateInfo, 2> stages = {vertStage, fragStage};
 
-    VkVertexInputBindingDescription vertBindDesc = vkh::vertInputBindDesc(0, sizeof(dvl::Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
-    VkVertexInputBindingDescription instanceBindDesc = vkh::vertInputBindDesc(1, sizeof(instancing::ObjectInstance), VK_VERTEX_INPUT_RATE_INSTANCE);
-    std::array<VkVertexInputBindingDescription, 2> bindDesc = {vertBindDesc, instanceBindDesc};
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = vkh::vertInputInfo(bindDesc.data(), bindDesc.size(), m_objectInputAttrDesc.data(), m_objectInputAttrDesc.size());
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = vkh::vertInputInfo(m_objectInputBindDesc.data(), m_objectInputBindDesc.size(), m_objectInputAttrDesc.data(), m_objectInputAttrDesc.size());
 
     VkPipelineInputAssemblyStateCreateInfo inputAssem{};
     inputAssem.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -223,6 +221,31 @@ void VkPipelines::createDeferredPipeline() {
         throw std::runtime_error("failed to create render pass!");
     }
 
+    // the late pass keeps what the first one drew, and is compatible with it so the same pipeline and framebuffers are used
+    // the depth is left readable by the pyramid shader between them
+    for (uint8_t i = 0; i < 4; i++) {
+        attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachments[i].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    attachments[4].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[4].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    VkSubpassDependency lateDependency{};
+    lateDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    lateDependency.dstSubpass = 0;
+    lateDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    lateDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    lateDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    lateDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    renderPassInfo.dependencyCount = 1;
+    renderPassInfo.pDependencies = &lateDependency;
+
+    if (vkCreateRenderPass(m_device, &renderPassInfo, nullptr, m_deferredLateRenderPass.p()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create late render pass!");
+    }
+
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineInfo.pStages = stages.data();
@@ -414,18 +437,19 @@ void VkPipelines::createShadowPipeline() {
     VkPipelineShaderStageCreateInfo fragStage = vkh::createShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderModule);
     std::array<VkPipelineShaderStageCreateInfo, 2> stages = {vertStage, fragStage};
 
-    VkVertexInputBindingDescription vertBindDesc = vkh::vertInputBindDesc(0, sizeof(dvl::Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
-    VkVertexInputBindingDescription instanceBindDesc = vkh::vertInputBindDesc(1, sizeof(instancing::ObjectInstance), VK_VERTEX_INPUT_RATE_INSTANCE);
+    // only the position stream is read, the instances keep the same binding as the other passes
+    VkVertexInputBindingDescription vertBindDesc = vkh::vertInputBindDesc(0, sizeof(dvl::PackedPosition), VK_VERTEX_INPUT_RATE_VERTEX);
+    VkVertexInputBindingDescription instanceBindDesc = vkh::vertInputBindDesc(2, sizeof(instancing::ObjectInstance), VK_VERTEX_INPUT_RATE_INSTANCE);
     std::array<VkVertexInputBindingDescription, 2> bindDesc = {vertBindDesc, instanceBindDesc};
 
-    std::array<VkVertexInputAttributeDescription, 5> attrDesc{};
-    attrDesc[0] = vkh::vertInputAttrDesc(VK_FORMAT_R32G32B32_SFLOAT, 0, 0, offsetof(dvl::Vertex, pos));
+    std::array<VkVertexInputAttributeDescription, 4> attrDesc{};
+    attrDesc[0] = vkh::vertInputAttrDesc(VK_FORMAT_R32G32B32_SFLOAT, 0, 0, 0);
 
-    for (uint32_t i = 0; i < 4; i++) {
+    for (uint32_t i = 0; i < 3; i++) {
         uint32_t index = i + 1;
-        size_t offset = offsetof(instancing::ObjectInstance, model) + sizeof(float) * 4 * i;
+        size_t offset = offsetof(instancing::ObjectInstance, transform) + sizeof(float) * 4 * i;
 
-        attrDesc[index] = vkh::vertInputAttrDesc(VK_FORMAT_R32G32B32A32_SFLOAT, 1, index, offset);
+        attrDesc[index] = vkh::vertInputAttrDesc(VK_FORMAT_R32G32B32A32_SFLOAT, 2, index, offset);
     }
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = vkh::vertInputInfo(bindDesc.data(), bindDesc.size(), attrDesc.data(), attrDesc.size());
@@ -681,11 +705,7 @@ void VkPipelines::createWBOITPipeline() {
     VkPipelineShaderStageCreateInfo fragStage = vkh::createShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderModule);
     std::array<VkPipelineShaderStageCreateInfo, 2> stages = {vertStage, fragStage};
 
-    VkVertexInputBindingDescription vertBindDesc = vkh::vertInputBindDesc(0, sizeof(dvl::Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
-    VkVertexInputBindingDescription instanceBindDesc = vkh::vertInputBindDesc(1, sizeof(instancing::ObjectInstance), VK_VERTEX_INPUT_RATE_INSTANCE);
-    std::array<VkVertexInputBindingDescription, 2> bindDesc = {vertBindDesc, instanceBindDesc};
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = vkh::vertInputInfo(bindDesc.data(), bindDesc.size(), m_objectInputAttrDesc.data(), m_objectInputAttrDesc.size());
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = vkh::vertInputInfo(m_objectInputBindDesc.data(), m_objectInputBindDesc.size(), m_objectInputAttrDesc.data(), m_objectInputAttrDesc.size());
 
     VkPipelineInputAssemblyStateCreateInfo inputAssem{};
     inputAssem.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -932,7 +952,9 @@ void VkPipelines::createCompositionPipeline() {
     colorResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    // offscreen targets are left ready to be copied out instead of presented
+    colorResolve.finalLayout = m_swap->isHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorResolveAttachmentRef{};
     colorResolveAttachmentRef.attachment = 1;
@@ -1086,4 +1108,74 @@ void VkPipelines::createRayTracingPipeline() {
         throw std::runtime_error("failed to create ray tracing pipeline!!");
     }
 }
+
+void VkPipelines::createCullPipeline() {
+    m_cullPipeline.reset();
+
+    VkhShaderModule compShaderModule = createShaderMod("cull.comp");
+    VkPipelineShaderStageCreateInfo compStage = vkh::createShaderStage(VK_SHADER_STAGE_COMPUTE_BIT, compShaderModule);
+
+    VkPushConstantRange pcRange{};
+    pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pcRange.offset = 0;
+    pcRange.size = sizeof(pushconstants::CullPushConst);
+
+    const std::vector<VkDescriptorSetLayout> layouts = m_descs->getLayouts(descriptorsets::PASSES::CULL);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.pSetLayouts = layouts.data();
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+    pipelineLayoutInfo.pPushConstantRanges = &pcRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    VkResult result = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, m_cullPipeline.layout.p());
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = compStage;
+    pipelineInfo.layout = m_cullPipeline.layout.v();
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, m_cullPipeline.pipeline.p()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull pipeline!");
+    }
+}
+
+void VkPipelines::createDepthPyramidPipeline() {
+    m_depthPyramidPipeline.reset();
+
+    VkhShaderModule compShaderModule = createShaderMod("depthpyramid.comp");
+    VkPipelineShaderStageCreateInfo compStage = vkh::createShaderStage(VK_SHADER_STAGE_COMPUTE_BIT, compShaderModule);
+
+    VkPushConstantRange pcRange{};
+    pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pcRange.offset = 0;
+    pcRange.size = sizeof(pushconstants::PyramidPushConst);
+
+    const std::vector<VkDescriptorSetLayout> layouts = m_descs->getLayouts(descriptorsets::PASSES::DEPTHPYRAMID);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.pSetLayouts = layouts.data();
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+    pipelineLayoutInfo.pPushConstantRanges = &pcRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    VkResult result = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, m_depthPyramidPipeline.layout.p());
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = compStage;
+    pipelineInfo.layout = m_depthPyramidPipeline.layout.v();
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, m_depthPyramidPipeline.pipeline.p()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid pipeline!");
+    }
+}
 }  // namespace pipelines
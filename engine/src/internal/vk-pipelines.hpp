@@ -32,9 +32,15 @@ public:
     [[nodiscard]] pipeline::PipelineData getCompPipe() const noexcept { return m_compPipeline; }
     [[nodiscard]] pipeline::PipelineData getWBOITPipe() const noexcept { return m_wboitPipeline; }
     [[nodiscard]] pipeline::PipelineData getRTPipe() const noexcept { return m_rtPipeline; }
+    [[nodiscard]] pipeline::PipelineData getCullPipe() const noexcept { return m_cullPipeline; }
+    [[nodiscard]] pipeline::PipelineData getDepthPyramidPipe() const noexcept { return m_depthPyramidPipeline; }
+
+    // continues the deferred pass, for the meshlets that were found visible once the depth pyramid was rebuilt
+    [[nodiscard]] VkhRenderPass getDeferredLateRenderPass() const noexcept { return m_deferredLateRenderPass; }
 
 private:
-    std::array<VkVertexInputAttributeDescription, 9> m_objectInputAttrDesc{};
+    std::array<VkVertexInputBindingDescription, 3> m_objectInputBindDesc{};
+    std::array<VkVertexInputAttributeDescription, 8> m_objectInputAttrDesc{};
 
     pipeline::PipelineData m_deferredPipeline{};
     pipeline::PipelineData m_lightingPipeline{};
@@ -43,6 +49,9 @@ private:
     pipeline::PipelineData m_compPipeline{};
     pipeline::PipelineData m_wboitPipeline{};
     pipeline::PipelineData m_rtPipeline{};
+    pipeline::PipelineData m_cullPipeline{};
+    pipeline::PipelineData m_depthPyramidPipeline{};
+    VkhRenderPass m_deferredLateRenderPass{};
 
     const swapchain::VkSwapChain* m_swap = nullptr;
     const textures::VkTextures* m_textures = nullptr;
@@ -52,7 +61,6 @@ private:
     VkDevice m_device{};
 
 private:
-    [[nodiscard]] std::vector<char> readFile(const std::string& filename) const;
     [[nodiscard]] VkhShaderModule createShaderMod(const std::string& name) const;
     void getObjectVertInputAttrDescriptions();
 
@@ -63,5 +71,7 @@ private:
     void createSkyboxPipeline();
     void createWBOITPipeline();
     void createCompositionPipeline();
+    void createCullPipeline();
+    void createDepthPyramidPipeline();
 };
 }  // namespace pipelines
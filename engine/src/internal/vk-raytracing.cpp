@@ -1,9 +1,12 @@
 #include "vk-raytracing.hpp"
 
+#include <algorithm>
+
 namespace raytracing {
-void VkRaytracing::init(uint32_t maxFrames, const VkhCommandPool& commandPool, VkQueue gQueue, VkDevice device, const scene::VkScene* scene, const textures::VkTextures* textures) noexcept {
+void VkRaytracing::init(uint32_t maxFrames, const VkhCommandPool& commandPool, VkQueue gQueue, VkDevice device, const scene::VkScene* scene, const textures::VkTextures* textures, uploads::VkUploads* uploads) noexcept {
     m_scene = scene;
     m_textures = textures;
+    m_uploads = uploads;
 
     m_maxFrames = maxFrames;
     m_commandPool = commandPool;
@@ -12,17 +15,11 @@ void VkRaytracing::init(uint32_t maxFrames, const VkhCommandPool& commandPool, V
 }
 
 void VkRaytracing::createAccelStructures() {
-    size_t uniqueObjectCount = m_scene->getUniqueObjectCount();
-
-    m_blas.resize(uniqueObjectCount);
-    const size_t* uniqueObjects = m_scene->getUniqueObjects();
-
-    for (size_t i = 0; i < uniqueObjectCount; i++) {
-        size_t index = uniqueObjects[i];
+    // one blas per buffer, which every mesh with the same geometry shares
+    m_blas.resize(m_scene->getBufferCount());
 
-        size_t bufferInd = m_scene->getBufferIndex(index);
-        vkh::BufData bufferData = m_scene->getBufferData(bufferInd);
-        createBLAS(bufferData, bufferInd);
+    for (size_t i = 0; i < m_blas.size(); i++) {
+        createBLAS(m_scene->getBufferData(i), i);
     }
 
     for (size_t i = 0; i < m_scene->getObjectCount(); i++) {
@@ -30,32 +27,90 @@ void VkRaytracing::createAccelStructures() {
     }
 
     m_tlas.resize(m_maxFrames);
+    m_pendingRanges.resize(m_maxFrames);
     for (size_t i = 0; i < m_maxFrames; i++) {
         createTLAS(m_tlas[i]);
     }
 }
 
-void VkRaytracing::updateTLAS(uint32_t currentFrame, bool changed) {
-    if (changed) m_meshInstances.clear();
+void VkRaytracing::recordNewBLAS(uploads::Batch& batch) {
+    // the blas are indexed by buffer index, and the meshes that were added have the highest ones
+    // the existing blas dont read from the geometry buffers once built, so they stay as they are
+    size_t oldCount = m_blas.size();
+    m_blas.resize(m_scene->getBufferCount());
+    if (oldCount == m_blas.size()) return;
 
-    for (size_t i = 0; i < m_scene->getObjectCount(); i++) {
-        if (changed) {
+    for (size_t i = oldCount; i < m_blas.size(); i++) {
+        createBLAS(m_scene->getBufferData(i), i, &batch);
+    }
+
+    // the tlas is rebuilt with the new blas once the batch has been submitted
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(batch.graphicsCommandBuffer.v(), VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+bool VkRaytracing::updateTLAS(uint32_t currentFrame, bool changed) {
+    if (changed) {
+        m_meshInstances.clear();
+        for (size_t i = 0; i < m_scene->getObjectCount(); i++) {
             createMeshInstace(i);
-        } else {
-            VkAccelerationStructureInstanceKHR& meshInstance = m_meshInstances[i];
+        }
 
-            const dml::mat4 m = m_scene->getObjectInstances()[i].model;
-            meshInstance.transform = mat4ToVk(m);
+        // the frames in flight keep tracing against the tlas they were recorded with
+        // so each one is rebuilt in its own command buffer once its frame comes around
+        for (rtstructures::TLAS& t : m_tlas) {
+            t.rebuildPending = true;
         }
+
+        return false;
     }
 
-    if (changed) {
-        for (size_t i = 0; i < m_maxFrames; i++) {
-            recreateTLAS(i, true);
-        }
-    } else {
-        recreateTLAS(currentFrame, false);
+    rtstructures::TLAS& t = m_tlas[currentFrame];
+
+    // the frame was recorded since its last update, so anything it had pending has been built
+    t.buildPending = false;
+
+    // the tlas are sized for a number of instances, so the frame's is recreated with room for more once they dont fit
+    // the old one is kept alive until every frame that may still be using it is done
+    bool grown = m_meshInstances.size() > t.capacity;
+    if (grown) {
+        m_uploads->retire(t.as);
+        m_uploads->retire(t.buffer);
+        m_uploads->retire(t.instanceBuffer);
+        m_uploads->retire(t.scratchBuffer);
+
+        t.as = {};
+        t.buffer = {};
+        t.instanceBuffer = {};
+        t.scratchBuffer = {};
+
+        createTLAS(t);
     }
+
+    refitTLAS(currentFrame);
+    return grown;
+}
+
+void VkRaytracing::recordTLASBuild(VkCommandBuffer commandBuffer, uint32_t currentFrame) const {
+    const rtstructures::TLAS& t = m_tlas[currentFrame];
+    if (!t.buildPending) return;
+
+    // the instances were written before the frame was submitted, so theyre visible to the build
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo = t.buildInfo;
+    buildInfo.pGeometries = &t.geometry;
+
+    const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &t.buildRange;
+    vkhfp::vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildInfo, &pBuildRangeInfo);
+
+    // the rays of the frame are traced against the updated tlas
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 }
 
 void VkRaytracing::createSBT(const VkhPipeline& rtPipeline, const VkPhysicalDeviceRayTracingPipelinePropertiesKHR& rtProperties) {
@@ -138,17 +193,20 @@ const VkAccelerationStructureKHR* VkRaytracing::tlasData(bool rtEnabled) {
     return m_rawTLASData.data();
 }
 
-void VkRaytracing::createBLAS(vkh::BufData bufferData, size_t index) {
+void VkRaytracing::createBLAS(vkh::BufData bufferData, size_t index, uploads::Batch* batch) {
     VkhAccelerationStructure tempBLAS{};
     uint32_t primitiveCount = bufferData.indexCount / 3;
 
     // get the device addresses (location of the data on the device) of the vertex and index buffers
     // this allows the data within the gpu to be accessed very efficiently
-    VkhBuffer vertBuffer = m_scene->getVertBuffer().buf;
+    // only the position stream is needed to build the blas
+    VkhBuffer vertBuffer = m_scene->getPositionBuffer().buf;
     VkhBuffer indexBuffer = m_scene->getIndexBuffer().buf;
 
-    VkDeviceAddress vertexAddress = vkh::bufferDeviceAddress(vertBuffer) + (bufferData.vertexOffset * sizeof(dvl::Vertex));
-    VkDeviceAddress indexAddress = vkh::bufferDeviceAddress(indexBuffer) + (bufferData.indexOffset * sizeof(uint32_t));
+    VkDeviceSize indexSectionOffset = m_scene->getIndexSectionOffset(scene::getIndexList(bufferData.indexType));
+
+    VkDeviceAddress vertexAddress = vkh::bufferDeviceAddress(vertBuffer) + (bufferData.vertexOffset * sizeof(dvl::PackedPosition));
+    VkDeviceAddress indexAddress = vkh::bufferDeviceAddress(indexBuffer) + indexSectionOffset + (bufferData.indexOffset * bufferData.indexSize());
 
     // acceleration structure geometry - specifies the device addresses and data inside of the vertex and index buffers
     VkAccelerationStructureGeometryKHR geometry{};
@@ -158,9 +216,9 @@ void VkRaytracing::createBLAS(vkh::BufData bufferData, size_t index) {
     geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
     geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
     geometry.geometry.triangles.vertexData.deviceAddress = vertexAddress;
-    geometry.geometry.triangles.vertexStride = sizeof(dvl::Vertex);
+    geometry.geometry.triangles.vertexStride = sizeof(dvl::PackedPosition);
     geometry.geometry.triangles.maxVertex = bufferData.vertexCount;
-    geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
+    geometry.geometry.triangles.indexType = bufferData.indexType;
     geometry.geometry.triangles.indexData.deviceAddress = indexAddress;
 
     VkBuildAccelerationStructureFlagsKHR accelerationFlags = 0;
@@ -181,6 +239,40 @@ void VkRaytracing::createBLAS(vkh::BufData bufferData, size_t index) {
     sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
     vkhfp::vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &primitiveCount, &sizeInfo);
 
+    // build range info - specifies the primitive count and offsets for the blas
+    VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
+    buildRangeInfo.primitiveCount = primitiveCount;
+    buildRangeInfo.primitiveOffset = 0;
+    buildRangeInfo.transformOffset = 0;
+    buildRangeInfo.firstVertex = 0;
+    const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
+
+    VkBufferUsageFlags scratchUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+    // blas added while the engine is running are built with the upload, so nothing waits on them
+    // compacting them would need the compacted size read back on the cpu first, so theyre left as theyre built
+    if (batch) {
+        VkBufferUsageFlags blasUsage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+        vkh::createDeviceLocalBuffer(m_blas[index].compBuffer, sizeInfo.accelerationStructureSize, blasUsage, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+
+        VkAccelerationStructureCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+        createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        createInfo.buffer = m_blas[index].compBuffer.buf.v();
+        createInfo.size = sizeInfo.accelerationStructureSize;
+        vkhfp::vkCreateAccelerationStructureKHR(m_device, &createInfo, nullptr, m_blas[index].blas.p());
+
+        // kept alive until the graphics queue is done with the batch
+        vkh::BufferObj& scratchBuffer = batch->stagingBuffers.emplace_back();
+        vkh::createDeviceLocalBuffer(scratchBuffer, sizeInfo.buildScratchSize, scratchUsage, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+
+        buildInfo.dstAccelerationStructure = m_blas[index].blas.v();
+        buildInfo.scratchData.deviceAddress = vkh::bufferDeviceAddress(scratchBuffer.buf);
+
+        vkhfp::vkCmdBuildAccelerationStructuresKHR(batch->graphicsCommandBuffer.v(), 1, &buildInfo, &pBuildRangeInfo);
+        return;
+    }
+
     // create a buffer for the BLAS - the buffer used in the creation of the blas
     vkh::BufferObj blasBuffer{};
     VkBufferUsageFlags blasUsage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
@@ -196,17 +288,8 @@ void VkRaytracing::createBLAS(vkh::BufData bufferData, size_t index) {
 
     // scratch buffer - used to create space for intermediate data thats used when building the BLAS
     vkh::BufferObj blasScratchBuffer{};
-    VkBufferUsageFlags scratchUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
     vkh::createDeviceLocalBuffer(blasScratchBuffer, sizeInfo.buildScratchSize, scratchUsage, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
 
-    // build range info - specifies the primitive count and offsets for the blas
-    VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
-    buildRangeInfo.primitiveCount = primitiveCount;
-    buildRangeInfo.primitiveOffset = 0;
-    buildRangeInfo.transformOffset = 0;
-    buildRangeInfo.firstVertex = 0;
-    const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
-
     // set the dst of the build info to be the blas and add the scratch buffer address
     buildInfo.dstAccelerationStructure = tempBLAS.v();
     buildInfo.scratchData.deviceAddress = vkh::bufferDeviceAddress(blasScratchBuffer.buf);
@@ -261,17 +344,20 @@ void VkRaytracing::createBLAS(vkh::BufData bufferData, size_t index) {
 }
 
 void VkRaytracing::createTLASInstanceBuffer(rtstructures::TLAS& t) {
-    VkDeviceSize iSize = m_meshInstances.size() * sizeof(VkAccelerationStructureInstanceKHR);
+    // its sized for the capacity so the tlas can be rebuilt with more instances in place
+    VkDeviceSize iSize = t.capacity * sizeof(VkAccelerationStructureInstanceKHR);
     VkBufferUsageFlags iUsage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
     VkMemoryAllocateFlags iMemFlags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
-    vkh::createAndWriteHostBuffer(t.instanceBuffer, m_meshInstances.data(), iSize, iUsage, iMemFlags);
+
+    // moved instances are written into it every frame, so it stays mapped
+    vkh::createMappedBuffer(t.instanceBuffer, iSize, iUsage, iMemFlags);
 }
 
 void VkRaytracing::createTLAS(rtstructures::TLAS& t) {
     t.as.reset();
 
-    uint32_t primitiveCount = static_cast<uint32_t>(m_meshInstances.size());
-    uint32_t primitiveCountMax = cfg::MAX_OBJECTS;
+    t.capacity = std::max({static_cast<uint32_t>(m_meshInstances.size()), t.capacity * 2, 1u});
+    uint32_t primitiveCountMax = t.capacity;
 
     // create a buffer to hold all of the instances
     createTLASInstanceBuffer(t);
@@ -317,83 +403,113 @@ void VkRaytracing::createTLAS(rtstructures::TLAS& t) {
 
     // scratch buffer - used to create space for intermediate data thats used when building the TLAS
     VkBufferUsageFlags scratchUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-    vkh::createDeviceLocalBuffer(t.scratchBuffer, sizeInfo.buildScratchSize, scratchUsage, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
-
-    // build range info - specifies the primitive count and offsets for the tlas
-    VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
-    buildRangeInfo.primitiveCount = primitiveCount;
-    buildRangeInfo.primitiveOffset = 0;
-    buildRangeInfo.transformOffset = 0;
-    buildRangeInfo.firstVertex = 0;
-    const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
+    // its updated in place every frame something moves, so the scratch buffer is big enough for either
+    VkDeviceSize scratchSize = std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize);
+    vkh::createDeviceLocalBuffer(t.scratchBuffer, scratchSize, scratchUsage, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
 
-    // set the dst of the build info to be the tlas and add the scratch buffer address
-    t.buildInfo.dstAccelerationStructure = t.as.v();
-    t.buildInfo.scratchData.deviceAddress = vkh::bufferDeviceAddress(t.scratchBuffer.buf);
-
-    // build and populate the TLAS
-    VkhCommandBuffer commandBufferB = vkh::beginSingleTimeCommands(m_commandPool);
-    vkhfp::vkCmdBuildAccelerationStructuresKHR(commandBufferB.v(), 1, &t.buildInfo, &pBuildRangeInfo);
-    vkh::endSingleTimeCommands(commandBufferB, m_commandPool, m_gQueue);
+    // the instances are written and the tlas is built in the frame's command buffer when its frame comes around
+    t.rebuildPending = true;
 }
 
-VkTransformMatrixKHR VkRaytracing::mat4ToVk(const dml::mat4& m) {
-    dml::mat4 t = m.transpose();
+VkTransformMatrixKHR VkRaytracing::toVk(const instancing::Transform& t) {
+    static_assert(sizeof(instancing::Transform) == sizeof(VkTransformMatrixKHR));
 
+    // the transforms are already laid out the same way
     VkTransformMatrixKHR result{};
-    std::memcpy(&result.matrix, &t.flat, 12 * sizeof(float));
+    std::memcpy(&result.matrix, &t.m, sizeof(VkTransformMatrixKHR));
     return result;
 }
 
 void VkRaytracing::createMeshInstace(size_t index) {
-    size_t bufferIndex = m_scene->getBufferIndex(index);
-    size_t objectIndex = m_scene->getUniqueObjectIndex(index);
+    const instancing::ObjectInstance& instance = m_scene->getObjectInstances()[index];
+    size_t bufferIndex = m_scene->getMeshBufferIndex(instance.meshIndex);
 
     VkAccelerationStructureInstanceKHR meshInstance{};
 
-    // copy the model matrix into instance data
-    const dml::mat4 m = m_scene->getObjectInstances()[index].model;
-    meshInstance.transform = mat4ToVk(m);
+    // copy the transform into instance data
+    meshInstance.transform = toVk(instance.transform);
 
     // det device address of the blas
     VkDeviceAddress blasAddress = vkh::asDeviceAddress(m_blas[bufferIndex].blas);
     meshInstance.accelerationStructureReference = blasAddress;
 
-    meshInstance.instanceCustomIndex = static_cast<uint32_t>(objectIndex);
+    meshInstance.instanceCustomIndex = instance.meshIndex;
     meshInstance.mask = 0xFF;
 
     m_meshInstances.push_back(meshInstance);
 }
 
-void VkRaytracing::recreateTLAS(size_t index, bool rebuild) {
-    rtstructures::TLAS& t = m_tlas[index];
+void VkRaytracing::refitTLAS(uint32_t currentFrame) {
+    const std::vector<instancing::SlotRange>& moved = m_scene->getDirtyInstanceRanges();
+    const instancing::ObjectInstance* instances = m_scene->getObjectInstances();
+    uint32_t instanceCount = static_cast<uint32_t>(m_meshInstances.size());
 
-    // if rebuilding, recreate the instance buffer to reflect the new size
-    if (rebuild) createTLASInstanceBuffer(t);
+    // only the instances that moved are updated
+    for (const instancing::SlotRange& range : moved) {
+        uint32_t end = std::min(range.first + range.count, instanceCount);
+        for (uint32_t i = range.first; i < end; i++) {
+            m_meshInstances[i].transform = toVk(instances[i].transform);
+        }
+    }
 
-    // copy the new data into the instance buffer
-    vkh::writeBuffer(t.instanceBuffer.mem, m_meshInstances.data(), m_meshInstances.size() * sizeof(VkAccelerationStructureInstanceKHR));
+    // each tlas is refit with them when its frame comes around, and isnt touched if nothing moved
+    for (std::vector<instancing::SlotRange>& pending : m_pendingRanges) {
+        pending.insert(pending.end(), moved.begin(), moved.end());
+    }
 
-    // update the instance buffer device address
-    t.geometry.geometry.instances.data.deviceAddress = vkh::bufferDeviceAddress(t.instanceBuffer.buf);
+    // a tlas whose instances changed is rebuilt with all of them, which includes the moved ones
+    rtstructures::TLAS& t = m_tlas[currentFrame];
+    if (t.rebuildPending) {
+        recreateTLAS(currentFrame);
+        return;
+    }
 
-    // update the build info
-    t.buildInfo.pGeometries = &t.geometry;
-    t.buildInfo.mode = rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
-    t.buildInfo.srcAccelerationStructure = rebuild ? VK_NULL_HANDLE : t.as.v();
+    std::vector<instancing::SlotRange>& ranges = m_pendingRanges[currentFrame];
+    if (ranges.empty()) return;
+
+    instancing::mergeRanges(ranges, 16);
+
+    for (const instancing::SlotRange& range : ranges) {
+        if (range.first >= instanceCount) break;
+        uint32_t count = std::min(range.count, instanceCount - range.first);
+        if (count == 0) continue;
+
+        VkDeviceSize offset = range.first * sizeof(VkAccelerationStructureInstanceKHR);
+        vkh::writeBuffer(t.instanceBuffer, m_meshInstances.data() + range.first, count * sizeof(VkAccelerationStructureInstanceKHR), offset);
+    }
+
+    ranges.clear();
+
+    // the update is recorded into the frame's command buffer, so moving instances never waits on the queue
+    t.buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+    t.buildInfo.srcAccelerationStructure = t.as.v();
     t.buildInfo.dstAccelerationStructure = t.as.v();
+    t.buildInfo.scratchData.deviceAddress = vkh::bufferDeviceAddress(t.scratchBuffer.buf);
 
-    // update the buildRangeInfo
-    VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
-    buildRangeInfo.primitiveCount = static_cast<uint32_t>(m_meshInstances.size());
-    buildRangeInfo.primitiveOffset = 0;
-    buildRangeInfo.transformOffset = 0;
-    buildRangeInfo.firstVertex = 0;
-    const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
+    t.buildRange = {};
+    t.buildRange.primitiveCount = instanceCount;
+    t.buildPending = true;
+}
 
-    // rebuild and populate the TLAS
-    VkhCommandBuffer commandBufferB = vkh::beginSingleTimeCommands(m_commandPool);
-    vkhfp::vkCmdBuildAccelerationStructuresKHR(commandBufferB.v(), 1, &t.buildInfo, &pBuildRangeInfo);
-    vkh::endSingleTimeCommands(commandBufferB, m_commandPool, m_gQueue);
+void VkRaytracing::recreateTLAS(uint32_t currentFrame) {
+    rtstructures::TLAS& t = m_tlas[currentFrame];
+    uint32_t instanceCount = static_cast<uint32_t>(m_meshInstances.size());
+
+    // the instance buffer has room for the capacity, and the frame is done with it, so every instance is written in place
+    if (instanceCount > 0) {
+        vkh::writeBuffer(t.instanceBuffer, m_meshInstances.data(), instanceCount * sizeof(VkAccelerationStructureInstanceKHR));
+    }
+
+    m_pendingRanges[currentFrame].clear();
+
+    t.buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    t.buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+    t.buildInfo.dstAccelerationStructure = t.as.v();
+    t.buildInfo.scratchData.deviceAddress = vkh::bufferDeviceAddress(t.scratchBuffer.buf);
+
+    t.buildRange = {};
+    t.buildRange.primitiveCount = instanceCount;
+    t.buildPending = true;
+    t.rebuildPending = false;
 }
 }  // namespace raytracing
@@ -8,6 +8,7 @@
 #include "structures/raytracing.hpp"
 #include "vk-scene.hpp"
 #include "vk-textures.hpp"
+#include "vk-uploads.hpp"
 
 namespace raytracing {
 class VkRaytracing {
@@ -19,9 +20,18 @@ public:
     VkRaytracing(VkRaytracing&&) = delete;
     VkRaytracing& operator=(VkRaytracing&&) = delete;
 
-    void init(uint32_t maxFrames, const VkhCommandPool& commandPool, VkQueue gQueue, VkDevice device, const scene::VkScene* scene, const textures::VkTextures* textures) noexcept;
+    void init(uint32_t maxFrames, const VkhCommandPool& commandPool, VkQueue gQueue, VkDevice device, const scene::VkScene* scene, const textures::VkTextures* textures, uploads::VkUploads* uploads) noexcept;
     void createAccelStructures();
-    void updateTLAS(uint32_t currentFrame, bool changed);
+
+    // builds the blas of the meshes added since the last call with the upload, which has to be finished before the tlas is rebuilt
+    void recordNewBLAS(uploads::Batch& batch);
+
+    // if changed, every tlas is rebuilt with the new instances when its frame comes around, otherwise the frame's tlas is refit
+    // returns true if the frame's tlas was recreated to fit more instances, so its descriptor has to be rewritten
+    bool updateTLAS(uint32_t currentFrame, bool changed);
+
+    // records the build or update of the frame's tlas, if it has one, ahead of the rays that are traced against it
+    void recordTLASBuild(VkCommandBuffer commandBuffer, uint32_t currentFrame) const;
     void createSBT(const VkhPipeline& rtPipeline, const VkPhysicalDeviceRayTracingPipelinePropertiesKHR& rtProperties);
 
     [[nodiscard]] const VkAccelerationStructureKHR* tlasData(bool rtEnabled);
@@ -37,9 +47,11 @@ private:
     std::vector<VkAccelerationStructureKHR> m_rawTLASData;
     rtstructures::SBT m_sbt{};
     std::vector<VkAccelerationStructureInstanceKHR> m_meshInstances;
+    std::vector<std::vector<instancing::SlotRange>> m_pendingRanges;  // the moved instances each tlas hasnt been updated with
 
     const scene::VkScene* m_scene = nullptr;
     const textures::VkTextures* m_textures = nullptr;
+    uploads::VkUploads* m_uploads = nullptr;
 
     uint32_t m_maxFrames = 0;
     VkDevice m_device{};
@@ -47,12 +59,13 @@ private:
     VkQueue m_gQueue{};
 
 private:
-    void createBLAS(vkh::BufData bufferData, size_t index);
+    void createBLAS(vkh::BufData bufferData, size_t index, uploads::Batch* batch = nullptr);
 
     void createTLASInstanceBuffer(rtstructures::TLAS& t);
     void createTLAS(rtstructures::TLAS& t);
-    [[nodiscard]] VkTransformMatrixKHR mat4ToVk(const dml::mat4& m);
+    [[nodiscard]] VkTransformMatrixKHR toVk(const instancing::Transform& t);
     void createMeshInstace(size_t index);
-    void recreateTLAS(size_t index, bool rebuild);
+    void refitTLAS(uint32_t currentFrame);
+    void recreateTLAS(uint32_t currentFrame);
 };
 }  // namespace raytracing
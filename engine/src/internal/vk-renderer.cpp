@@ -7,7 +7,7 @@
 #include "config.hpp"
 
 namespace renderer {
-void VkRenderer::init(bool rtEnabled, uint32_t maxFrames, bool showDebugInfo, VkDevice device, const setup::VkSetup* setup, const swapchain::VkSwapChain* swap, const textures::VkTextures* textures, const scene::VkScene* scene, const buffers::VkBuffers* buffers, const descriptorsets::VkDescriptorSets* descs, const pipelines::VkPipelines* pipelines, const raytracing::VkRaytracing* raytracing) noexcept {
+void VkRenderer::init(bool rtEnabled, bool meshletCulling, uint32_t maxFrames, bool showDebugInfo, VkDevice device, const setup::VkSetup* setup, const swapchain::VkSwapChain* swap, const textures::VkTextures* textures, const scene::VkScene* scene, const buffers::VkBuffers* buffers, const descriptorsets::VkDescriptorSets* descs, const pipelines::VkPipelines* pipelines, const raytracing::VkRaytracing* raytracing, uploads::VkUploads* uploads) noexcept {
     m_setup = setup;
     m_swap = swap;
     m_textures = textures;
@@ -16,8 +16,10 @@ void VkRenderer::init(bool rtEnabled, uint32_t maxFrames, bool showDebugInfo, Vk
     m_descs = descs;
     m_pipe = pipelines;
     m_raytracing = raytracing;
+    m_uploads = uploads;
 
     m_rtEnabled = rtEnabled;
+    m_meshletCulling = meshletCulling;
     m_maxFrames = maxFrames;
     m_showDebugInfo = showDebugInfo;
     m_device = device;
@@ -114,8 +116,16 @@ VkResult VkRenderer::drawFrame(uint32_t currentFrame, float fps, bool sceneChang
     VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     std::vector<VkSubmitInfo> submitInfos;
 
+    // when headless there is no image to acquire or present
+    // so the first submit doesnt wait and the last one doesnt signal
+    bool headless = m_swap->isHeadless();
+
     if (!m_rtEnabled) {
-        submitInfos.push_back(vkh::createSubmitInfo(m_deferredCB.primary[m_currentFrame].p(), 1, &waitStage, m_imageAvailableSemaphores[m_currentFrame], m_deferredSemaphores[m_currentFrame]));
+        if (headless) {
+            submitInfos.push_back(vkh::createSubmitInfo(m_deferredCB.primary[m_currentFrame].p(), 1, &waitStage, nullptr, m_deferredSemaphores[m_currentFrame].p(), 0, 1));
+        } else {
+            submitInfos.push_back(vkh::createSubmitInfo(m_deferredCB.primary[m_currentFrame].p(), 1, &waitStage, m_imageAvailableSemaphores[m_currentFrame], m_deferredSemaphores[m_currentFrame]));
+        }
 
         // dont submit shadow command buffers if no lights exist
         bool lightsExist = m_scene->lightsExist();
@@ -124,10 +134,19 @@ VkResult VkRenderer::drawFrame(uint32_t currentFrame, float fps, bool sceneChang
 
         submitInfos.push_back(vkh::createSubmitInfo(m_lightingCB.primary[m_currentFrame].p(), 1, &waitStage, lightingWaitSemaphore, m_wboitSemaphores[m_currentFrame]));
         submitInfos.push_back(vkh::createSubmitInfo(m_wboitCB.primary[m_currentFrame].p(), 1, &waitStage, m_wboitSemaphores[m_currentFrame], m_compSemaphores[m_currentFrame]));
-        submitInfos.push_back(vkh::createSubmitInfo(m_compCB.primary[m_currentFrame].p(), 1, &waitStage, m_compSemaphores[m_currentFrame], m_renderFinishedSemaphores[m_currentFrame]));
     } else {
-        submitInfos.push_back(vkh::createSubmitInfo(m_rtCB.primary[m_currentFrame].p(), 1, &waitStage, m_imageAvailableSemaphores[m_currentFrame], m_rtSemaphores[m_currentFrame]));
-        submitInfos.push_back(vkh::createSubmitInfo(m_compCB.primary[m_currentFrame].p(), 1, &waitStage, m_rtSemaphores[m_currentFrame], m_renderFinishedSemaphores[m_currentFrame]));
+        if (headless) {
+            submitInfos.push_back(vkh::createSubmitInfo(m_rtCB.primary[m_currentFrame].p(), 1, &waitStage, nullptr, m_rtSemaphores[m_currentFrame].p(), 0, 1));
+        } else {
+            submitInfos.push_back(vkh::createSubmitInfo(m_rtCB.primary[m_currentFrame].p(), 1, &waitStage, m_imageAvailableSemaphores[m_currentFrame], m_rtSemaphores[m_currentFrame]));
+        }
+    }
+
+    const VkhSemaphore& compWaitSemaphore = m_rtEnabled ? m_rtSemaphores[m_currentFrame] : m_compSemaphores[m_currentFrame];
+    if (headless) {
+        submitInfos.push_back(vkh::createSubmitInfo(m_compCB.primary[m_currentFrame].p(), 1, &waitStage, compWaitSemaphore.p(), nullptr, 1, 0));
+    } else {
+        submitInfos.push_back(vkh::createSubmitInfo(m_compCB.primary[m_currentFrame].p(), 1, &waitStage, compWaitSemaphore, m_renderFinishedSemaphores[m_currentFrame]));
     }
 
     // submit all command buffers in a single call
@@ -135,6 +154,9 @@ VkResult VkRenderer::drawFrame(uint32_t currentFrame, float fps, bool sceneChang
         throw std::runtime_error("failed to submit command buffers!");
     }
 
+    // the frame stays in its offscreen image, the frame fence signals when its done
+    if (headless) return VK_SUCCESS;
+
     // present the image
     uint32_t imageIndex = m_swap->getImageIndex();
     VkPresentInfoKHR presentInfo{};
@@ -248,6 +270,7 @@ void VkRenderer::renderImguiFrame(VkhCommandBuffer& commandBuffer) {
     text.push_back("Objects: " + std::to_string(m_scene->getObjectCount()));
     text.push_back("Lights: " + std::to_string(m_scene->getLightCount()));
     text.push_back("Path tracing: " + std::string(m_rtEnabled ? "ON" : "OFF"));
+    text.push_back("Meshlet culling: " + std::string(m_meshletCulling ? "ON" : "OFF"));
 
     // render the frame
     if (ImGui::Begin("Info", nullptr, flags)) {
@@ -264,18 +287,154 @@ void VkRenderer::renderImguiFrame(VkhCommandBuffer& commandBuffer) {
     ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer.v());
 }
 
-void VkRenderer::recordObjectCommandBuffers(VkhCommandBuffer& secondary, const pipeline::PipelineData& pipe, const VkCommandBufferBeginInfo& beginInfo, const VkDescriptorSet* descriptorsets, size_t descriptorCount) {
-    const std::array<VkBuffer, 2> vertexBuffersArray = {m_scene->getVertBuffer().buf.v(), m_buffers->getObjectInstanceBuffer(m_currentFrame).buf.v()};
-    const std::array<VkDeviceSize, 2> offsets = {0, 0};
+void VkRenderer::recordBufferBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) const {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void VkRenderer::recordCullCommands(VkCommandBuffer commandBuffer, uint32_t region, int batch) {
+    const vkh::BufferObj drawBuffer = m_buffers->getDrawBuffer(m_currentFrame);
+    VkDeviceSize regionOffset = m_buffers->getDrawRegionOffset(region);
+    VkDeviceSize occludedOffset = m_buffers->getOccludedListOffset();
+
+    // the late region only culls the meshlets the early phase found hidden, after the depth pyramid is rebuilt
+    uint32_t phase = (region == culling::LATE_REGION) ? culling::LATE_PHASE : culling::EARLY_PHASE;
+
+    // the previous draws from the region have to finish before its counts are reset
+    recordBufferBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdFillBuffer(commandBuffer, drawBuffer.buf.v(), regionOffset, culling::DRAW_COUNT_SIZE, 0);
+    if (region == culling::CAMERA_VIEW) vkCmdFillBuffer(commandBuffer, drawBuffer.buf.v(), occludedOffset, culling::DRAW_COUNT_SIZE, 0);
+    recordBufferBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    size_t itemCount = m_scene->getMeshletItemCount();
+
+    if (itemCount > 0) {
+        const std::vector<VkDescriptorSet> sets = m_descs->getSets(descriptorsets::PASSES::CULL);
+        pipeline::PipelineData cullPipe = m_pipe->getCullPipe();
+
+        pushconstants::CullPushConst cullPushConst{};
+        cullPushConst.meshlets = vkh::bufferDeviceAddress(m_scene->getMeshletBuffer().buf);
+        cullPushConst.objects = vkh::bufferDeviceAddress(m_buffers->getCullObjectBuffer(m_currentFrame).buf);
+        cullPushConst.instances = vkh::bufferDeviceAddress(m_buffers->getObjectInstanceBuffer(m_currentFrame).buf);
+        cullPushConst.draws = vkh::bufferDeviceAddress(drawBuffer.buf) + regionOffset;
+        cullPushConst.occluded = vkh::bufferDeviceAddress(drawBuffer.buf) + occludedOffset;
+        cullPushConst.itemCount = static_cast<uint32_t>(itemCount);
+        cullPushConst.objectCount = static_cast<uint32_t>(m_scene->getObjectCount());
+        cullPushConst.instanceStride = sizeof(instancing::ObjectInstance) / sizeof(float);
+        cullPushConst.frame = static_cast<int>(m_currentFrame);
+        cullPushConst.batch = batch;
+        cullPushConst.lightCount = static_cast<int>(m_scene->getLightCount());
+        cullPushConst.lightsPerBatch = cfg::LIGHTS_PER_BATCH;
+        cullPushConst.phase = phase;
+        cullPushConst.pyramidLevels = (batch < 0) ? m_textures->getDepthPyramidLevels() : 0;
+        cullPushConst.depthWidth = m_swap->getWidth();
+        cullPushConst.depthHeight = m_swap->getHeight();
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipe.pipeline.v());
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipe.layout.v(), 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullPipe.layout.v(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushconstants::CullPushConst), &cullPushConst);
+
+        // one invocation per meshlet, 64 per workgroup
+        // the late phase only knows how many were hidden on the gpu, so the invocations past the count return straight away
+        uint32_t groupCount = static_cast<uint32_t>((itemCount + 63) / 64);
+        vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+    }
+
+    recordBufferBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+}
+
+void VkRenderer::recordDepthPyramid(VkCommandBuffer commandBuffer) {
+    const vkh::Texture& depth = m_textures->getDeferredDepthTex(m_currentFrame);
+    uint32_t levelCount = m_textures->getDepthPyramidLevels();
+
+    // the late deferred pass moves the depth back to an attachment when it starts
+    VkImageMemoryBarrier depthBarrier{};
+    depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depthBarrier.image = depth.image.v();
+    depthBarrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+
+    // the early cull has to be done reading the pyramid before its overwritten
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+    const std::vector<VkDescriptorSet> sets = m_descs->getSets(descriptorsets::PASSES::DEPTHPYRAMID);
+    pipeline::PipelineData pyramidPipe = m_pipe->getDepthPyramidPipe();
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipe.pipeline.v());
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipe.layout.v(), 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+
+    // each level is reduced from the one before it, and the first from the depth
+    for (uint32_t level = 0; level < levelCount; level++) {
+        pushconstants::PyramidPushConst pyramidPushConst{};
+        pyramidPushConst.source = (level == 0) ? static_cast<int>(culling::MAX_PYRAMID_LEVELS + m_currentFrame) : static_cast<int>(level - 1);
+        pyramidPushConst.level = static_cast<int>(level);
+        pyramidPushConst.width = m_textures->getDepthPyramidWidth(level);
+        pyramidPushConst.height = m_textures->getDepthPyramidHeight(level);
+
+        vkCmdPushConstants(commandBuffer, pyramidPipe.layout.v(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushconstants::PyramidPushConst), &pyramidPushConst);
+
+        // 8x8 texels per workgroup
+        vkCmdDispatch(commandBuffer, (pyramidPushConst.width + 7) / 8, (pyramidPushConst.height + 7) / 8, 1);
+
+        // also makes the whole pyramid visible to the late cull, and to the early cull of the next frame
+        recordBufferBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+}
+
+void VkRenderer::recordSceneDraws(VkCommandBuffer commandBuffer, uint32_t view) const {
+    VkBuffer indexBuffer = m_scene->getIndexBuffer().buf.v();
+    VkBuffer sceneIndirectBuffer = m_buffers->getSceneIndirectCommandsBuffer(m_currentFrame);
+    uint32_t itemCount = static_cast<uint32_t>(m_scene->getMeshletItemCount());
+
+    // each index type has its own section of the index buffer, and its own list of draws
+    for (uint32_t list = 0; list < scene::INDEX_TYPES.size(); list++) {
+        uint32_t commandCount = m_scene->getIndirectCommandCount(list);
+        if (commandCount == 0) continue;
+
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, m_scene->getIndexSectionOffset(list), scene::INDEX_TYPES[list]);
+
+        if (m_meshletCulling) {
+            VkBuffer drawBuffer = m_buffers->getDrawBuffer(m_currentFrame).buf.v();
+            VkDeviceSize regionOffset = m_buffers->getDrawRegionOffset(view);
+
+            VkDeviceSize countOffset = regionOffset + (list * sizeof(uint32_t));
+            VkDeviceSize drawOffset = regionOffset + culling::DRAW_COUNT_SIZE + (list * itemCount * sizeof(VkDrawIndexedIndirectCommand));
+
+            vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, drawOffset, drawBuffer, countOffset, itemCount, sizeof(VkDrawIndexedIndirectCommand));
+        } else {
+            uint32_t firstCommand = m_scene->getIndirectCommandOffset(list);
+
+            // the culled instances of each view have draws of their own
+            if (m_scene->cullsInstances()) {
+                firstCommand = m_scene->getViewCommandOffset(view, list);
+                commandCount = m_scene->getViewCommandCount(view, list);
+                if (commandCount == 0) continue;
+            }
+
+            VkDeviceSize commandOffset = firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+            vkCmdDrawIndexedIndirect(commandBuffer, sceneIndirectBuffer, commandOffset, commandCount, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+}
+
+void VkRenderer::recordObjectCommandBuffers(VkhCommandBuffer& secondary, const pipeline::PipelineData& pipe, const VkCommandBufferBeginInfo& beginInfo, const VkDescriptorSet* descriptorsets, size_t descriptorCount, uint32_t region) {
+    const std::array<VkBuffer, 3> vertexBuffersArray = {m_scene->getPositionBuffer().buf.v(), m_scene->getAttributeBuffer().buf.v(), m_buffers->getObjectInstanceBuffer(m_currentFrame).buf.v()};
+    const std::array<VkDeviceSize, 3> offsets = {0, 0, 0};
 
     vkCmdBindPipeline(secondary.v(), VK_PIPELINE_BIND_POINT_GRAPHICS, pipe.pipeline.v());
     vkCmdBindDescriptorSets(secondary.v(), VK_PIPELINE_BIND_POINT_GRAPHICS, pipe.layout.v(), 0, static_cast<uint32_t>(descriptorCount), descriptorsets, 0, nullptr);
 
-    vkCmdBindVertexBuffers(secondary.v(), 0, 2, vertexBuffersArray.data(), offsets.data());
-    vkCmdBindIndexBuffer(secondary.v(), m_scene->getIndexBuffer().buf.v(), 0, VK_INDEX_TYPE_UINT32);
-
-    VkBuffer sceneIndirectBuffer = m_buffers->getSceneIndirectCommandsBuffer();
-    vkCmdDrawIndexedIndirect(secondary.v(), sceneIndirectBuffer, 0, static_cast<uint32_t>(m_scene->getUniqueObjectCount()), sizeof(VkDrawIndexedIndirectCommand));
+    vkCmdBindVertexBuffers(secondary.v(), 0, static_cast<uint32_t>(vertexBuffersArray.size()), vertexBuffersArray.data(), offsets.data());
+    recordSceneDraws(secondary.v(), region);
 }
 
 void VkRenderer::recordDeferredCommandBuffers() {
@@ -297,6 +456,12 @@ void VkRenderer::recordDeferredCommandBuffers() {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
 
+    // the first command buffer of the frame copies in whatever was staged since the last one
+    m_uploads->recordStagedCopies(deferredCommandBuffer.v());
+
+    // the camera's draws are also used by the wboit pass
+    if (m_meshletCulling) recordCullCommands(deferredCommandBuffer.v(), culling::CAMERA_VIEW, -1);
+
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = deferredPipe.renderPass.v();
@@ -309,9 +474,27 @@ void VkRenderer::recordDeferredCommandBuffers() {
     vkCmdBeginRenderPass(deferredCommandBuffer.v(), &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
     vkCmdPushConstants(deferredCommandBuffer.v(), deferredPipe.layout.v(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushconstants::FramePushConst), &m_framePushConst);
-    recordObjectCommandBuffers(deferredCommandBuffer, deferredPipe, beginInfo, sets.data(), sets.size());
+    recordObjectCommandBuffers(deferredCommandBuffer, deferredPipe, beginInfo, sets.data(), sets.size(), culling::CAMERA_VIEW);
 
     vkCmdEndRenderPass(deferredCommandBuffer.v());
+
+    // the pyramid is rebuilt from what was just drawn, and the meshlets that were hidden last frame are tested against it
+    // the ones that were uncovered are drawn on top, so they show up this frame rather than the next
+    if (m_meshletCulling) {
+        recordDepthPyramid(deferredCommandBuffer.v());
+        recordCullCommands(deferredCommandBuffer.v(), culling::LATE_REGION, -1);
+
+        renderPassInfo.renderPass = m_pipe->getDeferredLateRenderPass().v();
+        renderPassInfo.clearValueCount = 0;
+        renderPassInfo.pClearValues = nullptr;
+
+        vkCmdBeginRenderPass(deferredCommandBuffer.v(), &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        vkCmdPushConstants(deferredCommandBuffer.v(), deferredPipe.layout.v(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushconstants::FramePushConst), &m_framePushConst);
+        recordObjectCommandBuffers(deferredCommandBuffer, deferredPipe, beginInfo, sets.data(), sets.size(), culling::LATE_REGION);
+
+        vkCmdEndRenderPass(deferredCommandBuffer.v());
+    }
     if (vkEndCommandBuffer(deferredCommandBuffer.v()) != VK_SUCCESS) {
         throw std::runtime_error("failed to record command buffer!");
     }
@@ -319,8 +502,9 @@ void VkRenderer::recordDeferredCommandBuffers() {
 
 void VkRenderer::recordShadowCommandBuffers() {
     const std::vector<VkDescriptorSet> sets = m_descs->getSets(descriptorsets::PASSES::SHADOW);
-    const std::array<VkBuffer, 2> vertexBuffersArray = {m_scene->getVertBuffer().buf.v(), m_buffers->getObjectInstanceBuffer(m_currentFrame).buf.v()};
-    const std::array<VkDeviceSize, 2> offsets = {0, 0};
+    // the attribute stream isnt read by the shadow pipeline, but is bound so the instances keep their binding
+    const std::array<VkBuffer, 3> vertexBuffersArray = {m_scene->getPositionBuffer().buf.v(), m_scene->getAttributeBuffer().buf.v(), m_buffers->getObjectInstanceBuffer(m_currentFrame).buf.v()};
+    const std::array<VkDeviceSize, 3> offsets = {0, 0, 0};
 
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -329,7 +513,6 @@ void VkRenderer::recordShadowCommandBuffers() {
 
     const VkClearValue clearValue = VkClearValue{{{1.0f, 0}}};
     pipeline::PipelineData shadowPipe = m_pipe->getShadowPipe();
-    VkBuffer sceneIndirectBuffer = m_buffers->getSceneIndirectCommandsBuffer();
 
     size_t batchCount = m_scene->getShadowBatchCount();
 
@@ -342,6 +525,9 @@ void VkRenderer::recordShadowCommandBuffers() {
             throw std::runtime_error("failed to begin recording command buffer!");
         }
 
+        // every batch culls into the same region, after the previous batch has drawn from it
+        if (m_meshletCulling) recordCullCommands(shadowCommandBuffer, culling::SHADOW_VIEW, static_cast<int>(i));
+
         // begin render pass
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -364,10 +550,8 @@ void VkRenderer::recordShadowCommandBuffers() {
 
         vkCmdPushConstants(shadowCommandBuffer, shadowPipe.layout.v(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushconstants::ShadowPushConst), &shadowPushConst);
 
-        vkCmdBindVertexBuffers(shadowCommandBuffer, 0, 2, vertexBuffersArray.data(), offsets.data());
-        vkCmdBindIndexBuffer(shadowCommandBuffer, m_scene->getIndexBuffer().buf.v(), 0, VK_INDEX_TYPE_UINT32);
-
-        vkCmdDrawIndexedIndirect(shadowCommandBuffer, sceneIndirectBuffer, 0, static_cast<uint32_t>(m_scene->getUniqueObjectCount()), sizeof(VkDrawIndexedIndirectCommand));
+        vkCmdBindVertexBuffers(shadowCommandBuffer, 0, static_cast<uint32_t>(vertexBuffersArray.size()), vertexBuffersArray.data(), offsets.data());
+        recordSceneDraws(shadowCommandBuffer, culling::SHADOW_VIEW);
 
         // end the render pass and command buffer
         vkCmdEndRenderPass(shadowCommandBuffer);
@@ -466,7 +650,10 @@ void VkRenderer::recordWBOITCommandBuffers() {
     vkCmdPushConstants(wboitCommandBuffer.v(), wboitPipe.layout.v(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushconstants::FramePushConst), &m_framePushConst);
     vkCmdPushConstants(wboitCommandBuffer.v(), wboitPipe.layout.v(), VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(pushconstants::FramePushConst), sizeof(pushconstants::LightPushConst), &m_lightPushConst);
 
-    recordObjectCommandBuffers(wboitCommandBuffer, wboitPipe, beginInfo, sets.data(), sets.size());
+    recordObjectCommandBuffers(wboitCommandBuffer, wboitPipe, beginInfo, sets.data(), sets.size(), culling::CAMERA_VIEW);
+
+    // the bindings carry over, so only the draws of the late region are added
+    if (m_meshletCulling) recordSceneDraws(wboitCommandBuffer.v(), culling::LATE_REGION);
 
     vkCmdEndRenderPass(wboitCommandBuffer.v());
 
@@ -543,6 +730,9 @@ void VkRenderer::recordRTCommandBuffers() {
         throw std::runtime_error("failed to begin recording rt command buffer!");
     }
 
+    m_uploads->recordStagedCopies(commandBuffer);
+    m_raytracing->recordTLASBuild(commandBuffer, m_currentFrame);
+
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rtPipe.pipeline.v());
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rtPipe.layout.v(), 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
 
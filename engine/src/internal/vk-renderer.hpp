@@ -12,6 +12,7 @@
 #include "internal/vk-setup.hpp"
 #include "internal/vk-swapchain.hpp"
 #include "internal/vk-textures.hpp"
+#include "internal/vk-uploads.hpp"
 #include "libraries/vkhelper.hpp"
 #include "structures/commandbuffers.hpp"
 #include "structures/pushconstants.hpp"
@@ -26,7 +27,7 @@ public:
     VkRenderer(VkRenderer&&) = delete;
     VkRenderer& operator=(VkRenderer&&) = delete;
 
-    void init(bool rtEnabled, uint32_t maxFrames, bool showDebugInfo, VkDevice device, const setup::VkSetup* setup, const swapchain::VkSwapChain* swap, const textures::VkTextures* textures, const scene::VkScene* scene, const buffers::VkBuffers* buffers, const descriptorsets::VkDescriptorSets* descs, const pipelines::VkPipelines* pipelines, const raytracing::VkRaytracing* raytracing) noexcept;
+    void init(bool rtEnabled, bool meshletCulling, uint32_t maxFrames, bool showDebugInfo, VkDevice device, const setup::VkSetup* setup, const swapchain::VkSwapChain* swap, const textures::VkTextures* textures, const scene::VkScene* scene, const buffers::VkBuffers* buffers, const descriptorsets::VkDescriptorSets* descs, const pipelines::VkPipelines* pipelines, const raytracing::VkRaytracing* raytracing, uploads::VkUploads* uploads) noexcept;
     void createCommandBuffers();
     void createFrameBuffers(bool shadow);
     [[nodiscard]] VkResult drawFrame(uint32_t currentFrame, float fps, bool sceneChanged);
@@ -51,6 +52,7 @@ private:
     const descriptorsets::VkDescriptorSets* m_descs = nullptr;
     const pipelines::VkPipelines* m_pipe = nullptr;
     const raytracing::VkRaytracing* m_raytracing = nullptr;
+    uploads::VkUploads* m_uploads = nullptr;
 
     // framebuffers
     std::vector<VkhFramebuffer> m_lightingFB{};
@@ -86,6 +88,7 @@ private:
 
     // other
     bool m_rtEnabled = false;
+    bool m_meshletCulling = false;
     uint32_t m_maxFrames = 0;
     bool m_showDebugInfo = false;
 
@@ -103,7 +106,11 @@ private:
     void renderImguiFrame(VkhCommandBuffer& commandBuffer);
 
     // command buffer recording
-    void recordObjectCommandBuffers(VkhCommandBuffer& secondary, const pipeline::PipelineData& pipe, const VkCommandBufferBeginInfo& beginInfo, const VkDescriptorSet* descriptorsets, size_t descriptorCount);
+    void recordBufferBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) const;
+    void recordCullCommands(VkCommandBuffer commandBuffer, uint32_t region, int batch);
+    void recordDepthPyramid(VkCommandBuffer commandBuffer);
+    void recordSceneDraws(VkCommandBuffer commandBuffer, uint32_t view) const;
+    void recordObjectCommandBuffers(VkhCommandBuffer& secondary, const pipeline::PipelineData& pipe, const VkCommandBufferBeginInfo& beginInfo, const VkDescriptorSet* descriptorsets, size_t descriptorCount, uint32_t region);
     void recordDeferredCommandBuffers();
     void recordShadowCommandBuffers();
     void recordLightingCommandBuffers();
@@ -1,16 +1,25 @@
 #include "vk-scene.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <future>
+#include <iomanip>
+#include <sstream>
 #include <stdexcept>
 #include <unordered_set>
+#include <utility>
 
 #include "config.hpp"
 #include "libraries/dvl.hpp"
+#include "libraries/meshopt.hpp"
+#include "libraries/threadpool.hpp"
 #include "stb_image.h"
 
 namespace scene {
-void VkScene::init(bool rtEnabled, VkDevice device, const VkhCommandPool& commandPool, VkQueue gQueue) {
+void VkScene::init(bool rtEnabled, bool instanceCulling, VkDevice device, const VkhCommandPool& commandPool, VkQueue gQueue) {
     m_rtEnabled = rtEnabled;
+    m_instanceCulling = instanceCulling;
     m_device = device;
     m_commandPool = commandPool;
     m_gQueue = gQueue;
@@ -22,43 +31,43 @@ void VkScene::loadScene(const std::vector<ModelData>& modelData) {
     // load models
     utils::sep();
 
-    size_t imagesOffset = 0;
-    size_t modelIndex = 0;
-    std::vector<std::future<void>> m_modelFutures;
+    // declared before the pool, so no task can outlive the model it reads from
+    std::vector<PendingModel> pendingModels;
+    pendingModels.reserve(modelData.size());
+
+    threadpool::ThreadPool pool;
+
+    // parse the gltf files
+    std::vector<std::future<ParsedModel>> parsedModels;
+    parsedModels.reserve(modelData.size());
 
     for (const ModelData& m : modelData) {
         std::string path = std::string(cfg::MODEL_DIR) + m.file;
+        parsedModels.push_back(pool.submit([path]() { return parseModel(path); }));
+    }
 
-        // load the gltf model
-        tinygltf::Model gltfModel;
-        tinygltf::TinyGLTF loader;
-        std::string err;
-        std::string warn;
+    // queue the primitives of each model
+    for (size_t i = 0; i < modelData.size(); i++) {
+        ParsedModel parsed = parsedModels[i].get();
+        if (!parsed.model) continue;
 
-        bool ret = loader.LoadBinaryFromFile(&gltfModel, &err, &warn, path);
-        bool loaded = true;
+        PendingModel pending = loadModel(pool, std::move(parsed), modelData[i]);
 
-        if (!warn.empty()) {
-            utils::logWarning(warn);
-            loaded = false;
-        }
-        if (!err.empty()) {
-            utils::logWarning(err);
-            loaded = false;
-        }
-        if (!ret) {
-            utils::logWarning("Failed to load model!");
-            loaded = false;
-        }
-
-        if (loaded) {
-            m_modelFutures.emplace_back(std::async(std::launch::async, &VkScene::loadModel, this, gltfModel, path, m.file, m.scale, m.quat, m.pos, imagesOffset, modelIndex++));
-            imagesOffset += gltfModel.textures.size();
+        if (pending.model) {
+            pendingModels.push_back(std::move(pending));
         }
     }
 
-    for (auto& t : m_modelFutures) {
-        t.wait();
+    // add the models to the scene in the order they were given
+    // the image offsets are only known once the previous models have finished
+    size_t imagesOffset = 0;
+    for (PendingModel& pending : pendingModels) {
+        LoadedModel loaded = completeModel(pending);
+        if (!loaded.model) continue;
+
+        size_t textureCount = loaded.model->textures.size();
+        placeModel(loaded, imagesOffset);
+        imagesOffset += textureCount;
     }
 
     size_t modelsFailed = modelData.size() - m_loadedModelFiles.size();
@@ -67,91 +76,150 @@ void VkScene::loadScene(const std::vector<ModelData>& modelData) {
     }
 
     // if no objects were loaded
-    if (m_objects.size() == 0) {
+    if (m_instances.size() == 0) {
         throw std::runtime_error("No models were able to be loaded!");
     }
 
     auto duration = utils::duration<milliseconds>(now);
-    std::cout << "- Finished loading models in: " << utils::durationString(duration) << "\n";
+    std::cout << "- Finished loading models in: " << utils::durationString(duration) << " (" << pool.getThreadCount() << " threads)\n";
 
     utils::sep();
 
-    // make a seperate vector of the original objects
-    m_originalObjects.reserve(m_objects.size());
-    for (auto& obj : m_objects) {
-        m_originalObjects.push_back(std::make_unique<dvl::Mesh>(*obj));
-    }
-
     // create vert and index buffers
     createModelBuffers(false);
 }
 
 void VkScene::createModelBuffers(bool recreate) {
-    populateObjectMaps(true);
+    size_t bufferCount = m_geometryHashToBufferIndex.size();
+    if (!recreate) {
+        m_bufData.resize(bufferCount);
+        m_lodChains.resize(bufferCount);
+    }
+
+    m_lods.clear();
+
+    // meshes with the same geometry but different materials share their buffer data, which is written from the first of them
+    std::vector<const dvl::Mesh*> bufferMeshes(bufferCount, nullptr);
+    for (size_t i = 0; i < m_meshes.size(); i++) {
+        const dvl::Mesh*& bufferMesh = bufferMeshes[m_meshBufferIndices[i]];
+        if (bufferMesh == nullptr) bufferMesh = &m_meshes[i];
+    }
+
+    m_vertexCount = 0;
+    m_indexCounts.fill(0);
+    m_meshletBufferSize = 0;
+
+    for (const dvl::Mesh* mesh : bufferMeshes) {
+        size_t vertexCount = mesh->getVertices().size();
+        size_t indexCount = mesh->getIndices().size();
+        m_vertexCount += vertexCount;
+
+        // matches the index type and padding chosen below
+        if (dvl::fitsIndex16(vertexCount)) {
+            m_indexCounts[0] += indexCount + (indexCount & 1);
+        } else {
+            m_indexCounts[1] += indexCount;
+        }
+        m_meshletBufferSize += sizeof(dvl::Meshlet) * mesh->getMeshlets().size();
+    }
 
-    size_t uniqueObjectCount = getUniqueObjectCount();
-    if (!recreate) m_bufData.resize(uniqueObjectCount);
+    // the 16 bit section is padded to an even count per mesh, so the 32 bit section stays aligned
+    m_indexSectionOffsets[0] = 0;
+    m_indexSectionOffsets[1] = m_indexCounts[0] * sizeof(uint16_t);
 
-    vkh::BufferObj stagingVertBuffer{};
+    VkDeviceSize positionBufferSize = m_vertexCount * sizeof(dvl::PackedPosition);
+    VkDeviceSize attributeBufferSize = m_vertexCount * sizeof(dvl::PackedAttributes);
+    VkDeviceSize indexBufferSize = m_indexSectionOffsets[1] + m_indexCounts[1] * sizeof(uint32_t);
+
+    vkh::BufferObj stagingPositionBuffer{};
+    vkh::BufferObj stagingAttributeBuffer{};
     vkh::BufferObj stagingIndexBuffer{};
 
     const VkMemoryPropertyFlags stagingMemFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-    // create and map the vertex buffer
-    vkh::createBuffer(stagingVertBuffer, m_vertBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingMemFlags, 0);
-    char* vertexData;
-    vkMapMemory(m_device, stagingVertBuffer.mem.v(), 0, m_vertBufferSize, 0, reinterpret_cast<void**>(&vertexData));
+    // create and map the vertex streams
+    vkh::createBuffer(stagingPositionBuffer, positionBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingMemFlags, 0);
+    dvl::PackedPosition* positionData;
+    vkMapMemory(m_device, stagingPositionBuffer.mem.v(), 0, positionBufferSize, 0, reinterpret_cast<void**>(&positionData));
+
+    vkh::createBuffer(stagingAttributeBuffer, attributeBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingMemFlags, 0);
+    dvl::PackedAttributes* attributeData;
+    vkMapMemory(m_device, stagingAttributeBuffer.mem.v(), 0, attributeBufferSize, 0, reinterpret_cast<void**>(&attributeData));
+
     VkDeviceSize currentVertexOffset = 0;
 
     // create and map the index buffer
-    vkh::createBuffer(stagingIndexBuffer, m_indBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingMemFlags, 0);
+    vkh::createBuffer(stagingIndexBuffer, indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingMemFlags, 0);
     char* indexData;
-    vkMapMemory(m_device, stagingIndexBuffer.mem.v(), 0, m_indBufferSize, 0, reinterpret_cast<void**>(&indexData));
-    VkDeviceSize currentIndexOffset = 0;
+    vkMapMemory(m_device, stagingIndexBuffer.mem.v(), 0, indexBufferSize, 0, reinterpret_cast<void**>(&indexData));
+    std::array<VkDeviceSize, INDEX_TYPES.size()> currentIndexOffsets{};
 
-    const size_t* uniqueObjects = getUniqueObjects();
-
-    for (size_t i = 0; i < getUniqueObjectCount(); i++) {
-        size_t objectIndex = uniqueObjects[i];
-        size_t bufferInd = getBufferIndex(objectIndex);
+    // meshlets of every mesh
+    std::vector<dvl::Meshlet> meshlets;
+    meshlets.reserve(m_meshletBufferSize / sizeof(dvl::Meshlet));
 
+    for (size_t bufferInd = 0; bufferInd < bufferCount; bufferInd++) {
+        const dvl::Mesh& mesh = *bufferMeshes[bufferInd];
         vkh::BufData& bufferData = m_bufData[bufferInd];
 
         // vertex data
+        std::span<const dvl::Vertex> vertices = mesh.getVertices();
         bufferData.vertexOffset = static_cast<uint32_t>(currentVertexOffset);
-        bufferData.vertexCount = static_cast<uint32_t>(m_objects[objectIndex]->vertices.size());
-        std::memcpy(vertexData, m_objects[objectIndex]->vertices.data(), bufferData.vertexCount * sizeof(dvl::Vertex));
-        vertexData += bufferData.vertexCount * sizeof(dvl::Vertex);
+        bufferData.vertexCount = static_cast<uint32_t>(vertices.size());
+        dvl::packVertices(vertices, positionData + currentVertexOffset, attributeData + currentVertexOffset);
         currentVertexOffset += bufferData.vertexCount;
 
-        // index data
-        bufferData.indexOffset = static_cast<uint32_t>(currentIndexOffset);
-        bufferData.indexCount = static_cast<uint32_t>(m_objects[objectIndex]->indices.size());
-        std::memcpy(indexData, m_objects[objectIndex]->indices.data(), bufferData.indexCount * sizeof(uint32_t));
-        indexData += bufferData.indexCount * sizeof(uint32_t);
-        currentIndexOffset += bufferData.indexCount;
-    }
+        // index data, 16 bit whenever every vertex of the mesh can be indexed with it
+        std::span<const uint32_t> indices = mesh.getIndices();
+        bufferData.indexType = dvl::fitsIndex16(vertices.size()) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        bufferData.indexCount = static_cast<uint32_t>(indices.size());
 
-    vkUnmapMemory(m_device, stagingVertBuffer.mem.v());
-    vkUnmapMemory(m_device, stagingIndexBuffer.mem.v());
+        uint32_t list = getIndexList(bufferData.indexType);
+        bufferData.indexOffset = static_cast<uint32_t>(currentIndexOffsets[list]);
+        char* indexDst = indexData + m_indexSectionOffsets[list] + (bufferData.indexOffset * bufferData.indexSize());
 
-    VkBufferUsageFlags rtU = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
-    VkBufferUsageFlags vertU = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | ((m_rtEnabled) ? rtU : 0);
-    VkBufferUsageFlags indexU = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | ((m_rtEnabled) ? rtU : 0);
+        if (bufferData.indexType == VK_INDEX_TYPE_UINT16) {
+            uint16_t* indices16 = reinterpret_cast<uint16_t*>(indexDst);
+            for (size_t j = 0; j < indices.size(); j++) {
+                indices16[j] = static_cast<uint16_t>(indices[j]);
+            }
 
-    VkMemoryAllocateFlags vertM = (m_rtEnabled) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
-    VkMemoryAllocateFlags indexM = (m_rtEnabled) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+            currentIndexOffsets[list] += indices.size() + (indices.size() & 1);
+        } else {
+            std::memcpy(indexDst, indices.data(), indices.size() * sizeof(uint32_t));
+            currentIndexOffsets[list] += indices.size();
+        }
+
+        // meshlet data
+        std::span<const dvl::Meshlet> meshMeshlets = mesh.getMeshlets();
+        bufferData.meshletOffset = static_cast<uint32_t>(meshlets.size());
+        bufferData.meshletCount = static_cast<uint32_t>(meshMeshlets.size());
+        meshlets.insert(meshlets.end(), meshMeshlets.begin(), meshMeshlets.end());
+
+        addLodChain(bufferInd, mesh, bufferData);
+    }
+
+    vkUnmapMemory(m_device, stagingPositionBuffer.mem.v());
+    vkUnmapMemory(m_device, stagingAttributeBuffer.mem.v());
+    vkUnmapMemory(m_device, stagingIndexBuffer.mem.v());
 
-    vkh::createBuffer(m_vertBuffer, m_vertBufferSize, vertU, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertM);
-    vkh::createBuffer(m_indBuffer, m_indBufferSize, indexU, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexM);
+    createGeometryBuffers(m_geometry, m_vertexCount, indexBufferSize, meshlets.size() * sizeof(dvl::Meshlet));
 
-    // copy the vert staging buffer into the dst vert buffer
-    vkh::copyBuffer(stagingVertBuffer.buf, m_vertBuffer.buf, m_commandPool, m_gQueue, m_vertBufferSize);
+    // copy the staging buffers into the dst vertex buffers
+    vkh::copyBuffer(stagingPositionBuffer.buf, m_geometry.position.buf, m_commandPool, m_gQueue, positionBufferSize);
+    vkh::copyBuffer(stagingAttributeBuffer.buf, m_geometry.attribute.buf, m_commandPool, m_gQueue, attributeBufferSize);
 
     // copy the index staging buffer into the dst index buffer
-    vkh::copyBuffer(stagingIndexBuffer.buf, m_indBuffer.buf, m_commandPool, m_gQueue, m_indBufferSize);
+    vkh::copyBuffer(stagingIndexBuffer.buf, m_geometry.index.buf, m_commandPool, m_gQueue, indexBufferSize);
+
+    if (!meshlets.empty()) {
+        vkh::BufferObj stagingMeshletBuffer{};
+        VkDeviceSize meshletBufferSize = meshlets.size() * sizeof(dvl::Meshlet);
+        vkh::createAndWriteHostBuffer(stagingMeshletBuffer, meshlets.data(), meshletBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+        vkh::copyBuffer(stagingMeshletBuffer.buf, m_geometry.meshlet.buf, m_commandPool, m_gQueue, meshletBufferSize);
+    }
 
-    populateIndirectCommands();
+    updateDraws();
 }
 
 void VkScene::initSceneData(float up, float right, uint32_t swapWidth, uint32_t swapHeight) {
@@ -162,18 +230,18 @@ void VkScene::initSceneData(float up, float right, uint32_t swapWidth, uint32_t
 void VkScene::updateSceneData(float up, float right, uint32_t swapWidth, uint32_t swapHeight) {
     calcLightData();
     calcCameraMats(up, right, swapWidth, swapHeight);
-    calcObjectInstanceData();
+    updateNodes();
+    updateDraws();
 }
 
 void VkScene::calcTexIndices() {
-    const size_t* uniqueObjects = getUniqueObjects();
+    m_texIndices.resize(getMeshCount());
+    m_texIndexVersion++;
 
-    for (size_t i = 0; i < getUniqueObjectCount(); i++) {
-        size_t index = uniqueObjects[i];
+    for (size_t i = 0; i < getMeshCount(); i++) {
+        const dvl::Material& material = m_meshes[i].material;
 
-        const dvl::Material& material = getObjectMaterial(index);
-
-        texindices::TexIndexObj& textureIndexObject = m_texIndices->indices[index];
+        texindices::TexIndexObj& textureIndexObject = m_texIndices[i];
         textureIndexObject.albedoIndex = material.baseColor;
         textureIndexObject.metallicRoughnessIndex = material.metallicRoughness;
         textureIndexObject.normalIndex = material.normalMap;
@@ -181,107 +249,83 @@ void VkScene::calcTexIndices() {
         textureIndexObject.occlusionIndex = material.occlusionMap;
 
         if (m_rtEnabled) {
-            size_t bufferInd = getBufferIndex(index);
+            const vkh::BufData& bufferData = getBufferData(getMeshBufferIndex(i));
 
-            const vkh::BufData& bufferData = getBufferData(bufferInd);
+            VkDeviceSize indexSectionOffset = m_indexSectionOffsets[getIndexList(bufferData.indexType)];
 
-            textureIndexObject.vertAddr = vkh::bufferDeviceAddress(m_vertBuffer.buf) + (bufferData.vertexOffset * sizeof(dvl::Vertex));
-            textureIndexObject.indAddr = vkh::bufferDeviceAddress(m_indBuffer.buf) + (bufferData.indexOffset * sizeof(uint32_t));
+            textureIndexObject.attrAddr = vkh::bufferDeviceAddress(m_geometry.attribute.buf) + (bufferData.vertexOffset * sizeof(dvl::PackedAttributes));
+            textureIndexObject.indAddr = vkh::bufferDeviceAddress(m_geometry.index.buf) + indexSectionOffset + (bufferData.indexOffset * bufferData.indexSize());
+            textureIndexObject.index16 = (bufferData.indexType == VK_INDEX_TYPE_UINT16) ? 1 : 0;
         }
     }
 }
 
-bool VkScene::copyModel(const dml::vec3& pos, const std::string& name, const dml::vec3& scale, const dml::vec4& rotation) {
-    // ensure the file has been loaded previously
-    std::unordered_set<std::string> fileSet(m_loadedModelFiles.begin(), m_loadedModelFiles.end());
-    bool fileFound = fileSet.find(name) != fileSet.end();
-
-    if (!fileFound) {
-        throw std::runtime_error("File hasn't been loaded!");
-    }
-
-    std::vector<size_t> indices = getObjectIndices(name);
+void VkScene::copyModel(const dml::vec3& pos, const std::string& name, const dml::vec3& scale, const dml::vec4& rotation) {
+    size_t model = findLoadedModel(name);
 
-    if (m_objects.size() + indices.size() >= cfg::MAX_OBJECTS) {
-        return false;
-    }
+    // placed relative to where the model was loaded
+    dml::mat4 newModel = dml::translate(pos) * dml::rotateQuat(rotation) * dml::scale(scale);
+    placeTemplate(model, newModel * m_modelTemplates[model].placement, instancing::INSTANCE_COPY);
 
-    for (size_t i = 0; i < indices.size(); i++) {
-        size_t index = indices[i];
-        const std::unique_ptr<dvl::Mesh>& originalObject = m_originalObjects[index];
+    updateDraws();
+}
 
-        dvl::Mesh m;
-        m.scale = scale;
-        m.position = pos;
-        m.rotation = rotation;
-        m.meshHash = originalObject->meshHash;
-        m.material = originalObject->material;
+void VkScene::resetObjects() {
+    // the copies are destroyed a model at a time
+    for (uint32_t i = 0; i < m_handleSlots.size(); i++) {
+        const std::vector<uint32_t>& instances = m_handleSlots[i].instances;
+        if (instances.empty() || !(m_instances.flags[instances[0]] & instancing::INSTANCE_COPY)) continue;
 
-        dml::mat4 newModel = dml::translate(pos) * dml::rotateQuat(rotation) * dml::scale(scale);
-        m.modelMatrix = newModel * originalObject->modelMatrix;
-        m_objects.push_back(std::make_unique<dvl::Mesh>(std::move(m)));
+        destroyHandle(i);
     }
 
-    populateObjectMaps(false);
-    populateIndirectCommands();
+    updateDraws();
+}
 
-    return true;
+size_t VkScene::addInstances(const std::vector<ModelData>& instances) {
+    return spawnInstances(instances).size();
 }
 
-void VkScene::resetObjects() {
-    m_objects.clear();
-    m_objects.reserve(m_originalObjects.size());
+std::vector<instancing::InstanceHandle> VkScene::spawnInstances(std::span<const ModelData> instances) {
+    std::vector<instancing::InstanceHandle> handles;
+    handles.reserve(instances.size());
 
-    for (const std::unique_ptr<dvl::Mesh>& m : m_originalObjects) {
-        m_objects.push_back(std::make_unique<dvl::Mesh>(*m));
+    for (const ModelData& instance : instances) {
+        size_t model = findLoadedModel(instance.file);
+        handles.push_back(placeTemplate(model, dvl::calcPlacementMatrix(instance.pos, instance.quat, instance.scale), 0));
     }
 
-    populateObjectMaps(false);
-    populateIndirectCommands();
+    updateDraws();
+    return handles;
 }
 
-int32_t VkScene::getObjectInstanceCount(size_t objectIndex) const noexcept {
-    size_t hash = m_objects[objectIndex]->meshHash;
-
-    uint32_t count = 0;
-    for (auto& m : m_objects) {
-        if (m->meshHash == hash) {
-            count++;
-        }
+void VkScene::destroyInstances(std::span<const instancing::InstanceHandle> handles) {
+    for (instancing::InstanceHandle handle : handles) {
+        if (instanceExists(handle)) destroyHandle(handle.index);
     }
-    return count;
-}
 
-void VkScene::populateObjectMaps(bool getSize) {
-    std::sort(m_objects.begin(), m_objects.end(), [](const auto& a, const auto& b) { return a->meshHash < b->meshHash; });
-
-    m_objectHashToUniqueObjectIndex.clear();
-    m_objectHashToBufferIndex.clear();
+    updateDraws();
+}
 
-    uint32_t bufferIndex = 0;
-    for (size_t i = 0; i < m_objects.size(); i++) {
-        std::unique_ptr<dvl::Mesh>& obj = m_objects[i];
-        size_t hash = obj->meshHash;
+bool VkScene::instanceExists(instancing::InstanceHandle handle) const noexcept {
+    if (handle.index >= m_handleSlots.size()) return false;
 
-        // if object is unique
-        if (m_objectHashToUniqueObjectIndex.find(hash) == m_objectHashToUniqueObjectIndex.end()) {
-            if (getSize) {
-                m_vertBufferSize += sizeof(dvl::Vertex) * obj->vertices.size();
-                m_indBufferSize += sizeof(uint32_t) * obj->indices.size();
-            }
+    const instancing::HandleSlot& slot = m_handleSlots[handle.index];
+    return slot.generation == handle.generation && !slot.instances.empty();
+}
 
-            m_objectHashToUniqueObjectIndex[hash] = i;
-            m_objectHashToBufferIndex[hash] = bufferIndex++;
-        }
-    }
+void VkScene::setInstanceTransform(instancing::InstanceHandle handle, const dml::mat4& placement) {
+    if (!instanceExists(handle)) return;
+    instancing::InstanceStore& store = m_instances;
 
-    m_uniqueObjects.clear();
-    m_uniqueObjects.reserve(bufferIndex);
+    for (uint32_t i : m_handleSlots[handle.index].instances) {
+        int32_t node = store.nodes[i];
+        const dvl::NodeHierarchy& hierarchy = m_nodeHierarchies[store.models[i]];
+        dml::mat4 world = (node < 0) ? placement * store.instanceMatrices[i] : placement * hierarchy.worldMatrices[node] * store.instanceMatrices[i];
 
-    for (size_t i = 0; i < m_objects.size(); i++) {
-        if (isObjectUnique(i)) {
-            m_uniqueObjects.push_back(i);
-        }
+        store.placements[i] = placement;
+        store.transforms[i] = instancing::toTransform(world);
+        m_movedInstances.push_back(i);
     }
 }
 
@@ -295,6 +339,21 @@ size_t VkScene::getModelIndex(size_t index) const {
     throw std::runtime_error("Model index doesnt exist!");
 }
 
+void VkScene::setNodeTransform(const std::string& file, const std::string& nodeName, const dml::mat4& localMatrix) {
+    size_t modelIndex = findLoadedModel(file);
+    const tinygltf::Model& model = *m_models[modelIndex];
+    dvl::NodeHierarchy& hierarchy = m_nodeHierarchies[modelIndex];
+
+    for (size_t i = 0; i < model.nodes.size(); i++) {
+        if (model.nodes[i].name != nodeName || hierarchy.flatIndices[i] < 0) continue;
+
+        dvl::setNodeLocalMatrix(hierarchy, static_cast<uint32_t>(hierarchy.flatIndices[i]), localMatrix);
+        return;
+    }
+
+    throw std::runtime_error("Node doesnt exist!");
+}
+
 void VkScene::createLight(const dml::vec3& pos, const dml::vec3& target, float range) {
     light::LightDataObject l{};
     l.col = {1.0f, 1.0f, 1.0f};
@@ -306,12 +365,13 @@ void VkScene::createLight(const dml::vec3& pos, const dml::vec3& target, float r
     l.linearAttenuation = 2.0f / range;
     l.quadraticAttenuation = 1.0f / (range * range);
 
-    m_lights->raw[m_lightCount] = l;
-    m_lightCount++;
+    calcLightViewProj(l);
+    m_lights.push_back(l);
+    m_lightVersion++;
 }
 
 void VkScene::setPlayerLight(int index) {
-    if (index >= m_lightCount) {
+    if (index >= static_cast<int>(m_lights.size())) {
         throw std::runtime_error("Player index too high!");
     }
 
@@ -319,128 +379,1052 @@ void VkScene::setPlayerLight(int index) {
 }
 
 void VkScene::removeLights() {
-    m_lightCount = 0;
+    m_lights.clear();
+    m_lightVersion++;
     m_followPlayerIndex = -1;
 }
 
-std::vector<size_t> VkScene::getObjectIndices(const std::string& filename) {
-    std::vector<size_t> indices;
-    for (size_t i = 0; i < m_originalObjects.size(); i++) {
-        if (m_originalObjects[i]->file == filename) {
-            indices.push_back(i);
-        }
+size_t VkScene::findLoadedModel(const std::string& file) const {
+    auto it = std::find(m_loadedModelFiles.begin(), m_loadedModelFiles.end(), file);
+    if (it == m_loadedModelFiles.end()) {
+        throw std::runtime_error("File hasn't been loaded!");
     }
 
-    return indices;
+    return static_cast<size_t>(it - m_loadedModelFiles.begin());
 }
 
-void VkScene::loadModel(const tinygltf::Model& gltfModel, const std::string& path, const std::string& fileName, const dml::vec3& scale, const dml::vec4& rot, const dml::vec3& pos, size_t imagesOffset, size_t modelIndex) {
-    // get the index of the parent node for each node
-    std::unordered_map<int, int> parentInd;
-    for (size_t i = 0; i < gltfModel.nodes.size(); i++) {
-        const tinygltf::Node& node = gltfModel.nodes[i];
+uint32_t VkScene::addMesh(dvl::Mesh&& mesh) {
+    auto [it, inserted] = m_meshHashToMeshIndex.try_emplace(mesh.meshHash, static_cast<uint32_t>(m_meshes.size()));
+    if (!inserted) return it->second;
 
-        for (int childIndex : node.children) {
-            parentInd[childIndex] = static_cast<int>(i);
-        }
+    // identical geometry from any model is only stored once
+    size_t bufferIndex = m_geometryHashToBufferIndex.try_emplace(mesh.geometryHash, m_geometryHashToBufferIndex.size()).first->second;
+
+    m_meshBufferIndices.push_back(bufferIndex);
+    m_meshBuckets.emplace_back();
+    m_meshes.push_back(std::move(mesh));
+    return it->second;
+}
+
+void VkScene::addInstance(uint32_t meshId, uint32_t model, int32_t node, const dml::mat4& placement, const dml::mat4& instanceMatrix, uint32_t flags, uint32_t handle) {
+    const dvl::NodeHierarchy& hierarchy = m_nodeHierarchies[model];
+    dml::mat4 world = (node < 0) ? placement * instanceMatrix : placement * hierarchy.worldMatrices[node] * instanceMatrix;
+
+    uint32_t index = static_cast<uint32_t>(m_instances.size());
+    std::vector<uint32_t>& handleInstances = m_handleSlots[handle].instances;
+    std::vector<uint32_t>& bucket = m_meshBuckets[meshId];
+
+    m_instances.transforms.push_back(instancing::toTransform(world));
+    m_instances.meshIds.push_back(meshId);
+    m_instances.flags.push_back(flags);
+    m_instances.models.push_back(model);
+    m_instances.nodes.push_back(node);
+    m_instances.placements.push_back(placement);
+    m_instances.instanceMatrices.push_back(instanceMatrix);
+    m_instances.handles.push_back(handle);
+    m_instances.handleSlots.push_back(static_cast<uint32_t>(handleInstances.size()));
+    m_instances.bucketSlots.push_back(static_cast<uint32_t>(bucket.size()));
+
+    handleInstances.push_back(index);
+    bucket.push_back(index);
+    m_drawsDirty = true;
+}
+
+void VkScene::removeInstance(size_t index) {
+    instancing::InstanceStore& store = m_instances;
+    m_drawsDirty = true;
+
+    // swap remove it from its handle's instances and its mesh's bucket
+    auto swapRemove = [](std::vector<uint32_t>& list, uint32_t slot, std::vector<uint32_t>& slots) {
+        uint32_t moved = list.back();
+        list[slot] = moved;
+        slots[moved] = slot;
+        list.pop_back();
+    };
+
+    swapRemove(m_handleSlots[store.handles[index]].instances, store.handleSlots[index], store.handleSlots);
+    swapRemove(m_meshBuckets[store.meshIds[index]], store.bucketSlots[index], store.bucketSlots);
+
+    // then the last instance takes its place in the store
+    store.swapRemove(index);
+    if (index == store.size()) return;
+
+    m_handleSlots[store.handles[index]].instances[store.handleSlots[index]] = static_cast<uint32_t>(index);
+    m_meshBuckets[store.meshIds[index]][store.bucketSlots[index]] = static_cast<uint32_t>(index);
+}
+
+instancing::InstanceHandle VkScene::placeTemplate(size_t model, const dml::mat4& placement, uint32_t flags) {
+    const ModelTemplate& modelTemplate = m_modelTemplates[model];
+    if (modelTemplate.meshIds.empty()) return {};
+
+    // reuse the slot of a destroyed handle if there is one
+    uint32_t index = static_cast<uint32_t>(m_handleSlots.size());
+    if (m_freeHandles.empty()) {
+        m_handleSlots.emplace_back();
+    } else {
+        index = m_freeHandles.back();
+        m_freeHandles.pop_back();
+    }
+
+    for (size_t i = 0; i < modelTemplate.meshIds.size(); i++) {
+        addInstance(modelTemplate.meshIds[i], static_cast<uint32_t>(model), modelTemplate.nodes[i], placement, modelTemplate.instanceMatrices[i], flags, index);
     }
 
-    if (gltfModel.asset.version != "2.0") {
+    return {index, m_handleSlots[index].generation};
+}
+
+void VkScene::destroyHandle(uint32_t index) {
+    instancing::HandleSlot& slot = m_handleSlots[index];
+    while (!slot.instances.empty()) {
+        removeInstance(slot.instances.back());
+    }
+
+    slot.generation++;
+    m_freeHandles.push_back(index);
+}
+
+VkScene::ParsedModel VkScene::parseModel(const std::string& path) {
+    ParsedModel parsed{};
+
+    if (!parsed.file.open(path)) {
+        utils::logWarning("Failed to open " + path + " as a glb file!");
+        return parsed;
+    }
+
+    // parsed straight from the mapping, without reading the file into memory first
+    auto gltfModel = std::make_unique<tinygltf::Model>();
+    std::string err;
+    std::string warn;
+
+    bool ret = parsed.file.parse(*gltfModel, err, warn);
+    bool loaded = true;
+
+    if (!warn.empty()) {
+        utils::logWarning(warn);
+        loaded = false;
+    }
+    if (!err.empty()) {
+        utils::logWarning(err);
+        loaded = false;
+    }
+    if (!ret) {
+        utils::logWarning("Failed to load model!");
+        loaded = false;
+    }
+
+    if (loaded) parsed.model = std::move(gltfModel);
+    return parsed;
+}
+
+VkScene::PendingModel VkScene::loadModel(threadpool::ThreadPool& pool, ParsedModel parsed, const ModelData& data) {
+    PendingModel pending{};
+    const std::string& fileName = data.file;
+    std::unique_ptr<tinygltf::Model>& gltfModel = parsed.model;
+
+    if (gltfModel->asset.version != "2.0") {
         utils::logWarning(fileName + " doesnt use glTF 2.0");
-        return;
+        return pending;
     }
 
     // check if the model has any skins, animations, or cameras (not supported for now)
-    utils::logWarning(fileName + " contains skinning information", !gltfModel.skins.empty());
-    utils::logWarning(fileName + " contains animation data", !gltfModel.animations.empty());
-    utils::logWarning(fileName + " contains cameras", !gltfModel.cameras.empty());
+    utils::logWarning(fileName + " contains skinning information", !gltfModel->skins.empty());
+    utils::logWarning(fileName + " contains animation data", !gltfModel->animations.empty());
+    utils::logWarning(fileName + " contains cameras", !gltfModel->cameras.empty());
 
     // check if the gltf model relies on any extensions
-    for (const std::string& extension : gltfModel.extensionsUsed) {
+    for (const std::string& extension : gltfModel->extensionsUsed) {
+        if (extension == "EXT_mesh_gpu_instancing") continue;
         utils::logWarning(fileName + " uses extension: " + extension);
     }
 
-    uint32_t meshInd = 0;  // index of the mesh in the model
+    pending.data = data;
+
+    // the model and the mapped file are owned by the pending model, so the data they point to is stable until the tasks finish
+    const tinygltf::Model* model = gltfModel.get();
+    pending.file = std::make_shared<const glbfile::GlbFile>(std::move(parsed.file));
+    dvl::ModelBuffers buffers = pending.file->getBuffers(*model);
+
+    // the images decode in the background while the geometry is loaded
+    pending.images = decodeImages(*gltfModel, buffers, pending.file);
 
-    m_objects.reserve(gltfModel.meshes.size());
-    for (const tinygltf::Mesh& gltfMesh : gltfModel.meshes) {
-        std::vector<dvl::Mesh> meshes = dvl::loadMesh(gltfMesh, gltfModel, parentInd, meshInd++, scale, pos, rot, imagesOffset);
+    // hash the source file to find its mesh cache
+    const mappedfile::MappedFile& source = pending.file->getFile();
+    pending.sourceHash = utils::hashBytes(source.data(), source.size());
 
-        for (dvl::Mesh& m : meshes) {
-            m.file = fileName;
-            m_objects.push_back(std::make_unique<dvl::Mesh>(m));
+    std::ostringstream cacheName;
+    cacheName << std::hex << std::setw(16) << std::setfill('0') << pending.sourceHash;
+    pending.cachePath = cfg::CACHE_DIR + cacheName.str() + ".vmesh";
+
+    // the nodes are needed whether or not the meshes are cached
+    pending.nodes = dvl::flattenNodes(*gltfModel, buffers);
+
+    if (pending.sourceHash != 0 && pending.cache.load(pending.cachePath, pending.sourceHash)) {
+        pending.model = std::move(gltfModel);
+        return pending;
+    }
+
+    // each primitive is loaded as its own task
+    pending.model = std::move(gltfModel);
+
+    for (size_t meshInd = 0; meshInd < model->meshes.size(); meshInd++) {
+        uint32_t meshIndex = static_cast<uint32_t>(meshInd);
+
+        for (size_t i = 0; i < model->meshes[meshInd].primitives.size(); i++) {
+            pending.primitives.push_back(pool.submit([model, buffers, meshIndex, i]() { return loadPrimitive(*model, buffers, meshIndex, i); }));
+        }
+    }
+
+    return pending;
+}
+
+std::vector<imagedecode::PendingImage> VkScene::decodeImages(tinygltf::Model& model, const dvl::ModelBuffers& buffers, const std::shared_ptr<const glbfile::GlbFile>& file) {
+    std::vector<imagedecode::PendingImage> images;
+    images.reserve(model.images.size());
+
+    for (tinygltf::Image& image : model.images) {
+        std::span<const uint8_t> encoded{};
+        std::shared_ptr<const void> owner{};
+
+        if (image.bufferView >= 0) {
+            // embedded images are read straight from the mapped file
+            const tinygltf::BufferView& bufferView = model.bufferViews[image.bufferView];
+            std::span<const uint8_t> buffer = buffers[bufferView.buffer];
+
+            if (bufferView.byteOffset <= buffer.size() && bufferView.byteLength <= buffer.size() - bufferView.byteOffset) {
+                encoded = buffer.subspan(bufferView.byteOffset, bufferView.byteLength);
+            }
+
+            owner = file;
+        } else {
+            // other images were left encoded by the loader, and are moved out of the model for the task to own
+            auto bytes = std::make_shared<const std::vector<unsigned char>>(std::move(image.image));
+            encoded = *bytes;
+            owner = std::move(bytes);
         }
+
+        images.push_back(imagedecode::PendingImage::submit(m_imagePool, encoded, std::move(owner)));
+    }
+
+    return images;
+}
+
+void VkScene::releaseModelImages() noexcept {
+    // cancel anything that wasnt needed, and free the decoded pixels
+    for (std::vector<imagedecode::PendingImage>& images : m_modelImages) {
+        for (const imagedecode::PendingImage& image : images) image.cancel();
+        images.clear();
+    }
+}
+
+VkScene::LoadedPrimitive VkScene::loadPrimitive(const tinygltf::Model& model, const dvl::ModelBuffers& buffers, uint32_t meshIndex, size_t primitiveIndex) {
+    LoadedPrimitive primitive{};
+    primitive.mesh = dvl::loadPrimitive(model.meshes[meshIndex], primitiveIndex, model, buffers, 0);
+
+    std::vector<dvl::Vertex>& vertices = primitive.mesh.vertices;
+    std::vector<uint32_t>& indices = primitive.mesh.indices;
+
+    // reorder for the vertex cache, overdraw and vertex fetch
+    primitive.before = meshopt::analyzeVertexCache(indices, vertices.size());
+    meshopt::optimizeMesh(vertices, indices);
+    primitive.after = meshopt::analyzeVertexCache(indices, vertices.size());
+
+    // the simplified levels are appended after the optimized indices, and every level gets its own meshlets
+    primitive.mesh.lods = meshopt::buildLods(vertices, indices, primitive.mesh.meshlets);
+
+    return primitive;
+}
+
+LoadedModel VkScene::completeModel(PendingModel& pending) {
+    LoadedModel loaded{};
+    const std::string& fileName = pending.data.file;
+
+    // the meshes are in the order of the model's primitives
+    for (size_t meshInd = 0; meshInd < pending.model->meshes.size(); meshInd++) {
+        loaded.meshIndices.insert(loaded.meshIndices.end(), pending.model->meshes[meshInd].primitives.size(), static_cast<uint32_t>(meshInd));
+    }
+
+    if (pending.cache.valid()) {
+        // the cached meshes view directly into the mapped file
+        loaded.meshes = pending.cache.createMeshes(0);
+        std::cout << "- Loaded " << fileName << " from mesh cache\n";
+    } else {
+        loaded.meshes.reserve(pending.primitives.size());
+
+        meshopt::CacheStats before{};
+        meshopt::CacheStats after{};
+
+        // wait for every primitive, even if one has failed, so no task outlives the model
+        bool failed = false;
+        for (std::future<LoadedPrimitive>& future : pending.primitives) {
+            try {
+                LoadedPrimitive primitive = future.get();
+                before += primitive.before;
+                after += primitive.after;
+                loaded.meshes.push_back(std::move(primitive.mesh));
+            } catch (const std::exception& e) {
+                utils::logWarning(fileName + ": " + e.what(), !failed);
+                failed = true;
+            }
+        }
+
+        if (failed) return LoadedModel{};
+
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "- Optimized " << fileName << ": ACMR " << before.getACMR() << " -> " << after.getACMR() << ", ATVR " << before.getATVR() << " -> " << after.getATVR() << "\n";
+        std::cout << std::defaultfloat;
+
+        // the cache keeps the matrix of the first node of each mesh
+        std::vector<dml::mat4> localMatrices;
+        localMatrices.reserve(loaded.meshIndices.size());
+
+        for (uint32_t meshIndex : loaded.meshIndices) {
+            const std::vector<uint32_t>& meshNodes = pending.nodes.meshNodes[meshIndex];
+            localMatrices.push_back(meshNodes.empty() ? dml::mat4{} : pending.nodes.worldMatrices[meshNodes[0]]);
+        }
+
+        if (pending.sourceHash != 0) meshcache::write(pending.cachePath, pending.sourceHash, loaded.meshes, localMatrices, 0);
+    }
+
+    // every primitive has been read, so the glb is unmapped once the images have been decoded
+    pending.file.reset();
+
+    loaded.model = std::move(pending.model);
+    loaded.data = pending.data;
+    loaded.sourceHash = pending.sourceHash;
+    loaded.cache = std::move(pending.cache);
+    loaded.images = std::move(pending.images);
+    loaded.nodes = std::move(pending.nodes);
+    return loaded;
+}
+
+void VkScene::placeModel(LoadedModel& loaded, size_t imagesOffset) {
+    const std::string& fileName = loaded.data.file;
+    const dvl::NodeHierarchy& nodes = loaded.nodes;
+
+    // every node that uses a mesh places an instance of it
+    ModelTemplate modelTemplate{};
+    modelTemplate.placement = dvl::calcPlacementMatrix(loaded.data.pos, loaded.data.quat, loaded.data.scale);
+
+    for (size_t i = 0; i < loaded.meshes.size(); i++) {
+        dvl::Mesh& m = loaded.meshes[i];
+
+        // the meshes were loaded without the image offset of the model
+        std::array<int*, 5> material = {&m.material.baseColor, &m.material.metallicRoughness, &m.material.normalMap, &m.material.occlusionMap, &m.material.emissiveMap};
+        for (int* index : material) {
+            if (*index >= 0) *index += static_cast<int>(imagesOffset);
+        }
+
+        // the same geometry with different images is a different mesh
+        m.meshHash = dvl::calcMeshHash(m);
+        m.file = fileName;
+
+        static const std::vector<uint32_t> noNodes{};
+        const std::vector<uint32_t>& meshNodes = (i < loaded.meshIndices.size()) ? nodes.meshNodes[loaded.meshIndices[i]] : noNodes;
+        uint32_t meshId = addMesh(std::move(m));
+
+        // a mesh that no node uses is placed once, where the model is
+        if (meshNodes.empty()) {
+            modelTemplate.meshIds.push_back(meshId);
+            modelTemplate.nodes.push_back(-1);
+            modelTemplate.instanceMatrices.emplace_back();
+        }
+
+        for (uint32_t node : meshNodes) {
+            const std::vector<dml::mat4>& nodeInstances = nodes.instances[node];
+            size_t count = std::max<size_t>(nodeInstances.size(), 1);
+
+            for (size_t j = 0; j < count; j++) {
+                modelTemplate.meshIds.push_back(meshId);
+                modelTemplate.nodes.push_back(static_cast<int32_t>(node));
+                modelTemplate.instanceMatrices.push_back(nodeInstances.empty() ? dml::mat4{} : nodeInstances[j]);
+            }
+        }
+    }
+
+    if (modelTemplate.meshIds.size() > loaded.meshes.size()) {
+        std::cout << "- Placed " << modelTemplate.meshIds.size() << " instances of " << loaded.meshes.size() << " meshes from " << fileName << "\n";
     }
 
-    m_models.push_back(std::make_unique<tinygltf::Model>(gltfModel));
+    loaded.meshes.clear();
+
+    if (loaded.cache.valid()) m_meshCaches.push_back(std::move(loaded.cache));
+
+    size_t modelIndex = m_loadedModelFiles.size();
+    m_loadedModelIndices.push_back(m_models.size());
+    m_models.push_back(std::move(loaded.model));
+    m_modelHashes.push_back(loaded.sourceHash);
+    m_modelImages.push_back(std::move(loaded.images));
+    m_nodeHierarchies.push_back(std::move(loaded.nodes));
+    m_modelTemplates.push_back(std::move(modelTemplate));
     m_loadedModelFiles.push_back(fileName);
-    m_loadedModelIndices.push_back(modelIndex);
+
+    placeTemplate(modelIndex, m_modelTemplates[modelIndex].placement, 0);
 }
 
-void VkScene::calcLightData() noexcept {
-    for (size_t i = 0; i < getLightCount(); i++) {
-        light::LightDataObject& data = m_lights->raw[i];
-        bool followPlayer = m_followPlayerIndex == i;
+std::unique_ptr<LoadedModel> VkScene::loadModelFile(const ModelData& data) {
+    ParsedModel parsed = parseModel(std::string(cfg::MODEL_DIR) + data.file);
+    if (!parsed.model) return nullptr;
+
+    // the primitives are loaded on the image workers, which never wait on this thread
+    PendingModel pending = loadModel(m_imagePool, std::move(parsed), data);
+    if (!pending.model) return nullptr;
+
+    auto loaded = std::make_unique<LoadedModel>(completeModel(pending));
+    if (!loaded->model) return nullptr;
+
+    stageGeometry(*loaded);
+    return loaded;
+}
+
+void VkScene::stageGeometry(LoadedModel& loaded) {
+    StagedGeometry& staged = loaded.staged;
+
+    // lay out the unique meshes of the model the same way createModelBuffers does
+    std::unordered_set<size_t> hashes;
+    size_t vertexCount = 0;
+    std::array<size_t, INDEX_TYPES.size()> indexCounts{};
+    size_t meshletCount = 0;
+
+    for (size_t i = 0; i < loaded.meshes.size(); i++) {
+        const dvl::Mesh& mesh = loaded.meshes[i];
+        if (!hashes.insert(mesh.geometryHash).second) continue;
+
+        StagedMesh& stagedMesh = staged.meshes.emplace_back();
+        stagedMesh.geometryHash = mesh.geometryHash;
+        stagedMesh.meshIndex = i;
+
+        vkh::BufData& bufferData = stagedMesh.bufferData;
+        size_t meshVertexCount = mesh.getVertices().size();
+        size_t meshIndexCount = mesh.getIndices().size();
+
+        bufferData.vertexOffset = static_cast<uint32_t>(vertexCount);
+        bufferData.vertexCount = static_cast<uint32_t>(meshVertexCount);
+        vertexCount += meshVertexCount;
+
+        bufferData.indexType = dvl::fitsIndex16(meshVertexCount) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        bufferData.indexCount = static_cast<uint32_t>(meshIndexCount);
+
+        uint32_t list = getIndexList(bufferData.indexType);
+        bufferData.indexOffset = static_cast<uint32_t>(indexCounts[list]);
+        indexCounts[list] += meshIndexCount + ((list == 0) ? (meshIndexCount & 1) : 0);
+
+        bufferData.meshletOffset = static_cast<uint32_t>(meshletCount);
+        bufferData.meshletCount = static_cast<uint32_t>(mesh.getMeshlets().size());
+        meshletCount += bufferData.meshletCount;
+    }
+
+    // every section starts on a 16 byte boundary, which covers the alignment of each of them
+    VkDeviceSize stagingSize = 0;
+    auto addSection = [&stagingSize](VkDeviceSize size) {
+        VkDeviceSize offset = (stagingSize + 15) & ~VkDeviceSize(15);
+        stagingSize = offset + size;
+        return offset;
+    };
+
+    staged.positionOffset = addSection(vertexCount * sizeof(dvl::PackedPosition));
+    staged.attributeOffset = addSection(vertexCount * sizeof(dvl::PackedAttributes));
+    staged.indexOffsets[0] = addSection(indexCounts[0] * sizeof(uint16_t));
+    staged.indexOffsets[1] = addSection(indexCounts[1] * sizeof(uint32_t));
+    staged.meshletOffset = addSection(meshletCount * sizeof(dvl::Meshlet));
+
+    if (stagingSize == 0) return;
 
-        if (followPlayer) {
-            data.pos = dml::getCamWorldPos(m_cam.matrices.view);
-            data.target = data.pos + dml::quatToDir(m_cam.quat);
+    VkDevice device = VkSingleton::v().gdevice();
+    vkh::createHostVisibleBuffer(staged.buffer, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+    char* data = nullptr;
+    vkMapMemory(device, staged.buffer.mem.v(), 0, stagingSize, 0, reinterpret_cast<void**>(&data));
+
+    dvl::PackedPosition* positionData = reinterpret_cast<dvl::PackedPosition*>(data + staged.positionOffset);
+    dvl::PackedAttributes* attributeData = reinterpret_cast<dvl::PackedAttributes*>(data + staged.attributeOffset);
+    dvl::Meshlet* meshletData = reinterpret_cast<dvl::Meshlet*>(data + staged.meshletOffset);
+
+    for (const StagedMesh& stagedMesh : staged.meshes) {
+        const dvl::Mesh& mesh = loaded.meshes[stagedMesh.meshIndex];
+        const vkh::BufData& bufferData = stagedMesh.bufferData;
+
+        dvl::packVertices(mesh.getVertices(), positionData + bufferData.vertexOffset, attributeData + bufferData.vertexOffset);
+
+        std::span<const uint32_t> indices = mesh.getIndices();
+        char* indexDst = data + staged.indexOffsets[getIndexList(bufferData.indexType)] + (bufferData.indexOffset * bufferData.indexSize());
+
+        if (bufferData.indexType == VK_INDEX_TYPE_UINT16) {
+            uint16_t* indices16 = reinterpret_cast<uint16_t*>(indexDst);
+            for (size_t j = 0; j < indices.size(); j++) {
+                indices16[j] = static_cast<uint16_t>(indices[j]);
+            }
+        } else {
+            std::memcpy(indexDst, indices.data(), indices.size() * sizeof(uint32_t));
+        }
+
+        std::span<const dvl::Meshlet> meshlets = mesh.getMeshlets();
+        std::copy(meshlets.begin(), meshlets.end(), meshletData + bufferData.meshletOffset);
+    }
+
+    vkUnmapMemory(device, staged.buffer.mem.v());
+}
+
+void VkScene::recordModelUpload(uploads::VkUploads& uploads, uploads::Batch& batch, LoadedModel& loaded) {
+    const StagedGeometry& staged = loaded.staged;
+
+    // the new meshes go after the scene's, so nothing that's already in the scene moves
+    // apart from the 32 bit indices, which move along with the end of the 16 bit section
+    loaded.added.clear();
+    loaded.vertexCount = m_vertexCount;
+    loaded.indexCounts = m_indexCounts;
+    loaded.meshletBufferSize = m_meshletBufferSize;
+
+    std::vector<VkBufferCopy> positionCopies;
+    std::vector<VkBufferCopy> attributeCopies;
+    std::array<std::vector<VkBufferCopy>, INDEX_TYPES.size()> indexCopies;
+    std::vector<VkBufferCopy> meshletCopies;
+
+    for (const StagedMesh& stagedMesh : staged.meshes) {
+        // meshes the scene already has are drawn from its buffers
+        if (m_geometryHashToBufferIndex.contains(stagedMesh.geometryHash)) continue;
+
+        const vkh::BufData& src = stagedMesh.bufferData;
+        StagedMesh& added = loaded.added.emplace_back(stagedMesh);
+        vkh::BufData& dst = added.bufferData;
+
+        dst.vertexOffset = static_cast<uint32_t>(loaded.vertexCount);
+        positionCopies.push_back({staged.positionOffset + src.vertexOffset * sizeof(dvl::PackedPosition), dst.vertexOffset * sizeof(dvl::PackedPosition), src.vertexCount * sizeof(dvl::PackedPosition)});
+        attributeCopies.push_back({staged.attributeOffset + src.vertexOffset * sizeof(dvl::PackedAttributes), dst.vertexOffset * sizeof(dvl::PackedAttributes), src.vertexCount * sizeof(dvl::PackedAttributes)});
+        loaded.vertexCount += src.vertexCount;
+
+        // the dst offsets are relative to the section until the new section offsets are known
+        uint32_t list = getIndexList(src.indexType);
+        size_t indexCount = src.indexCount + ((list == 0) ? (src.indexCount & 1) : 0);
+        dst.indexOffset = static_cast<uint32_t>(loaded.indexCounts[list]);
+        indexCopies[list].push_back({staged.indexOffsets[list] + src.indexOffset * src.indexSize(), dst.indexOffset * src.indexSize(), indexCount * src.indexSize()});
+        loaded.indexCounts[list] += indexCount;
+
+        dst.meshletOffset = static_cast<uint32_t>(loaded.meshletBufferSize / sizeof(dvl::Meshlet));
+        if (src.meshletCount > 0) {
+            meshletCopies.push_back({staged.meshletOffset + src.meshletOffset * sizeof(dvl::Meshlet), loaded.meshletBufferSize, src.meshletCount * sizeof(dvl::Meshlet)});
+            loaded.meshletBufferSize += src.meshletCount * sizeof(dvl::Meshlet);
         }
+    }
+
+    if (loaded.added.empty()) return;
+
+    VkDeviceSize indexSectionOffset = loaded.indexCounts[0] * sizeof(uint16_t);
+    for (VkBufferCopy& copy : indexCopies[1]) copy.dstOffset += indexSectionOffset;
+
+    VkDeviceSize indexBufferSize = indexSectionOffset + loaded.indexCounts[1] * sizeof(uint32_t);
+    createGeometryBuffers(loaded.buffers, loaded.vertexCount, indexBufferSize, loaded.meshletBufferSize);
+
+    GeometryBuffers& buffers = loaded.buffers;
+    std::array<std::pair<vkh::BufferObj*, const std::vector<VkBufferCopy>*>, 5> newCopies = {{
+        {&buffers.position, &positionCopies},
+        {&buffers.attribute, &attributeCopies},
+        {&buffers.index, &indexCopies[0]},
+        {&buffers.index, &indexCopies[1]},
+        {&buffers.meshlet, &meshletCopies},
+    }};
+
+    // the new meshes are copied on the transfer queue
+    VkCommandBuffer transferCommandBuffer = batch.transferCommandBuffer.v();
+    for (const auto& [buffer, copies] : newCopies) {
+        if (copies->empty()) continue;
+        vkCmdCopyBuffer(transferCommandBuffer, staged.buffer.buf.v(), buffer->buf.v(), static_cast<uint32_t>(copies->size()), copies->data());
+    }
 
-        float aspectRatio = static_cast<float>(cfg::SHADOW_WIDTH) / static_cast<float>(cfg::SHADOW_HEIGHT);
+    uploads.releaseBuffer(batch, buffers.position);
+    uploads.releaseBuffer(batch, buffers.attribute);
+    uploads.releaseBuffer(batch, buffers.index);
+    if (buffers.meshlet.buf.valid()) uploads.releaseBuffer(batch, buffers.meshlet);
+
+    // the scene's buffers are owned by the graphics queue, so theyre copied there
+    // the buffers are device local, so it's a gpu copy without a round trip through the cpu
+    VkCommandBuffer graphicsCommandBuffer = batch.graphicsCommandBuffer.v();
+    auto copyOld = [graphicsCommandBuffer](const vkh::BufferObj& src, const vkh::BufferObj& dst, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size) {
+        if (size == 0) return;
+
+        VkBufferCopy copy{srcOffset, dstOffset, size};
+        vkCmdCopyBuffer(graphicsCommandBuffer, src.buf.v(), dst.buf.v(), 1, &copy);
+    };
+
+    copyOld(m_geometry.position, buffers.position, 0, 0, m_vertexCount * sizeof(dvl::PackedPosition));
+    copyOld(m_geometry.attribute, buffers.attribute, 0, 0, m_vertexCount * sizeof(dvl::PackedAttributes));
+    copyOld(m_geometry.index, buffers.index, 0, 0, m_indexCounts[0] * sizeof(uint16_t));
+    copyOld(m_geometry.index, buffers.index, m_indexSectionOffsets[1], indexSectionOffset, m_indexCounts[1] * sizeof(uint32_t));
+    copyOld(m_geometry.meshlet, buffers.meshlet, 0, 0, m_meshletBufferSize);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    batch.stagingBuffers.push_back(staged.buffer);
+}
+
+void VkScene::addModel(uploads::VkUploads& uploads, LoadedModel& loaded, size_t imagesOffset) {
+    // the new meshes are given the next buffer indices
+    for (StagedMesh& added : loaded.added) {
+        size_t bufferIndex = m_geometryHashToBufferIndex.try_emplace(added.geometryHash, m_geometryHashToBufferIndex.size()).first->second;
+
+        m_bufData.resize(m_geometryHashToBufferIndex.size());
+        m_lodChains.resize(m_geometryHashToBufferIndex.size());
+
+        m_bufData[bufferIndex] = added.bufferData;
+        addLodChain(bufferIndex, loaded.meshes[added.meshIndex], m_bufData[bufferIndex]);
+    }
+
+    if (!loaded.added.empty()) {
+        // the frames in flight still read from the old buffers
+        uploads.retire(m_geometry.position);
+        uploads.retire(m_geometry.attribute);
+        uploads.retire(m_geometry.index);
+        uploads.retire(m_geometry.meshlet);
+
+        m_geometry = loaded.buffers;
+        m_vertexCount = loaded.vertexCount;
+        m_indexCounts = loaded.indexCounts;
+        m_indexSectionOffsets[1] = m_indexCounts[0] * sizeof(uint16_t);
+        m_meshletBufferSize = loaded.meshletBufferSize;
+    }
+
+    // the textures were already created from the images
+    for (const imagedecode::PendingImage& image : loaded.images) image.cancel();
+    loaded.images.clear();
+
+    placeModel(loaded, imagesOffset);
+    updateDraws();
+}
+
+void VkScene::createGeometryBuffers(GeometryBuffers& buffers, size_t vertexCount, VkDeviceSize indexBufferSize, VkDeviceSize meshletBufferSize) const {
+    // the buffers are copied from when a model is added, so they can be grown on the gpu
+    VkBufferUsageFlags copyU = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-        dml::vec3 up = dml::vec3(0.0f, 1.0f, 0.0f);
-        if (data.pos == data.target) {
-            std::cerr << "Light position and target are the same!\n";
-            return;
+    // the positions and indices are built into the blas, the attributes are read by the hit shader
+    VkBufferUsageFlags rtU = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+    VkBufferUsageFlags positionU = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | copyU | ((m_rtEnabled) ? rtU : 0);
+    VkBufferUsageFlags attributeU = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | copyU | ((m_rtEnabled) ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
+    VkBufferUsageFlags indexU = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | copyU | ((m_rtEnabled) ? rtU : 0);
+
+    VkMemoryAllocateFlags vertM = (m_rtEnabled) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+    VkMemoryAllocateFlags indexM = (m_rtEnabled) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+
+    vkh::createBuffer(buffers.position, vertexCount * sizeof(dvl::PackedPosition), positionU, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertM);
+    vkh::createBuffer(buffers.attribute, vertexCount * sizeof(dvl::PackedAttributes), attributeU, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertM);
+    vkh::createBuffer(buffers.index, indexBufferSize, indexU, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexM);
+
+    // the meshlets are only read by the cull shader, through their address
+    if (meshletBufferSize > 0) {
+        VkBufferUsageFlags meshletU = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | copyU;
+        vkh::createBuffer(buffers.meshlet, meshletBufferSize, meshletU, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+    }
+}
+
+void VkScene::addLodChain(size_t bufferIndex, const dvl::Mesh& mesh, vkh::BufData& bufferData) {
+    // levels of detail, the full detail mesh is always the first
+    LodChain& chain = m_lodChains[bufferIndex];
+    chain.sphere = calcBoundingSphere(mesh.getVertices());
+    chain.lodOffset = static_cast<uint32_t>(m_lods.size());
+
+    std::span<const dvl::MeshLod> lods = mesh.getLods();
+    if (lods.empty()) {
+        dvl::MeshLod full{};
+        full.indexCount = bufferData.indexCount;
+        full.meshletCount = bufferData.meshletCount;
+        m_lods.push_back(full);
+    } else {
+        lods = lods.first(std::min<size_t>(lods.size(), meshopt::MAX_LODS));
+        m_lods.insert(m_lods.end(), lods.begin(), lods.end());
+    }
+
+    chain.lodCount = static_cast<uint32_t>(m_lods.size()) - chain.lodOffset;
+    chain.maxMeshletCount = 0;
+    for (uint32_t j = chain.lodOffset; j < m_lods.size(); j++) {
+        chain.maxMeshletCount = std::max(chain.maxMeshletCount, m_lods[j].meshletCount);
+    }
+
+    // the raytracer and the whole object draws use the full detail mesh
+    bufferData.indexCount = m_lods[chain.lodOffset].indexCount;
+}
+
+void VkScene::updateNodes() {
+    for (size_t i = 0; i < m_nodeHierarchies.size(); i++) {
+        dvl::NodeHierarchy& hierarchy = m_nodeHierarchies[i];
+        if (hierarchy.dirty.empty()) continue;
+
+        // only the dirty subtrees are recomputed, so only the instances in them have to move
+        // copies of the model are moved along with the instances it was loaded with
+        std::vector<dvl::NodeRange> ranges = dvl::updateWorldMatrices(hierarchy);
+        instancing::InstanceStore& store = m_instances;
+
+        for (size_t j = 0; j < store.size(); j++) {
+            if (store.models[j] != i || store.nodes[j] < 0) continue;
+
+            uint32_t node = static_cast<uint32_t>(store.nodes[j]);
+            bool moved = std::any_of(ranges.begin(), ranges.end(), [node](const dvl::NodeRange& r) { return node >= r.first && node < r.first + r.count; });
+            if (!moved) continue;
+
+            dml::mat4 world = store.placements[j] * hierarchy.worldMatrices[node] * store.instanceMatrices[j];
+            store.transforms[j] = instancing::toTransform(world);
+            m_movedInstances.push_back(static_cast<uint32_t>(j));
         }
+    }
+}
 
-        dml::mat4 view = dml::lookAt(data.pos, data.target, up);
+void VkScene::calcLightData() noexcept {
+    // the other lights only move when theyre created, so only the one following the camera is updated
+    if (m_followPlayerIndex < 0 || m_followPlayerIndex >= static_cast<int>(m_lights.size())) return;
+    light::LightDataObject& data = m_lights[m_followPlayerIndex];
+
+    dml::vec3 pos = dml::getCamWorldPos(m_cam.matrices.view);
+    dml::vec3 target = pos + dml::quatToDir(m_cam.quat);
+    if (pos == data.pos && target == data.target) return;
+
+    data.pos = pos;
+    data.target = target;
+    calcLightViewProj(data);
+    m_lightVersion++;
+}
 
-        float fov = dml::degrees(data.outerConeAngle) * 2.0f;
-        dml::mat4 proj = dml::projection(fov, aspectRatio, cfg::NEAR_PLANE, cfg::FAR_PLANE);
+void VkScene::calcLightViewProj(light::LightDataObject& data) noexcept {
+    float aspectRatio = static_cast<float>(cfg::SHADOW_WIDTH) / static_cast<float>(cfg::SHADOW_HEIGHT);
 
-        data.viewProj = proj * view;
+    dml::vec3 up = dml::vec3(0.0f, 1.0f, 0.0f);
+    if (data.pos == data.target) {
+        std::cerr << "Light position and target are the same!\n";
+        return;
     }
+
+    dml::mat4 view = dml::lookAt(data.pos, data.target, up);
+
+    float fov = dml::degrees(data.outerConeAngle) * 2.0f;
+    dml::mat4 proj = dml::projection(fov, aspectRatio, cfg::NEAR_PLANE, cfg::FAR_PLANE);
+
+    data.viewProj = proj * view;
 }
 
 void VkScene::calcCameraMats(float up, float right, uint32_t swapWidth, uint32_t swapHeight) noexcept {
+    // called once per frame, so the matrices being replaced are the ones the last frame was drawn with
+    m_cam.matrices.prevViewProj = m_cam.matrices.proj * m_cam.matrices.view;
+
     m_cam.matrices.view = m_cam.getViewMatrix(up, right);
 
     float aspect = static_cast<float>(swapWidth) / static_cast<float>(swapHeight);
     m_cam.matrices.proj = dml::projection(m_cam.fov, aspect, cfg::NEAR_PLANE, cfg::FAR_PLANE);
     m_cam.matrices.iview = dml::inverseMatrix(m_cam.matrices.view);
     m_cam.matrices.iproj = dml::inverseMatrix(m_cam.matrices.proj);
+
+    m_lodPixelScale = static_cast<float>(swapHeight) / (2.0f * std::tan(dml::radians(m_cam.fov) * 0.5f));
+}
+
+void VkScene::updateDraws() {
+    selectLods();
+
+    if (!m_drawsDirty) {
+        updateMovedInstances();
+    } else {
+        calcObjectInstanceData();
+        populateIndirectCommands();
+        populateCullObjects();
+
+        m_drawsDirty = false;
+        m_drawVersion++;
+    }
+
+    cullInstances();
+}
+
+void VkScene::selectLods() {
+    if (m_objectLods.size() != m_instances.size()) {
+        m_objectLods.resize(m_instances.size());
+        m_drawsDirty = true;
+    }
+
+    // the raytracer always uses the full detail meshes
+    // the shadow passes use the camera's levels too
+    if (m_rtEnabled || m_lodPixelScale <= 0.0f) return;
+
+    dml::vec3 camPos = getCamWorldPos();
+
+    auto selectLod = [&](size_t i) {
+        const LodChain& chain = m_lodChains[m_meshBufferIndices[m_instances.meshIds[i]]];
+        uint32_t level = 0;
+
+        if (chain.lodCount > 1) {
+            const instancing::Transform& transform = m_instances.transforms[i];
+            float scale = instancing::getMaxScale(transform);
+
+            // the closest the object can be to the camera
+            dml::vec3 center = instancing::transformPoint(transform, chain.sphere.xyz());
+            float distance = (center - camPos).length() - (chain.sphere.w * scale);
+
+            // use the coarsest level whose error is too small to see
+            if (distance > cfg::NEAR_PLANE) {
+                float pixelsPerUnit = m_lodPixelScale * scale / distance;
+
+                for (uint32_t l = 1; l < chain.lodCount; l++) {
+                    if (m_lods[chain.lodOffset + l].error * pixelsPerUnit > cfg::LOD_PIXEL_ERROR) break;
+                    level = l;
+                }
+            }
+        }
+
+        // an instance changing level moves it to another draw
+        if (level != m_objectLods[i]) {
+            m_objectLods[i] = level;
+            m_drawsDirty = true;
+        }
+    };
+
+    // every level is selected again once the camera moves, otherwise only the moved instances can change level
+    // when the draws are rebuilt the levels may belong to other instances, since removing one moves another into its place
+    bool camMoved = !(camPos == m_lodCamPos) || m_lodPixelScale != m_lodCamPixelScale;
+    if (camMoved || m_drawsDirty) {
+        m_lodCamPos = camPos;
+        m_lodCamPixelScale = m_lodPixelScale;
+
+        for (size_t i = 0; i < m_instances.size(); i++) {
+            selectLod(i);
+        }
+    } else {
+        for (uint32_t i : m_movedInstances) {
+            selectLod(i);
+        }
+    }
 }
 
 void VkScene::calcObjectInstanceData() noexcept {
-    // calc matrices for objects
-    for (size_t i = 0; i < m_objects.size(); i++) {
-        m_objInstanceData->object[i].model = m_objects[i]->modelMatrix;
-        m_objInstanceData->object[i].objectIndex = static_cast<uint32_t>(getUniqueObjectIndex(i));
+    size_t meshCount = getMeshCount();
+    size_t objectCount = m_instances.size();
+
+    m_drawOrder.resize(objectCount);
+    m_lodInstanceCounts.assign(meshCount, {});
+    m_meshFirstInstances.resize(meshCount);
+
+    // the instances of each mesh are contiguous, so theyre sorted by level within that range
+    // an instanced draw per level can then cover each level's instances
+    uint32_t first = 0;
+    for (size_t i = 0; i < meshCount; i++) {
+        const std::vector<uint32_t>& bucket = m_meshBuckets[i];
+        m_meshFirstInstances[i] = first;
+
+        std::array<uint32_t, meshopt::MAX_LODS>& counts = m_lodInstanceCounts[i];
+        for (uint32_t j : bucket) {
+            counts[m_objectLods[j]]++;
+        }
+
+        std::array<uint32_t, meshopt::MAX_LODS> slots{};
+        uint32_t slot = first;
+        for (size_t l = 0; l < meshopt::MAX_LODS; l++) {
+            slots[l] = slot;
+            slot += counts[l];
+        }
+
+        for (uint32_t j : bucket) {
+            m_drawOrder[slots[m_objectLods[j]]++] = j;
+        }
+
+        first += static_cast<uint32_t>(bucket.size());
+    }
+
+    // gather the transforms into the instance slots
+    m_objInstanceData.resize(objectCount);
+    m_instanceSlots.resize(objectCount);
+    const instancing::Transform* transforms = m_instances.transforms.data();
+    const uint32_t* meshIds = m_instances.meshIds.data();
+
+    for (size_t i = 0; i < objectCount; i++) {
+        uint32_t objectIndex = m_drawOrder[i];
+
+        m_objInstanceData[i].transform = transforms[objectIndex];
+        m_objInstanceData[i].meshIndex = meshIds[objectIndex];
+        m_instanceSlots[objectIndex] = static_cast<uint32_t>(i);
+    }
+
+    if (m_instanceCulling) {
+        m_cullSpheres.resize(objectCount);
+        for (size_t i = 0; i < objectCount; i++) {
+            calcCullSphere(static_cast<uint32_t>(i), m_drawOrder[i]);
+        }
+
+        m_cullDirty = true;
     }
+
+    // every slot may have changed, which covers any instances that moved
+    m_movedInstances.clear();
+    m_dirtyInstanceRanges.clear();
+    if (objectCount > 0) m_dirtyInstanceRanges.push_back({0, static_cast<uint32_t>(objectCount)});
+}
+
+void VkScene::updateMovedInstances() noexcept {
+    for (uint32_t i : m_movedInstances) {
+        uint32_t slot = m_instanceSlots[i];
+        m_objInstanceData[slot].transform = m_instances.transforms[i];
+        m_dirtyInstanceRanges.push_back({slot, 1});
+
+        if (m_instanceCulling) calcCullSphere(slot, i);
+    }
+
+    m_cullDirty = m_cullDirty || !m_movedInstances.empty();
+    m_movedInstances.clear();
 }
 
 void VkScene::populateIndirectCommands() {
     m_sceneIndirectCommands.clear();
-    m_sceneIndirectCommands.reserve(getUniqueObjectCount());
+    m_sceneIndirectCommands.reserve(getIndirectCommandCapacity());
+    m_indirectCommandCounts.fill(0);
+
+    // the commands are grouped by index type, so each list can be drawn with its own index buffer binding
+    for (VkIndexType indexType : INDEX_TYPES) {
+        for (size_t i = 0; i < getMeshCount(); i++) {
+            if (m_meshBuckets[i].empty()) continue;
+
+            size_t bufferIndex = m_meshBufferIndices[i];
+            const vkh::BufData& bufferData = m_bufData[bufferIndex];
+            if (bufferData.indexType != indexType) continue;
+
+            // one command per level that has instances, in the order of the instance slots
+            const LodChain& chain = m_lodChains[bufferIndex];
+            uint32_t firstInstance = m_meshFirstInstances[i];
+
+            for (uint32_t l = 0; l < chain.lodCount; l++) {
+                uint32_t instanceCount = m_lodInstanceCounts[i][l];
+                if (instanceCount == 0) continue;
+
+                const dvl::MeshLod& lod = m_lods[chain.lodOffset + l];
+
+                VkDrawIndexedIndirectCommand indirectCommand{};
+                indirectCommand.firstIndex = bufferData.indexOffset + lod.indexOffset;
+                indirectCommand.firstInstance = firstInstance;
+                indirectCommand.indexCount = lod.indexCount;
+                indirectCommand.instanceCount = instanceCount;
+                indirectCommand.vertexOffset = bufferData.vertexOffset;
+                m_sceneIndirectCommands.push_back(indirectCommand);
+
+                m_indirectCommandCounts[getIndexList(indexType)]++;
+                firstInstance += instanceCount;
+            }
+        }
+    }
+}
 
-    const size_t* uniqueObjects = getUniqueObjects();
+void VkScene::populateCullObjects() {
+    m_cullObjects.clear();
+    m_cullObjects.reserve(m_instances.size());
+    m_meshletItemCount = 0;
+    m_meshletItemCapacity = 0;
 
-    for (size_t i = 0; i < getUniqueObjectCount(); i++) {
-        size_t index = uniqueObjects[i];
+    // cull objects are in the same order as the instance slots
+    for (size_t i = 0; i < m_instances.size(); i++) {
+        size_t objectIndex = m_drawOrder[i];
+        size_t bufferIndex = m_meshBufferIndices[m_instances.meshIds[objectIndex]];
 
-        size_t bufferIndex = getBufferIndex(index);
         const vkh::BufData& bufferData = m_bufData[bufferIndex];
+        const LodChain& chain = m_lodChains[bufferIndex];
+        const dvl::MeshLod& lod = m_lods[chain.lodOffset + m_objectLods[objectIndex]];
+
+        // the meshlets of every level are relative to the first index of the mesh
+        culling::CullObject object{};
+        object.firstItem = static_cast<uint32_t>(m_meshletItemCount);
+        object.meshletOffset = bufferData.meshletOffset + lod.meshletOffset;
+        object.meshletCount = lod.meshletCount;
+        object.firstIndex = bufferData.indexOffset;
+        object.vertexOffset = static_cast<int32_t>(bufferData.vertexOffset);
+        object.drawList = getIndexList(bufferData.indexType);
+        m_cullObjects.push_back(object);
+
+        m_meshletItemCount += lod.meshletCount;
+        m_meshletItemCapacity += chain.maxMeshletCount;
+    }
+}
+
+void VkScene::calcCullSphere(uint32_t slot, uint32_t objectIndex) noexcept {
+    const instancing::Transform& transform = m_instances.transforms[objectIndex];
+    const dml::vec4& sphere = m_lodChains[m_meshBufferIndices[m_instances.meshIds[objectIndex]]].sphere;
+
+    // every level of the mesh is within the bounds of the full detail one
+    dml::vec3 center = instancing::transformPoint(transform, sphere.xyz());
+    m_cullSpheres.set(slot, center, sphere.w * instancing::getMaxScale(transform));
+}
+
+void VkScene::cullInstances() {
+    if (!m_instanceCulling) return;
+
+    dml::mat4 camViewProj = m_cam.matrices.proj * m_cam.matrices.view;
+    if (!m_cullDirty && camViewProj == m_cullCamViewProj && m_cullLightVersion == m_lightVersion) return;
+
+    m_cullDirty = false;
+    m_cullCamViewProj = camViewProj;
+    m_cullLightVersion = m_lightVersion;
+
+    // the shadow pass draws each instance for every light, so it has to be visible to any of them
+    std::array<std::vector<frustumcull::Frustum>, culling::VIEW_COUNT> frusta;
+    frusta[culling::CAMERA_VIEW].push_back(frustumcull::extractFrustum(camViewProj));
+
+    for (const light::LightDataObject& light : m_lights) {
+        frusta[culling::SHADOW_VIEW].push_back(frustumcull::extractFrustum(light.viewProj));
+    }
+
+    size_t objectCount = m_instances.size();
+    for (uint32_t view = 0; view < culling::VIEW_COUNT; view++) {
+        std::vector<uint8_t>& visible = m_slotVisibility[view];
+
+        if (frusta[view].empty()) {
+            visible.assign(objectCount, 0);
+        } else {
+            visible.resize(objectCount);
+            frustumcull::testSpheres(m_cullPool, m_cullSpheres, frusta[view], visible.data());
+        }
+    }
+
+    // each of the scene's draws is split into one per view, that only covers its visible instances
+    m_viewInstances.clear();
+    m_viewCommands.clear();
+
+    for (uint32_t view = 0; view < culling::VIEW_COUNT; view++) {
+        const std::vector<uint8_t>& visible = m_slotVisibility[view];
+        size_t command = 0;
+
+        for (uint32_t list = 0; list < INDEX_TYPES.size(); list++) {
+            m_viewCommandOffsets[view][list] = static_cast<uint32_t>(m_viewCommands.size());
+
+            for (uint32_t i = 0; i < m_indirectCommandCounts[list]; i++, command++) {
+                VkDrawIndexedIndirectCommand indirectCommand = m_sceneIndirectCommands[command];
+                uint32_t firstInstance = static_cast<uint32_t>(m_viewInstances.size());
+                uint32_t lastSlot = indirectCommand.firstInstance + indirectCommand.instanceCount;
+
+                for (uint32_t slot = indirectCommand.firstInstance; slot < lastSlot; slot++) {
+                    if (visible[slot]) m_viewInstances.push_back(m_objInstanceData[slot]);
+                }
+
+                indirectCommand.firstInstance = firstInstance;
+                indirectCommand.instanceCount = static_cast<uint32_t>(m_viewInstances.size()) - firstInstance;
+                if (indirectCommand.instanceCount > 0) m_viewCommands.push_back(indirectCommand);
+            }
+
+            m_viewCommandCounts[view][list] = static_cast<uint32_t>(m_viewCommands.size()) - m_viewCommandOffsets[view][list];
+        }
+    }
+
+    m_cullVersion++;
+}
+
+dml::vec4 VkScene::calcBoundingSphere(std::span<const dvl::Vertex> vertices) noexcept {
+    if (vertices.empty()) return {};
 
-        // scene indirect commands
-        VkDrawIndexedIndirectCommand indirectCommand{};
-        indirectCommand.firstIndex = bufferData.indexOffset;
-        indirectCommand.firstInstance = static_cast<uint32_t>(index);
-        indirectCommand.indexCount = bufferData.indexCount;
-        indirectCommand.instanceCount = getObjectInstanceCount(index);
-        indirectCommand.vertexOffset = bufferData.vertexOffset;
-        m_sceneIndirectCommands.push_back(indirectCommand);
+    dml::vec3 minPos = vertices[0].pos;
+    dml::vec3 maxPos = vertices[0].pos;
+
+    for (const dvl::Vertex& vertex : vertices) {
+        minPos = {std::min(minPos.x, vertex.pos.x), std::min(minPos.y, vertex.pos.y), std::min(minPos.z, vertex.pos.z)};
+        maxPos = {std::max(maxPos.x, vertex.pos.x), std::max(maxPos.y, vertex.pos.y), std::max(maxPos.z, vertex.pos.z)};
     }
+
+    dml::vec3 center = (minPos + maxPos) * 0.5f;
+    float radius = 0.0f;
+
+    for (const dvl::Vertex& vertex : vertices) {
+        radius = std::max(radius, (vertex.pos - center).length());
+    }
+
+    return dml::vec4(center, radius);
 }
 }  // namespace scene
@@ -2,19 +2,39 @@
 
 #include <vulkan/vulkan.h>
 
+#include <array>
+#include <future>
+#include <memory>
+#include <span>
 #include <unordered_map>
 #include <vector>
 
 #include "config.hpp"
 #include "libraries/dml.hpp"
 #include "libraries/dvl.hpp"
+#include "libraries/frustumcull.hpp"
+#include "libraries/glbfile.hpp"
+#include "libraries/imagedecode.hpp"
+#include "libraries/meshcache.hpp"
+#include "libraries/meshopt.hpp"
+#include "libraries/threadpool.hpp"
 #include "libraries/vkhelper.hpp"
 #include "structures/cam.hpp"
+#include "structures/culling.hpp"
 #include "structures/instancing.hpp"
 #include "structures/light.hpp"
 #include "structures/texindices.hpp"
+#include "vk-uploads.hpp"
 
 namespace scene {
+// the index buffer has a section per index type, and the indirect commands have a list per index type
+// both are in this order
+constexpr std::array<VkIndexType, 2> INDEX_TYPES = {VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32};
+
+[[nodiscard]] constexpr uint32_t getIndexList(VkIndexType indexType) noexcept {
+    return (indexType == VK_INDEX_TYPE_UINT16) ? 0 : 1;
+}
+
 struct ModelData {
     std::string file{};
     dml::vec3 pos{};
@@ -22,6 +42,55 @@ struct ModelData {
     dml::vec4 quat{};
 };
 
+// the vertex streams, indices and meshlets of every unique mesh
+struct GeometryBuffers {
+    vkh::BufferObj position{};
+    vkh::BufferObj attribute{};
+    vkh::BufferObj index{};
+    vkh::BufferObj meshlet{};
+};
+
+// a unique mesh of a loaded model, and where its data is
+struct StagedMesh {
+    size_t geometryHash = 0;
+    size_t meshIndex = 0;  // into the meshes of the model
+    vkh::BufData bufferData{};
+};
+
+// the unique meshes of a loaded model, packed into a staging buffer the same way as the scene's buffers
+struct StagedGeometry {
+    vkh::BufferObj buffer{};
+    VkDeviceSize positionOffset = 0;
+    VkDeviceSize attributeOffset = 0;
+    std::array<VkDeviceSize, INDEX_TYPES.size()> indexOffsets{};
+    VkDeviceSize meshletOffset = 0;
+
+    std::vector<StagedMesh> meshes;  // offsets are relative to each section
+};
+
+// a model loaded after the scene was created, which isnt part of it until its merged in
+struct LoadedModel {
+    std::unique_ptr<tinygltf::Model> model{};
+    ModelData data{};
+    uint64_t sourceHash = 0;
+    meshcache::MeshCache cache{};
+    std::vector<imagedecode::PendingImage> images;
+    dvl::NodeHierarchy nodes{};
+
+    // the image indices of the materials are relative to the model
+    // each is placed once for every node that uses its gltf mesh
+    std::vector<dvl::Mesh> meshes;
+    std::vector<uint32_t> meshIndices;  // the gltf mesh of each of the meshes
+    StagedGeometry staged{};
+
+    // the scene's geometry with the new meshes after it, swapped in once the upload is done
+    GeometryBuffers buffers{};
+    std::vector<StagedMesh> added;  // offsets are where they are in the new buffers
+    size_t vertexCount = 0;
+    std::array<size_t, INDEX_TYPES.size()> indexCounts{};
+    VkDeviceSize meshletBufferSize = 0;
+};
+
 class VkScene {
 public:
     // delete copying and moving
@@ -32,22 +101,44 @@ public:
     VkScene& operator=(VkScene&&) = delete;
 
     // setup
-    void init(bool rtEnabled, VkDevice device, const VkhCommandPool& commandPool, VkQueue gQueue);
+    void init(bool rtEnabled, bool instanceCulling, VkDevice device, const VkhCommandPool& commandPool, VkQueue gQueue);
     void loadScene(const std::vector<ModelData>& modelData);
     void createModelBuffers(bool recreate);
 
+    // loading after the scene was created
+    // the model is loaded on the calling thread, and the rest is done on the main thread once it has loaded
+    [[nodiscard]] std::unique_ptr<LoadedModel> loadModelFile(const ModelData& data);
+    void recordModelUpload(uploads::VkUploads& uploads, uploads::Batch& batch, LoadedModel& loaded);
+    void addModel(uploads::VkUploads& uploads, LoadedModel& loaded, size_t imagesOffset);
+
     // scene
     void initSceneData(float up, float right, uint32_t swapWidth, uint32_t swapHeight);
     void updateSceneData(float up, float right, uint32_t swapWidth, uint32_t swapHeight);
     void calcTexIndices();
 
     // objects
-    [[nodiscard]] bool copyModel(const dml::vec3& pos, const std::string& name, const dml::vec3& scale, const dml::vec4& rotation);
+    void copyModel(const dml::vec3& pos, const std::string& name, const dml::vec3& scale, const dml::vec4& rotation);
     void resetObjects();
-    [[nodiscard]] int32_t getObjectInstanceCount(size_t objectIndex) const noexcept;
-    void populateObjectMaps(bool getSize);
+
+    // places instances of loaded models, with the draws only rebuilt once for all of them
+    // theyre part of the scene, so resetting the objects keeps them
+    size_t addInstances(const std::vector<ModelData>& instances);
+
+    // the same as addInstances, but returns a handle for each instance, in order
+    // an instance can be destroyed without moving any of the others
+    std::vector<instancing::InstanceHandle> spawnInstances(std::span<const ModelData> instances);
+    void destroyInstances(std::span<const instancing::InstanceHandle> handles);
+    [[nodiscard]] bool instanceExists(instancing::InstanceHandle handle) const noexcept;
+
+    // replaces where the instances of a handle are placed, and only they are uploaded again
+    void setInstanceTransform(instancing::InstanceHandle handle, const dml::mat4& placement);
+
     [[nodiscard]] size_t getModelIndex(size_t index) const;
 
+    // replaces the local matrix of a node of a loaded model
+    // the meshes under it are moved when the scene data is next updated
+    void setNodeTransform(const std::string& file, const std::string& nodeName, const dml::mat4& localMatrix);
+
     // lights
     void createLight(const dml::vec3& pos, const dml::vec3& target, float range);
     void setPlayerLight(int index);
@@ -63,40 +154,73 @@ public:
     [[nodiscard]] const cam::CamMatrices* getCamMatrices() const noexcept { return &m_cam.matrices; }
 
     // tex indices
-    [[nodiscard]] const texindices::TexIndexObj* getTexIndices() const noexcept { return m_texIndices->indices.data(); }
+    [[nodiscard]] const texindices::TexIndexObj* getTexIndices() const noexcept { return m_texIndices.data(); }
+    [[nodiscard]] uint64_t getTexIndexVersion() const noexcept { return m_texIndexVersion; }  // changes whenever the tex indices are recalculated
 
     // models
     [[nodiscard]] size_t getModelCount() const noexcept { return m_models.size(); }
     [[nodiscard]] const tinygltf::Model* getModel(size_t index) const noexcept { return m_models[index].get(); }
+    [[nodiscard]] uint64_t getModelHash(size_t index) const noexcept { return m_modelHashes[index]; }
 
-    // objects
-    [[nodiscard]] size_t getObjectCount() const noexcept { return m_objects.size(); }
-    [[nodiscard]] const dvl::Mesh* getObject(size_t index) const noexcept { return m_objects[index].get(); }
-    [[nodiscard]] const instancing::ObjectInstance* getObjectInstances() const noexcept { return m_objInstanceData->object.data(); }
-    [[nodiscard]] const dvl::Material& getObjectMaterial(size_t index) const noexcept { return m_objects[index]->material; }
+    // images of each model, decoding in the background since the model was loaded
+    [[nodiscard]] const std::vector<imagedecode::PendingImage>& getModelImages(size_t index) const noexcept { return m_modelImages[index]; }
+    [[nodiscard]] threadpool::ThreadPool& getImagePool() noexcept { return m_imagePool; }
+    void releaseModelImages() noexcept;
+
+    // objects, in the order theyre drawn in
+    [[nodiscard]] size_t getObjectCount() const noexcept { return m_instances.size(); }
+    [[nodiscard]] const instancing::ObjectInstance* getObjectInstances() const noexcept { return m_objInstanceData.data(); }
 
-    [[nodiscard]] size_t getUniqueObjectIndex(size_t objectIndex) const { return m_objectHashToUniqueObjectIndex.at(m_objects[objectIndex]->meshHash); }
-    [[nodiscard]] size_t getBufferIndex(size_t objectIndex) const { return m_objectHashToBufferIndex.at(m_objects[objectIndex]->meshHash); }
-    [[nodiscard]] bool isObjectUnique(size_t objectIndex) const { return objectIndex == getUniqueObjectIndex(objectIndex); }
+    // the slots whose instance or cull object changed since the last frame, cleared once every copy of them has been told
+    [[nodiscard]] const std::vector<instancing::SlotRange>& getDirtyInstanceRanges() const noexcept { return m_dirtyInstanceRanges; }
+    void clearDirtyInstanceRanges() noexcept { m_dirtyInstanceRanges.clear(); }
 
-    [[nodiscard]] size_t getUniqueObjectCount() const { return m_uniqueObjects.size(); };
-    [[nodiscard]] const size_t* getUniqueObjects() const { return m_uniqueObjects.data(); }
+    // meshes, which every object is an instance of
+    [[nodiscard]] size_t getMeshCount() const noexcept { return m_meshes.size(); }
+    [[nodiscard]] size_t getMeshBufferIndex(size_t meshIndex) const noexcept { return m_meshBufferIndices[meshIndex]; }
 
     // lights
-    [[nodiscard]] const light::LightDataObject* getRawLightData() const noexcept { return m_lights->raw.data(); }
-    [[nodiscard]] size_t getLightCount() const noexcept { return m_lightCount; }
-    [[nodiscard]] bool lightsExist() const noexcept { return (m_lightCount > 0); }
+    [[nodiscard]] const light::LightDataObject* getRawLightData() const noexcept { return m_lights.data(); }
+    [[nodiscard]] size_t getLightCount() const noexcept { return m_lights.size(); }
+    [[nodiscard]] bool lightsExist() const noexcept { return !m_lights.empty(); }
+    [[nodiscard]] uint64_t getLightVersion() const noexcept { return m_lightVersion; }  // changes whenever a light does
 
-    [[nodiscard]] const light::LightDataObject* getLight(size_t index) const noexcept { return &m_lights->raw[index]; }
-    [[nodiscard]] const dml::mat4& getLightVP(size_t index) const noexcept { return m_lights->raw[index].viewProj; }
-    [[nodiscard]] const size_t getShadowBatchCount() const noexcept { return (m_lightCount / cfg::LIGHTS_PER_BATCH) + (m_lightCount > 0 ? 1 : 0); }
+    [[nodiscard]] const light::LightDataObject* getLight(size_t index) const noexcept { return &m_lights[index]; }
+    [[nodiscard]] const dml::mat4& getLightVP(size_t index) const noexcept { return m_lights[index].viewProj; }
+    [[nodiscard]] const size_t getShadowBatchCount() const noexcept { return (m_lights.size() / cfg::LIGHTS_PER_BATCH) + (m_lights.empty() ? 0 : 1); }
 
     // buffers
-    [[nodiscard]] const vkh::BufferObj& getVertBuffer() const noexcept { return m_vertBuffer; }
-    [[nodiscard]] const vkh::BufferObj& getIndexBuffer() const noexcept { return m_indBuffer; }
+    [[nodiscard]] const vkh::BufferObj& getPositionBuffer() const noexcept { return m_geometry.position; }
+    [[nodiscard]] const vkh::BufferObj& getAttributeBuffer() const noexcept { return m_geometry.attribute; }
+    [[nodiscard]] const vkh::BufferObj& getIndexBuffer() const noexcept { return m_geometry.index; }
+    [[nodiscard]] VkDeviceSize getIndexSectionOffset(uint32_t list) const noexcept { return m_indexSectionOffsets[list]; }
+    [[nodiscard]] const vkh::BufferObj& getMeshletBuffer() const noexcept { return m_geometry.meshlet; }
     [[nodiscard]] const vkh::BufData& getBufferData(size_t bufferIndex) const noexcept { return m_bufData[bufferIndex]; }
+    [[nodiscard]] size_t getBufferCount() const noexcept { return m_bufData.size(); }
 
     [[nodiscard]] const VkDrawIndexedIndirectCommand* getSceneIndirectCommands() const noexcept { return m_sceneIndirectCommands.data(); }
+    [[nodiscard]] uint64_t getDrawVersion() const noexcept { return m_drawVersion; }  // changes whenever the draws are rebuilt
+    [[nodiscard]] uint32_t getIndirectCommandCount(uint32_t list) const noexcept { return m_indirectCommandCounts[list]; }
+    [[nodiscard]] uint32_t getIndirectCommandOffset(uint32_t list) const noexcept { return (list > 0) ? m_indirectCommandCounts[0] : 0; }
+
+    // meshlet culling
+    [[nodiscard]] const culling::CullObject* getCullObjects() const noexcept { return m_cullObjects.data(); }
+    [[nodiscard]] size_t getMeshletItemCount() const noexcept { return m_meshletItemCount; }
+    [[nodiscard]] size_t getMeshletItemCapacity() const noexcept { return m_meshletItemCapacity; }
+
+    // the most indirect commands the scene can have, one per level of detail of each mesh
+    [[nodiscard]] size_t getIndirectCommandCapacity() const noexcept { return getMeshCount() * meshopt::MAX_LODS; }
+
+    // instance culling, done on the cpu when the meshlets arent culled on the gpu
+    // the visible instances of each view are copied out in the order theyre drawn, after those of the views before it
+    [[nodiscard]] bool cullsInstances() const noexcept { return m_instanceCulling; }
+    [[nodiscard]] uint64_t getCullVersion() const noexcept { return m_cullVersion; }  // changes whenever the instances are culled again
+    [[nodiscard]] const instancing::ObjectInstance* getViewInstances() const noexcept { return m_viewInstances.data(); }
+    [[nodiscard]] size_t getViewInstanceCount() const noexcept { return m_viewInstances.size(); }
+    [[nodiscard]] const VkDrawIndexedIndirectCommand* getViewCommands() const noexcept { return m_viewCommands.data(); }
+    [[nodiscard]] size_t getViewCommandTotal() const noexcept { return m_viewCommands.size(); }
+    [[nodiscard]] uint32_t getViewCommandCount(uint32_t view, uint32_t list) const noexcept { return m_viewCommandCounts[view][list]; }
+    [[nodiscard]] uint32_t getViewCommandOffset(uint32_t view, uint32_t list) const noexcept { return m_viewCommandOffsets[view][list]; }
 
 private:
     struct CamData {
@@ -118,49 +242,179 @@ private:
         }
     };
 
+    // a primitive with its vertex cache stats from before and after optimization
+    struct LoadedPrimitive {
+        dvl::Mesh mesh{};
+        meshopt::CacheStats before{};
+        meshopt::CacheStats after{};
+    };
+
+    // the levels of detail of a unique object, and the bounds they are selected with
+    struct LodChain {
+        dml::vec4 sphere{};  // object space, xyz is the center and w is the radius
+        uint32_t lodOffset = 0;
+        uint32_t lodCount = 0;
+        uint32_t maxMeshletCount = 0;
+    };
+
+    // the instances a loaded model was placed with, relative to where it was placed
+    // more instances of the model are placed from it
+    struct ModelTemplate {
+        dml::mat4 placement{};
+        std::vector<uint32_t> meshIds;
+        std::vector<int32_t> nodes;
+        std::vector<dml::mat4> instanceMatrices;
+    };
+
+    // a parsed model, and the mapped glb its binary chunk is read from
+    struct ParsedModel {
+        std::unique_ptr<tinygltf::Model> model{};
+        glbfile::GlbFile file{};
+    };
+
+    // a model whose primitives are still being loaded
+    struct PendingModel {
+        std::unique_ptr<tinygltf::Model> model{};
+        ModelData data{};
+
+        // the primitives read their accessors from the mapped file
+        // the images hold onto it as well, until theyre decoded
+        std::shared_ptr<const glbfile::GlbFile> file{};
+        std::vector<imagedecode::PendingImage> images;
+
+        uint64_t sourceHash = 0;
+        std::string cachePath{};
+        meshcache::MeshCache cache{};
+
+        // one per primitive, in the order they appear in the model
+        std::vector<std::future<LoadedPrimitive>> primitives;
+        dvl::NodeHierarchy nodes{};
+    };
+
 private:
     // models
     std::vector<std::unique_ptr<tinygltf::Model>> m_models;
+    std::vector<uint64_t> m_modelHashes;  // hash of each model's source file, 0 if unknown
+    std::vector<std::vector<imagedecode::PendingImage>> m_modelImages;
     std::vector<std::string> m_loadedModelFiles;
     std::vector<size_t> m_loadedModelIndices;
-
-    // objects / meshes
-    std::vector<std::unique_ptr<dvl::Mesh>> m_objects;
-    std::vector<std::unique_ptr<dvl::Mesh>> m_originalObjects;
+    std::vector<meshcache::MeshCache> m_meshCaches;
+    std::vector<dvl::NodeHierarchy> m_nodeHierarchies;
+    std::vector<ModelTemplate> m_modelTemplates;
+
+    // meshes, one per unique geometry and material
+    std::vector<dvl::Mesh> m_meshes;
+    std::vector<size_t> m_meshBufferIndices;
+    std::unordered_map<size_t, uint32_t> m_meshHashToMeshIndex;
+    std::unordered_map<size_t, size_t> m_geometryHashToBufferIndex;  // identical meshes share their buffer data, whatever their material
+
+    // objects, each an instance of a mesh
+    instancing::InstanceStore m_instances;
+    std::vector<instancing::ObjectInstance> m_objInstanceData;
+    std::vector<std::vector<uint32_t>> m_meshBuckets;  // the instances of each mesh
+
+    // the draws are only rebuilt when an instance is added, removed or changes level
+    // otherwise only the slots of the instances that moved are written
+    bool m_drawsDirty = true;
+    uint64_t m_drawVersion = 0;
+    std::vector<uint32_t> m_instanceSlots;   // the slot each instance is drawn from
+    std::vector<uint32_t> m_movedInstances;  // into the store, since the draws were last updated
+    std::vector<instancing::SlotRange> m_dirtyInstanceRanges;
+
+    std::vector<instancing::HandleSlot> m_handleSlots;
+    std::vector<uint32_t> m_freeHandles;
 
     int m_followPlayerIndex = -1;
-    size_t m_lightCount = 0;
 
-    vkh::BufferObj m_vertBuffer{};
-    vkh::BufferObj m_indBuffer{};
+    GeometryBuffers m_geometry{};
     std::vector<vkh::BufData> m_bufData;
-    VkDeviceSize m_vertBufferSize = 0;
-    VkDeviceSize m_indBufferSize = 0;
+    size_t m_vertexCount = 0;
+    std::array<size_t, INDEX_TYPES.size()> m_indexCounts{};
+    std::array<VkDeviceSize, INDEX_TYPES.size()> m_indexSectionOffsets{};
+    VkDeviceSize m_meshletBufferSize = 0;
 
     std::vector<VkDrawIndexedIndirectCommand> m_sceneIndirectCommands;
-
-    std::unordered_map<size_t, size_t> m_objectHashToUniqueObjectIndex;
-    std::unordered_map<size_t, size_t> m_objectHashToBufferIndex;
-    std::vector<size_t> m_uniqueObjects;
+    std::array<uint32_t, INDEX_TYPES.size()> m_indirectCommandCounts{};
+    std::vector<culling::CullObject> m_cullObjects;
+    size_t m_meshletItemCount = 0;
+    size_t m_meshletItemCapacity = 0;
+
+    // levels of detail
+    std::vector<LodChain> m_lodChains;  // indexed like m_bufData
+    std::vector<dvl::MeshLod> m_lods;
+    std::vector<uint32_t> m_objectLods;  // the level each object is drawn with
+    std::vector<uint32_t> m_drawOrder;   // the object in each instance slot, with each mesh's instances grouped by level
+    std::vector<std::array<uint32_t, meshopt::MAX_LODS>> m_lodInstanceCounts;  // instances of each mesh at each level
+    std::vector<uint32_t> m_meshFirstInstances;                                 // the first instance slot of each mesh
+    float m_lodPixelScale = 0.0f;  // pixels covered by one unit at a distance of one unit
+
+    // the levels are only selected again once the camera has moved since they last were
+    dml::vec3 m_lodCamPos{};
+    float m_lodCamPixelScale = 0.0f;
+
+    // instance culling, which is only done again once the camera, the lights or the instances have changed
+    bool m_instanceCulling = false;
+    bool m_cullDirty = true;
+    uint64_t m_cullVersion = 0;
+    dml::mat4 m_cullCamViewProj{};
+    uint64_t m_cullLightVersion = UINT64_MAX;
+    frustumcull::Spheres m_cullSpheres;  // the world space bounds of each instance slot
+    std::array<std::vector<uint8_t>, culling::VIEW_COUNT> m_slotVisibility;
+    std::vector<instancing::ObjectInstance> m_viewInstances;
+    std::vector<VkDrawIndexedIndirectCommand> m_viewCommands;
+    std::array<std::array<uint32_t, INDEX_TYPES.size()>, culling::VIEW_COUNT> m_viewCommandCounts{};
+    std::array<std::array<uint32_t, INDEX_TYPES.size()>, culling::VIEW_COUNT> m_viewCommandOffsets{};
 
     CamData m_cam{};
-    std::unique_ptr<light::RawLights> m_lights = std::make_unique<light::RawLights>();
-    std::unique_ptr<texindices::TexIndices> m_texIndices = std::make_unique<texindices::TexIndices>();
-    std::unique_ptr<instancing::ObjectInstanceData> m_objInstanceData = std::make_unique<instancing::ObjectInstanceData>();
+    std::vector<light::LightDataObject> m_lights;
+    uint64_t m_lightVersion = 0;
+    std::vector<texindices::TexIndexObj> m_texIndices;  // indexed like m_meshes
+    uint64_t m_texIndexVersion = 0;
 
     bool m_rtEnabled = false;
     VkDevice m_device{};
     VkhCommandPool m_commandPool{};
     VkQueue m_gQueue{};
 
-private:
-    std::vector<size_t> getObjectIndices(const std::string& filename);
+    // every cull waits for its tasks, so the pool is never left with work
+    threadpool::ThreadPool m_cullPool;
 
-    void loadModel(const tinygltf::Model& gltfModel, const std::string& path, const std::string& fileName, const dml::vec3& scale, const dml::vec4& rot, const dml::vec3& pos, size_t imagesOffset, size_t modelIndex);
+    // images are decoded in the background, and the textures are compressed on the same workers
+    // declared last, so no task can outlive the models or files it reads from
+    threadpool::ThreadPool m_imagePool;
 
+private:
+    [[nodiscard]] size_t findLoadedModel(const std::string& file) const;
+    uint32_t addMesh(dvl::Mesh&& mesh);
+    void addInstance(uint32_t meshId, uint32_t model, int32_t node, const dml::mat4& placement, const dml::mat4& instanceMatrix, uint32_t flags, uint32_t handle);
+    void removeInstance(size_t index);
+    instancing::InstanceHandle placeTemplate(size_t model, const dml::mat4& placement, uint32_t flags);
+    void destroyHandle(uint32_t index);
+
+    static ParsedModel parseModel(const std::string& path);
+    PendingModel loadModel(threadpool::ThreadPool& pool, ParsedModel parsed, const ModelData& data);
+    static LoadedPrimitive loadPrimitive(const tinygltf::Model& model, const dvl::ModelBuffers& buffers, uint32_t meshIndex, size_t primitiveIndex);
+    std::vector<imagedecode::PendingImage> decodeImages(tinygltf::Model& model, const dvl::ModelBuffers& buffers, const std::shared_ptr<const glbfile::GlbFile>& file);
+    LoadedModel completeModel(PendingModel& pending);
+    void placeModel(LoadedModel& loaded, size_t imagesOffset);
+    static void stageGeometry(LoadedModel& loaded);
+
+    void createGeometryBuffers(GeometryBuffers& buffers, size_t vertexCount, VkDeviceSize indexBufferSize, VkDeviceSize meshletBufferSize) const;
+    void addLodChain(size_t bufferIndex, const dvl::Mesh& mesh, vkh::BufData& bufferData);
+
+    void updateNodes();
     void calcLightData() noexcept;
+    static void calcLightViewProj(light::LightDataObject& data) noexcept;
     void calcCameraMats(float up, float right, uint32_t swapWidth, uint32_t swapHeight) noexcept;
+    void updateDraws();
+    void selectLods();
     void calcObjectInstanceData() noexcept;
+    void updateMovedInstances() noexcept;
     void populateIndirectCommands();
+    void populateCullObjects();
+    void calcCullSphere(uint32_t slot, uint32_t objectIndex) noexcept;
+    void cullInstances();
+
+    static dml::vec4 calcBoundingSphere(std::span<const dvl::Vertex> vertices) noexcept;
 };
 }  // namespace scene
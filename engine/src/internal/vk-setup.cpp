@@ -1,14 +1,19 @@
 #include "vk-setup.hpp"
 
+#include <set>
 #include <string>
+#include <vector>
 
 #include "config.hpp"
 #include "libraries/utils.hpp"
 
 namespace setup {
 core::VkCore VkSetup::init(GLFWwindow* window) {
+    // without a window the engine renders offscreen, so no surface is needed
+    m_headless = (window == nullptr);
+
     createInstance();
-    createSurface(window);
+    if (!m_headless) createSurface(window);
     pickPhysicalDevice();
     getPhysicalDeviceProperties();
     createDevice();
@@ -92,12 +97,17 @@ void VkSetup::createInstance() {
     instanceInfo.engineVersion = VK_MAKE_VERSION(0, 1, 0);
     instanceInfo.apiVersion = VK_API_VERSION_1_3;
 
+    std::vector<const char*> extensions;
+
     // get glfw extensions
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    if (!m_headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+
+        extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+    }
 
-    extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
     extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
     const std::vector<const char*> validationLayers = {"VK_LAYER_KHRONOS_validation"};
@@ -168,6 +178,14 @@ void VkSetup::pickPhysicalDevice() {
     // check if ray tracing is supported
     m_rtSupported = isRTSupported();
 
+    // needed to draw the meshlets that pass gpu culling
+    m_drawIndirectCountSupported = isSupported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+    // mesh textures are uploaded as bc7 and bc5 when they can be sampled
+    VkPhysicalDeviceFeatures deviceFeatures;
+    vkGetPhysicalDeviceFeatures(m_vulkanCore.physicalDevice, &deviceFeatures);
+    m_textureCompressionBCSupported = (deviceFeatures.textureCompressionBC == VK_TRUE);
+
     utils::sep();
     std::cout << "Raytacing is " << (m_rtSupported ? "supported" : "not supported") << " on this device!\n";
 }
@@ -222,6 +240,7 @@ void VkSetup::createDevice() {
     descIndexing.runtimeDescriptorArray = VK_TRUE;
     descIndexing.descriptorBindingVariableDescriptorCount = VK_TRUE;
     descIndexing.descriptorBindingPartiallyBound = VK_TRUE;
+    descIndexing.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
 
     if (m_rtSupported) {
         descIndexing.pNext = &rtFeatures;
@@ -229,28 +248,35 @@ void VkSetup::createDevice() {
         descIndexing.pNext = &bufferDeviceAddressFeatures;
     }
 
+    // a queue from each family that's used, the transfer family can be seperate from the rest
+    std::set<uint32_t> queueFamilies = {m_queueFamilyIndices.graphicsFamily.value(), m_queueFamilyIndices.presentFamily.value(), m_queueFamilyIndices.computeFamily.value(), m_queueFamilyIndices.transferFamily.value()};
+
     float queuePriority = 1.0f;
-    VkDeviceQueueCreateInfo queueInfo{};
-    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueInfo.queueFamilyIndex = m_queueFamilyIndices.graphicsFamily.value();
-    queueInfo.queueCount = 1;
-    queueInfo.pQueuePriorities = &queuePriority;
+    std::vector<VkDeviceQueueCreateInfo> queueInfos;
+    for (uint32_t family : queueFamilies) {
+        VkDeviceQueueCreateInfo queueInfo{};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = family;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &queuePriority;
+        queueInfos.push_back(queueInfo);
+    }
 
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.imageCubeArray = VK_TRUE;
     deviceFeatures.sampleRateShading = VK_TRUE;
     deviceFeatures.shaderInt64 = VK_TRUE;
     deviceFeatures.multiDrawIndirect = VK_TRUE;
+    deviceFeatures.textureCompressionBC = m_textureCompressionBCSupported ? VK_TRUE : VK_FALSE;
 
     VkDeviceCreateInfo newInfo{};
     newInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     newInfo.pNext = &descIndexing;  // add the indexing features to the pNext chain
-    newInfo.pQueueCreateInfos = &queueInfo;
-    newInfo.queueCreateInfoCount = 1;
+    newInfo.pQueueCreateInfos = queueInfos.data();
+    newInfo.queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size());
     newInfo.pEnabledFeatures = &deviceFeatures;  // device features to enable
 
     std::vector<const char*> deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         VK_KHR_MAINTENANCE3_EXTENSION_NAME,
         VK_KHR_MULTIVIEW_EXTENSION_NAME,
         VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME,
@@ -258,6 +284,14 @@ void VkSetup::createDevice() {
         VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
     };
 
+    if (!m_headless) {
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    if (m_drawIndirectCountSupported) {
+        deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+
     if (m_rtSupported) {
         deviceExtensions.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
         deviceExtensions.push_back(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
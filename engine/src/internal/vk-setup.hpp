@@ -23,7 +23,11 @@ public:
     [[nodiscard]] uint32_t getMaxMultiViewCount() const noexcept { return m_maxMultiViewCount; }
 
     [[nodiscard]] uint32_t getGraphicsFamily() const { return m_queueFamilyIndices.graphicsFamily.value(); }
+    [[nodiscard]] uint32_t getTransferFamily() const { return m_queueFamilyIndices.transferFamily.value(); }
     [[nodiscard]] bool isRaytracingSupported() const noexcept { return m_rtSupported; }
+    [[nodiscard]] bool isDrawIndirectCountSupported() const noexcept { return m_drawIndirectCountSupported; }
+    [[nodiscard]] bool isTextureCompressionBCSupported() const noexcept { return m_textureCompressionBCSupported; }
+    [[nodiscard]] bool isHeadless() const noexcept { return m_headless; }
 
     [[nodiscard]] VkQueue gQueue() const noexcept { return m_graphicsQueue; }
     [[nodiscard]] VkQueue pQueue() const noexcept { return m_presentQueue; }
@@ -45,6 +49,9 @@ private:
     vkh::QueueFamilyIndices m_queueFamilyIndices;
 
     bool m_rtSupported = false;
+    bool m_drawIndirectCountSupported = false;
+    bool m_textureCompressionBCSupported = false;
+    bool m_headless = false;
 
 private:
     // helper
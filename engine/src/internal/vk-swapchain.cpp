@@ -78,6 +78,31 @@ void VkSwapChain::createSwap(core::VkCore& core, uint32_t graphicsFamily) {
         }
     }
 
+    createViewport();
+}
+
+void VkSwapChain::createOffscreen(uint32_t imageCount) {
+    m_headless = true;
+    m_extent = {cfg::SCREEN_WIDTH, cfg::SCREEN_HEIGHT};
+    m_imageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    m_imageCount = imageCount;
+
+    // one image per frame in flight, so the frame fence also guards the image
+    m_offscreenImages.clear();
+    m_offscreenImages.resize(m_imageCount);
+    m_imageViews.clear();
+    m_imageViews.resize(m_imageCount);
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    for (size_t i = 0; i < m_imageCount; i++) {
+        vkh::createSwapTexture(m_offscreenImages[i], m_imageFormat, usage, m_extent.width, m_extent.height);
+        m_imageViews[i] = m_offscreenImages[i].imageView;
+    }
+
+    createViewport();
+}
+
+void VkSwapChain::createViewport() {
     // create the viewport for the swap chain
     m_viewport.x = 0.0f;
     m_viewport.y = 0.0f;
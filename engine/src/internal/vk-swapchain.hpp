@@ -18,7 +18,11 @@ public:
     VkSwapChain& operator=(VkSwapChain&&) = delete;
 
     void createSwap(core::VkCore& core, uint32_t graphicsFamily);
-    void reset() { m_swapChain.reset(); }
+    void createOffscreen(uint32_t imageCount);
+    void reset() {
+        m_swapChain.reset();
+        m_offscreenImages.clear();
+    }
 
     // getters
     [[nodiscard]] VkFormat getFormat() const noexcept { return m_imageFormat; }
@@ -37,17 +41,27 @@ public:
     [[nodiscard]] uint32_t getImageIndex() const noexcept { return m_imageIndex; }
     [[nodiscard]] uint32_t* getImageIndexP() noexcept { return &m_imageIndex; }
 
+    [[nodiscard]] bool isHeadless() const noexcept { return m_headless; }
+    [[nodiscard]] const vkh::Texture& getOffscreenImage(size_t index) const noexcept { return m_offscreenImages[index]; }
+
 private:
     VkhSwapchainKHR m_swapChain{};
 
     std::vector<VkImage> m_images;
     std::vector<VkhImageView> m_imageViews;
 
+    // headless render targets that replace the swapchain images
+    std::vector<vkh::Texture> m_offscreenImages;
+
     VkFormat m_imageFormat = VK_FORMAT_UNDEFINED;
     VkViewport m_viewport{};
     VkExtent2D m_extent{};
 
     uint32_t m_imageCount = 0;
     uint32_t m_imageIndex = 0;
+    bool m_headless = false;
+
+private:
+    void createViewport();
 };
 }  // namespace swapchain
@@ -1,12 +1,32 @@
 #include "vk-textures.hpp"
 
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+
+#include "config.hpp"
+#include "libraries/cubemap.hpp"
 #include "libraries/dvl.hpp"
+#include "libraries/packfile.hpp"
 #include "libraries/utils.hpp"
 #include "libraries/vkhelper.hpp"
 #include "stb_image.h"
+#include "structures/culling.hpp"
 
 namespace textures {
-void VkTextures::init(uint32_t maxFrames, VkhCommandPool commandPool, VkQueue gQueue, const swapchain::VkSwapChain* swap, scene::VkScene* scene) {
+namespace {
+// key/value entry of the texture cache, since opacity cant be found without decoding the blocks
+constexpr std::string_view OPAQUE_KEY = "VisageOpaque";
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+}  // namespace
+
+void VkTextures::init(uint32_t maxFrames, bool compressTextures, bool depthPyramid, VkhCommandPool commandPool, VkQueue gQueue, const swapchain::VkSwapChain* swap, scene::VkScene* scene) {
+    m_compressTextures = compressTextures;
+    m_createDepthPyramid = depthPyramid;
     m_commandPool = commandPool;
     m_gQueue = gQueue;
 
@@ -43,6 +63,8 @@ void VkTextures::createRenderTextures(bool rtEnabled, bool createShadow) {
 
             createDeferredTextures(i);
         }
+
+        if (m_createDepthPyramid) createDepthPyramid();
     }
 }
 
@@ -53,24 +75,165 @@ void VkTextures::loadMeshTextures() {
 
     auto now = utils::now();
 
-    // load the raw image data of each model
     size_t totalImages = 0;
     size_t totalTextures = 0;
 
+    std::vector<size_t> modelIndices(modelSize);
     for (size_t i = 0; i < modelSize; i++) {
-        size_t modelIndex = m_scene->getModelIndex(i);
-        const tinygltf::Model* model = m_scene->getModel(modelIndex);
+        modelIndices[i] = m_scene->getModelIndex(i);
+        const tinygltf::Model* model = m_scene->getModel(modelIndices[i]);
 
         totalImages += model->images.size();
         totalTextures += model->textures.size();
+    }
 
-        loadModelTextures(model);
+    if (m_compressTextures) {
+        // every model's images are queued first, so the workers keep compressing while earlier models upload
+        // the compression tasks wait on decodes, which is safe since every decode was queued before them
+        threadpool::ThreadPool& pool = m_scene->getImagePool();
+        std::vector<std::vector<std::future<CompressedTexture>>> images(modelSize);
+
+        for (size_t i = 0; i < modelSize; i++) {
+            size_t modelIndex = modelIndices[i];
+            images[i] = compressModelImages(pool, m_scene->getModel(modelIndex), m_scene->getModelHash(modelIndex), m_scene->getModelImages(modelIndex));
+        }
+
+        for (size_t i = 0; i < modelSize; i++) {
+            createCompressedTextures(m_scene->getModel(modelIndices[i]), images[i]);
+        }
+    } else {
+        for (size_t modelIndex : modelIndices) {
+            loadModelTextures(m_scene->getModel(modelIndex), m_scene->getModelImages(modelIndex));
+        }
     }
 
+    m_scene->releaseModelImages();
+
     std::cout << "- Finished loading " << totalTextures << " textures, and " << totalImages << " images in: " << utils::durationString(utils::duration<milliseconds>(now)) << "\n";
     utils::sep();
 }
 
+StagedTextures VkTextures::stageModelTextures(const tinygltf::Model* model, uint64_t modelHash, const std::vector<imagedecode::PendingImage>& images) {
+    StagedTextures staged{};
+    if (model->textures.empty()) return staged;
+
+    // the levels of each image, uncompressed images only have their full size level
+    std::vector<CompressedTexture> sources(model->images.size());
+
+    if (m_compressTextures) {
+        std::vector<std::future<CompressedTexture>> compressed = compressModelImages(m_scene->getImagePool(), model, modelHash, images);
+        for (size_t i = 0; i < compressed.size(); i++) {
+            if (compressed[i].valid()) sources[i] = compressed[i].get();
+        }
+    } else {
+        std::vector<vkh::TextureType> imageTypes = getImageTypes(model);
+
+        for (const tinygltf::Texture& texture : model->textures) {
+            CompressedTexture& source = sources[texture.source];
+            if (!source.levels.empty()) continue;
+
+            const imagedecode::DecodedImage& image = images[texture.source].get();
+            source.type = imageTypes[texture.source];
+            source.width = image.width;
+            source.height = image.height;
+
+            for (size_t j = 0; j < image.size(); j += 4) {
+                if (image.pixels.get()[j + 3] < 255) {
+                    source.opaque = false;
+                    break;
+                }
+            }
+
+            source.levels.emplace_back(image.pixels.get(), image.size());
+        }
+    }
+
+    VkDeviceSize stagingSize = 0;
+    for (const tinygltf::Texture& texture : model->textures) {
+        for (std::span<const uint8_t> level : sources[texture.source].levels) {
+            stagingSize = alignUp(stagingSize, texcompress::BLOCK_BYTES) + level.size();
+        }
+    }
+
+    vkh::createHostVisibleBuffer(staged.stagingBuffer, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+    VkDevice device = VkSingleton::v().gdevice();
+    uint8_t* stagingData = nullptr;
+    vkMapMemory(device, staged.stagingBuffer.mem.v(), 0, stagingSize, 0, reinterpret_cast<void**>(&stagingData));
+
+    VkDeviceSize offset = 0;
+    for (const tinygltf::Texture& texture : model->textures) {
+        const CompressedTexture& source = sources[texture.source];
+
+        StagedTexture& stagedTex = staged.textures.emplace_back();
+        stagedTex.type = source.type;
+        stagedTex.generateMips = !m_compressTextures;
+
+        vkh::Texture& tex = stagedTex.tex;
+        tex.width = source.width;
+        tex.height = source.height;
+        tex.fullyOpaque = source.opaque;
+
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        if (stagedTex.generateMips) {
+            tex.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(tex.width, tex.height)))) + 1;
+            usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        } else {
+            tex.mipLevels = static_cast<uint32_t>(source.levels.size());
+        }
+
+        vkh::createTexture(tex, source.type, usage, tex.width, tex.height);
+
+        for (uint32_t i = 0; i < source.levels.size(); i++) {
+            std::span<const uint8_t> level = source.levels[i];
+
+            offset = alignUp(offset, texcompress::BLOCK_BYTES);
+            std::memcpy(stagingData + offset, level.data(), level.size());
+
+            VkBufferImageCopy& region = stagedTex.regions.emplace_back();
+            region.bufferOffset = offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = i;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = {std::max(tex.width >> i, 1u), std::max(tex.height >> i, 1u), 1};
+
+            offset += level.size();
+        }
+    }
+
+    vkUnmapMemory(device, staged.stagingBuffer.mem.v());
+    return staged;
+}
+
+void VkTextures::recordTextureUpload(uploads::VkUploads& uploads, uploads::Batch& batch, const StagedTextures& staged) const {
+    if (staged.textures.empty()) return;
+
+    for (const StagedTexture& stagedTex : staged.textures) {
+        const vkh::Texture& tex = stagedTex.tex;
+
+        // the levels are copied on the transfer queue
+        vkh::transitionImageLayout(batch.transferCommandBuffer, tex, stagedTex.type, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        vkCmdCopyBufferToImage(batch.transferCommandBuffer.v(), staged.stagingBuffer.buf.v(), tex.image.v(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(stagedTex.regions.size()), stagedTex.regions.data());
+        uploads.releaseImage(batch, tex, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+        // blits need a graphics queue, so the mipmaps are generated once the copy is done
+        if (stagedTex.generateMips) {
+            generateMipmaps(batch.graphicsCommandBuffer, tex, stagedTex.type);
+        } else {
+            vkh::transitionImageLayout(batch.graphicsCommandBuffer, tex, stagedTex.type, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
+
+    batch.stagingBuffers.push_back(staged.stagingBuffer);
+}
+
+void VkTextures::addTextures(const StagedTextures& staged) {
+    for (const StagedTexture& stagedTex : staged.textures) {
+        m_meshTextures.push_back(stagedTex.tex);
+    }
+}
+
 void VkTextures::createNewShadowBatch() {
     for (uint32_t i = 0; i < m_maxFrames; i++) {
         vkh::Texture shadowMap{};
@@ -85,13 +248,18 @@ void VkTextures::resetShadowTextures() {
     m_shadow.clear();
 }
 
-void VkTextures::loadModelTextures(const tinygltf::Model* model) {
+std::vector<vkh::TextureType> VkTextures::getImageTypes(const tinygltf::Model* model) const {
     std::vector<bool> imagesSRGB(model->images.size());
 
+    // normal maps are only stored as bc5 if the image isnt used for anything else
+    std::vector<bool> normalMaps(model->images.size());
+    std::vector<bool> otherMaps(model->images.size());
+
     for (const auto& material : model->materials) {
         if (material.pbrMetallicRoughness.baseColorTexture.index >= 0) {
             int index = model->textures[material.pbrMetallicRoughness.baseColorTexture.index].source;
             imagesSRGB[index] = true;
+            otherMaps[index] = true;
         } else {
             utils::logWarning("Material: " + material.name + " doesnt have an albedo texture!");
         }
@@ -99,6 +267,7 @@ void VkTextures::loadModelTextures(const tinygltf::Model* model) {
         if (material.pbrMetallicRoughness.metallicRoughnessTexture.index >= 0) {
             int index = model->textures[material.pbrMetallicRoughness.metallicRoughnessTexture.index].source;
             imagesSRGB[index] = false;
+            otherMaps[index] = true;
         } else {
             utils::logWarning("Material: " + material.name + " doesnt have a metallic roughness texture!");
         }
@@ -106,6 +275,7 @@ void VkTextures::loadModelTextures(const tinygltf::Model* model) {
         if (material.normalTexture.index >= 0) {
             int index = model->textures[material.normalTexture.index].source;
             imagesSRGB[index] = false;
+            normalMaps[index] = true;
         } else {
             utils::logWarning("Material: " + material.name + " doesnt have a normal map!");
         }
@@ -113,50 +283,208 @@ void VkTextures::loadModelTextures(const tinygltf::Model* model) {
         if (material.emissiveTexture.index >= 0) {
             int index = model->textures[material.emissiveTexture.index].source;
             imagesSRGB[index] = true;
+            otherMaps[index] = true;
         }
 
         if (material.occlusionTexture.index >= 0) {
             int index = model->textures[material.occlusionTexture.index].source;
             imagesSRGB[index] = false;
+            otherMaps[index] = true;
         }
     }
 
+    std::vector<vkh::TextureType> types(model->images.size());
+    for (size_t i = 0; i < types.size(); i++) {
+        if (!m_compressTextures) {
+            types[i] = imagesSRGB[i] ? vkh::SRGB : vkh::UNORM;
+        } else if (normalMaps[i] && !otherMaps[i]) {
+            types[i] = vkh::BC5;
+        } else {
+            types[i] = imagesSRGB[i] ? vkh::BC7_SRGB : vkh::BC7_UNORM;
+        }
+    }
+
+    return types;
+}
+
+void VkTextures::loadModelTextures(const tinygltf::Model* model, const std::vector<imagedecode::PendingImage>& images) {
+    std::vector<vkh::TextureType> imageTypes = getImageTypes(model);
+
     for (size_t i = 0; i < model->textures.size(); i++) {
         int imageIndex = model->textures[i].source;
-        const tinygltf::Image& image = model->images[imageIndex];
 
-        // only images with 4 channels are supported
-        int channels = image.component;
-        if (channels != 4) {
-            throw std::runtime_error("Unsupported number of channels in image!");
-        }
+        // waits for the image if it's still being decoded
+        const imagedecode::DecodedImage& image = images[imageIndex].get();
 
         // check if the image is fully opaque or not
         bool opaque = true;
-        for (size_t j = 0; j < image.image.size(); j += 4) {
-            if (image.image[j + 3] < 255) {
+        for (size_t j = 0; j < image.size(); j += 4) {
+            if (image.pixels.get()[j + 3] < 255) {
                 opaque = false;
                 break;
             }
         }
 
         MeshTexture meshTexture{};
-        meshTexture.imageData = std::move(image.image);
-        meshTexture.type = (imagesSRGB[imageIndex]) ? vkh::SRGB : vkh::UNORM;
+        meshTexture.imageData = image.pixels.get();
+        meshTexture.type = imageTypes[imageIndex];
 
         createMeshTexture(meshTexture, image.width, image.height, opaque);
     }
 }
 
-void VkTextures::createImageStagingBuffer(vkh::Texture& tex, const unsigned char* imgData) {
-    size_t bpp = 4;
-    VkDeviceSize imageSize = static_cast<VkDeviceSize>(tex.width) * tex.height * bpp;
+std::vector<std::future<VkTextures::CompressedTexture>> VkTextures::compressModelImages(threadpool::ThreadPool& pool, const tinygltf::Model* model, uint64_t modelHash, const std::vector<imagedecode::PendingImage>& pendingImages) {
+    std::vector<vkh::TextureType> imageTypes = getImageTypes(model);
+    std::vector<std::future<CompressedTexture>> images(model->images.size());
 
-    vkh::createAndWriteHostBuffer(tex.stagingBuffer, imgData, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    for (const tinygltf::Texture& texture : model->textures) {
+        int imageIndex = texture.source;
+        if (images[imageIndex].valid()) continue;
+
+        // the cache is keyed by the source file, so it can only be used if the file was hashed
+        std::string cachePath;
+        if (modelHash != 0) {
+            std::ostringstream cacheName;
+            cacheName << std::hex << std::setw(16) << std::setfill('0') << modelHash << std::dec << "-" << imageIndex;
+            cachePath = cfg::CACHE_DIR + cacheName.str() + ".ktx2";
+        }
+
+        imagedecode::PendingImage image = pendingImages[imageIndex];
+        vkh::TextureType type = imageTypes[imageIndex];
+
+        images[imageIndex] = pool.submit([image, type, cachePath]() { return compressImage(image, type, cachePath); });
+    }
+
+    return images;
+}
+
+VkTextures::CompressedTexture VkTextures::compressImage(const imagedecode::PendingImage& pending, vkh::TextureType type, const std::string& cachePath) {
+    CompressedTexture tex{};
+    tex.type = type;
+
+    // the size is read from the image header, so the cache can be checked without decoding
+    tex.width = pending.getWidth();
+    tex.height = pending.getHeight();
+
+    VkFormat format = vkh::getTextureFormat(type);
+    uint32_t levelCount = texcompress::getMipLevelCount(tex.width, tex.height);
+
+    // use the cached mip chain if it matches the image
+    if (!cachePath.empty() && tex.file.open(cachePath)) {
+        bool valid = tex.file.getFormat() == format && tex.file.getFaceCount() == 1 && tex.file.getWidth() == tex.width && tex.file.getHeight() == tex.height && tex.file.getLevelCount() == levelCount;
+
+        for (uint32_t i = 0; i < levelCount && valid; i++) {
+            size_t levelSize = texcompress::getLevelSize(std::max(tex.width >> i, 1u), std::max(tex.height >> i, 1u));
+            valid = (tex.file.getLevel(i).size() == levelSize);
+        }
+
+        if (valid) {
+            pending.cancel();
+            tex.opaque = (tex.file.getValue(OPAQUE_KEY) == "true");
+            for (uint32_t i = 0; i < levelCount; i++) tex.levels.push_back(tex.file.getLevel(i));
+
+            return tex;
+        }
+
+        tex.file = ktxfile::KtxFile{};
+    }
+
+    const imagedecode::DecodedImage& image = pending.get();
+
+    // check if the image is fully opaque or not
+    for (size_t j = 0; j < image.size(); j += 4) {
+        if (image.pixels.get()[j + 3] < 255) {
+            tex.opaque = false;
+            break;
+        }
+    }
+
+    texcompress::Format compressedFormat = texcompress::Format::BC7_UNORM;
+    if (type == vkh::BC7_SRGB) compressedFormat = texcompress::Format::BC7_SRGB;
+    if (type == vkh::BC5) compressedFormat = texcompress::Format::BC5;
+
+    tex.image = texcompress::compress(image.pixels.get(), tex.width, tex.height, compressedFormat);
+    for (const texcompress::Level& level : tex.image.levels) {
+        tex.levels.emplace_back(tex.image.data.data() + level.offset, level.size);
+    }
+
+    if (!cachePath.empty()) {
+        ktxfile::write(cachePath, format, tex.width, tex.height, 1, tex.levels, {{std::string(OPAQUE_KEY), tex.opaque ? "true" : "false"}});
+    }
+
+    return tex;
 }
 
-void VkTextures::createImageStagingBufferHDR(vkh::Texture& tex, const float* imgData) {
-    size_t bpp = 16;
+void VkTextures::createCompressedTextures(const tinygltf::Model* model, std::vector<std::future<CompressedTexture>>& images) {
+    if (model->textures.empty()) return;
+
+    std::vector<CompressedTexture> compressed(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        if (images[i].valid()) compressed[i] = images[i].get();
+    }
+
+    // every level of every texture is staged in a single buffer
+    VkDeviceSize stagingSize = 0;
+    for (const tinygltf::Texture& texture : model->textures) {
+        for (std::span<const uint8_t> level : compressed[texture.source].levels) {
+            stagingSize = alignUp(stagingSize, texcompress::BLOCK_BYTES) + level.size();
+        }
+    }
+
+    vkh::BufferObj stagingBuffer{};
+    vkh::createHostVisibleBuffer(stagingBuffer, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+    VkDevice device = VkSingleton::v().gdevice();
+    uint8_t* stagingData = nullptr;
+    vkMapMemory(device, stagingBuffer.mem.v(), 0, stagingSize, 0, reinterpret_cast<void**>(&stagingData));
+
+    // the precompressed levels are copied directly, so the whole model is uploaded with one submit
+    VkhCommandBuffer tempBuffer = vkh::beginSingleTimeCommands(m_commandPool);
+    VkDeviceSize offset = 0;
+
+    for (const tinygltf::Texture& texture : model->textures) {
+        const CompressedTexture& image = compressed[texture.source];
+
+        vkh::Texture tex{};
+        tex.width = image.width;
+        tex.height = image.height;
+        tex.fullyOpaque = image.opaque;
+        tex.mipLevels = static_cast<uint32_t>(image.levels.size());
+
+        vkh::createTexture(tex, image.type, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, tex.width, tex.height);
+
+        std::vector<VkBufferImageCopy> regions(tex.mipLevels);
+        for (uint32_t i = 0; i < tex.mipLevels; i++) {
+            std::span<const uint8_t> level = image.levels[i];
+
+            // buffer offsets have to be a multiple of the block size
+            offset = alignUp(offset, texcompress::BLOCK_BYTES);
+            std::memcpy(stagingData + offset, level.data(), level.size());
+
+            VkBufferImageCopy& region = regions[i];
+            region.bufferOffset = offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = i;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = {std::max(tex.width >> i, 1u), std::max(tex.height >> i, 1u), 1};
+
+            offset += level.size();
+        }
+
+        vkh::transitionImageLayout(tempBuffer, tex, image.type, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        vkCmdCopyBufferToImage(tempBuffer.v(), stagingBuffer.buf.v(), tex.image.v(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+        vkh::transitionImageLayout(tempBuffer, tex, image.type, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        m_meshTextures.push_back(tex);
+    }
+
+    vkUnmapMemory(device, stagingBuffer.mem.v());
+    vkh::endSingleTimeCommands(tempBuffer, m_commandPool, m_gQueue);
+}
+
+void VkTextures::createImageStagingBuffer(vkh::Texture& tex, const unsigned char* imgData) {
+    size_t bpp = 4;
     VkDeviceSize imageSize = static_cast<VkDeviceSize>(tex.width) * tex.height * bpp;
 
     vkh::createAndWriteHostBuffer(tex.stagingBuffer, imgData, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
@@ -169,7 +497,7 @@ void VkTextures::createMeshTexture(const MeshTexture& meshTexture, uint32_t widt
     tex.fullyOpaque = opaque;
     tex.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(tex.width, tex.height)))) + 1;
 
-    createImageStagingBuffer(tex, meshTexture.imageData.data());
+    createImageStagingBuffer(tex, meshTexture.imageData);
 
     VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
@@ -192,12 +520,20 @@ void VkTextures::createMeshTexture(const MeshTexture& meshTexture, uint32_t widt
     vkh::transitionImageLayout(tempBuffer, tex, meshTexture.type, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
     vkCmdCopyBufferToImage(tempBuffer.v(), tex.stagingBuffer.buf.v(), tex.image.v(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
+    generateMipmaps(tempBuffer, tex, meshTexture.type);
+
+    vkh::endSingleTimeCommands(tempBuffer, m_commandPool, m_gQueue);
+
+    m_meshTextures.push_back(tex);
+}
+
+void VkTextures::generateMipmaps(const VkhCommandBuffer& commandBuffer, const vkh::Texture& tex, vkh::TextureType type) {
     int mipWidth = tex.width;
     int mipHeight = tex.height;
 
     // create mipmaps for the image if enabled
     for (uint32_t j = 0; j < tex.mipLevels; j++) {
-        vkh::transitionImageLayout(tempBuffer, tex, meshTexture.type, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 1, j);
+        vkh::transitionImageLayout(commandBuffer, tex, type, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 1, j);
 
         // if the cutrrent mip level isnt the last, blit the image to generate the next mip level
         // bliting is the process of transfering the image data from one image to another usually with a form of scaling or filtering
@@ -218,40 +554,30 @@ void VkTextures::createMeshTexture(const MeshTexture& meshTexture, uint32_t widt
             blit.dstSubresource.mipLevel = j + 1;
             blit.dstSubresource.baseArrayLayer = 0;
             blit.dstSubresource.layerCount = 1;
-            vkCmdBlitImage(tempBuffer.v(), tex.image.v(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, tex.image.v(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+            vkCmdBlitImage(commandBuffer.v(), tex.image.v(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, tex.image.v(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
         }
 
-        vkh::transitionImageLayout(tempBuffer, tex, meshTexture.type, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, j);
+        vkh::transitionImageLayout(commandBuffer, tex, type, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, j);
 
         // for the next mip level, divide the width and height by 2, unless theyre already 1
         if (mipWidth > 1) mipWidth /= 2;
         if (mipHeight > 1) mipHeight /= 2;
     }
-
-    vkh::endSingleTimeCommands(tempBuffer, m_commandPool, m_gQueue);
-
-    m_meshTextures.push_back(tex);
 }
 
 void VkTextures::getImageData(const std::string& path, vkh::Texture& t, unsigned char*& imgData) {
-    int texWidth, texHeight, texChannels;
-    imgData = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, 4);
-    t.width = texWidth;
-    t.height = texHeight;
-    if (imgData == nullptr) {
-        std::string error = stbi_failure_reason();
-        throw std::runtime_error("failed to load LDR image: " + path + "! Reason: " + error);
+    mappedfile::MappedFile file;
+    if (!packfile::openMapped(file, path)) {
+        throw std::runtime_error("failed to open LDR image: " + path + "!");
     }
-}
 
-void VkTextures::getImageDataHDR(const std::string& path, vkh::Texture& t, float*& imgData) {
     int texWidth, texHeight, texChannels;
-    imgData = stbi_loadf(path.c_str(), &texWidth, &texHeight, &texChannels, 4);
+    imgData = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &texWidth, &texHeight, &texChannels, 4);
     t.width = texWidth;
     t.height = texHeight;
     if (imgData == nullptr) {
         std::string error = stbi_failure_reason();
-        throw std::runtime_error("failed to load HDR image: " + path + "! Reason: " + error);
+        throw std::runtime_error("failed to load LDR image: " + path + "! Reason: " + error);
     }
 }
 
@@ -289,56 +615,111 @@ void VkTextures::createTextureFromFile(vkh::Texture& tex, const std::string& pat
 }
 
 void VkTextures::createCubemapTextureFromFile(vkh::Texture& tex, const std::string& path) {
-    tex.arrayLayers = 6;
+    mappedfile::MappedFile file;
+    if (!packfile::openMapped(file, path)) {
+        throw std::runtime_error("failed to open HDR image: " + path + "!");
+    }
+
+    // the cache is keyed by the source file, so a changed skybox is converted again
+    std::ostringstream cacheName;
+    cacheName << std::hex << std::setw(16) << std::setfill('0') << utils::hashBytes(file.data(), file.size());
+    std::string cachePath = cfg::CACHE_DIR + cacheName.str() + "-sky.ktx2";
 
-    float* imageData = nullptr;
-    getImageDataHDR(path, tex, imageData);
+    VkFormat format = vkh::getTextureFormat(vkh::CUBEMAP);
+    std::vector<std::span<const uint8_t>> levels;
 
-    createImageStagingBufferHDR(tex, imageData);
+    ktxfile::KtxFile cache;
+    if (cache.open(cachePath)) {
+        uint32_t faceSize = cache.getWidth();
+        bool valid = cache.getFormat() == format && cache.getFaceCount() == cubemap::FACE_COUNT && cache.getHeight() == faceSize && cache.getLevelCount() == cubemap::getMipLevelCount(faceSize);
 
-    // calculate the size of one face of the cubemap
-    uint32_t faceWidth = tex.width / 4;
-    uint32_t faceHeight = tex.height / 3;
-    size_t bpp = 16;
+        for (uint32_t i = 0; i < cache.getLevelCount() && valid; i++) {
+            valid = (cache.getLevel(i).size() == cubemap::getLevelSize(std::max(faceSize >> i, 1u)));
+        }
 
-    // ensure the atlas dimensions are valid for a horizontal cross layout
-    if (faceHeight != faceWidth) {
-        throw std::runtime_error("Cubemap atlas dimensions are invalid!!");
+        if (valid) {
+            tex.width = faceSize;
+            tex.height = faceSize;
+            for (uint32_t i = 0; i < cache.getLevelCount(); i++) levels.push_back(cache.getLevel(i));
+        }
     }
 
-    vkh::createTexture(tex, vkh::CUBEMAP, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, faceWidth, faceHeight);
+    // decode and convert the atlas, this only happens the first time a skybox is loaded
+    cubemap::Cubemap converted{};
+    if (levels.empty()) {
+        int width, height, channels;
+        float* imageData = stbi_loadf_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &channels, 4);
+        if (imageData == nullptr) {
+            std::string error = stbi_failure_reason();
+            throw std::runtime_error("failed to load HDR image: " + path + "! Reason: " + error);
+        }
 
-    VkhCommandBuffer tempBuffer = vkh::beginSingleTimeCommands(m_commandPool);
-    vkh::transitionImageLayout(tempBuffer, tex, vkh::CUBEMAP, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        tex.width = static_cast<uint32_t>(width);
+        tex.height = static_cast<uint32_t>(height);
 
-    std::array<VkBufferImageCopy, 6> regions;
-    std::array<std::pair<uint32_t, uint32_t>, 6> faceOffsets = {{{2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {3, 1}}};
+        // ensure the atlas dimensions are valid for a horizontal cross layout
+        if (!cubemap::isValidCross(tex.width, tex.height)) {
+            stbi_image_free(imageData);
+            throw std::runtime_error("Cubemap atlas dimensions are invalid!!");
+        }
 
-    for (uint32_t i = 0; i < regions.size(); i++) {
-        VkBufferImageCopy& region = regions[i];
+        converted = cubemap::fromCross(imageData, tex.width, tex.height);
+        stbi_image_free(imageData);
 
-        uint32_t offsetX = faceOffsets[i].first * faceWidth;
-        uint32_t offsetY = faceOffsets[i].second * faceHeight;
+        tex.width = converted.faceSize;
+        tex.height = converted.faceSize;
+        for (const cubemap::Level& level : converted.levels) {
+            levels.emplace_back(converted.data.data() + level.offset, level.size);
+        }
 
-        region.bufferOffset = offsetY * tex.width * bpp + offsetX * bpp;
-        region.bufferRowLength = tex.width;
-        region.bufferImageHeight = 0;
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = i;
-        region.imageSubresource.layerCount = 1;
+        ktxfile::write(cachePath, format, tex.width, tex.height, cubemap::FACE_COUNT, levels, {});
+    }
 
-        region.imageOffset = {0, 0, 0};
-        region.imageExtent = {faceWidth, faceHeight, 1};
+    tex.arrayLayers = cubemap::FACE_COUNT;
+    tex.mipLevels = static_cast<uint32_t>(levels.size());
 
-        vkCmdCopyBufferToImage(tempBuffer.v(), tex.stagingBuffer.buf.v(), tex.image.v(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    // every level is staged in a single buffer
+    VkDeviceSize stagingSize = 0;
+    for (std::span<const uint8_t> level : levels) {
+        stagingSize += level.size();
     }
 
+    vkh::BufferObj stagingBuffer{};
+    vkh::createHostVisibleBuffer(stagingBuffer, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+    VkDevice device = VkSingleton::v().gdevice();
+    uint8_t* stagingData = nullptr;
+    vkMapMemory(device, stagingBuffer.mem.v(), 0, stagingSize, 0, reinterpret_cast<void**>(&stagingData));
+
+    vkh::createTexture(tex, vkh::CUBEMAP, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, tex.width, tex.height);
+
+    // each level holds the faces one after the other, so a level is copied to every layer at once
+    std::vector<VkBufferImageCopy> regions(tex.mipLevels);
+    VkDeviceSize offset = 0;
+
+    for (uint32_t i = 0; i < tex.mipLevels; i++) {
+        std::memcpy(stagingData + offset, levels[i].data(), levels[i].size());
+
+        uint32_t faceSize = std::max(tex.width >> i, 1u);
+
+        VkBufferImageCopy& region = regions[i];
+        region.bufferOffset = offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = i;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = cubemap::FACE_COUNT;
+        region.imageExtent = {faceSize, faceSize, 1};
+
+        offset += levels[i].size();
+    }
+
+    vkUnmapMemory(device, stagingBuffer.mem.v());
+
+    VkhCommandBuffer tempBuffer = vkh::beginSingleTimeCommands(m_commandPool);
+    vkh::transitionImageLayout(tempBuffer, tex, vkh::CUBEMAP, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    vkCmdCopyBufferToImage(tempBuffer.v(), stagingBuffer.buf.v(), tex.image.v(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
     vkh::transitionImageLayout(tempBuffer, tex, vkh::CUBEMAP, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     vkh::endSingleTimeCommands(tempBuffer, m_commandPool, m_gQueue);
-
-    // free image data
-    stbi_image_free(imageData);
 }
 
 void VkTextures::createCompTextures() {
@@ -395,4 +776,57 @@ void VkTextures::createDeferredTextures(size_t i) {
         vkh::createTexture(m_deferredColor[texIndex], type, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, m_swap->getWidth(), m_swap->getHeight());
     }
 }
+
+void VkTextures::createDepthPyramid() {
+    // each texel of the first level covers 2x2 pixels of the deferred depth, rounded up so none are left out
+    // the next levels are normal mips, which round down, so the pyramid shader has the last texel of a level
+    // cover the odd row or column of the level before it
+    uint32_t width = (m_swap->getWidth() + 1) / 2;
+    uint32_t height = (m_swap->getHeight() + 1) / 2;
+
+    uint32_t levels = 1;
+    while ((std::max(width, height) >> levels) > 0) levels++;
+
+    m_depthPyramid.width = width;
+    m_depthPyramid.height = height;
+    m_depthPyramid.mipLevels = std::min(levels, culling::MAX_PYRAMID_LEVELS);
+
+    // its written by the pyramid shader and read by the cull shader, so it stays in the general layout
+    m_depthPyramidViews.clear();
+    vkh::createTexture(m_depthPyramid, vkh::ALPHA, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, width, height);
+
+    VkFormat format = vkh::getTextureFormat(vkh::ALPHA);
+    m_depthPyramidViews.resize(m_depthPyramid.mipLevels);
+
+    for (uint32_t i = 0; i < m_depthPyramid.mipLevels; i++) {
+        vkh::createMipView(m_depthPyramidViews[i], m_depthPyramid, format, i);
+    }
+
+    VkImageSubresourceRange range{};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = 0;
+    range.levelCount = m_depthPyramid.mipLevels;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_depthPyramid.image.v();
+    barrier.subresourceRange = range;
+
+    // the first frame has no depth to build it from, so its cleared to the far plane, which hides nothing
+    VkClearColorValue farPlane{};
+    farPlane.float32[0] = 1.0f;
+
+    VkhCommandBuffer tempBuffer = vkh::beginSingleTimeCommands(m_commandPool);
+    vkCmdPipelineBarrier(tempBuffer.v(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    vkCmdClearColorImage(tempBuffer.v(), m_depthPyramid.image.v(), VK_IMAGE_LAYOUT_GENERAL, &farPlane, 1, &range);
+    vkh::endSingleTimeCommands(tempBuffer, m_commandPool, m_gQueue);
+}
 }  // namespace textures
@@ -2,12 +2,34 @@
 
 #include <vulkan/vulkan.h>
 
+#include <algorithm>
+#include <future>
+
 #include "libraries/dvl.hpp"
+#include "libraries/imagedecode.hpp"
+#include "libraries/ktxfile.hpp"
+#include "libraries/texcompress.hpp"
+#include "libraries/threadpool.hpp"
 #include "libraries/vkhelper.hpp"
 #include "vk-scene.hpp"
 #include "vk-swapchain.hpp"
+#include "vk-uploads.hpp"
 
 namespace textures {
+// a texture created on a loading thread, whose levels are in the staging buffer
+struct StagedTexture {
+    vkh::Texture tex{};
+    vkh::TextureType type = vkh::SRGB;
+    std::vector<VkBufferImageCopy> regions;
+    bool generateMips = false;  // only the full size level is staged
+};
+
+// the textures of a model loaded after the scene was created
+struct StagedTextures {
+    vkh::BufferObj stagingBuffer{};
+    std::vector<StagedTexture> textures;
+};
+
 class VkTextures {
 public:
     // delete copying and moving
@@ -17,12 +39,18 @@ public:
     VkTextures(VkTextures&&) = delete;
     VkTextures& operator=(VkTextures&&) = delete;
 
-    void init(uint32_t maxFrames, VkhCommandPool commandPool, VkQueue gQueue, const swapchain::VkSwapChain* swap, scene::VkScene* scene);
+    void init(uint32_t maxFrames, bool compressTextures, bool depthPyramid, VkhCommandPool commandPool, VkQueue gQueue, const swapchain::VkSwapChain* swap, scene::VkScene* scene);
     void createRenderTextures(bool rtEnabled, bool createShadow);
     void loadMeshTextures();
 
     void loadSkybox(const std::string& fileName) { createCubemapTextureFromFile(m_skyboxCubemap, cfg::SKYBOX_DIR + fileName); }
 
+    // mesh textures loaded after the scene was created
+    // the textures are staged on the loading thread, and the rest is done on the main thread
+    [[nodiscard]] StagedTextures stageModelTextures(const tinygltf::Model* model, uint64_t modelHash, const std::vector<imagedecode::PendingImage>& images);
+    void recordTextureUpload(uploads::VkUploads& uploads, uploads::Batch& batch, const StagedTextures& staged) const;
+    void addTextures(const StagedTextures& staged);
+
     void createNewShadowBatch();
     void resetShadowTextures();
 
@@ -39,6 +67,13 @@ public:
     [[nodiscard]] vkh::Texture getDeferredDepthTex(size_t index) const noexcept { return m_deferredDepth[index]; }
     [[nodiscard]] vkh::Texture getShadowTex(size_t batchIndex, size_t currentFrame) const noexcept { return m_shadow[currentFrame + (batchIndex * m_maxFrames)]; }
 
+    // the farthest depth of each texel of the level before it, for occlusion culling
+    [[nodiscard]] const vkh::Texture& getDepthPyramid() const noexcept { return m_depthPyramid; }
+    [[nodiscard]] const VkhImageView& getDepthPyramidView(size_t level) const noexcept { return m_depthPyramidViews[level]; }
+    [[nodiscard]] uint32_t getDepthPyramidLevels() const noexcept { return static_cast<uint32_t>(m_depthPyramidViews.size()); }
+    [[nodiscard]] uint32_t getDepthPyramidWidth(uint32_t level) const noexcept { return std::max(m_depthPyramid.width >> level, 1u); }
+    [[nodiscard]] uint32_t getDepthPyramidHeight(uint32_t level) const noexcept { return std::max(m_depthPyramid.height >> level, 1u); }
+
     [[nodiscard]] const vkh::Texture* getCompTextures() const noexcept { return m_comp.data(); }
     [[nodiscard]] size_t getCompTexCount() const noexcept { return m_comp.size(); }
     [[nodiscard]] constexpr VkSampleCountFlagBits getCompSampleCount() const noexcept { return m_compSampleCount; }
@@ -53,10 +88,24 @@ public:
 
 private:
     struct MeshTexture {
-        std::vector<unsigned char> imageData;
+        const unsigned char* imageData;
         vkh::TextureType type;
     };
 
+    // the mip chain of a block compressed image, read from the texture cache or encoded on import
+    struct CompressedTexture {
+        ktxfile::KtxFile file{};
+        texcompress::CompressedImage image{};  // only used when the image had to be encoded
+
+        vkh::TextureType type = vkh::BC7_UNORM;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        bool opaque = true;
+
+        // views into either the file or the image, largest level first
+        std::vector<std::span<const uint8_t>> levels{};
+    };
+
 private:
     static constexpr VkSampleCountFlagBits m_compSampleCount = VK_SAMPLE_COUNT_8_BIT;
 
@@ -69,6 +118,9 @@ private:
     std::vector<vkh::Texture> m_deferredColor{};
     std::vector<vkh::Texture> m_deferredDepth{};
 
+    vkh::Texture m_depthPyramid{};
+    std::vector<VkhImageView> m_depthPyramidViews{};
+
     vkh::Texture m_skyboxCubemap{};
     std::string m_skyboxPath{};
 
@@ -83,17 +135,24 @@ private:
     VkhCommandPool m_commandPool{};
     VkQueue m_gQueue{};
     uint32_t m_maxFrames = 0;
+    bool m_compressTextures = false;
+    bool m_createDepthPyramid = false;
 
 private:
-    void loadModelTextures(const tinygltf::Model* model);
+    std::vector<vkh::TextureType> getImageTypes(const tinygltf::Model* model) const;
+
+    void loadModelTextures(const tinygltf::Model* model, const std::vector<imagedecode::PendingImage>& images);
+
+    std::vector<std::future<CompressedTexture>> compressModelImages(threadpool::ThreadPool& pool, const tinygltf::Model* model, uint64_t modelHash, const std::vector<imagedecode::PendingImage>& pendingImages);
+    static CompressedTexture compressImage(const imagedecode::PendingImage& pending, vkh::TextureType type, const std::string& cachePath);
+    void createCompressedTextures(const tinygltf::Model* model, std::vector<std::future<CompressedTexture>>& images);
 
     void createImageStagingBuffer(vkh::Texture& tex, const unsigned char* imgData);
-    void createImageStagingBufferHDR(vkh::Texture& tex, const float* imgData);
 
     void createMeshTexture(const MeshTexture& meshTexture, uint32_t width, uint32_t height, bool opaque);
+    static void generateMipmaps(const VkhCommandBuffer& commandBuffer, const vkh::Texture& tex, vkh::TextureType type);
 
     void getImageData(const std::string& path, vkh::Texture& t, unsigned char*& imgData);
-    void getImageDataHDR(const std::string& path, vkh::Texture& t, float*& imgData);
 
     void createTextureFromFile(vkh::Texture& tex, const std::string& path);
     void createCubemapTextureFromFile(vkh::Texture& tex, const std::string& path);
@@ -104,5 +163,6 @@ private:
     void createWBOITTextures(size_t i);
     void createShadowTextures();
     void createDeferredTextures(size_t i);
+    void createDepthPyramid();
 };
 }  // namespace textures
@@ -0,0 +1,223 @@
+#include "vk-uploads.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace uploads {
+void VkUploads::init(uint32_t maxFrames, VkDevice device, uint32_t transferFamily, uint32_t graphicsFamily, VkQueue tQueue, VkQueue gQueue) {
+    m_maxFrames = maxFrames;
+    m_device = device;
+
+    m_transferFamily = transferFamily;
+    m_graphicsFamily = graphicsFamily;
+    m_tQueue = tQueue;
+    m_gQueue = gQueue;
+
+    m_transferPool = vkh::createCommandPool(m_transferFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    m_graphicsPool = vkh::createCommandPool(m_graphicsFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+    m_rings.resize(m_maxFrames);
+}
+
+std::unique_ptr<Batch> VkUploads::begin() {
+    auto batch = std::make_unique<Batch>(vkh::allocateCommandBuffers(m_transferPool), vkh::allocateCommandBuffers(m_graphicsPool));
+    batch->semaphore = vkh::createSemaphore();
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(m_device, &fenceInfo, nullptr, batch->fence.p()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upload fence!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(batch->transferCommandBuffer.v(), &beginInfo);
+    vkBeginCommandBuffer(batch->graphicsCommandBuffer.v(), &beginInfo);
+
+    return batch;
+}
+
+void VkUploads::submit(Batch& batch) {
+    vkEndCommandBuffer(batch.transferCommandBuffer.v());
+
+    VkSubmitInfo submitInfo = vkh::createSubmitInfo(batch.transferCommandBuffer.p(), 1, nullptr, nullptr, batch.semaphore.p(), 0, 1);
+    if (vkQueueSubmit(m_tQueue, 1, &submitInfo, batch.fence.v()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit upload!");
+    }
+}
+
+bool VkUploads::isComplete(const Batch& batch) const {
+    return vkGetFenceStatus(m_device, batch.fence.v()) == VK_SUCCESS;
+}
+
+void VkUploads::finish(std::unique_ptr<Batch> batch) {
+    vkEndCommandBuffer(batch->graphicsCommandBuffer.v());
+
+    // the copies are already done, so waiting on them doesnt hold up the queue
+    // it's submitted before the frame, so the frame sees everything the batch did
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo submitInfo = vkh::createSubmitInfo(batch->graphicsCommandBuffer.p(), 1, &waitStage, batch->semaphore.p(), nullptr, 1, 0);
+    if (vkQueueSubmit(m_gQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit upload!");
+    }
+
+    getRetired().batches.push_back(std::move(batch));
+}
+
+void VkUploads::releaseBuffer(Batch& batch, const vkh::BufferObj& buffer) const {
+    // the semaphore is enough when both queues are from the same family
+    if (m_transferFamily == m_graphicsFamily) return;
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = m_transferFamily;
+    barrier.dstQueueFamilyIndex = m_graphicsFamily;
+    barrier.buffer = buffer.buf.v();
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    // release
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(batch.transferCommandBuffer.v(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    // acquire
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(batch.graphicsCommandBuffer.v(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void VkUploads::releaseImage(Batch& batch, const vkh::Texture& tex, VkImageLayout layout) const {
+    if (m_transferFamily == m_graphicsFamily) return;
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = m_transferFamily;
+    barrier.dstQueueFamilyIndex = m_graphicsFamily;
+    barrier.image = tex.image.v();
+    barrier.oldLayout = layout;
+    barrier.newLayout = layout;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = tex.mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = tex.arrayLayers;
+
+    // release
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(batch.transferCommandBuffer.v(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // acquire
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(batch.graphicsCommandBuffer.v(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void VkUploads::retire(const vkh::BufferObj& buffer) {
+    if (buffer.buf.valid()) getRetired().buffers.push_back(buffer);
+}
+
+void VkUploads::retire(const VkhAccelerationStructure& accelerationStructure) {
+    if (accelerationStructure.valid()) getRetired().accelerationStructures.push_back(accelerationStructure);
+}
+
+void VkUploads::collect() {
+    m_frame++;
+
+    // each frame's fence covers everything submitted before it, so once the frame slot comes back around its resources are free
+    std::erase_if(m_retired, [this](const Retired& r) { return r.frame + m_maxFrames <= m_frame; });
+}
+
+void VkUploads::stage(const vkh::BufferObj& dst, const void* data, VkDeviceSize size, VkDeviceSize dstOffset) {
+    if (size == 0) return;
+
+    StagingRing& ring = getRing(size);
+    std::memcpy(static_cast<char*>(ring.buffer.mapped) + ring.head, data, static_cast<size_t>(size));
+
+    m_stagedCopies.push_back({ring.buffer.buf.v(), dst.buf.v(), {ring.head, dstOffset, size}});
+
+    // keep every copy 16 byte aligned, which covers any copy offset alignment
+    ring.head = (ring.head + size + 15) & ~static_cast<VkDeviceSize>(15);
+}
+
+void VkUploads::recordStagedCopies(VkCommandBuffer commandBuffer) {
+    if (m_stagedCopies.empty()) return;
+
+    // the frames before this one may still be reading what gets overwritten
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    auto overlaps = [](const std::vector<VkBufferCopy>& regions, const VkBufferCopy& region) {
+        return std::any_of(regions.begin(), regions.end(), [&](const VkBufferCopy& r) { return region.dstOffset < r.dstOffset + r.size && r.dstOffset < region.dstOffset + region.size; });
+    };
+
+    // copies between the same buffers are recorded together, in the order they were staged
+    std::vector<VkBufferCopy> regions;
+    std::vector<VkBuffer> written;
+
+    for (size_t i = 0; i < m_stagedCopies.size();) {
+        const StagedCopy& first = m_stagedCopies[i];
+
+        // a later write to the same buffer may overlap an earlier one, so it has to land after it
+        if (std::find(written.begin(), written.end(), first.dst) != written.end()) {
+            VkMemoryBarrier transferBarrier{};
+            transferBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            transferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            transferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &transferBarrier, 0, nullptr, 0, nullptr);
+            written.clear();
+        }
+
+        regions.clear();
+        for (; i < m_stagedCopies.size(); i++) {
+            const StagedCopy& copy = m_stagedCopies[i];
+            if (copy.src != first.src || copy.dst != first.dst || overlaps(regions, copy.region)) break;
+            regions.push_back(copy.region);
+        }
+
+        vkCmdCopyBuffer(commandBuffer, first.src, first.dst, static_cast<uint32_t>(regions.size()), regions.data());
+        written.push_back(first.dst);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    m_stagedCopies.clear();
+}
+
+VkUploads::StagingRing& VkUploads::getRing(VkDeviceSize size) {
+    StagingRing& ring = m_rings[m_frame % m_maxFrames];
+
+    // the frame that last used the ring is done with it, unless some of its copies still havent been recorded
+    if (ring.frame != m_frame && m_stagedCopies.empty()) ring.head = 0;
+    ring.frame = m_frame;
+
+    if (ring.head + size <= ring.capacity) return ring;
+
+    // copies already staged still read from the old buffer, so its kept until the frame is done
+    retire(ring.buffer);
+    ring.buffer = {};
+
+    ring.capacity = std::max({size, ring.capacity * 2, static_cast<VkDeviceSize>(65536)});
+    ring.head = 0;
+    vkh::createMappedBuffer(ring.buffer, ring.capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+    return ring;
+}
+
+VkUploads::Retired& VkUploads::getRetired() {
+    if (m_retired.empty() || m_retired.back().frame != m_frame) {
+        m_retired.emplace_back().frame = m_frame;
+    }
+
+    return m_retired.back();
+}
+}  // namespace uploads
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "libraries/vkhelper.hpp"
+
+namespace uploads {
+// copies recorded for the transfer queue, and the work that has to happen on the graphics queue once theyre done
+struct Batch {
+    VkhCommandBuffer transferCommandBuffer;
+    VkhCommandBuffer graphicsCommandBuffer;
+    VkhSemaphore semaphore{};
+    VkhFence fence{};
+
+    // kept alive until the graphics queue is done with the batch
+    std::vector<vkh::BufferObj> stagingBuffers;
+
+    Batch(VkhCommandBuffer transfer, VkhCommandBuffer graphics) : transferCommandBuffer(std::move(transfer)), graphicsCommandBuffer(std::move(graphics)) {}
+};
+
+class VkUploads {
+public:
+    // delete copying and moving
+    VkUploads() = default;
+    VkUploads(const VkUploads&) = delete;
+    VkUploads& operator=(const VkUploads&) = delete;
+    VkUploads(VkUploads&&) = delete;
+    VkUploads& operator=(VkUploads&&) = delete;
+
+    void init(uint32_t maxFrames, VkDevice device, uint32_t transferFamily, uint32_t graphicsFamily, VkQueue tQueue, VkQueue gQueue);
+
+    // batches
+    [[nodiscard]] std::unique_ptr<Batch> begin();
+    void submit(Batch& batch);
+    [[nodiscard]] bool isComplete(const Batch& batch) const;
+    void finish(std::unique_ptr<Batch> batch);
+
+    // hands a resource written on the transfer queue over to the graphics queue
+    void releaseBuffer(Batch& batch, const vkh::BufferObj& buffer) const;
+    void releaseImage(Batch& batch, const vkh::Texture& tex, VkImageLayout layout) const;
+
+    // resources the frames in flight may still be using are destroyed once theyre done
+    void retire(const vkh::BufferObj& buffer);
+    void retire(const VkhAccelerationStructure& accelerationStructure);
+    void collect();
+
+    // small writes to device local buffers go through a mapped ring of staging memory
+    // the data is copied into the ring straight away, and into the buffer at the start of the next frame
+    void stage(const vkh::BufferObj& dst, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+    void recordStagedCopies(VkCommandBuffer commandBuffer);
+
+private:
+    struct Retired {
+        uint64_t frame = 0;
+        std::vector<vkh::BufferObj> buffers;
+        std::vector<VkhAccelerationStructure> accelerationStructures;
+        std::vector<std::unique_ptr<Batch>> batches;
+    };
+
+    // each frame in flight has its own, which is written from the start again once the frame comes back around
+    struct StagingRing {
+        vkh::BufferObj buffer{};
+        VkDeviceSize capacity = 0;
+        VkDeviceSize head = 0;
+        uint64_t frame = 0;
+    };
+
+    struct StagedCopy {
+        VkBuffer src = VK_NULL_HANDLE;
+        VkBuffer dst = VK_NULL_HANDLE;
+        VkBufferCopy region{};
+    };
+
+private:
+    VkhCommandPool m_transferPool{};
+    VkhCommandPool m_graphicsPool{};
+    std::vector<Retired> m_retired;
+
+    std::vector<StagingRing> m_rings;
+    std::vector<StagedCopy> m_stagedCopies;
+
+    uint64_t m_frame = 0;
+    uint32_t m_maxFrames = 0;
+    uint32_t m_transferFamily = 0;
+    uint32_t m_graphicsFamily = 0;
+
+    VkDevice m_device{};
+    VkQueue m_tQueue{};
+    VkQueue m_gQueue{};
+
+private:
+    [[nodiscard]] Retired& getRetired();
+    [[nodiscard]] StagingRing& getRing(VkDeviceSize size);
+};
+}  // namespace uploads
@@ -0,0 +1,100 @@
+#include "cubemap.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <utility>
+
+#include "dvl.hpp"
+
+namespace cubemap {
+namespace {
+// the position of each face in the cross, in faces
+constexpr std::array<std::pair<uint32_t, uint32_t>, FACE_COUNT> FACE_OFFSETS = {{{2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {3, 1}}};
+
+// halves a square rgba32f face in each dimension
+std::vector<float> downsample(const std::vector<float>& face, uint32_t size) {
+    uint32_t half = std::max(size / 2, 1u);
+    std::vector<float> result(static_cast<size_t>(half) * half * 4);
+
+    for (uint32_t y = 0; y < half; y++) {
+        for (uint32_t x = 0; x < half; x++) {
+            uint32_t x0 = std::min(x * 2, size - 1);
+            uint32_t x1 = std::min(x * 2 + 1, size - 1);
+            uint32_t y0 = std::min(y * 2, size - 1);
+            uint32_t y1 = std::min(y * 2 + 1, size - 1);
+
+            for (uint32_t c = 0; c < 4; c++) {
+                float sum = face[(y0 * size + x0) * 4 + c] + face[(y0 * size + x1) * 4 + c] + face[(y1 * size + x0) * 4 + c] + face[(y1 * size + x1) * 4 + c];
+                result[(y * half + x) * 4 + c] = sum * 0.25f;
+            }
+        }
+    }
+
+    return result;
+}
+}  // namespace
+
+uint32_t getMipLevelCount(uint32_t faceSize) noexcept {
+    return static_cast<uint32_t>(std::bit_width(faceSize));
+}
+
+size_t getLevelSize(uint32_t faceSize) noexcept {
+    return static_cast<size_t>(faceSize) * faceSize * TEXEL_BYTES * FACE_COUNT;
+}
+
+bool isValidCross(uint32_t width, uint32_t height) noexcept {
+    return width > 0 && width % 4 == 0 && height % 3 == 0 && width / 4 == height / 3;
+}
+
+Cubemap fromCross(const float* rgba, uint32_t width, uint32_t height) {
+    Cubemap cubemap{};
+    cubemap.faceSize = std::min(width / 4, height / 3);
+
+    uint32_t levelCount = getMipLevelCount(cubemap.faceSize);
+    cubemap.levels.resize(levelCount);
+
+    size_t totalSize = 0;
+    for (uint32_t i = 0; i < levelCount; i++) {
+        Level& level = cubemap.levels[i];
+        level.faceSize = std::max(cubemap.faceSize >> i, 1u);
+        level.offset = totalSize;
+        level.size = getLevelSize(level.faceSize);
+
+        totalSize += level.size;
+    }
+
+    cubemap.data.resize(totalSize);
+
+    for (uint32_t f = 0; f < FACE_COUNT; f++) {
+        uint32_t size = cubemap.faceSize;
+
+        // copy the face out of the atlas
+        std::vector<float> face(static_cast<size_t>(size) * size * 4);
+        uint32_t offsetX = FACE_OFFSETS[f].first * size;
+        uint32_t offsetY = FACE_OFFSETS[f].second * size;
+
+        for (uint32_t y = 0; y < size; y++) {
+            const float* row = rgba + ((static_cast<size_t>(offsetY + y) * width + offsetX) * 4);
+            std::memcpy(face.data() + (static_cast<size_t>(y) * size * 4), row, static_cast<size_t>(size) * 4 * sizeof(float));
+        }
+
+        for (uint32_t i = 0; i < levelCount; i++) {
+            const Level& level = cubemap.levels[i];
+            size_t faceBytes = level.size / FACE_COUNT;
+            uint8_t* dst = cubemap.data.data() + level.offset + (faceBytes * f);
+
+            // filtering is done at full precision, only the stored texels are halves
+            for (size_t j = 0; j < face.size(); j++) {
+                uint16_t value = dvl::toHalf(face[j]);
+                std::memcpy(dst + (j * sizeof(uint16_t)), &value, sizeof(uint16_t));
+            }
+
+            if (i + 1 < levelCount) face = downsample(face, level.faceSize);
+        }
+    }
+
+    return cubemap;
+}
+}  // namespace cubemap
@@ -0,0 +1,40 @@
+// Conversion of HDR horizontal cross atlases into half float cubemaps
+// The faces are in Vulkan layer order (+X, -X, +Y, -Y, +Z, -Z)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cubemap {
+constexpr uint32_t FACE_COUNT = 6;
+
+// rgba16f
+constexpr size_t TEXEL_BYTES = 8;
+
+struct Level {
+    uint32_t faceSize = 0;
+
+    // every face of the level is stored one after the other
+    size_t offset = 0;  // in bytes from the start of the cubemap data
+    size_t size = 0;
+};
+
+struct Cubemap {
+    uint32_t faceSize = 0;
+
+    std::vector<Level> levels{};
+    std::vector<uint8_t> data{};
+};
+
+[[nodiscard]] uint32_t getMipLevelCount(uint32_t faceSize) noexcept;
+[[nodiscard]] size_t getLevelSize(uint32_t faceSize) noexcept;
+
+// true if the atlas is 4 faces wide and 3 faces high
+[[nodiscard]] bool isValidCross(uint32_t width, uint32_t height) noexcept;
+
+// splits the atlas into faces and builds the full mip chain
+// each level is a box filter of the one above it, done before the conversion to half floats
+[[nodiscard]] Cubemap fromCross(const float* rgba, uint32_t width, uint32_t height);
+}  // namespace cubemap
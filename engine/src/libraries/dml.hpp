@@ -1,6 +1,7 @@
 // Drew's Math Library (DML)
 
 #pragma once
+#include <cmath>
 #include <iostream>
 
 namespace mathc {
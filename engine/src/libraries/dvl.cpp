@@ -1,16 +1,309 @@
 #include "dvl.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
 #include "libraries/dvl.hpp"
 
 namespace dvl {
+namespace {
+int16_t toSnorm16(float value) noexcept {
+    return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+// maps the direction onto an octahedron, then folds the lower half over the upper half
+std::array<int16_t, 2> encodeOctahedral(const dml::vec3& dir) noexcept {
+    float sum = std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z);
+    if (sum == 0.0f) return {0, 0};
+
+    float x = dir.x / sum;
+    float y = dir.y / sum;
+
+    if (dir.z < 0.0f) {
+        float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    return {toSnorm16(x), toSnorm16(y)};
+}
+
+// the size of a component that instance attributes can use, 0 for anything else
+size_t getComponentSize(int componentType) noexcept {
+    switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return sizeof(float);
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return sizeof(uint8_t);
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return sizeof(uint16_t);
+        default:
+            return 0;
+    }
+}
+
+// throws if count elements of the accessor would be read from outside of its buffer
+// the attributes are read tightly packed, which never reaches further than the accessor's own stride does
+void checkAccessorBounds(const tinygltf::Accessor& accessor, const tinygltf::BufferView& bufferView, std::span<const uint8_t> buffer, size_t offset, size_t elementSize) {
+    int stride = accessor.ByteStride(bufferView);
+    if (stride <= 0) throw std::runtime_error("Accessor has an invalid stride!");
+
+    size_t step = std::max(static_cast<size_t>(stride), elementSize);
+    size_t size = (accessor.count > 0) ? ((accessor.count - 1) * step) + elementSize : 0;
+    if (offset >= buffer.size() || size > buffer.size() - offset) throw std::runtime_error("Accessor is outside of its buffer!");
+}
+
+// integer components are normalized
+float readComponent(const uint8_t* data, int componentType) noexcept {
+    switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+            float value = 0.0f;
+            std::memcpy(&value, data, sizeof(float));
+            return value;
+        }
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            return std::max(static_cast<float>(static_cast<int8_t>(data[0])) / 127.0f, -1.0f);
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return static_cast<float>(data[0]) / 255.0f;
+        case TINYGLTF_COMPONENT_TYPE_SHORT: {
+            int16_t value = 0;
+            std::memcpy(&value, data, sizeof(int16_t));
+            return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+            uint16_t value = 0;
+            std::memcpy(&value, data, sizeof(uint16_t));
+            return static_cast<float>(value) / 65535.0f;
+        }
+        default:
+            return 0.0f;
+    }
+}
+
+// reads an attribute of EXT_mesh_gpu_instancing, which is a vector of floats or normalized integers
+// returns nothing if the attribute isnt given or doesnt fit in its buffer
+template <size_t N>
+std::vector<std::array<float, N>> readInstanceAttribute(const tinygltf::Model& model, const ModelBuffers& buffers, const tinygltf::Value& attributes, const std::string& name) {
+    std::vector<std::array<float, N>> values;
+    if (!attributes.Has(name) || !attributes.Get(name).IsNumber()) return values;
+
+    int accessorIndex = attributes.Get(name).GetNumberAsInt();
+    if (accessorIndex < 0 || static_cast<size_t>(accessorIndex) >= model.accessors.size()) return values;
+
+    const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+    size_t componentSize = getComponentSize(accessor.componentType);
+    bool supported = accessor.type == static_cast<int>(N) && componentSize > 0 && !accessor.sparse.isSparse;
+    if (!supported || accessor.bufferView < 0 || static_cast<size_t>(accessor.bufferView) >= model.bufferViews.size()) return values;
+
+    const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+    if (bufferView.buffer < 0 || static_cast<size_t>(bufferView.buffer) >= buffers.size()) return values;
+
+    std::span<const uint8_t> buffer = buffers[bufferView.buffer];
+    int stride = accessor.ByteStride(bufferView);
+    if (stride <= 0 || accessor.count == 0) return values;
+
+    size_t offset = bufferView.byteOffset + accessor.byteOffset;
+    size_t size = ((accessor.count - 1) * static_cast<size_t>(stride)) + (componentSize * N);
+    if (offset > buffer.size() || size > buffer.size() - offset) return values;
+
+    values.resize(accessor.count);
+    for (size_t i = 0; i < accessor.count; i++) {
+        const uint8_t* element = buffer.data() + offset + (i * static_cast<size_t>(stride));
+
+        for (size_t c = 0; c < N; c++) {
+            values[i][c] = readComponent(element + (c * componentSize), accessor.componentType);
+        }
+    }
+
+    return values;
+}
+
+// the transforms of EXT_mesh_gpu_instancing, relative to the node
+std::vector<dml::mat4> loadNodeInstances(const tinygltf::Model& model, const ModelBuffers& buffers, const tinygltf::Node& node) {
+    std::vector<dml::mat4> instances;
+
+    auto it = node.extensions.find("EXT_mesh_gpu_instancing");
+    if (it == node.extensions.end() || !it->second.Has("attributes")) return instances;
+
+    const tinygltf::Value& attributes = it->second.Get("attributes");
+    std::vector<std::array<float, 3>> translations = readInstanceAttribute<3>(model, buffers, attributes, "TRANSLATION");
+    std::vector<std::array<float, 4>> rotations = readInstanceAttribute<4>(model, buffers, attributes, "ROTATION");
+    std::vector<std::array<float, 3>> scales = readInstanceAttribute<3>(model, buffers, attributes, "SCALE");
+
+    // every attribute thats given has a value per instance
+    size_t count = std::max({translations.size(), rotations.size(), scales.size()});
+    auto matches = [count](size_t size) { return size == 0 || size == count; };
+
+    if (!matches(translations.size()) || !matches(rotations.size()) || !matches(scales.size())) {
+        utils::logWarning("Node " + node.name + " has instance attributes of different lengths");
+        return instances;
+    }
+
+    instances.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        dml::vec3 translation = translations.empty() ? dml::vec3{0.0f, 0.0f, 0.0f} : dml::vec3{translations[i][0], translations[i][1], translations[i][2]};
+        dml::vec4 rotation = rotations.empty() ? dml::vec4{0.0f, 0.0f, 0.0f, 1.0f} : dml::vec4{rotations[i][0], rotations[i][1], rotations[i][2], rotations[i][3]};
+        dml::vec3 scale = scales.empty() ? dml::vec3{1.0f, 1.0f, 1.0f} : dml::vec3{scales[i][0], scales[i][1], scales[i][2]};
+
+        instances.push_back(dml::translate(translation) * dml::rotateQuat(rotation) * dml::scale(scale));
+    }
+
+    return instances;
+}
+}  // namespace
+
+uint16_t toHalf(float value) noexcept {
+    uint32_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(float));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t floatExponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // infinity and nan
+    if (floatExponent == 0xff) return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+    int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+    if (exponent >= 31) return static_cast<uint16_t>(sign | 0x7c00);
+
+    // too small for a normal half, so its stored as a subnormal
+    if (exponent <= 0) {
+        if (exponent < -10) return static_cast<uint16_t>(sign);
+
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    // a carry out of the mantissa correctly rounds up into the exponent
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;
+
+    return static_cast<uint16_t>(half);
+}
+
+void packVertices(std::span<const Vertex> vertices, PackedPosition* positions, PackedAttributes* attributes) noexcept {
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Vertex& vertex = vertices[i];
+
+        positions[i] = {vertex.pos.x, vertex.pos.y, vertex.pos.z};
+
+        PackedAttributes& packed = attributes[i];
+        packed.normal = encodeOctahedral(vertex.normal);
+        packed.tangent = encodeOctahedral(vertex.tangent);
+        packed.tex = {toHalf(vertex.tex.x), toHalf(vertex.tex.y)};
+    }
+}
+
+VertexWelder::VertexWelder(size_t maxVertices) {
+    // keep the table at most half full so probe sequences stay short
+    size_t slotCount = 16;
+    while (slotCount < maxVertices * 2) slotCount <<= 1;
+    rehash(slotCount);
+
+    m_keys.reserve(maxVertices);
+    m_vertices.reserve(maxVertices);
+}
+
+uint32_t VertexWelder::weld(const Vertex& vertex) {
+    Key key = makeKey(vertex);
+    uint64_t hash = hashKey(key);
+    uint64_t tag = hash & 0xffffffff00000000ULL;
+
+    size_t slot = static_cast<size_t>(hash) & m_mask;
+    while (m_slots[slot] != 0) {
+        uint64_t entry = m_slots[slot];
+        uint32_t index = static_cast<uint32_t>(entry) - 1;
+
+        // only compare the keys if the tags match
+        if ((entry & 0xffffffff00000000ULL) == tag && m_keys[index] == key) {
+            return index;
+        }
+
+        slot = (slot + 1) & m_mask;
+    }
+
+    // vertex hasnt been seen before
+    uint32_t index = static_cast<uint32_t>(m_vertices.size());
+    m_slots[slot] = tag | (static_cast<uint64_t>(index) + 1);
+    m_keys.push_back(key);
+    m_vertices.push_back(vertex);
+
+    if (m_vertices.size() * 2 > m_slots.size()) {
+        rehash(m_slots.size() * 2);
+    }
+
+    return index;
+}
+
+VertexWelder::Key VertexWelder::makeKey(const Vertex& vertex) noexcept {
+    Key key{};
+    std::memcpy(&key[0], &vertex.pos, sizeof(float) * 3);
+    std::memcpy(&key[3], &vertex.tex, sizeof(float) * 2);
+    std::memcpy(&key[5], &vertex.normal, sizeof(float) * 3);
+    std::memcpy(&key[8], &vertex.tangent, sizeof(float) * 3);
+    return key;
+}
+
+uint64_t VertexWelder::hashKey(const Key& key) noexcept {
+    constexpr uint64_t primes[6] = {
+        0x9e3779b185ebca87ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL,
+        0xd6e8feb86659fd93ULL, 0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL};
+
+    // each lane is mixed independently so the loop can be vectorized
+    uint64_t hash = 0;
+    for (size_t i = 0; i < 6; i++) {
+        uint64_t lane;
+        std::memcpy(&lane, &key[i * 2], sizeof(uint64_t));
+        hash ^= (lane ^ (lane >> 31)) * primes[i];
+    }
+
+    hash ^= hash >> 32;
+    hash *= primes[0];
+    hash ^= hash >> 29;
+    return hash;
+}
+
+void VertexWelder::rehash(size_t slotCount) {
+    m_slots.assign(slotCount, 0);
+    m_mask = slotCount - 1;
+
+    for (size_t i = 0; i < m_keys.size(); i++) {
+        uint64_t hash = hashKey(m_keys[i]);
+        size_t slot = static_cast<size_t>(hash) & m_mask;
+        while (m_slots[slot] != 0) slot = (slot + 1) & m_mask;
+
+        m_slots[slot] = (hash & 0xffffffff00000000ULL) | (static_cast<uint64_t>(i) + 1);
+    }
+}
+
 // returns an iterator to the attribute from a given name (TEXCOORD_0, NORMAL, etc)
 std::map<std::string, int>::const_iterator getAttributeIt(const std::string& name, const std::map<std::string, int>& attributes) {
     std::map<std::string, int>::const_iterator it = attributes.find(name);
     return it;
 }
 
+ModelBuffers getModelBuffers(const tinygltf::Model& model) {
+    ModelBuffers buffers;
+    buffers.reserve(model.buffers.size());
+
+    for (const tinygltf::Buffer& buffer : model.buffers) {
+        buffers.emplace_back(buffer.data.data(), buffer.data.size());
+    }
+
+    return buffers;
+}
+
 // returns a pointer to the beggining of the attribute data
-const float* getAccessorData(const tinygltf::Model& model, const std::map<std::string, int>& attributes, const std::string& attributeName) {
+const float* getAccessorData(const tinygltf::Model& model, const ModelBuffers& buffers, const std::map<std::string, int>& attributes, const std::string& attributeName, size_t componentCount) {
     auto it = getAttributeIt(attributeName, attributes);  // get the attribute iterator from the attribute name
     if (it == attributes.end()) return nullptr;           // if the attribute isnt found, return nullptr
 
@@ -27,37 +320,56 @@ const float* getAccessorData(const tinygltf::Model& model, const std::map<std::s
     // get the buffer based from the buffer view
     // the buffer is the raw binary data of the model
     // bufferView.buffer is the index of the buffer to use
-    const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+    std::span<const uint8_t> buffer = buffers[bufferView.buffer];
 
     // get the offset of the accessor in the buffer
     // bufferView.byteOffset is the offset of the buffer view inside the buffer
     // accessor.byteOffset is the offset of the accessor in the buffer view
     // the sum gives the total offset from the start to the beginning of the attribute data
     size_t offset = bufferView.byteOffset + accessor.byteOffset;
+    checkAccessorBounds(accessor, bufferView, buffer, offset, componentCount * sizeof(float));
 
     // return the data from the buffer marking the start of the attribute data
-    return reinterpret_cast<const float*>(&buffer.data[offset]);
+    return reinterpret_cast<const float*>(&buffer[offset]);
 }
 
 // returns a pointer to the start of the index data (indices of the mesh)
-const void* getIndexData(const tinygltf::Model& model, const tinygltf::Accessor& accessor) {
+const void* getIndexData(const tinygltf::Model& model, const ModelBuffers& buffers, const tinygltf::Accessor& accessor) {
     // get the buffer view and buffer
     const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-    const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+    std::span<const uint8_t> buffer = buffers[bufferView.buffer];
 
     // get the offset of the accessor in the buffer
     size_t offset = bufferView.byteOffset + accessor.byteOffset;
 
+    // indices of any other type arent read, so they dont have to fit
+    size_t indexSize = 0;
+    switch (accessor.componentType) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            indexSize = sizeof(uint8_t);
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            indexSize = sizeof(uint16_t);
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            indexSize = sizeof(uint32_t);
+            break;
+        default:
+            return nullptr;
+    }
+
+    checkAccessorBounds(accessor, bufferView, buffer, offset, indexSize);
+
     // go through the accessors component type
     // the compoenent type is the datatype of the data thats being read
     // from this data, cast the binary data (of the buffer) to the correct type
     switch (accessor.componentType) {
         case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-            return reinterpret_cast<const uint8_t*>(&buffer.data[offset]);
+            return reinterpret_cast<const uint8_t*>(&buffer[offset]);
         case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-            return reinterpret_cast<const uint16_t*>(&buffer.data[offset]);
+            return reinterpret_cast<const uint16_t*>(&buffer[offset]);
         case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-            return reinterpret_cast<const uint32_t*>(&buffer.data[offset]);
+            return reinterpret_cast<const uint32_t*>(&buffer[offset]);
         default:
             // if the component type isnt supported, return nullptr
             return nullptr;
@@ -118,162 +430,241 @@ dml::mat4 calcNodeLM(const tinygltf::Node& node) {  // get the local matrix of t
     return translationMatrix * rotationMatrix * scaleMatrix;
 }
 
-int getNodeIndex(const tinygltf::Model& model, int meshIndex) {
-    for (size_t i = 0; i < model.nodes.size(); i++) {
-        if (model.nodes[i].mesh == meshIndex) {
-            return static_cast<int>(i);
+NodeHierarchy flattenNodes(const tinygltf::Model& model, const ModelBuffers& buffers) {
+    NodeHierarchy hierarchy{};
+    size_t nodeCount = model.nodes.size();
+    hierarchy.flatIndices.assign(nodeCount, -1);
+
+    std::vector<bool> hasParent(nodeCount, false);
+    for (const tinygltf::Node& node : model.nodes) {
+        for (int child : node.children) {
+            if (child >= 0 && static_cast<size_t>(child) < nodeCount) hasParent[child] = true;
         }
     }
-    return -1;  // not found
-}
 
-dml::mat4 calcMeshWM(const tinygltf::Model& gltfMod, int meshIndex, std::unordered_map<int, int>& parentIndex, Mesh& m) {
-    int currentNodeIndex = getNodeIndex(gltfMod, meshIndex);
+    // the gltf node and flattened parent of each node left to visit
+    std::vector<std::pair<int32_t, int32_t>> stack;
+    for (size_t i = nodeCount; i-- > 0;) {
+        if (!hasParent[i]) stack.emplace_back(static_cast<int32_t>(i), -1);
+    }
 
-    // get the matricies for object positioning
-    dml::mat4 translationMatrix = dml::translate(m.position);
-    dml::mat4 rotationMatrix = dml::rotateQuat(m.rotation);
-    dml::mat4 scaleMatrix = dml::scale(m.scale * 0.03f);  // 0.03 scales it down to a reasonable size
-    dml::mat4 modelMatrix = translationMatrix * rotationMatrix * scaleMatrix;
+    // depth first, so the descendants of a node are visited before anything else on the stack
+    while (!stack.empty()) {
+        auto [node, parent] = stack.back();
+        stack.pop_back();
 
-    // walk up the node hierarchy to accumulate transformations
-    dml::mat4 localModelMatrix{};
-    while (currentNodeIndex != -1) {
-        const tinygltf::Node& node = gltfMod.nodes[currentNodeIndex];
-        dml::mat4 localMatrix = calcNodeLM(node);
+        // a node can only be visited once, even if the file lists it as a child more than once
+        if (hierarchy.flatIndices[node] != -1) continue;
 
-        // combine the localMatrix with the accumulated modelMatrix
-        localModelMatrix = localMatrix * localModelMatrix;
+        int32_t flatIndex = static_cast<int32_t>(hierarchy.nodes.size());
+        hierarchy.flatIndices[node] = flatIndex;
+        hierarchy.nodes.push_back(node);
+        hierarchy.parents.push_back(parent);
+        hierarchy.localMatrices.push_back(calcNodeLM(model.nodes[node]));
 
-        // move up to the parent node for the next iteration
-        if (parentIndex.find(currentNodeIndex) != parentIndex.end()) {
-            currentNodeIndex = parentIndex[currentNodeIndex];
-        } else {
-            currentNodeIndex = -1;  // no parent, exit loop
+        const std::vector<int>& children = model.nodes[node].children;
+        for (size_t i = children.size(); i-- > 0;) {
+            int child = children[i];
+            if (child >= 0 && static_cast<size_t>(child) < nodeCount) stack.emplace_back(child, flatIndex);
         }
     }
 
-    return modelMatrix * localModelMatrix;
+    // children come after their parents, so walking backwards adds each subtree to its parent once its complete
+    size_t flatCount = hierarchy.nodes.size();
+    hierarchy.subtreeSizes.assign(flatCount, 1);
+    for (size_t i = flatCount; i-- > 0;) {
+        int32_t parent = hierarchy.parents[i];
+        if (parent >= 0) hierarchy.subtreeSizes[parent] += hierarchy.subtreeSizes[i];
+    }
+
+    hierarchy.worldMatrices.resize(flatCount);
+    for (size_t i = 0; i < flatCount; i++) {
+        int32_t parent = hierarchy.parents[i];
+        hierarchy.worldMatrices[i] = (parent >= 0) ? hierarchy.worldMatrices[parent] * hierarchy.localMatrices[i] : hierarchy.localMatrices[i];
+    }
+
+    // every node that uses a mesh places an instance of it
+    hierarchy.meshNodes.resize(model.meshes.size());
+    hierarchy.instances.resize(flatCount);
+
+    for (size_t i = 0; i < flatCount; i++) {
+        const tinygltf::Node& node = model.nodes[hierarchy.nodes[i]];
+        if (node.mesh < 0 || static_cast<size_t>(node.mesh) >= model.meshes.size()) continue;
+
+        hierarchy.meshNodes[node.mesh].push_back(static_cast<uint32_t>(i));
+        hierarchy.instances[i] = loadNodeInstances(model, buffers, node);
+    }
+
+    return hierarchy;
 }
 
-std::vector<Mesh> loadMesh(const tinygltf::Mesh& mesh, const tinygltf::Model& model, std::unordered_map<int, int>& parentInd, uint32_t meshInd, dml::vec3 scale, dml::vec3 pos, dml::vec4 rot, size_t imagesOffset) {
-    std::vector<Mesh> newObjects;
+void setNodeLocalMatrix(NodeHierarchy& hierarchy, uint32_t node, const dml::mat4& matrix) {
+    hierarchy.localMatrices[node] = matrix;
+    hierarchy.dirty.push_back(node);
+}
 
-    size_t primitiveCount = mesh.primitives.size();
-    newObjects.reserve(primitiveCount);
+std::vector<NodeRange> updateWorldMatrices(NodeHierarchy& hierarchy) {
+    std::vector<NodeRange> ranges;
+    if (hierarchy.dirty.empty()) return ranges;
 
-    // process primitives in the mesh
-    for (size_t i = 0; i < primitiveCount; i++) {
-        const tinygltf::Primitive& primitive = mesh.primitives[i];
-        Mesh object{};
+    std::sort(hierarchy.dirty.begin(), hierarchy.dirty.end());
 
-        std::unordered_map<Vertex, uint32_t, VertHash> uniqueVertices;
-        std::vector<Vertex> tempVertices;
-        std::vector<uint32_t> tempIndices;
+    for (uint32_t node : hierarchy.dirty) {
+        // already updated as part of an ancestor's subtree
+        if (!ranges.empty() && node < ranges.back().first + ranges.back().count) continue;
 
-        const float* positionData = getAccessorData(model, primitive.attributes, "POSITION");
-        const float* texCoordData = getAccessorData(model, primitive.attributes, "TEXCOORD_0");
-        const float* normalData = getAccessorData(model, primitive.attributes, "NORMAL");
-        const float* tangentData = getAccessorData(model, primitive.attributes, "TANGENT");
+        NodeRange range{node, hierarchy.subtreeSizes[node]};
 
-        if (!positionData || !texCoordData || !normalData) {
-            throw std::runtime_error("Mesh doesn't contain position, normal or texture coord data!");
+        // the parent of the subtree's root is outside of it, so its world matrix is already up to date
+        for (uint32_t i = range.first; i < range.first + range.count; i++) {
+            int32_t parent = hierarchy.parents[i];
+            hierarchy.worldMatrices[i] = (parent >= 0) ? hierarchy.worldMatrices[parent] * hierarchy.localMatrices[i] : hierarchy.localMatrices[i];
         }
 
-        // indices
-        const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
-        const void* rawIndices = getIndexData(model, indexAccessor);
-
-        // position data
-        auto positionIt = getAttributeIt("POSITION", primitive.attributes);
-        const tinygltf::Accessor& positionAccessor = model.accessors[positionIt->second];
-
-        // calculate the tangents if theyre not found
-        std::vector<dml::vec3> tangents(positionAccessor.count, dml::vec3{0.0f, 0.0f, 0.0f});
-        if (!tangentData) {
-            switch (indexAccessor.componentType) {
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                    calculateTangents<uint8_t>(positionData, texCoordData, tangents, rawIndices, indexAccessor.count);
-                    break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                    calculateTangents<uint16_t>(positionData, texCoordData, tangents, rawIndices, indexAccessor.count);
-                    break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                    calculateTangents<uint32_t>(positionData, texCoordData, tangents, rawIndices, indexAccessor.count);
-                    break;
-                default:
-                    break;
-            }
+        ranges.push_back(range);
+    }
+
+    hierarchy.dirty.clear();
+    return ranges;
+}
+
+// get the matrix that places the mesh in the scene
+dml::mat4 calcPlacementMatrix(const Mesh& m) {
+    return calcPlacementMatrix(m.position, m.rotation, m.scale);
+}
+
+dml::mat4 calcPlacementMatrix(const dml::vec3& pos, const dml::vec4& rotation, const dml::vec3& scale) {
+    dml::mat4 translationMatrix = dml::translate(pos);
+    dml::mat4 rotationMatrix = dml::rotateQuat(rotation);
+    dml::mat4 scaleMatrix = dml::scale(scale * 0.03f);  // 0.03 scales it down to a reasonable size
+    return translationMatrix * rotationMatrix * scaleMatrix;
+}
+
+uint64_t hashGeometry(std::span<const Vertex> vertices, std::span<const uint32_t> indices) {
+    // the padding of the vertices is uninitialized, so only the floats are hashed
+    uint64_t hash = vertices.size();
+    for (const Vertex& vertex : vertices) {
+        VertexWelder::Key key = VertexWelder::makeKey(vertex);
+        hash = utils::hashBytes(key.data(), sizeof(key), hash);
+    }
+
+    return utils::hashBytes(indices.data(), indices.size_bytes(), hash);
+}
+
+size_t calcMeshHash(const Mesh& m) {
+    std::array<int, 5> material = {m.material.baseColor, m.material.metallicRoughness, m.material.normalMap, m.material.occlusionMap, m.material.emissiveMap};
+    return utils::combineHashes(m.geometryHash, static_cast<size_t>(utils::hashBytes(material.data(), sizeof(material))));
+}
+
+Mesh loadPrimitive(const tinygltf::Mesh& mesh, size_t primitiveIndex, const tinygltf::Model& model, const ModelBuffers& buffers, size_t imagesOffset) {
+    const tinygltf::Primitive& primitive = mesh.primitives[primitiveIndex];
+    Mesh object{};
+
+    std::vector<uint32_t> tempIndices;
+
+    const float* positionData = getAccessorData(model, buffers, primitive.attributes, "POSITION", 3);
+    const float* texCoordData = getAccessorData(model, buffers, primitive.attributes, "TEXCOORD_0", 2);
+    const float* normalData = getAccessorData(model, buffers, primitive.attributes, "NORMAL", 3);
+    const float* tangentData = getAccessorData(model, buffers, primitive.attributes, "TANGENT", 3);
+
+    if (!positionData || !texCoordData || !normalData) {
+        throw std::runtime_error("Mesh doesn't contain position, normal or texture coord data!");
+    }
+
+    // every index has to refer to a vertex that each of the attributes has
+    size_t vertexCount = SIZE_MAX;
+    for (const char* name : {"POSITION", "TEXCOORD_0", "NORMAL", "TANGENT"}) {
+        auto it = getAttributeIt(name, primitive.attributes);
+        if (it != primitive.attributes.end()) vertexCount = std::min(vertexCount, model.accessors[it->second].count);
+    }
+
+    // indices
+    const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+    const void* rawIndices = getIndexData(model, buffers, indexAccessor);
+
+    // position data
+    auto positionIt = getAttributeIt("POSITION", primitive.attributes);
+    const tinygltf::Accessor& positionAccessor = model.accessors[positionIt->second];
+
+    // calculate the tangents if theyre not found
+    std::vector<dml::vec3> tangents(positionAccessor.count, dml::vec3{0.0f, 0.0f, 0.0f});
+    if (!tangentData) {
+        switch (indexAccessor.componentType) {
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                calculateTangents<uint8_t>(positionData, texCoordData, tangents, rawIndices, indexAccessor.count, vertexCount);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                calculateTangents<uint16_t>(positionData, texCoordData, tangents, rawIndices, indexAccessor.count, vertexCount);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                calculateTangents<uint32_t>(positionData, texCoordData, tangents, rawIndices, indexAccessor.count, vertexCount);
+                break;
+            default:
+                break;
         }
+    }
 
-        for (size_t j = 0; j < indexAccessor.count; j++) {
-            uint32_t index;  // use the largest type to ensure no overflow
-
-            switch (indexAccessor.componentType) {
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                    index = static_cast<const uint8_t*>(rawIndices)[j];
-                    break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                    index = static_cast<const uint16_t*>(rawIndices)[j];
-                    break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                    index = static_cast<const uint32_t*>(rawIndices)[j];
-                    break;
-                default:
-                    continue;  // skip this iteration
-            }
-
-            Vertex vertex;
-            vertex.pos = {positionData[3 * index], positionData[3 * index + 1], positionData[3 * index + 2]};
-            vertex.tex = {texCoordData[2 * index], texCoordData[2 * index + 1]};
-            vertex.normal = {normalData[3 * index], normalData[3 * index + 1], normalData[3 * index + 2]};
-
-            if (tangentData) {
-                vertex.tangent = {tangentData[3 * index], tangentData[3 * index + 1], tangentData[3 * index + 2]};
-            } else {
-                vertex.tangent = tangents[index];
-            }
-
-            if (uniqueVertices.count(vertex) == 0) {
-                uniqueVertices[vertex] = static_cast<uint32_t>(tempVertices.size());
-                tempVertices.push_back(vertex);
-            }
-            tempIndices.push_back(uniqueVertices[vertex]);
+    VertexWelder welder(positionAccessor.count);
+    tempIndices.reserve(indexAccessor.count);
+
+    for (size_t j = 0; j < indexAccessor.count; j++) {
+        uint32_t index;  // use the largest type to ensure no overflow
+
+        switch (indexAccessor.componentType) {
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                index = static_cast<const uint8_t*>(rawIndices)[j];
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                index = static_cast<const uint16_t*>(rawIndices)[j];
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                index = static_cast<const uint32_t*>(rawIndices)[j];
+                break;
+            default:
+                continue;  // skip this iteration
         }
 
-        if (primitive.material >= 0) {  // if the primitive has a material
-            const tinygltf::Material& tinygltfMaterial = model.materials[primitive.material];
+        if (index >= vertexCount) throw std::runtime_error("Index is outside of the mesh's vertices!");
 
-            Material material{};
-            material.baseColor = getImageIndex(model, tinygltfMaterial.pbrMetallicRoughness.baseColorTexture, imagesOffset);
-            material.metallicRoughness = getImageIndex(model, tinygltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture, imagesOffset);
-            material.normalMap = getImageIndex(model, tinygltfMaterial.normalTexture, imagesOffset);
-            material.emissiveMap = getImageIndex(model, tinygltfMaterial.emissiveTexture, imagesOffset);
-            material.occlusionMap = getImageIndex(model, tinygltfMaterial.occlusionTexture, imagesOffset);
+        Vertex vertex;
+        vertex.pos = {positionData[3 * index], positionData[3 * index + 1], positionData[3 * index + 2]};
+        vertex.tex = {texCoordData[2 * index], texCoordData[2 * index + 1]};
+        vertex.normal = {normalData[3 * index], normalData[3 * index + 1], normalData[3 * index + 2]};
 
-            object.material = material;
+        if (tangentData) {
+            vertex.tangent = {tangentData[3 * index], tangentData[3 * index + 1], tangentData[3 * index + 2]};
+        } else {
+            vertex.tangent = tangents[index];
         }
 
-        object.vertices = tempVertices;
-        object.indices = tempIndices;
+        tempIndices.push_back(welder.weld(vertex));
+    }
 
-        size_t hash1 = std::hash<std::size_t>{}(meshInd * tempIndices.size() * tempVertices.size() + i);
-        size_t hash2 = std::hash<std::string>{}(mesh.name);
+    if (primitive.material >= 0) {  // if the primitive has a material
+        const tinygltf::Material& tinygltfMaterial = model.materials[primitive.material];
 
-        object.meshHash = utils::combineHashes(hash1, hash2);
+        Material material{};
+        material.baseColor = getImageIndex(model, tinygltfMaterial.pbrMetallicRoughness.baseColorTexture, imagesOffset);
+        material.metallicRoughness = getImageIndex(model, tinygltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture, imagesOffset);
+        material.normalMap = getImageIndex(model, tinygltfMaterial.normalTexture, imagesOffset);
+        material.emissiveMap = getImageIndex(model, tinygltfMaterial.emissiveTexture, imagesOffset);
+        material.occlusionMap = getImageIndex(model, tinygltfMaterial.occlusionTexture, imagesOffset);
 
-        object.name = mesh.name;
+        object.material = material;
+    }
 
-        object.scale = scale;
-        object.position = pos;
-        object.rotation = rot;
+    object.vertices = std::move(welder.getVertices());
+    object.indices = std::move(tempIndices);
 
-        // calculate the model matrix for the mesh
-        object.modelMatrix = calcMeshWM(model, meshInd, parentInd, object);
+    object.geometryHash = hashGeometry(object.vertices, object.indices);
+    object.meshHash = calcMeshHash(object);
 
-        newObjects.push_back(object);
-    }
+    object.name = mesh.name;
+
+    return object;
+}
 
-    return newObjects;
+Mesh loadPrimitive(const tinygltf::Mesh& mesh, size_t primitiveIndex, const tinygltf::Model& model, size_t imagesOffset) {
+    return loadPrimitive(mesh, primitiveIndex, model, getModelBuffers(model), imagesOffset);
 }
 };  // namespace dvl
@@ -6,6 +6,8 @@
 #include <tiny_gltf.h>
 #include <vulkan/vulkan.h>
 
+#include <array>
+#include <span>
 #include <unordered_map>
 
 #include "dml.hpp"
@@ -23,27 +25,62 @@ struct Vertex {
     }
 };
 
-struct VertHash {
-    size_t operator()(const Vertex& vertex) const {
-        size_t seed = 0;
+// the vertex format used on the gpu, split into two streams
+// positions are read by every pass, the attributes only by the passes that shade
+struct PackedPosition {
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+};
 
-        utils::combineHash(seed, vertex.pos.x);
-        utils::combineHash(seed, vertex.pos.y);
-        utils::combineHash(seed, vertex.pos.z);
+// normal and tangent are octahedral encoded snorm16 pairs, tex is a half float pair
+struct PackedAttributes {
+    std::array<int16_t, 2> normal{};
+    std::array<int16_t, 2> tangent{};
+    std::array<uint16_t, 2> tex{};
+};
 
-        utils::combineHash(seed, vertex.tex.x);
-        utils::combineHash(seed, vertex.tex.y);
+// rounds to the nearest half float, values out of range become infinity
+[[nodiscard]] uint16_t toHalf(float value) noexcept;
 
-        utils::combineHash(seed, vertex.normal.x);
-        utils::combineHash(seed, vertex.normal.y);
-        utils::combineHash(seed, vertex.normal.z);
+// packs the vertices into the position and attribute streams
+// both destinations must have room for every vertex
+void packVertices(std::span<const Vertex> vertices, PackedPosition* positions, PackedAttributes* attributes) noexcept;
 
-        utils::combineHash(seed, vertex.tangent.x);
-        utils::combineHash(seed, vertex.tangent.y);
-        utils::combineHash(seed, vertex.tangent.z);
+// true if the indices of a mesh with this many vertices fit in 16 bits
+[[nodiscard]] constexpr bool fitsIndex16(size_t vertexCount) noexcept {
+    return vertexCount <= 65536;
+}
 
-        return seed;
-    }
+// welds identical vertices together using a flat open addressing table
+// vertices are compared bit for bit, so the padding in Vertex is never read
+class VertexWelder {
+public:
+    // maxVertices is the most unique vertices expected (the accessor count)
+    explicit VertexWelder(size_t maxVertices);
+
+    // returns the index of the vertex, adding it if it hasnt been seen before
+    uint32_t weld(const Vertex& vertex);
+
+    [[nodiscard]] std::vector<Vertex>& getVertices() noexcept { return m_vertices; }
+
+    // the 11 floats of the vertex + 1 word of padding
+    // also used by hashGeometry, so the hash never depends on the padding
+    using Key = std::array<uint32_t, 12>;
+
+    static Key makeKey(const Vertex& vertex) noexcept;
+
+private:
+    static uint64_t hashKey(const Key& key) noexcept;
+
+    void rehash(size_t slotCount);
+
+    // high 32 bits are a tag from the hash, low 32 bits are the vertex index + 1 (0 means empty)
+    std::vector<uint64_t> m_slots;
+    size_t m_mask = 0;
+
+    std::vector<Key> m_keys;
+    std::vector<Vertex> m_vertices;
 };
 
 struct Material {
@@ -56,10 +93,33 @@ struct Material {
     Material() = default;
 };
 
+// a contiguous range of a mesh's triangles that is culled as a group
+struct Meshlet {
+    dml::vec4 sphere{0.0f, 0.0f, 0.0f, 0.0f};  // xyz is the center, w is the radius
+    dml::vec4 cone{0.0f, 0.0f, 0.0f, 1.0f};    // xyz is the average normal, w is the cutoff (1 disables cone culling)
+
+    uint32_t triangleOffset = 0;  // relative to the first index of the mesh
+    uint32_t triangleCount = 0;
+    uint32_t vertexCount = 0;
+    uint32_t padding = 0;
+};
+
+// a level of detail of a mesh, as a range of its indices and meshlets
+// every level uses the vertices of the full detail mesh
+struct MeshLod {
+    uint32_t indexOffset = 0;  // relative to the first index of the mesh
+    uint32_t indexCount = 0;
+    uint32_t meshletOffset = 0;  // relative to the first meshlet of the mesh
+    uint32_t meshletCount = 0;
+    float error = 0.0f;  // how far the level deviates from the full detail mesh, in object space
+};
+
 struct Mesh {
     Material material{};
     std::vector<Vertex> vertices{};
-    std::vector<uint32_t> indices{};
+    std::vector<uint32_t> indices{};  // the indices of every level of detail, starting with the full detail mesh
+    std::vector<Meshlet> meshlets{};
+    std::vector<MeshLod> lods{};
 
     dml::vec3 position{};
     dml::vec4 rotation{};
@@ -68,22 +128,59 @@ struct Mesh {
 
     size_t textureCount = 0;
 
-    size_t meshHash = 0;
+    size_t geometryHash = 0;  // of the vertex and index data, so identical meshes from any file share it
+    size_t meshHash = 0;      // of the geometry and the material, instances with the same one share a mesh of the scene
     std::string name{};
     std::string file{};
 
+    // views into memory mapped cache data, used instead of vertices and indices when set
+    std::span<const Vertex> vertexView{};
+    std::span<const uint32_t> indexView{};
+    std::span<const Meshlet> meshletView{};
+    std::span<const MeshLod> lodView{};
+
     Mesh() = default;
+
+    [[nodiscard]] std::span<const Vertex> getVertices() const noexcept { return vertexView.empty() ? std::span<const Vertex>(vertices) : vertexView; }
+    [[nodiscard]] std::span<const uint32_t> getIndices() const noexcept { return indexView.empty() ? std::span<const uint32_t>(indices) : indexView; }
+    [[nodiscard]] std::span<const Meshlet> getMeshlets() const noexcept { return meshletView.empty() ? std::span<const Meshlet>(meshlets) : meshletView; }
+    [[nodiscard]] std::span<const MeshLod> getLods() const noexcept { return lodView.empty() ? std::span<const MeshLod>(lods) : lodView; }
+};
+
+// a subtree of flattened nodes
+struct NodeRange {
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+// the nodes of a model flattened depth first, so every parent comes before its children and every subtree is contiguous
+// the world matrices can then be computed in a single pass, and a subtree can be updated on its own
+struct NodeHierarchy {
+    std::vector<int32_t> nodes{};          // the gltf node of each flattened node
+    std::vector<int32_t> parents{};        // the flattened parent of each node, -1 for roots
+    std::vector<uint32_t> subtreeSizes{};  // including the node itself
+
+    std::vector<dml::mat4> localMatrices{};
+    std::vector<dml::mat4> worldMatrices{};  // relative to the model
+
+    std::vector<int32_t> flatIndices{};               // the flattened node of each gltf node, -1 if its not part of the hierarchy
+    std::vector<std::vector<uint32_t>> meshNodes{};   // the flattened nodes that use each mesh, each places an instance of it
+    std::vector<std::vector<dml::mat4>> instances{};  // the EXT_mesh_gpu_instancing transforms of each node, relative to it
+
+    std::vector<uint32_t> dirty{};  // nodes whose local matrix changed since the world matrices were updated
 };
 
 template <typename IndexType>
-void calculateTangents(const float* positionData, const float* texCoordData, std::vector<dml::vec3>& tangents, const void* rawIndices, size_t size) {
-    for (size_t i = 0; i < size; i += 3) {
+void calculateTangents(const float* positionData, const float* texCoordData, std::vector<dml::vec3>& tangents, const void* rawIndices, size_t size, size_t vertexCount) {
+    for (size_t i = 0; i + 2 < size; i += 3) {
         std::array<IndexType, 3> indices{};
         std::array<dml::vec3, 3> pos{};
         std::array<dml::vec2, 3> tex{};
 
         for (uint8_t j = 0; j < 3; j++) {
             indices[j] = static_cast<const IndexType*>(rawIndices)[i + j];
+            if (indices[j] >= vertexCount) throw std::runtime_error("Index is outside of the mesh's vertices!");
+
             pos[j] = {positionData[3 * indices[j]], positionData[3 * indices[j] + 1], positionData[3 * indices[j] + 2]};
             tex[j] = {texCoordData[2 * indices[j]], texCoordData[2 * indices[j] + 1]};
         }
@@ -121,19 +218,43 @@ void calculateTangents(const float* positionData, const float* texCoordData, std
 
 std::map<std::string, int>::const_iterator getAttributeIt(const std::string& name, const std::map<std::string, int>& attributes);
 
-const float* getAccessorData(const tinygltf::Model& model, const std::map<std::string, int>& attributes, const std::string& attributeName);
+// the data of each buffer of a model, indexed like model.buffers
+// lets the buffers be read from memory the model doesnt own, like a memory mapped glb
+using ModelBuffers = std::vector<std::span<const uint8_t>>;
+
+// views into the buffers owned by the model
+ModelBuffers getModelBuffers(const tinygltf::Model& model);
+
+const float* getAccessorData(const tinygltf::Model& model, const ModelBuffers& buffers, const std::map<std::string, int>& attributes, const std::string& attributeName, size_t componentCount);
 
-const void* getIndexData(const tinygltf::Model& model, const tinygltf::Accessor& accessor);
+const void* getIndexData(const tinygltf::Model& model, const ModelBuffers& buffers, const tinygltf::Accessor& accessor);
 
 dml::mat4 gltfToMat4(const std::vector<double>& vec);
 
 dml::mat4 calcNodeLM(const tinygltf::Node& node);
 
-int getNodeIndex(const tinygltf::Model& model, int meshIndex);
+// every node without a parent is a root, and the world matrices are computed for the whole hierarchy
+// the buffers are only read for the instances of EXT_mesh_gpu_instancing
+NodeHierarchy flattenNodes(const tinygltf::Model& model, const ModelBuffers& buffers);
+
+// the world matrices of the node's subtree are updated the next time the dirty nodes are
+void setNodeLocalMatrix(NodeHierarchy& hierarchy, uint32_t node, const dml::mat4& matrix);
+
+// recomputes the world matrices of every dirty subtree, and returns the ranges of nodes that changed
+std::vector<NodeRange> updateWorldMatrices(NodeHierarchy& hierarchy);
+
+dml::mat4 calcPlacementMatrix(const Mesh& m);
+dml::mat4 calcPlacementMatrix(const dml::vec3& pos, const dml::vec4& rotation, const dml::vec3& scale);
+
+uint64_t hashGeometry(std::span<const Vertex> vertices, std::span<const uint32_t> indices);
 
-dml::mat4 calcMeshWM(const tinygltf::Model& gltfMod, int meshIndex, std::unordered_map<int, int>& parentIndex, Mesh& m);
+// the image indices of the material have to include the model's image offset
+// otherwise the same indices in different models would be treated as the same images
+size_t calcMeshHash(const Mesh& m);
 
-std::vector<Mesh> loadMesh(const tinygltf::Mesh& mesh, const tinygltf::Model& model, std::unordered_map<int, int>& parentInd, uint32_t meshInd, dml::vec3 scale, dml::vec3 pos, dml::vec4 rot, size_t imagesOffset);
+// loads a single primitive of a mesh without placing it in the scene
+Mesh loadPrimitive(const tinygltf::Mesh& mesh, size_t primitiveIndex, const tinygltf::Model& model, const ModelBuffers& buffers, size_t imagesOffset);
+Mesh loadPrimitive(const tinygltf::Mesh& mesh, size_t primitiveIndex, const tinygltf::Model& model, size_t imagesOffset);
 
 template <typename TinygltfTexture>
 int getImageIndex(const tinygltf::Model& model, const TinygltfTexture& texture, size_t offset) {
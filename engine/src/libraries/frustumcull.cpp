@@ -0,0 +1,138 @@
+#include "frustumcull.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FRUSTUMCULL_SSE
+#endif
+
+namespace frustumcull {
+namespace {
+Plane normalizePlane(float a, float b, float c, float d) noexcept {
+    float length = std::sqrt((a * a) + (b * b) + (c * c));
+    if (length == 0.0f) return {a, b, c, d};
+
+    return {a / length, b / length, c / length, d / length};
+}
+
+bool testSphere(const Spheres& spheres, std::span<const Frustum> frusta, size_t index) noexcept {
+    float x = spheres.x[index];
+    float y = spheres.y[index];
+    float z = spheres.z[index];
+    float r = spheres.radius[index];
+
+    for (const Frustum& frustum : frusta) {
+        bool inside = true;
+        for (const Plane& p : frustum) {
+            inside = inside && (p.a * x) + (p.b * y) + (p.c * z) + p.d >= -r;
+        }
+
+        if (inside) return true;
+    }
+
+    return false;
+}
+}  // namespace
+
+Frustum extractFrustum(const dml::mat4& viewProj) noexcept {
+    // the rows of the matrix, which is stored by column
+    std::array<std::array<float, 4>, 4> rows{};
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            rows[row][col] = viewProj.m[col][row];
+        }
+    }
+
+    Frustum frustum{};
+    for (int i = 0; i < 3; i++) {
+        const std::array<float, 4>& r = rows[i];
+        const std::array<float, 4>& w = rows[3];
+
+        frustum[i * 2] = normalizePlane(w[0] + r[0], w[1] + r[1], w[2] + r[2], w[3] + r[3]);
+        frustum[(i * 2) + 1] = normalizePlane(w[0] - r[0], w[1] - r[1], w[2] - r[2], w[3] - r[3]);
+    }
+
+    return frustum;
+}
+
+void testSpheres(const Spheres& spheres, std::span<const Frustum> frusta, size_t first, size_t last, uint8_t* visible) noexcept {
+    size_t i = first;
+
+#ifdef FRUSTUMCULL_SSE
+    // the spheres are tested in blocks, so each plane is only loaded into a register once per block
+    constexpr size_t BLOCK_SIZE = 256;
+    __m128 anyInside[BLOCK_SIZE / 4];
+
+    while (i + 4 <= last) {
+        size_t quadCount = std::min(BLOCK_SIZE, last - i) / 4;
+        std::fill_n(anyInside, quadCount, _mm_setzero_ps());
+
+        for (const Frustum& frustum : frusta) {
+            __m128 planes[24];
+            for (size_t p = 0; p < frustum.size(); p++) {
+                planes[(p * 4)] = _mm_set1_ps(frustum[p].a);
+                planes[(p * 4) + 1] = _mm_set1_ps(frustum[p].b);
+                planes[(p * 4) + 2] = _mm_set1_ps(frustum[p].c);
+                planes[(p * 4) + 3] = _mm_set1_ps(frustum[p].d);
+            }
+
+            for (size_t q = 0; q < quadCount; q++) {
+                size_t index = i + (q * 4);
+                __m128 x = _mm_loadu_ps(spheres.x.data() + index);
+                __m128 y = _mm_loadu_ps(spheres.y.data() + index);
+                __m128 z = _mm_loadu_ps(spheres.z.data() + index);
+                __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius.data() + index));
+
+                // four spheres against one plane at a time
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (size_t p = 0; p < 24; p += 4) {
+                    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planes[p]), _mm_mul_ps(y, planes[p + 1])), _mm_add_ps(_mm_mul_ps(z, planes[p + 2]), planes[p + 3]));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+                }
+
+                anyInside[q] = _mm_or_ps(anyInside[q], inside);
+            }
+        }
+
+        for (size_t q = 0; q < quadCount; q++, i += 4) {
+            int mask = _mm_movemask_ps(anyInside[q]);
+            visible[i] = static_cast<uint8_t>(mask & 1);
+            visible[i + 1] = static_cast<uint8_t>((mask >> 1) & 1);
+            visible[i + 2] = static_cast<uint8_t>((mask >> 2) & 1);
+            visible[i + 3] = static_cast<uint8_t>((mask >> 3) & 1);
+        }
+    }
+#endif
+
+    for (; i < last; i++) {
+        visible[i] = testSphere(spheres, frusta, i) ? 1 : 0;
+    }
+}
+
+void testSpheres(threadpool::ThreadPool& pool, const Spheres& spheres, std::span<const Frustum> frusta, uint8_t* visible) {
+    size_t count = spheres.size();
+
+    // the calling thread takes a part too, so it isnt left waiting
+    size_t taskCount = std::min(pool.getThreadCount() + 1, std::max(count / MIN_TASK_SIZE, static_cast<size_t>(1)));
+
+    // keep the parts a multiple of four, so only the last one has a scalar tail
+    size_t taskSize = (((count + taskCount - 1) / taskCount) + 3) & ~static_cast<size_t>(3);
+
+    std::vector<std::future<void>> tasks;
+    tasks.reserve(taskCount);
+
+    for (size_t first = taskSize; first < count; first += taskSize) {
+        size_t last = std::min(first + taskSize, count);
+        tasks.push_back(pool.submit([&spheres, frusta, first, last, visible]() { testSpheres(spheres, frusta, first, last, visible); }));
+    }
+
+    testSpheres(spheres, frusta, 0, std::min(taskSize, count), visible);
+
+    for (std::future<void>& task : tasks) {
+        task.get();
+    }
+}
+}  // namespace frustumcull
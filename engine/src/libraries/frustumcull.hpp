@@ -0,0 +1,60 @@
+// Frustum culling of bounding spheres
+// The spheres are stored with an array per component, so they're tested four at a time with SSE where it's available
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "dml.hpp"
+#include "threadpool.hpp"
+
+namespace frustumcull {
+// below this many spheres per task, the tasks cost more than they save
+constexpr size_t MIN_TASK_SIZE = 4096;
+
+// ax + by + cz + d, with the normal facing into the frustum and normalized so d is a distance
+struct Plane {
+    float a = 0.0f;
+    float b = 0.0f;
+    float c = 0.0f;
+    float d = 0.0f;
+};
+
+using Frustum = std::array<Plane, 6>;
+
+// world space bounding spheres
+struct Spheres {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+
+    [[nodiscard]] size_t size() const noexcept { return x.size(); }
+
+    void resize(size_t count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        radius.resize(count);
+    }
+
+    void set(size_t index, const dml::vec3& center, float r) noexcept {
+        x[index] = center.x;
+        y[index] = center.y;
+        z[index] = center.z;
+        radius[index] = r;
+    }
+};
+
+// the near plane uses the -w to w depth range, which is conservative for 0 to w
+[[nodiscard]] Frustum extractFrustum(const dml::mat4& viewProj) noexcept;
+
+// visible[i] is set to 1 if sphere i is at least partly inside any of the frusta, and 0 if it isnt
+void testSpheres(const Spheres& spheres, std::span<const Frustum> frusta, size_t first, size_t last, uint8_t* visible) noexcept;
+
+// splits the spheres between the pool and the calling thread, and waits for every part to be tested
+void testSpheres(threadpool::ThreadPool& pool, const Spheres& spheres, std::span<const Frustum> frusta, uint8_t* visible);
+}  // namespace frustumcull
@@ -0,0 +1,170 @@
+#include "glbfile.hpp"
+
+#include <json.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "imagedecode.hpp"
+#include "packfile.hpp"
+
+namespace glbfile {
+namespace {
+// a single zero byte, stands in for anything tinygltf would otherwise copy out of the bin chunk
+constexpr const char* PLACEHOLDER_URI = "data:application/octet-stream;base64,AA==";
+
+uint32_t readU32(const uint8_t* data) {
+    uint32_t value = 0;
+    std::memcpy(&value, data, sizeof(uint32_t));
+    return value;
+}
+}  // namespace
+
+bool GlbFile::open(const std::string& path) {
+    m_json = {};
+    m_bin = {};
+    if (!packfile::openMapped(m_file, path)) return false;
+
+    // header: magic, version, length
+    const uint8_t* data = m_file.data();
+    size_t size = m_file.size();
+
+    bool valid = size >= 20 && readU32(data) == MAGIC && readU32(data + 4) == 2;
+    size_t length = valid ? readU32(data + 8) : 0;
+    valid = valid && length <= size;
+
+    // the json chunk always comes first
+    size_t jsonLength = valid ? readU32(data + 12) : 0;
+    valid = valid && readU32(data + 16) == CHUNK_JSON && 20 + jsonLength <= length;
+
+    if (!valid) {
+        m_file.close();
+        return false;
+    }
+
+    m_json = {data + 20, jsonLength};
+
+    // the bin chunk is optional
+    size_t binChunk = 20 + jsonLength;
+    if (binChunk + 8 <= length && readU32(data + binChunk + 4) == CHUNK_BIN) {
+        size_t binLength = readU32(data + binChunk);
+
+        if (binChunk + 8 + binLength > length) {
+            m_file.close();
+            m_json = {};
+            return false;
+        }
+
+        m_bin = {data + binChunk + 8, binLength};
+    }
+
+    m_baseDir = std::filesystem::path(path).parent_path().string();
+    return true;
+}
+
+bool GlbFile::parse(tinygltf::Model& model, std::string& err, std::string& warn) const {
+    if (!valid()) {
+        err = "GLB file isnt open";
+        return false;
+    }
+
+    nlohmann::json json = nlohmann::json::parse(m_json.begin(), m_json.end(), nullptr, false);
+    if (json.is_discarded() || !json.is_object()) {
+        err = "GLB file has an invalid JSON chunk";
+        return false;
+    }
+
+    // tinygltf copies the whole bin chunk into the buffer that has no uri, so only the json is given to it
+    // the buffer gets a placeholder, and getBuffers reads the bin chunk from the mapping instead
+    bool hasBinBuffer = false;
+    nlohmann::json& buffers = json["buffers"];
+    if (buffers.is_array() && !buffers.empty() && buffers[0].is_object() && !buffers[0].contains("uri")) {
+        if (m_bin.empty()) {
+            err = "GLB file has a buffer without a uri, but no BIN chunk";
+            return false;
+        }
+
+        buffers[0]["uri"] = PLACEHOLDER_URI;
+        buffers[0]["byteLength"] = 1;
+        hasBinBuffer = true;
+    }
+
+    // embedded images would be read from the placeholder, so they get one too
+    // their buffer views are restored after parsing, and they are decoded from the mapping (see imagedecode)
+    struct ImageView {
+        size_t index = 0;
+        int bufferView = -1;
+        std::string mimeType{};
+    };
+
+    std::vector<ImageView> imageViews;
+    nlohmann::json& images = json["images"];
+    if (images.is_array()) {
+        for (size_t i = 0; i < images.size(); i++) {
+            nlohmann::json& image = images[i];
+            if (!image.is_object() || !image.contains("bufferView") || !image["bufferView"].is_number_integer()) continue;
+
+            std::string mimeType = image.contains("mimeType") && image["mimeType"].is_string() ? image["mimeType"].get<std::string>() : "";
+            imageViews.push_back({i, image["bufferView"].get<int>(), std::move(mimeType)});
+            image.erase("bufferView");
+            image["uri"] = PLACEHOLDER_URI;
+        }
+    }
+
+    // operator[] adds a null member for anything the file didnt have, which tinygltf would reject
+    if (buffers.is_null()) json.erase("buffers");
+    if (images.is_null()) json.erase("images");
+
+    std::string text = json.dump();
+    json = nullptr;
+
+    if (text.size() > std::numeric_limits<unsigned int>::max()) {
+        err = "GLB file is too large to parse";
+        return false;
+    }
+
+    // images are left encoded, to be decoded on worker threads
+    tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(imagedecode::deferImage, nullptr);
+
+    bool ret = loader.LoadASCIIFromString(&model, &err, &warn, text.data(), static_cast<unsigned int>(text.size()), m_baseDir);
+    if (!ret) return false;
+
+    if (hasBinBuffer) {
+        model.buffers[0].uri.clear();
+        std::vector<unsigned char>().swap(model.buffers[0].data);
+    }
+
+    for (ImageView& view : imageViews) {
+        if (view.index >= model.images.size()) continue;
+
+        tinygltf::Image& image = model.images[view.index];
+        image.bufferView = view.bufferView;
+        image.mimeType = std::move(view.mimeType);
+        image.uri.clear();
+        std::vector<unsigned char>().swap(image.image);
+    }
+
+    return true;
+}
+
+std::vector<std::span<const uint8_t>> GlbFile::getBuffers(const tinygltf::Model& model) const {
+    std::vector<std::span<const uint8_t>> buffers;
+    buffers.reserve(model.buffers.size());
+
+    for (size_t i = 0; i < model.buffers.size(); i++) {
+        const tinygltf::Buffer& buffer = model.buffers[i];
+
+        if (i == 0 && buffer.uri.empty() && buffer.data.empty()) {
+            buffers.push_back(m_bin);
+        } else {
+            buffers.emplace_back(buffer.data.data(), buffer.data.size());
+        }
+    }
+
+    return buffers;
+}
+}  // namespace glbfile
@@ -0,0 +1,56 @@
+// Memory mapped glTF binary (GLB) files
+// The JSON chunk is parsed by tinygltf, and the BIN chunk is read in place from the mapping
+
+#pragma once
+
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "mappedfile.hpp"
+
+namespace glbfile {
+constexpr uint32_t MAGIC = 0x46546c67;       // "glTF"
+constexpr uint32_t CHUNK_JSON = 0x4e4f534a;  // "JSON"
+constexpr uint32_t CHUNK_BIN = 0x004e4942;   // "BIN"
+
+class GlbFile {
+public:
+    GlbFile() = default;
+
+    // delete copying
+    GlbFile(const GlbFile&) = delete;
+    GlbFile& operator=(const GlbFile&) = delete;
+
+    // the chunks point into the mapping, which doesnt move with the file
+    GlbFile(GlbFile&&) noexcept = default;
+    GlbFile& operator=(GlbFile&&) noexcept = default;
+
+    // returns false if the file couldnt be mapped or isnt a valid glb
+    bool open(const std::string& path);
+
+    // parses the file into the model, leaving the images encoded (see imagedecode)
+    // only the JSON chunk is given to tinygltf, so the BIN chunk is never copied and getBuffers reads it from the mapping
+    bool parse(tinygltf::Model& model, std::string& err, std::string& warn) const;
+
+    // the data of each buffer of a parsed model, indexed like model.buffers
+    // only valid while the file is open
+    [[nodiscard]] std::vector<std::span<const uint8_t>> getBuffers(const tinygltf::Model& model) const;
+
+    // getters
+    [[nodiscard]] bool valid() const noexcept { return m_file.valid(); }
+    [[nodiscard]] const mappedfile::MappedFile& getFile() const noexcept { return m_file; }
+    [[nodiscard]] std::span<const uint8_t> getJson() const noexcept { return m_json; }
+    [[nodiscard]] std::span<const uint8_t> getBin() const noexcept { return m_bin; }
+
+private:
+    mappedfile::MappedFile m_file;
+    std::string m_baseDir{};
+
+    std::span<const uint8_t> m_json{};
+    std::span<const uint8_t> m_bin{};
+};
+}  // namespace glbfile
@@ -0,0 +1,75 @@
+#include "imagedecode.hpp"
+
+#include <limits>
+#include <stdexcept>
+
+#include "stb_image.h"
+
+namespace imagedecode {
+void PixelDeleter::operator()(uint8_t* pixels) const noexcept {
+    stbi_image_free(pixels);
+}
+
+bool deferImage(tinygltf::Image* image, const int, std::string*, std::string*, int, int, const unsigned char* bytes, int size, void*) {
+    image->as_is = true;
+
+    // the bytes of a buffer view are tinygltf's copy of the buffer, which doesnt outlive the parse
+    if (image->bufferView < 0 && bytes != nullptr && size > 0) {
+        image->image.assign(bytes, bytes + size);
+    }
+
+    return true;
+}
+
+DecodedImage decode(std::span<const uint8_t> encoded) {
+    if (encoded.empty() || encoded.size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("Image has no data to decode!");
+    }
+
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+
+    // always decoded to 4 channels
+    stbi_uc* pixels = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height, &channels, 4);
+    if (pixels == nullptr) {
+        std::string error = stbi_failure_reason();
+        throw std::runtime_error("Failed to decode image! Reason: " + error);
+    }
+
+    DecodedImage image{};
+    image.width = static_cast<uint32_t>(width);
+    image.height = static_cast<uint32_t>(height);
+    image.pixels.reset(pixels);
+    return image;
+}
+
+PendingImage PendingImage::submit(threadpool::ThreadPool& pool, std::span<const uint8_t> encoded, std::shared_ptr<const void> owner) {
+    PendingImage image{};
+
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+
+    if (!encoded.empty() && encoded.size() <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+        if (stbi_info_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height, &channels)) {
+            image.m_width = static_cast<uint32_t>(width);
+            image.m_height = static_cast<uint32_t>(height);
+        }
+    }
+
+    image.m_cancelled = std::make_shared<std::atomic<bool>>(false);
+
+    auto task = [encoded, owner = std::move(owner), cancelled = image.m_cancelled]() {
+        if (cancelled->load(std::memory_order_relaxed)) return DecodedImage{};
+        return decode(encoded);
+    };
+
+    image.m_future = pool.submit(std::move(task)).share();
+    return image;
+}
+
+void PendingImage::cancel() const noexcept {
+    if (m_cancelled) m_cancelled->store(true, std::memory_order_relaxed);
+}
+}  // namespace imagedecode
@@ -0,0 +1,67 @@
+// Deferred decoding of glTF images
+// tinygltf is given a loader that leaves images encoded, so they can be decoded on worker threads after parsing
+
+#pragma once
+
+#include <tiny_gltf.h>
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "threadpool.hpp"
+
+namespace imagedecode {
+struct PixelDeleter {
+    void operator()(uint8_t* pixels) const noexcept;
+};
+
+// 8 bit rgba pixels
+struct DecodedImage {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::unique_ptr<uint8_t, PixelDeleter> pixels{};
+
+    [[nodiscard]] size_t size() const noexcept { return static_cast<size_t>(width) * height * 4; }
+};
+
+// image loader for tinygltf::TinyGLTF::SetImageLoader
+// images in a buffer view are left empty since their bytes can be read from the buffer
+// any other image keeps its encoded bytes in image.image, with as_is set
+bool deferImage(tinygltf::Image* image, const int imageIndex, std::string* err, std::string* warn, int reqWidth, int reqHeight, const unsigned char* bytes, int size, void* userData);
+
+// throws if the image couldnt be decoded
+DecodedImage decode(std::span<const uint8_t> encoded);
+
+// an image being decoded on a thread pool
+class PendingImage {
+public:
+    PendingImage() = default;
+
+    // reads the size from the header of the image and queues the decode
+    // owner is kept alive until the decode has finished, so it should own the encoded bytes
+    static PendingImage submit(threadpool::ThreadPool& pool, std::span<const uint8_t> encoded, std::shared_ptr<const void> owner);
+
+    // skips the decode if it hasnt started yet, for images that turned out not to be needed
+    void cancel() const noexcept;
+
+    // waits for the decode, rethrowing if it failed
+    // a cancelled image has no pixels
+    [[nodiscard]] const DecodedImage& get() const { return m_future.get(); }
+
+    // getters
+    [[nodiscard]] bool valid() const noexcept { return m_future.valid(); }
+    [[nodiscard]] uint32_t getWidth() const noexcept { return m_width; }
+    [[nodiscard]] uint32_t getHeight() const noexcept { return m_height; }
+
+private:
+    std::shared_future<DecodedImage> m_future{};
+    std::shared_ptr<std::atomic<bool>> m_cancelled{};
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+};
+}  // namespace imagedecode
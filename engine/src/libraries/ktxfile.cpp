@@ -0,0 +1,256 @@
+#include "ktxfile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "packfile.hpp"
+#include "utils.hpp"
+
+namespace ktxfile {
+namespace {
+static_assert(sizeof(Header) == 80 && sizeof(LevelIndex) == 24);
+
+// mip levels are aligned to the lcm of the texel block size and 4
+constexpr size_t LEVEL_ALIGNMENT = 16;
+
+// data format descriptor values (khronos data format specification)
+constexpr uint32_t DF_MODEL_RGBSDA = 1;
+constexpr uint32_t DF_MODEL_BC5 = 132;
+constexpr uint32_t DF_MODEL_BC7 = 134;
+constexpr uint32_t DF_PRIMARIES_BT709 = 1;
+constexpr uint32_t DF_TRANSFER_LINEAR = 1;
+constexpr uint32_t DF_TRANSFER_SRGB = 2;
+constexpr uint32_t DF_SAMPLE_SIGNED = 0x40;
+constexpr uint32_t DF_SAMPLE_FLOAT = 0x80;
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void appendU32(std::vector<uint8_t>& data, uint32_t value) {
+    size_t offset = data.size();
+    data.resize(offset + sizeof(uint32_t));
+    std::memcpy(data.data() + offset, &value, sizeof(uint32_t));
+}
+
+// a basic descriptor block for rgba16f
+std::vector<uint8_t> createFloatDfd() {
+    uint32_t blockSize = 24 + (16 * 4);
+
+    std::vector<uint8_t> dfd;
+    appendU32(dfd, 4 + blockSize);
+
+    appendU32(dfd, 0);                       // vendor id and descriptor type
+    appendU32(dfd, 2 | (blockSize << 16));  // version and block size
+    appendU32(dfd, DF_MODEL_RGBSDA | (DF_PRIMARIES_BT709 << 8) | (DF_TRANSFER_LINEAR << 16));
+    appendU32(dfd, 0);  // block dimensions - 1
+    appendU32(dfd, 8);  // bytes per texel
+    appendU32(dfd, 0);
+
+    // a signed float sample of 16 bits per channel, the limits are -1 and 1 as floats
+    const std::array<uint32_t, 4> channels = {0, 1, 2, 15};
+    for (uint32_t i = 0; i < channels.size(); i++) {
+        appendU32(dfd, (i * 16) | (15 << 16) | ((channels[i] | DF_SAMPLE_FLOAT | DF_SAMPLE_SIGNED) << 24));
+        appendU32(dfd, 0);
+        appendU32(dfd, 0xBF800000);
+        appendU32(dfd, 0x3F800000);
+    }
+
+    return dfd;
+}
+
+// a basic descriptor block for rgba16f or a 4x4 block compressed format
+std::vector<uint8_t> createDfd(VkFormat format) {
+    if (format == VK_FORMAT_R16G16B16A16_SFLOAT) return createFloatDfd();
+
+    bool bc5 = (format == VK_FORMAT_BC5_UNORM_BLOCK);
+    bool srgb = (format == VK_FORMAT_BC7_SRGB_BLOCK);
+
+    uint32_t sampleCount = bc5 ? 2 : 1;
+    uint32_t blockSize = 24 + (16 * sampleCount);
+
+    std::vector<uint8_t> dfd;
+    appendU32(dfd, 4 + blockSize);
+
+    appendU32(dfd, 0);                       // vendor id and descriptor type
+    appendU32(dfd, 2 | (blockSize << 16));  // version and block size
+    appendU32(dfd, (bc5 ? DF_MODEL_BC5 : DF_MODEL_BC7) | (DF_PRIMARIES_BT709 << 8) | ((srgb ? DF_TRANSFER_SRGB : DF_TRANSFER_LINEAR) << 16));
+    appendU32(dfd, 3 | (3 << 8));  // block dimensions - 1
+    appendU32(dfd, 16);            // bytes per block
+    appendU32(dfd, 0);
+
+    // bc5 has a red and green sample of 64 bits each, bc7 a single sample of all 128 bits
+    for (uint32_t i = 0; i < sampleCount; i++) {
+        uint32_t bitOffset = bc5 ? i * 64 : 0;
+        uint32_t bitLength = bc5 ? 63 : 127;
+
+        appendU32(dfd, bitOffset | (bitLength << 16) | (i << 24));
+        appendU32(dfd, 0);
+        appendU32(dfd, 0);
+        appendU32(dfd, 0xFFFFFFFF);
+    }
+
+    return dfd;
+}
+
+std::vector<uint8_t> createKvd(std::vector<std::pair<std::string, std::string>> values) {
+    std::sort(values.begin(), values.end());
+
+    std::vector<uint8_t> kvd;
+    for (const auto& [key, value] : values) {
+        appendU32(kvd, static_cast<uint32_t>(key.size() + value.size() + 2));
+
+        kvd.insert(kvd.end(), key.begin(), key.end());
+        kvd.push_back(0);
+        kvd.insert(kvd.end(), value.begin(), value.end());
+        kvd.push_back(0);
+
+        kvd.resize(alignUp(kvd.size(), 4));
+    }
+
+    return kvd;
+}
+}  // namespace
+
+bool KtxFile::open(const std::string& path) {
+    m_header = nullptr;
+    m_levels = nullptr;
+    if (!packfile::openMapped(m_file, path)) return false;
+
+    size_t size = m_file.size();
+    const Header* header = m_file.at<Header>(0);
+
+    bool valid = size >= sizeof(Header) && header->identifier == IDENTIFIER;
+    valid = valid && header->supercompressionScheme == 0 && header->pixelDepth == 0 && header->layerCount <= 1 && (header->faceCount == 1 || header->faceCount == 6);
+    valid = valid && header->levelCount > 0 && sizeof(Header) + (header->levelCount * sizeof(LevelIndex)) <= size;
+    valid = valid && static_cast<size_t>(header->kvdByteOffset) + header->kvdByteLength <= size;
+
+    if (valid) {
+        const LevelIndex* levels = m_file.at<LevelIndex>(sizeof(Header));
+
+        for (uint32_t i = 0; i < header->levelCount && valid; i++) {
+            valid = levels[i].byteOffset <= size && levels[i].byteLength <= size - levels[i].byteOffset;
+        }
+
+        m_levels = levels;
+    }
+
+    if (!valid) {
+        m_file.close();
+        m_levels = nullptr;
+        return false;
+    }
+
+    m_header = header;
+    return true;
+}
+
+std::string_view KtxFile::getValue(std::string_view key) const {
+    const uint8_t* data = m_file.data() + m_header->kvdByteOffset;
+    size_t offset = 0;
+
+    while (offset + sizeof(uint32_t) <= m_header->kvdByteLength) {
+        uint32_t length = 0;
+        std::memcpy(&length, data + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+
+        if (length > m_header->kvdByteLength - offset) break;
+
+        // the key and value are both null terminated
+        std::string_view entry(reinterpret_cast<const char*>(data + offset), length);
+        size_t keyEnd = entry.find('\0');
+
+        if (keyEnd != std::string_view::npos && entry.substr(0, keyEnd) == key) {
+            std::string_view value = entry.substr(keyEnd + 1);
+            if (!value.empty() && value.back() == '\0') value.remove_suffix(1);
+            return value;
+        }
+
+        offset = alignUp(offset + length, 4);
+    }
+
+    return {};
+}
+
+std::span<const uint8_t> KtxFile::getLevel(uint32_t level) const noexcept {
+    const LevelIndex& index = m_levels[level];
+    return {m_file.data() + index.byteOffset, static_cast<size_t>(index.byteLength)};
+}
+
+bool write(const std::string& path, VkFormat format, uint32_t width, uint32_t height, uint32_t faceCount, const std::vector<std::span<const uint8_t>>& levels, const std::vector<std::pair<std::string, std::string>>& values) {
+    std::vector<uint8_t> dfd = createDfd(format);
+    std::vector<uint8_t> kvd = createKvd(values);
+
+    Header header{};
+    header.vkFormat = format;
+    header.pixelWidth = width;
+    header.pixelHeight = height;
+    header.faceCount = faceCount;
+    header.levelCount = static_cast<uint32_t>(levels.size());
+
+    header.dfdByteOffset = static_cast<uint32_t>(sizeof(Header) + (levels.size() * sizeof(LevelIndex)));
+    header.dfdByteLength = static_cast<uint32_t>(dfd.size());
+    header.kvdByteOffset = kvd.empty() ? 0 : header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+
+    // the smallest level is stored first
+    std::vector<LevelIndex> levelIndex(levels.size());
+    size_t offset = header.dfdByteOffset + dfd.size() + kvd.size();
+
+    for (size_t i = levels.size(); i-- > 0;) {
+        offset = alignUp(offset, LEVEL_ALIGNMENT);
+
+        levelIndex[i].byteOffset = offset;
+        levelIndex[i].byteLength = levels[i].size();
+        levelIndex[i].uncompressedByteLength = levels[i].size();
+
+        offset += levels[i].size();
+    }
+
+    std::filesystem::path outPath(path);
+    std::filesystem::path tempPath = outPath;
+    tempPath += ".tmp";
+
+    std::error_code ec;
+    std::filesystem::create_directories(outPath.parent_path(), ec);
+
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        utils::logWarning("Failed to write texture cache: " + path);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char*>(levelIndex.data()), levelIndex.size() * sizeof(LevelIndex));
+    file.write(reinterpret_cast<const char*>(dfd.data()), dfd.size());
+    file.write(reinterpret_cast<const char*>(kvd.data()), kvd.size());
+
+    for (size_t i = levels.size(); i-- > 0;) {
+        size_t pos = static_cast<size_t>(file.tellp());
+        size_t padding = levelIndex[i].byteOffset - pos;
+
+        const char zeros[LEVEL_ALIGNMENT]{};
+        file.write(zeros, padding);
+        file.write(reinterpret_cast<const char*>(levels[i].data()), levels[i].size());
+    }
+
+    file.close();
+    if (!file) {
+        utils::logWarning("Failed to write texture cache: " + path);
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    // rename once fully written so a partially written cache is never loaded
+    std::filesystem::rename(tempPath, outPath, ec);
+    if (ec) {
+        utils::logWarning("Failed to write texture cache: " + path);
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    return true;
+}
+}  // namespace ktxfile
@@ -0,0 +1,73 @@
+// Reading and writing of KTX2 files
+// Only single layer 2D textures and cubemaps without supercompression are supported, which is all the texture caches need
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "mappedfile.hpp"
+
+namespace ktxfile {
+constexpr std::array<uint8_t, 12> IDENTIFIER = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+struct Header {
+    std::array<uint8_t, 12> identifier = IDENTIFIER;
+    uint32_t vkFormat = VK_FORMAT_UNDEFINED;
+    uint32_t typeSize = 1;
+    uint32_t pixelWidth = 0;
+    uint32_t pixelHeight = 0;
+    uint32_t pixelDepth = 0;
+    uint32_t layerCount = 0;
+    uint32_t faceCount = 1;
+    uint32_t levelCount = 0;
+    uint32_t supercompressionScheme = 0;
+
+    uint32_t dfdByteOffset = 0;
+    uint32_t dfdByteLength = 0;
+    uint32_t kvdByteOffset = 0;
+    uint32_t kvdByteLength = 0;
+    uint64_t sgdByteOffset = 0;
+    uint64_t sgdByteLength = 0;
+};
+
+struct LevelIndex {
+    uint64_t byteOffset = 0;
+    uint64_t byteLength = 0;
+    uint64_t uncompressedByteLength = 0;
+};
+
+class KtxFile {
+public:
+    // returns false if the file doesnt exist or isnt a supported ktx2 file
+    bool open(const std::string& path);
+
+    // the value of a key in the key/value data, empty if the key doesnt exist
+    [[nodiscard]] std::string_view getValue(std::string_view key) const;
+
+    // getters
+    [[nodiscard]] bool valid() const noexcept { return m_file.valid(); }
+    [[nodiscard]] VkFormat getFormat() const noexcept { return static_cast<VkFormat>(m_header->vkFormat); }
+    [[nodiscard]] uint32_t getWidth() const noexcept { return m_header->pixelWidth; }
+    [[nodiscard]] uint32_t getHeight() const noexcept { return m_header->pixelHeight; }
+    [[nodiscard]] uint32_t getFaceCount() const noexcept { return m_header->faceCount; }
+    [[nodiscard]] uint32_t getLevelCount() const noexcept { return m_header->levelCount; }
+    [[nodiscard]] std::span<const uint8_t> getLevel(uint32_t level) const noexcept;
+
+private:
+    mappedfile::MappedFile m_file;
+    const Header* m_header = nullptr;
+    const LevelIndex* m_levels = nullptr;
+};
+
+// levels are ordered from the largest to the smallest, and hold every face of the level
+// the values are written as null terminated strings
+bool write(const std::string& path, VkFormat format, uint32_t width, uint32_t height, uint32_t faceCount, const std::vector<std::span<const uint8_t>>& levels, const std::vector<std::pair<std::string, std::string>>& values);
+}  // namespace ktxfile
@@ -0,0 +1,52 @@
+// Read only memory mapped files
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+
+namespace mappedfile {
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path) { open(path); }
+    ~MappedFile() { close(); }
+
+    // delete copying
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // returns false if the file doesnt exist or couldnt be mapped
+    bool open(const std::string& path);
+    void close() noexcept;
+
+    // points at memory owned by another mapping, which has to outlive this
+    void view(std::span<const uint8_t> data) noexcept;
+
+    // getters
+    [[nodiscard]] bool valid() const noexcept { return m_data != nullptr; }
+    [[nodiscard]] const uint8_t* data() const noexcept { return m_data; }
+    [[nodiscard]] size_t size() const noexcept { return m_size; }
+
+    template <typename T>
+    [[nodiscard]] const T* at(size_t offset) const noexcept {
+        return reinterpret_cast<const T*>(m_data + offset);
+    }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_owned = false;
+
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+}  // namespace mappedfile
@@ -0,0 +1,269 @@
+#include "meshcache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "packfile.hpp"
+
+namespace meshcache {
+namespace {
+constexpr size_t DATA_ALIGNMENT = 64;
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// true if count elements starting at offset fit in capacity elements, without overflowing
+bool rangeFits(uint64_t offset, uint64_t count, uint64_t capacity) {
+    return offset <= capacity && count <= capacity - offset;
+}
+
+void writePadding(std::ofstream& file, size_t alignment) {
+    size_t pos = static_cast<size_t>(file.tellp());
+    size_t padding = alignUp(pos, alignment) - pos;
+
+    const char zeros[DATA_ALIGNMENT]{};
+    file.write(zeros, padding);
+}
+
+// copies the vertices field by field into zeroed memory, so the padding of dvl::Vertex is always written as zeros
+// otherwise two caches built from the same file wouldnt be byte identical
+void writeVertices(std::ofstream& file, std::span<const dvl::Vertex> vertices) {
+    constexpr size_t batchSize = 4096;
+    std::vector<uint8_t> batch(std::min(vertices.size(), batchSize) * sizeof(dvl::Vertex), 0);
+
+    for (size_t first = 0; first < vertices.size(); first += batchSize) {
+        size_t count = std::min(vertices.size() - first, batchSize);
+
+        for (size_t i = 0; i < count; i++) {
+            const dvl::Vertex& v = vertices[first + i];
+            uint8_t* dst = batch.data() + (i * sizeof(dvl::Vertex));
+
+            std::memcpy(dst + offsetof(dvl::Vertex, pos), &v.pos, sizeof(float) * 3);
+            std::memcpy(dst + offsetof(dvl::Vertex, tex), &v.tex, sizeof(float) * 2);
+            std::memcpy(dst + offsetof(dvl::Vertex, normal), &v.normal, sizeof(float) * 3);
+            std::memcpy(dst + offsetof(dvl::Vertex, tangent), &v.tangent, sizeof(float) * 3);
+        }
+
+        file.write(reinterpret_cast<const char*>(batch.data()), static_cast<std::streamsize>(count * sizeof(dvl::Vertex)));
+    }
+}
+}  // namespace
+
+bool MeshCache::load(const std::string& path, uint64_t sourceHash) {
+    if (!packfile::openMapped(m_file, path)) return false;
+
+    // validate the header
+    if (m_file.size() < sizeof(Header)) {
+        m_file.close();
+        return false;
+    }
+
+    const Header* header = m_file.at<Header>(0);
+    bool matches = header->magic == MAGIC && header->version == VERSION && header->sourceHash == sourceHash;
+    bool layoutMatches = header->vertexSize == sizeof(dvl::Vertex) && header->fileSize == m_file.size();
+
+    if (!matches || !layoutMatches || !sectionsInBounds(*header)) {
+        m_file.close();
+        return false;
+    }
+
+    // a truncated or corrupt cache is treated as a miss, rather than read past the end of the file
+    m_header = header;
+    if (!entriesInBounds()) {
+        m_header = nullptr;
+        m_file.close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshCache::sectionsInBounds(const Header& header) const noexcept {
+    // the sections are written in order, and each one ends where the next begins
+    std::array<uint64_t, 7> offsets = {header.entriesOffset, header.stringsOffset, header.vertexDataOffset, header.indexDataOffset, header.meshletDataOffset, header.lodDataOffset, m_file.size()};
+    for (size_t i = 1; i < offsets.size(); i++) {
+        if (offsets[i - 1] > offsets[i]) return false;
+    }
+
+    // the data is viewed in place, so it has to be aligned the way it was written
+    for (uint64_t offset : {header.entriesOffset, header.vertexDataOffset, header.indexDataOffset, header.meshletDataOffset, header.lodDataOffset}) {
+        if (offset % DATA_ALIGNMENT != 0) return false;
+    }
+
+    return header.meshCount <= (header.stringsOffset - header.entriesOffset) / sizeof(MeshEntry);
+}
+
+bool MeshCache::entriesInBounds() const noexcept {
+    uint64_t stringsSize = m_header->vertexDataOffset - m_header->stringsOffset;
+    uint64_t vertexCapacity = (m_header->indexDataOffset - m_header->vertexDataOffset) / sizeof(dvl::Vertex);
+    uint64_t indexCapacity = (m_header->meshletDataOffset - m_header->indexDataOffset) / sizeof(uint32_t);
+    uint64_t meshletCapacity = (m_header->lodDataOffset - m_header->meshletDataOffset) / sizeof(dvl::Meshlet);
+    uint64_t lodCapacity = (m_file.size() - m_header->lodDataOffset) / sizeof(dvl::MeshLod);
+
+    const MeshEntry* entries = m_file.at<MeshEntry>(m_header->entriesOffset);
+    const dvl::MeshLod* lodData = m_file.at<dvl::MeshLod>(m_header->lodDataOffset);
+
+    for (uint32_t i = 0; i < m_header->meshCount; i++) {
+        const MeshEntry& e = entries[i];
+
+        bool inBounds = rangeFits(e.nameOffset, e.nameLength, stringsSize) && rangeFits(e.vertexOffset, e.vertexCount, vertexCapacity) && rangeFits(e.indexOffset, e.indexCount, indexCapacity) &&
+                        rangeFits(e.meshletOffset, e.meshletCount, meshletCapacity) && rangeFits(e.lodOffset, e.lodCount, lodCapacity);
+        if (!inBounds) return false;
+
+        // the levels of detail are ranges of the mesh's own indices and meshlets
+        for (uint64_t j = 0; j < e.lodCount; j++) {
+            const dvl::MeshLod& lod = lodData[e.lodOffset + j];
+            if (!rangeFits(lod.indexOffset, lod.indexCount, e.indexCount) || !rangeFits(lod.meshletOffset, lod.meshletCount, e.meshletCount)) return false;
+        }
+    }
+
+    return true;
+}
+
+std::vector<dvl::Mesh> MeshCache::createMeshes(size_t imagesOffset) const {
+    std::vector<dvl::Mesh> meshes(m_header->meshCount);
+
+    const MeshEntry* entries = m_file.at<MeshEntry>(m_header->entriesOffset);
+    const dvl::Vertex* vertexData = m_file.at<dvl::Vertex>(m_header->vertexDataOffset);
+    const uint32_t* indexData = m_file.at<uint32_t>(m_header->indexDataOffset);
+    const dvl::Meshlet* meshletData = m_file.at<dvl::Meshlet>(m_header->meshletDataOffset);
+    const dvl::MeshLod* lodData = m_file.at<dvl::MeshLod>(m_header->lodDataOffset);
+
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const MeshEntry& e = entries[i];
+        dvl::Mesh& m = meshes[i];
+
+        std::array<int*, 5> material = {&m.material.baseColor, &m.material.metallicRoughness, &m.material.normalMap, &m.material.occlusionMap, &m.material.emissiveMap};
+        for (size_t j = 0; j < material.size(); j++) {
+            *material[j] = (e.material[j] >= 0) ? e.material[j] + static_cast<int>(imagesOffset) : -1;
+        }
+
+        m.geometryHash = static_cast<size_t>(e.geometryHash);
+        m.meshHash = dvl::calcMeshHash(m);
+        m.name.assign(m_file.at<char>(m_header->stringsOffset + e.nameOffset), e.nameLength);
+
+        m.vertexView = std::span<const dvl::Vertex>(vertexData + e.vertexOffset, e.vertexCount);
+        m.indexView = std::span<const uint32_t>(indexData + e.indexOffset, e.indexCount);
+        m.meshletView = std::span<const dvl::Meshlet>(meshletData + e.meshletOffset, e.meshletCount);
+        m.lodView = std::span<const dvl::MeshLod>(lodData + e.lodOffset, e.lodCount);
+
+        std::memcpy(m.modelMatrix.flat, e.localMatrix, sizeof(e.localMatrix));
+    }
+
+    return meshes;
+}
+
+void write(const std::string& path, uint64_t sourceHash, const std::vector<dvl::Mesh>& meshes, const std::vector<dml::mat4>& localMatrices, size_t imagesOffset) {
+    Header header{};
+    header.sourceHash = sourceHash;
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+
+    std::vector<MeshEntry> entries(meshes.size());
+    std::string strings;
+
+    uint64_t vertexCount = 0;
+    uint64_t indexCount = 0;
+    uint64_t meshletCount = 0;
+    uint64_t lodCount = 0;
+
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const dvl::Mesh& m = meshes[i];
+        MeshEntry& e = entries[i];
+
+        std::array<int, 5> material = {m.material.baseColor, m.material.metallicRoughness, m.material.normalMap, m.material.occlusionMap, m.material.emissiveMap};
+        for (size_t j = 0; j < material.size(); j++) {
+            e.material[j] = (material[j] >= 0) ? material[j] - static_cast<int>(imagesOffset) : -1;
+        }
+
+        e.geometryHash = m.geometryHash;
+        e.nameOffset = strings.size();
+        e.nameLength = static_cast<uint32_t>(m.name.size());
+        strings += m.name;
+
+        e.vertexOffset = vertexCount;
+        e.vertexCount = m.getVertices().size();
+        e.indexOffset = indexCount;
+        e.indexCount = m.getIndices().size();
+        e.meshletOffset = meshletCount;
+        e.meshletCount = m.getMeshlets().size();
+        e.lodOffset = lodCount;
+        e.lodCount = m.getLods().size();
+
+        vertexCount += e.vertexCount;
+        indexCount += e.indexCount;
+        meshletCount += e.meshletCount;
+        lodCount += e.lodCount;
+
+        std::memcpy(e.localMatrix, localMatrices[i].flat, sizeof(e.localMatrix));
+    }
+
+    // calculate the layout of the file
+    header.entriesOffset = alignUp(sizeof(Header), DATA_ALIGNMENT);
+    header.stringsOffset = header.entriesOffset + entries.size() * sizeof(MeshEntry);
+    header.vertexDataOffset = alignUp(header.stringsOffset + strings.size(), DATA_ALIGNMENT);
+    header.indexDataOffset = alignUp(header.vertexDataOffset + vertexCount * sizeof(dvl::Vertex), DATA_ALIGNMENT);
+    header.meshletDataOffset = alignUp(header.indexDataOffset + indexCount * sizeof(uint32_t), DATA_ALIGNMENT);
+    header.lodDataOffset = alignUp(header.meshletDataOffset + meshletCount * sizeof(dvl::Meshlet), DATA_ALIGNMENT);
+    header.fileSize = header.lodDataOffset + lodCount * sizeof(dvl::MeshLod);
+
+    std::filesystem::path outPath(path);
+    std::filesystem::path tempPath = outPath;
+    tempPath += ".tmp";
+
+    std::error_code ec;
+    std::filesystem::create_directories(outPath.parent_path(), ec);
+
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        utils::logWarning("Failed to write mesh cache: " + path);
+        return;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    writePadding(file, DATA_ALIGNMENT);
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshEntry));
+    file.write(strings.data(), strings.size());
+
+    writePadding(file, DATA_ALIGNMENT);
+    for (const dvl::Mesh& m : meshes) {
+        writeVertices(file, m.getVertices());
+    }
+
+    writePadding(file, DATA_ALIGNMENT);
+    for (const dvl::Mesh& m : meshes) {
+        std::span<const uint32_t> indices = m.getIndices();
+        file.write(reinterpret_cast<const char*>(indices.data()), indices.size_bytes());
+    }
+
+    writePadding(file, DATA_ALIGNMENT);
+    for (const dvl::Mesh& m : meshes) {
+        std::span<const dvl::Meshlet> meshlets = m.getMeshlets();
+        file.write(reinterpret_cast<const char*>(meshlets.data()), meshlets.size_bytes());
+    }
+
+    writePadding(file, DATA_ALIGNMENT);
+    for (const dvl::Mesh& m : meshes) {
+        std::span<const dvl::MeshLod> lods = m.getLods();
+        file.write(reinterpret_cast<const char*>(lods.data()), lods.size_bytes());
+    }
+
+    file.close();
+    if (!file) {
+        utils::logWarning("Failed to write mesh cache: " + path);
+        std::filesystem::remove(tempPath, ec);
+        return;
+    }
+
+    // rename once fully written so a partially written cache is never loaded
+    std::filesystem::rename(tempPath, outPath, ec);
+    if (ec) {
+        utils::logWarning("Failed to write mesh cache: " + path);
+        std::filesystem::remove(tempPath, ec);
+    }
+}
+}  // namespace meshcache
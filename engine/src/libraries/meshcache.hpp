@@ -0,0 +1,77 @@
+// On disk cache of processed glTF geometry
+// Keyed by a hash of the source file, so any change to the source creates a new cache
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "dml.hpp"
+#include "dvl.hpp"
+#include "mappedfile.hpp"
+
+namespace meshcache {
+constexpr uint32_t MAGIC = 0x4853454d;  // "MESH"
+constexpr uint32_t VERSION = 6;
+
+struct Header {
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint64_t sourceHash = 0;
+
+    uint32_t vertexSize = sizeof(dvl::Vertex);
+    uint32_t meshCount = 0;
+
+    uint64_t entriesOffset = 0;
+    uint64_t stringsOffset = 0;
+    uint64_t vertexDataOffset = 0;
+    uint64_t indexDataOffset = 0;
+    uint64_t meshletDataOffset = 0;
+    uint64_t lodDataOffset = 0;
+    uint64_t fileSize = 0;
+};
+
+struct MeshEntry {
+    // material texture indices, without the offset of the model's images
+    int32_t material[5]{};
+    uint32_t nameLength = 0;
+
+    uint64_t geometryHash = 0;
+    uint64_t nameOffset = 0;
+
+    // offsets are in elements from the start of the vertex, index, meshlet and lod data
+    uint64_t vertexOffset = 0;
+    uint64_t vertexCount = 0;
+    uint64_t indexOffset = 0;
+    uint64_t indexCount = 0;
+    uint64_t meshletOffset = 0;
+    uint64_t meshletCount = 0;
+    uint64_t lodOffset = 0;
+    uint64_t lodCount = 0;
+
+    // matrix of the mesh's node hierarchy
+    float localMatrix[16]{};
+};
+
+class MeshCache {
+public:
+    // returns false if the cache doesnt exist, doesnt match the source, or any of its ranges are outside of the file
+    bool load(const std::string& path, uint64_t sourceHash);
+
+    // creates meshes that view directly into the mapped file
+    // the model matrix of each mesh is set to its local matrix
+    [[nodiscard]] std::vector<dvl::Mesh> createMeshes(size_t imagesOffset) const;
+
+    [[nodiscard]] bool valid() const noexcept { return m_file.valid(); }
+
+private:
+    mappedfile::MappedFile m_file;
+    const Header* m_header = nullptr;
+
+    [[nodiscard]] bool sectionsInBounds(const Header& header) const noexcept;
+    [[nodiscard]] bool entriesInBounds() const noexcept;
+};
+
+// meshes and localMatrices are parallel arrays
+void write(const std::string& path, uint64_t sourceHash, const std::vector<dvl::Mesh>& meshes, const std::vector<dml::mat4>& localMatrices, size_t imagesOffset);
+}  // namespace meshcache
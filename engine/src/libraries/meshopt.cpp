@@ -0,0 +1,739 @@
+#include "meshopt.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace meshopt {
+namespace {
+constexpr uint32_t INVALID_VERTEX = ~0u;
+
+// returns the next vertex with live triangles from the dead end stack, or the next in input order
+uint32_t skipDeadEnd(const std::vector<uint32_t>& liveCount, std::vector<uint32_t>& deadEnd, uint32_t& cursor) {
+    while (!deadEnd.empty()) {
+        uint32_t vertex = deadEnd.back();
+        deadEnd.pop_back();
+
+        if (liveCount[vertex] > 0) return vertex;
+    }
+
+    while (cursor < liveCount.size()) {
+        if (liveCount[cursor] > 0) return cursor;
+        cursor++;
+    }
+
+    return INVALID_VERTEX;
+}
+
+struct Cluster {
+    uint32_t start = 0;
+    uint32_t end = 0;
+    float sortKey = 0.0f;
+};
+
+// the sum of the squared distances to a set of planes, weighted by the area they came from
+struct Quadric {
+    double a00 = 0.0, a11 = 0.0, a22 = 0.0;
+    double a01 = 0.0, a02 = 0.0, a12 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    void addPlane(const dml::vec3& normal, double distance, double w) noexcept {
+        double x = normal.x;
+        double y = normal.y;
+        double z = normal.z;
+
+        a00 += w * x * x;
+        a11 += w * y * y;
+        a22 += w * z * z;
+        a01 += w * x * y;
+        a02 += w * x * z;
+        a12 += w * y * z;
+        b0 += w * x * distance;
+        b1 += w * y * distance;
+        b2 += w * z * distance;
+        c += w * distance * distance;
+        weight += w;
+    }
+
+    Quadric& operator+=(const Quadric& other) noexcept {
+        a00 += other.a00;
+        a11 += other.a11;
+        a22 += other.a22;
+        a01 += other.a01;
+        a02 += other.a02;
+        a12 += other.a12;
+        b0 += other.b0;
+        b1 += other.b1;
+        b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+        return *this;
+    }
+
+    // the average squared distance from the point to the planes
+    [[nodiscard]] double evaluate(const dml::vec3& p) const noexcept {
+        if (weight <= 0.0) return 0.0;
+
+        double x = p.x;
+        double y = p.y;
+        double z = p.z;
+
+        double result = a00 * x * x + a11 * y * y + a22 * z * z;
+        result += 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z);
+        result += 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+
+        return std::max(result, 0.0) / weight;
+    }
+};
+
+// moving one vertex onto another
+struct Collapse {
+    uint32_t from = 0;
+    uint32_t to = 0;
+    double cost = 0.0;
+};
+
+// the first vertex with the same position as each vertex
+std::vector<uint32_t> findPositionGroups(std::span<const dvl::Vertex> vertices) {
+    using Key = std::array<uint32_t, 3>;
+
+    auto makeKey = [&](uint32_t vertex) {
+        Key key{};
+        std::memcpy(key.data(), &vertices[vertex].pos, sizeof(Key));
+        return key;
+    };
+
+    std::vector<uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return makeKey(a) < makeKey(b); });
+
+    std::vector<uint32_t> groups(vertices.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        bool sameAsPrevious = i > 0 && makeKey(order[i]) == makeKey(order[i - 1]);
+        groups[order[i]] = sameAsPrevious ? groups[order[i - 1]] : order[i];
+    }
+
+    return groups;
+}
+
+// vertices on a border, a uv seam, or a non manifold edge cant be moved without tearing or stretching the surface
+std::vector<bool> findLockedVertices(std::span<const dvl::Vertex> vertices, std::span<const uint32_t> indices) {
+    std::vector<uint32_t> groups = findPositionGroups(vertices);
+    std::vector<bool> locked(vertices.size(), false);
+
+    // vertices that share their position with another vertex are on a seam
+    std::vector<uint32_t> groupSizes(vertices.size(), 0);
+    for (uint32_t group : groups) {
+        groupSizes[group]++;
+    }
+
+    // edges that arent shared by exactly two triangles are on a border
+    std::vector<uint64_t> edges;
+    edges.reserve(indices.size());
+
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (size_t j = 0; j < 3; j++) {
+            uint32_t a = groups[indices[i + j]];
+            uint32_t b = groups[indices[i + (j + 1) % 3]];
+            if (a == b) continue;
+
+            edges.push_back((static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b));
+        }
+    }
+
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<bool> lockedGroups(vertices.size(), false);
+    for (size_t i = 0; i < edges.size();) {
+        size_t end = i;
+        while (end < edges.size() && edges[end] == edges[i]) end++;
+
+        if (end - i != 2) {
+            lockedGroups[edges[i] >> 32] = true;
+            lockedGroups[edges[i] & 0xFFFFFFFF] = true;
+        }
+
+        i = end;
+    }
+
+    for (size_t v = 0; v < vertices.size(); v++) {
+        locked[v] = groupSizes[groups[v]] > 1 || lockedGroups[groups[v]];
+    }
+
+    return locked;
+}
+
+// the triangles around each vertex
+void buildTriangleAdjacency(std::span<const uint32_t> indices, size_t vertexCount, std::vector<uint32_t>& offsets, std::vector<uint32_t>& adjacency) {
+    offsets.assign(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+        offsets[index + 1]++;
+    }
+
+    for (size_t i = 0; i < vertexCount; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    adjacency.resize(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+}
+
+float calcRadius(std::span<const dvl::Vertex> vertices, std::span<const uint32_t> indices) {
+    constexpr float maxFloat = std::numeric_limits<float>::max();
+    dml::vec3 minPos(maxFloat, maxFloat, maxFloat);
+    dml::vec3 maxPos(-maxFloat, -maxFloat, -maxFloat);
+
+    for (uint32_t index : indices) {
+        const dml::vec3& pos = vertices[index].pos;
+
+        minPos = {std::min(minPos.x, pos.x), std::min(minPos.y, pos.y), std::min(minPos.z, pos.z)};
+        maxPos = {std::max(maxPos.x, pos.x), std::max(maxPos.y, pos.y), std::max(maxPos.z, pos.z)};
+    }
+
+    dml::vec3 center = (minPos + maxPos) * 0.5f;
+    float radius = 0.0f;
+
+    for (uint32_t index : indices) {
+        radius = std::max(radius, (vertices[index].pos - center).length());
+    }
+
+    return radius;
+}
+}  // namespace
+
+CacheStats analyzeVertexCache(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize) {
+    CacheStats stats{};
+    stats.triangles = indices.size() / 3;
+    stats.vertices = vertexCount;
+
+    // a vertex is in the cache if fewer than cacheSize misses happened since it was added
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+
+    for (uint32_t index : indices) {
+        if (time - cacheTime[index] > cacheSize) {
+            cacheTime[index] = time++;
+            stats.transformed++;
+        }
+    }
+
+    return stats;
+}
+
+std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+    std::vector<uint32_t> clusters;
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return clusters;
+
+    // build the vertex to triangle adjacency
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    for (uint32_t index : indices) {
+        liveCount[index]++;
+    }
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < vertexCount; i++) {
+        offsets[i + 1] = offsets[i] + liveCount[i];
+    }
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    deadEnd.reserve(indices.size());
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    uint32_t cursor = 0;
+    uint32_t fanning = indices[0];
+    clusters.push_back(0);
+
+    while (fanning != INVALID_VERTEX) {
+        candidates.clear();
+
+        // emit every remaining triangle around the fanning vertex
+        for (uint32_t i = offsets[fanning]; i < offsets[fanning + 1]; i++) {
+            uint32_t triangle = adjacency[i];
+            if (emitted[triangle]) continue;
+
+            for (uint32_t j = 0; j < 3; j++) {
+                uint32_t vertex = indices[triangle * 3 + j];
+
+                result.push_back(vertex);
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                liveCount[vertex]--;
+
+                if (time - cacheTime[vertex] > cacheSize) {
+                    cacheTime[vertex] = time++;
+                }
+            }
+
+            emitted[triangle] = true;
+        }
+
+        // pick the oldest candidate that will still be in the cache after its triangles are emitted
+        uint32_t next = INVALID_VERTEX;
+        int64_t bestPriority = -1;
+
+        for (uint32_t vertex : candidates) {
+            if (liveCount[vertex] == 0) continue;
+
+            int64_t priority = 0;
+            int64_t age = time - cacheTime[vertex];
+            if (age + 2 * static_cast<int64_t>(liveCount[vertex]) <= cacheSize) {
+                priority = age;
+            }
+
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+
+        // dead end, start a new cluster
+        if (next == INVALID_VERTEX) {
+            next = skipDeadEnd(liveCount, deadEnd, cursor);
+            if (next != INVALID_VERTEX) clusters.push_back(static_cast<uint32_t>(result.size() / 3));
+        }
+
+        fanning = next;
+    }
+
+    indices = std::move(result);
+    return clusters;
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, std::span<const dvl::Vertex> vertices, const std::vector<uint32_t>& clusters, float threshold, uint32_t cacheSize) {
+    uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    if (triangleCount == 0 || clusters.empty()) return;
+
+    std::vector<uint32_t> cacheTime(vertices.size(), 0);
+    uint32_t time = cacheSize + 1;
+
+    auto isMiss = [&](uint32_t vertex) {
+        if (time - cacheTime[vertex] > cacheSize) {
+            cacheTime[vertex] = time++;
+            return true;
+        }
+        return false;
+    };
+
+    // split each cluster where its ACMR so far is close to the ACMR of the whole cluster
+    std::vector<Cluster> split;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        uint32_t start = clusters[c];
+        uint32_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : triangleCount;
+
+        // clear the cache between clusters
+        time += cacheSize + 1;
+
+        size_t clusterMisses = 0;
+        for (uint32_t i = start * 3; i < end * 3; i++) {
+            clusterMisses += isMiss(indices[i]);
+        }
+
+        float clusterACMR = static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+        time += cacheSize + 1;
+        uint32_t splitStart = start;
+        size_t misses = 0;
+
+        for (uint32_t t = start; t < end; t++) {
+            for (uint32_t j = 0; j < 3; j++) {
+                misses += isMiss(indices[t * 3 + j]);
+            }
+
+            float acmr = static_cast<float>(misses) / static_cast<float>(t + 1 - splitStart);
+            if (t + 1 < end && acmr <= clusterACMR * threshold) {
+                split.push_back({splitStart, t + 1});
+                splitStart = t + 1;
+                misses = 0;
+                time += cacheSize + 1;
+            }
+        }
+
+        split.push_back({splitStart, end});
+    }
+
+    // area weighted centroid and normal of each cluster
+    dml::vec3 meshCentroid{};
+    float meshArea = 0.0f;
+
+    std::vector<dml::vec3> centroids(split.size());
+    std::vector<dml::vec3> normals(split.size());
+
+    for (size_t c = 0; c < split.size(); c++) {
+        dml::vec3 centroid{};
+        dml::vec3 normal{};
+        float area = 0.0f;
+
+        for (uint32_t t = split[c].start; t < split[c].end; t++) {
+            const dml::vec3& p0 = vertices[indices[t * 3]].pos;
+            const dml::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+            const dml::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+
+            dml::vec3 faceNormal = dml::cross(p1 - p0, p2 - p0);
+            float faceArea = faceNormal.length();
+
+            centroid += (p0 + p1 + p2) * (faceArea / 3.0f);
+            normal += faceNormal;
+            area += faceArea;
+        }
+
+        meshCentroid += centroid;
+        meshArea += area;
+
+        centroids[c] = (area > 0.0f) ? centroid / area : dml::vec3{};
+        normals[c] = dml::normalize(normal);
+    }
+
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    // clusters on the outside facing away from the center are the least likely to be occluded
+    for (size_t c = 0; c < split.size(); c++) {
+        split[c].sortKey = dml::dot(centroids[c] - meshCentroid, normals[c]);
+    }
+
+    std::stable_sort(split.begin(), split.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    for (const Cluster& cluster : split) {
+        result.insert(result.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+    }
+
+    indices = std::move(result);
+}
+
+void optimizeVertexFetch(std::vector<dvl::Vertex>& vertices, std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> remap(vertices.size(), INVALID_VERTEX);
+
+    std::vector<dvl::Vertex> result;
+    result.reserve(vertices.size());
+
+    for (uint32_t& index : indices) {
+        if (remap[index] == INVALID_VERTEX) {
+            remap[index] = static_cast<uint32_t>(result.size());
+            result.push_back(vertices[index]);
+        }
+
+        index = remap[index];
+    }
+
+    // unused vertices are dropped
+    vertices = std::move(result);
+}
+
+std::vector<dvl::Meshlet> buildMeshlets(std::span<const dvl::Vertex> vertices, std::span<const uint32_t> indices, uint32_t maxVertices, uint32_t maxTriangles) {
+    std::vector<dvl::Meshlet> meshlets;
+
+    uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    if (triangleCount == 0) return meshlets;
+
+    // the last meshlet each vertex was added to
+    std::vector<uint32_t> vertexMeshlet(vertices.size(), INVALID_VERTEX);
+    uint32_t meshletIndex = 0;
+
+    dvl::Meshlet meshlet{};
+
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        uint32_t newVertices = 0;
+        for (uint32_t j = 0; j < 3; j++) {
+            newVertices += vertexMeshlet[indices[t * 3 + j]] != meshletIndex;
+        }
+
+        // start a new meshlet if the triangle doesnt fit
+        if (meshlet.vertexCount + newVertices > maxVertices || meshlet.triangleCount == maxTriangles) {
+            meshlets.push_back(meshlet);
+            meshletIndex++;
+
+            meshlet = dvl::Meshlet{};
+            meshlet.triangleOffset = t;
+        }
+
+        for (uint32_t j = 0; j < 3; j++) {
+            uint32_t vertex = indices[t * 3 + j];
+
+            if (vertexMeshlet[vertex] != meshletIndex) {
+                vertexMeshlet[vertex] = meshletIndex;
+                meshlet.vertexCount++;
+            }
+        }
+
+        meshlet.triangleCount++;
+    }
+
+    meshlets.push_back(meshlet);
+
+    for (dvl::Meshlet& m : meshlets) {
+        calcMeshletBounds(m, vertices, indices);
+    }
+
+    return meshlets;
+}
+
+void calcMeshletBounds(dvl::Meshlet& meshlet, std::span<const dvl::Vertex> vertices, std::span<const uint32_t> indices) {
+    size_t first = static_cast<size_t>(meshlet.triangleOffset) * 3;
+    size_t last = first + static_cast<size_t>(meshlet.triangleCount) * 3;
+
+    // bounding sphere around the center of the bounding box
+    constexpr float maxFloat = std::numeric_limits<float>::max();
+    dml::vec3 minPos(maxFloat, maxFloat, maxFloat);
+    dml::vec3 maxPos(-maxFloat, -maxFloat, -maxFloat);
+
+    for (size_t i = first; i < last; i++) {
+        const dml::vec3& pos = vertices[indices[i]].pos;
+
+        minPos = {std::min(minPos.x, pos.x), std::min(minPos.y, pos.y), std::min(minPos.z, pos.z)};
+        maxPos = {std::max(maxPos.x, pos.x), std::max(maxPos.y, pos.y), std::max(maxPos.z, pos.z)};
+    }
+
+    dml::vec3 center = (minPos + maxPos) * 0.5f;
+    float radius = 0.0f;
+
+    for (size_t i = first; i < last; i++) {
+        radius = std::max(radius, (vertices[indices[i]].pos - center).length());
+    }
+
+    meshlet.sphere = dml::vec4(center, radius);
+    meshlet.cone = dml::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // the cone axis is the average of the face normals
+    std::vector<dml::vec3> normals;
+    normals.reserve(meshlet.triangleCount);
+
+    dml::vec3 axis{};
+    for (size_t i = first; i < last; i += 3) {
+        const dml::vec3& p0 = vertices[indices[i]].pos;
+        const dml::vec3& p1 = vertices[indices[i + 1]].pos;
+        const dml::vec3& p2 = vertices[indices[i + 2]].pos;
+
+        dml::vec3 normal = dml::cross(p1 - p0, p2 - p0);
+        float length = normal.length();
+
+        // degenerate triangles are never rasterized
+        if (length == 0.0f) continue;
+
+        normals.push_back(normal / length);
+        axis += normals.back();
+    }
+
+    float axisLength = axis.length();
+    if (axisLength == 0.0f) return;
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const dml::vec3& normal : normals) {
+        minDot = std::min(minDot, dml::dot(axis, normal));
+    }
+
+    // a cone that covers a hemisphere always has a front facing triangle
+    if (minDot <= 0.0f) return;
+
+    // sine of the cone angle, the meshlet is backfacing when the view direction is within 90 degrees minus the cone angle of the axis
+    meshlet.cone = dml::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+}
+
+void optimizeMesh(std::vector<dvl::Vertex>& vertices, std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> clusters = optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices, clusters);
+    optimizeVertexFetch(vertices, indices);
+}
+
+std::vector<uint32_t> simplify(std::span<const dvl::Vertex> vertices, std::span<const uint32_t> indices, size_t targetIndexCount, float targetError, float& error) {
+    std::vector<uint32_t> result(indices.begin(), indices.end());
+    error = 0.0f;
+
+    size_t vertexCount = vertices.size();
+    std::vector<bool> locked = findLockedVertices(vertices, indices);
+
+    // the planes of the triangles around each vertex
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const dml::vec3& p0 = vertices[indices[i]].pos;
+        const dml::vec3& p1 = vertices[indices[i + 1]].pos;
+        const dml::vec3& p2 = vertices[indices[i + 2]].pos;
+
+        dml::vec3 normal = dml::cross(p1 - p0, p2 - p0);
+        float length = normal.length();
+        if (length == 0.0f) continue;
+
+        normal /= length;
+        double distance = -dml::dot(normal, p0);
+
+        for (size_t j = 0; j < 3; j++) {
+            quadrics[indices[i + j]].addPlane(normal, distance, length * 0.5);
+        }
+    }
+
+    double maxCost = static_cast<double>(targetError) * targetError;
+    double largestCost = 0.0;
+
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+
+    // a collapse is rejected if it would turn a remaining triangle over
+    auto flips = [&](uint32_t from, uint32_t to) {
+        for (uint32_t i = offsets[from]; i < offsets[from + 1]; i++) {
+            const uint32_t* triangle = &result[adjacency[i] * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue;
+
+            std::array<dml::vec3, 3> before{};
+            std::array<dml::vec3, 3> after{};
+
+            for (size_t j = 0; j < 3; j++) {
+                before[j] = vertices[triangle[j]].pos;
+                after[j] = (triangle[j] == from) ? vertices[to].pos : before[j];
+            }
+
+            dml::vec3 normalBefore = dml::cross(before[1] - before[0], before[2] - before[0]);
+            dml::vec3 normalAfter = dml::cross(after[1] - after[0], after[2] - after[0]);
+
+            if (dml::dot(normalBefore, normalAfter) <= 0.25f * normalBefore.length() * normalAfter.length()) return true;
+        }
+
+        return false;
+    };
+
+    // every pass collapses the cheapest edges that dont share any triangles
+    while (result.size() > targetIndexCount) {
+        buildTriangleAdjacency(result, vertexCount, offsets, adjacency);
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (size_t j = 0; j < 3; j++) {
+                uint32_t a = result[i + j];
+                uint32_t b = result[i + (j + 1) % 3];
+
+                if (!locked[a]) collapses.push_back({a, b, quadrics[a].evaluate(vertices[b].pos)});
+                if (!locked[b]) collapses.push_back({b, a, quadrics[b].evaluate(vertices[a].pos)});
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t triangleCount = result.size() / 3;
+        size_t targetTriangleCount = targetIndexCount / 3;
+        size_t collapsed = 0;
+
+        for (const Collapse& collapse : collapses) {
+            if (triangleCount <= targetTriangleCount || collapse.cost > maxCost) break;
+            if (touched[collapse.from] || touched[collapse.to] || flips(collapse.from, collapse.to)) continue;
+
+            // the triangles around the vertex cant change again until the next pass
+            for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++) {
+                const uint32_t* triangle = &result[adjacency[i] * 3];
+                bool removed = false;
+
+                for (size_t j = 0; j < 3; j++) {
+                    touched[triangle[j]] = true;
+                    removed |= triangle[j] == collapse.to;
+                }
+
+                triangleCount -= removed;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            largestCost = std::max(largestCost, collapse.cost);
+            collapsed++;
+        }
+
+        if (collapsed == 0) break;
+
+        // remove the triangles that collapsed
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            uint32_t a = remap[result[i]];
+            uint32_t b = remap[result[i + 1]];
+            uint32_t c = remap[result[i + 2]];
+            if (a == b || a == c || b == c) continue;
+
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+
+        result.resize(write);
+    }
+
+    error = static_cast<float>(std::sqrt(largestCost));
+    return result;
+}
+
+std::vector<dvl::MeshLod> buildLods(std::span<const dvl::Vertex> vertices, std::vector<uint32_t>& indices, std::vector<dvl::Meshlet>& meshlets) {
+    std::vector<dvl::MeshLod> lods;
+
+    meshlets = buildMeshlets(vertices, indices);
+
+    dvl::MeshLod full{};
+    full.indexCount = static_cast<uint32_t>(indices.size());
+    full.meshletCount = static_cast<uint32_t>(meshlets.size());
+    lods.push_back(full);
+
+    // every level is simplified from the full detail mesh, so the errors dont add up
+    const std::vector<uint32_t> fullIndices = indices;
+    float maxError = calcRadius(vertices, fullIndices) * LOD_MAX_ERROR;
+    size_t previousCount = fullIndices.size();
+
+    while (lods.size() < MAX_LODS && previousCount / 3 >= LOD_MIN_TRIANGLES) {
+        size_t target = static_cast<size_t>(static_cast<float>(previousCount / 3) * LOD_TRIANGLE_RATIO) * 3;
+
+        float error = 0.0f;
+        std::vector<uint32_t> lodIndices = simplify(vertices, fullIndices, target, maxError, error);
+
+        // not worth keeping if it didnt get much smaller
+        if (lodIndices.empty() || static_cast<float>(lodIndices.size()) > static_cast<float>(previousCount) * LOD_MIN_REDUCTION) break;
+
+        optimizeVertexCache(lodIndices, vertices.size());
+
+        dvl::MeshLod lod{};
+        lod.indexOffset = static_cast<uint32_t>(indices.size());
+        lod.indexCount = static_cast<uint32_t>(lodIndices.size());
+        lod.meshletOffset = static_cast<uint32_t>(meshlets.size());
+        lod.error = std::max(error, lods.back().error);
+
+        // meshlets are relative to the first index of the mesh, not the level
+        std::vector<dvl::Meshlet> lodMeshlets = buildMeshlets(vertices, lodIndices);
+        for (dvl::Meshlet& meshlet : lodMeshlets) {
+            meshlet.triangleOffset += lod.indexOffset / 3;
+        }
+
+        lod.meshletCount = static_cast<uint32_t>(lodMeshlets.size());
+
+        indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+        meshlets.insert(meshlets.end(), lodMeshlets.begin(), lodMeshlets.end());
+        lods.push_back(lod);
+
+        previousCount = lodIndices.size();
+    }
+
+    return lods;
+}
+}  // namespace meshopt
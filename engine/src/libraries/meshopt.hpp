@@ -0,0 +1,92 @@
+// Import time optimizations of index and vertex order
+// Vertex cache: Tipsify (Sander et al. 2007)
+// Overdraw: clusters sorted front to back from the outside of the mesh
+// Meshlets: greedy contiguous triangle ranges with a bounding sphere and normal cone
+// LODs: quadric error metric edge collapses (Garland and Heckbert 1997) onto existing vertices
+
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "dvl.hpp"
+
+namespace meshopt {
+// size of the simulated post transform vertex cache
+constexpr uint32_t CACHE_SIZE = 16;
+
+// how much worse the ACMR can get to allow for better overdraw
+constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+// meshlet limits, the same as what mesh shading hardware typically prefers
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// levels of detail of a mesh, including the full detail mesh
+constexpr uint32_t MAX_LODS = 5;
+
+// each level aims for this fraction of the triangles of the level before it
+constexpr float LOD_TRIANGLE_RATIO = 0.5f;
+
+// the chain stops when a level cant get below this fraction of the level before it
+constexpr float LOD_MIN_REDUCTION = 0.85f;
+
+// meshes with fewer triangles than this arent simplified any further
+constexpr uint32_t LOD_MIN_TRIANGLES = 64;
+
+// the most a level can deviate from the full detail mesh, relative to the radius of the mesh
+constexpr float LOD_MAX_ERROR = 0.1f;
+
+struct CacheStats {
+    size_t triangles = 0;
+    size_t vertices = 0;
+    size_t transformed = 0;
+
+    // average cache miss ratio (transformed vertices per triangle)
+    [[nodiscard]] float getACMR() const noexcept { return triangles ? static_cast<float>(transformed) / static_cast<float>(triangles) : 0.0f; }
+
+    // average transform to vertex ratio (1.0 is perfect)
+    [[nodiscard]] float getATVR() const noexcept { return vertices ? static_cast<float>(transformed) / static_cast<float>(vertices) : 0.0f; }
+
+    CacheStats& operator+=(const CacheStats& other) noexcept {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        transformed += other.transformed;
+        return *this;
+    }
+};
+
+// simulates a fifo vertex cache
+[[nodiscard]] CacheStats analyzeVertexCache(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+// reorders the triangles for the vertex cache
+// returns the first triangle of each cluster (where the algorithm hit a dead end)
+std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+// reorders the clusters from optimizeVertexCache so outward facing clusters are drawn first
+// clusters are split further when the ACMR stays within the threshold
+void optimizeOverdraw(std::vector<uint32_t>& indices, std::span<const dvl::Vertex> vertices, const std::vector<uint32_t>& clusters, float threshold = OVERDRAW_THRESHOLD, uint32_t cacheSize = CACHE_SIZE);
+
+// reorders the vertices in the order they're first used by the indices
+void optimizeVertexFetch(std::vector<dvl::Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// splits the triangles into meshlets without changing their order
+// so each meshlet can be drawn as its own range of the index buffer
+[[nodiscard]] std::vector<dvl::Meshlet> buildMeshlets(std::span<const dvl::Vertex> vertices, std::span<const uint32_t> indices, uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// calculates the bounding sphere and normal cone of the meshlet
+void calcMeshletBounds(dvl::Meshlet& meshlet, std::span<const dvl::Vertex> vertices, std::span<const uint32_t> indices);
+
+// runs every optimization on the mesh
+void optimizeMesh(std::vector<dvl::Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// collapses edges until the target index count or the target error is reached
+// vertices are only moved onto their neighbours, so the result indexes the same vertices
+// borders and uv seams are kept as they are
+// error is set to the largest distance a surface moved, in object space
+[[nodiscard]] std::vector<uint32_t> simplify(std::span<const dvl::Vertex> vertices, std::span<const uint32_t> indices, size_t targetIndexCount, float targetError, float& error);
+
+// appends the simplified levels of detail after the full detail indices, and builds the meshlets of every level
+// the indices should already be optimized
+[[nodiscard]] std::vector<dvl::MeshLod> buildLods(std::span<const dvl::Vertex> vertices, std::vector<uint32_t>& indices, std::vector<dvl::Meshlet>& meshlets);
+}  // namespace meshopt
@@ -0,0 +1,211 @@
+#include "packfile.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+#include "utils.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace packfile {
+namespace {
+static_assert(sizeof(Header) == 32 && sizeof(Entry) == 24);
+
+PackFile g_pack;
+std::filesystem::path g_root;
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void writePadding(std::ofstream& file) {
+    size_t pos = static_cast<size_t>(file.tellp());
+    size_t padding = alignUp(pos, ALIGNMENT) - pos;
+
+    static const char zeros[ALIGNMENT]{};
+    file.write(zeros, padding);
+}
+
+// the pack is read front to back on startup, so ask for all of it up front
+void prefetch(const mappedfile::MappedFile& file) {
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range{};
+    range.VirtualAddress = const_cast<uint8_t*>(file.data());
+    range.NumberOfBytes = file.size();
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    void* data = const_cast<uint8_t*>(file.data());
+    madvise(data, file.size(), MADV_SEQUENTIAL);
+    madvise(data, file.size(), MADV_WILLNEED);
+#endif
+}
+}  // namespace
+
+bool PackFile::open(const std::string& path) {
+    close();
+    if (!m_file.open(path)) return false;
+
+    // validate the header
+    if (m_file.size() < sizeof(Header)) {
+        close();
+        return false;
+    }
+
+    const Header* header = m_file.at<Header>(0);
+    bool matches = header->magic == MAGIC && header->version == VERSION;
+
+    // compare against what is left of the file, adding the offsets could wrap on a corrupt pack
+    uint64_t size = m_file.size();
+    bool inBounds = header->tocOffset <= size && header->tocSize <= size - header->tocOffset && header->entryCount <= header->tocSize / sizeof(Entry);
+
+    if (!matches || !inBounds) {
+        close();
+        return false;
+    }
+
+    const Entry* entries = m_file.at<Entry>(header->tocOffset);
+    const char* names = m_file.at<char>(header->tocOffset);
+
+    for (uint32_t i = 0; i < header->entryCount; i++) {
+        const Entry& e = entries[i];
+        bool valid = e.offset <= size && e.size <= size - e.offset && e.nameOffset <= header->tocSize && e.nameLength <= header->tocSize - e.nameOffset;
+
+        if (!valid) {
+            close();
+            return false;
+        }
+
+        std::string_view name(names + e.nameOffset, e.nameLength);
+        m_entries[name] = {m_file.data() + e.offset, e.size};
+    }
+
+    return true;
+}
+
+void PackFile::close() noexcept {
+    m_entries.clear();
+    m_file.close();
+}
+
+std::span<const uint8_t> PackFile::find(std::string_view name) const {
+    auto it = m_entries.find(name);
+    return it == m_entries.end() ? std::span<const uint8_t>{} : it->second;
+}
+
+bool write(const std::string& path, const std::vector<PackEntry>& entries) {
+    Header header{};
+    header.entryCount = static_cast<uint32_t>(entries.size());
+    header.tocOffset = sizeof(Header);
+
+    // the toc is written first, so the entry sizes have to be known before any data is written
+    std::vector<Entry> toc(entries.size());
+    std::string names;
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(entries[i].path, ec);
+        if (ec) {
+            utils::logWarning("Failed to read pack entry: " + entries[i].path);
+            return false;
+        }
+
+        toc[i].size = size;
+        toc[i].nameOffset = static_cast<uint32_t>((entries.size() * sizeof(Entry)) + names.size());
+        toc[i].nameLength = static_cast<uint32_t>(entries[i].name.size());
+        names += entries[i].name;
+    }
+
+    header.tocSize = (toc.size() * sizeof(Entry)) + names.size();
+
+    size_t offset = alignUp(header.tocOffset + header.tocSize, ALIGNMENT);
+    for (Entry& e : toc) {
+        e.offset = offset;
+        offset = alignUp(offset + e.size, ALIGNMENT);
+    }
+
+    std::filesystem::path outPath(path);
+    std::filesystem::path tempPath = outPath;
+    tempPath += ".tmp";
+
+    std::error_code ec;
+    std::filesystem::create_directories(outPath.parent_path(), ec);
+
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        utils::logWarning("Failed to write pack: " + path);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char*>(toc.data()), toc.size() * sizeof(Entry));
+    file.write(names.data(), names.size());
+
+    for (size_t i = 0; i < entries.size() && file; i++) {
+        mappedfile::MappedFile source;
+        if (!source.open(entries[i].path) || source.size() != toc[i].size) {
+            utils::logWarning("Failed to read pack entry: " + entries[i].path);
+            file.setstate(std::ios::failbit);
+            break;
+        }
+
+        writePadding(file);
+        file.write(reinterpret_cast<const char*>(source.data()), source.size());
+    }
+
+    // pad the end so the last entry is a whole number of pages too
+    writePadding(file);
+
+    file.close();
+    if (!file) {
+        utils::logWarning("Failed to write pack: " + path);
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    // rename once fully written so a partially written pack is never loaded
+    std::filesystem::rename(tempPath, outPath, ec);
+    if (ec) {
+        utils::logWarning("Failed to write pack: " + path);
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    return true;
+}
+
+bool mount(const std::string& path, const std::string& root) {
+    if (!g_pack.open(path)) return false;
+
+    g_root = std::filesystem::path(root).lexically_normal();
+    prefetch(g_pack.getFile());
+    return true;
+}
+
+void unmount() noexcept {
+    g_pack.close();
+    g_root.clear();
+}
+
+std::span<const uint8_t> findMounted(const std::string& path) {
+    if (!g_pack.valid()) return {};
+
+    std::filesystem::path relative = std::filesystem::path(path).lexically_normal().lexically_relative(g_root);
+    if (relative.empty()) return {};
+
+    return g_pack.find(relative.generic_string());
+}
+
+bool openMapped(mappedfile::MappedFile& file, const std::string& path) {
+    std::span<const uint8_t> data = findMounted(path);
+    if (data.empty()) return file.open(path);
+
+    file.view(data);
+    return true;
+}
+}  // namespace packfile
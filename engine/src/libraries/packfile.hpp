@@ -0,0 +1,75 @@
+// Single file asset packs
+// Every entry starts on a page boundary so it can be used straight from the mapping
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mappedfile.hpp"
+
+namespace packfile {
+constexpr std::array<char, 4> MAGIC = {'V', 'P', 'A', 'K'};
+constexpr uint32_t VERSION = 1;
+constexpr size_t ALIGNMENT = 4096;
+
+struct Header {
+    std::array<char, 4> magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t entryCount = 0;
+    uint32_t reserved = 0;
+
+    // the entries are followed by their names
+    uint64_t tocOffset = 0;
+    uint64_t tocSize = 0;
+};
+
+struct Entry {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t nameOffset = 0;
+    uint32_t nameLength = 0;
+};
+
+struct PackEntry {
+    // the name the entry is looked up by, relative to the pack root
+    std::string name;
+    std::string path;
+};
+
+class PackFile {
+public:
+    // returns false if the file doesnt exist or isnt a valid pack
+    bool open(const std::string& path);
+    void close() noexcept;
+
+    // the data of an entry, empty if the pack doesnt have it
+    [[nodiscard]] std::span<const uint8_t> find(std::string_view name) const;
+
+    // getters
+    [[nodiscard]] bool valid() const noexcept { return m_file.valid(); }
+    [[nodiscard]] const mappedfile::MappedFile& getFile() const noexcept { return m_file; }
+
+private:
+    mappedfile::MappedFile m_file;
+    std::unordered_map<std::string_view, std::span<const uint8_t>> m_entries;
+};
+
+// writes the entries in order, so they should be in the order theyre loaded in
+bool write(const std::string& path, const std::vector<PackEntry>& entries);
+
+// files opened through openMapped are read from the mounted pack when it has them
+// names are looked up relative to the root
+bool mount(const std::string& path, const std::string& root);
+void unmount() noexcept;
+
+[[nodiscard]] std::span<const uint8_t> findMounted(const std::string& path);
+
+// opens a file from the mounted pack, or from disk if it isnt in it
+bool openMapped(mappedfile::MappedFile& file, const std::string& path);
+}  // namespace packfile
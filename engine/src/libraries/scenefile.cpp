@@ -0,0 +1,207 @@
+#include "scenefile.hpp"
+
+#include <json.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "mappedfile.hpp"
+#include "packfile.hpp"
+#include "utils.hpp"
+
+namespace scenefile {
+namespace {
+static_assert(sizeof(Header) == 64 && sizeof(Instance) == 44 && sizeof(Light) == 28);
+
+template <size_t N>
+std::array<float, N> readFloats(const nlohmann::json& value, const std::array<float, N>& fallback) {
+    if (value.is_null()) return fallback;
+
+    // a single number is used for every component, which is how scales are usually given
+    if (value.is_number()) {
+        std::array<float, N> result{};
+        result.fill(value.get<float>());
+        return result;
+    }
+
+    if (!value.is_array() || value.size() != N) {
+        throw std::runtime_error("Expected an array of " + std::to_string(N) + " numbers");
+    }
+
+    std::array<float, N> result{};
+    for (size_t i = 0; i < N; i++) {
+        result[i] = value[i].get<float>();
+    }
+
+    return result;
+}
+
+const nlohmann::json& getValue(const nlohmann::json& object, const char* key) {
+    static const nlohmann::json null{};
+
+    auto it = object.find(key);
+    return (it == object.end()) ? null : *it;
+}
+}  // namespace
+
+bool load(const std::string& path, const std::string& cacheDir, Scene& scene) {
+    mappedfile::MappedFile file;
+    if (!packfile::openMapped(file, path)) return false;
+
+    uint64_t sourceHash = utils::hashBytes(file.data(), file.size());
+
+    std::ostringstream cacheName;
+    cacheName << std::hex << std::setw(16) << std::setfill('0') << sourceHash;
+    std::string cachePath = cacheDir + cacheName.str() + ".vscene";
+
+    if (loadBinary(cachePath, sourceHash, scene)) return true;
+
+    try {
+        scene = parse(reinterpret_cast<const char*>(file.data()), file.size());
+    } catch (const std::exception& e) {
+        throw std::runtime_error("Failed to parse scene: " + path + ": " + e.what());
+    }
+
+    writeBinary(cachePath, sourceHash, scene);
+    return true;
+}
+
+bool loadBinary(const std::string& path, uint64_t sourceHash, Scene& scene) {
+    mappedfile::MappedFile file;
+    if (!packfile::openMapped(file, path)) return false;
+
+    // validate the header
+    if (file.size() < sizeof(Header)) return false;
+
+    const Header* header = file.at<Header>(0);
+    bool matches = header->magic == MAGIC && header->version == VERSION && header->sourceHash == sourceHash && header->fileSize == file.size();
+    bool inBounds = header->instancesOffset + (header->instanceCount * sizeof(Instance)) <= file.size();
+    inBounds = inBounds && header->lightsOffset + (header->lightCount * sizeof(Light)) <= file.size();
+    inBounds = inBounds && header->namesOffset + header->namesSize <= file.size();
+
+    if (!matches || !inBounds) return false;
+
+    // the records are copied out in one go each
+    scene = {};
+    scene.instances.resize(header->instanceCount);
+    scene.lights.resize(header->lightCount);
+    std::memcpy(scene.instances.data(), file.data() + header->instancesOffset, header->instanceCount * sizeof(Instance));
+    std::memcpy(scene.lights.data(), file.data() + header->lightsOffset, header->lightCount * sizeof(Light));
+
+    const char* names = file.at<char>(header->namesOffset);
+    size_t offset = 0;
+
+    for (uint32_t i = 0; i < header->modelCount; i++) {
+        const char* end = static_cast<const char*>(std::memchr(names + offset, '\0', header->namesSize - offset));
+        if (end == nullptr) return false;
+
+        scene.models.emplace_back(names + offset, end);
+        offset = static_cast<size_t>(end - names) + 1;
+    }
+
+    for (const Instance& instance : scene.instances) {
+        if (instance.model >= scene.models.size()) return false;
+    }
+
+    return true;
+}
+
+bool writeBinary(const std::string& path, uint64_t sourceHash, const Scene& scene) {
+    std::string names;
+    for (const std::string& model : scene.models) {
+        names += model;
+        names.push_back('\0');
+    }
+
+    Header header{};
+    header.sourceHash = sourceHash;
+    header.modelCount = static_cast<uint32_t>(scene.models.size());
+    header.instanceCount = static_cast<uint32_t>(scene.instances.size());
+    header.lightCount = static_cast<uint32_t>(scene.lights.size());
+    header.namesSize = static_cast<uint32_t>(names.size());
+
+    header.instancesOffset = sizeof(Header);
+    header.lightsOffset = header.instancesOffset + (scene.instances.size() * sizeof(Instance));
+    header.namesOffset = header.lightsOffset + (scene.lights.size() * sizeof(Light));
+    header.fileSize = header.namesOffset + names.size();
+
+    std::filesystem::path outPath(path);
+    std::filesystem::path tempPath = outPath;
+    tempPath += ".tmp";
+
+    std::error_code ec;
+    std::filesystem::create_directories(outPath.parent_path(), ec);
+
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        utils::logWarning("Failed to write scene cache: " + path);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char*>(scene.instances.data()), scene.instances.size() * sizeof(Instance));
+    file.write(reinterpret_cast<const char*>(scene.lights.data()), scene.lights.size() * sizeof(Light));
+    file.write(names.data(), names.size());
+
+    file.close();
+    if (!file) {
+        utils::logWarning("Failed to write scene cache: " + path);
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    // rename once fully written so a partially written cache is never loaded
+    std::filesystem::rename(tempPath, outPath, ec);
+    if (ec) {
+        utils::logWarning("Failed to write scene cache: " + path);
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    return true;
+}
+
+Scene parse(const char* text, size_t size) {
+    nlohmann::json json = nlohmann::json::parse(text, text + size);
+    Scene scene{};
+
+    for (const nlohmann::json& model : getValue(json, "models")) {
+        scene.models.push_back(model.get<std::string>());
+    }
+
+    const nlohmann::json& instances = getValue(json, "instances");
+    scene.instances.reserve(instances.size());
+
+    for (const nlohmann::json& value : instances) {
+        Instance instance{};
+        instance.model = value.at("model").get<uint32_t>();
+        instance.pos = readFloats(getValue(value, "pos"), instance.pos);
+        instance.scale = readFloats(getValue(value, "scale"), instance.scale);
+        instance.rotation = readFloats(getValue(value, "rotation"), instance.rotation);
+
+        if (instance.model >= scene.models.size()) {
+            throw std::runtime_error("Instance uses a model that doesnt exist");
+        }
+
+        scene.instances.push_back(instance);
+    }
+
+    const nlohmann::json& lights = getValue(json, "lights");
+    scene.lights.reserve(lights.size());
+
+    for (const nlohmann::json& value : lights) {
+        Light light{};
+        light.pos = readFloats(getValue(value, "pos"), light.pos);
+        light.target = readFloats(getValue(value, "target"), light.target);
+        if (value.contains("range")) light.range = value["range"].get<float>();
+
+        scene.lights.push_back(light);
+    }
+
+    return scene;
+}
+}  // namespace scenefile
@@ -0,0 +1,69 @@
+// Scene descriptions listing models, instances and lights
+// Scenes are written as json, and a binary form of each is cached so it can be read straight from a mapping
+//
+// {
+//     "models": ["model.glb"],
+//     "instances": [{"model": 0, "pos": [0, 0, 0], "scale": 1, "rotation": [0, 0, 0, 1]}],
+//     "lights": [{"pos": [0, 2, 0], "target": [0, 0, 0], "range": 5}]
+// }
+//
+// everything but the model of an instance is optional
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace scenefile {
+constexpr std::array<char, 4> MAGIC = {'V', 'S', 'C', 'N'};
+constexpr uint32_t VERSION = 1;
+
+struct Instance {
+    uint32_t model = 0;  // into the models of the scene
+    std::array<float, 3> pos{0.0f, 0.0f, 0.0f};
+    std::array<float, 3> scale{1.0f, 1.0f, 1.0f};
+    std::array<float, 4> rotation{0.0f, 0.0f, 0.0f, 1.0f};
+};
+
+struct Light {
+    std::array<float, 3> pos{0.0f, 0.0f, 0.0f};
+    std::array<float, 3> target{0.0f, 0.0f, 1.0f};
+    float range = 5.0f;
+};
+
+struct Header {
+    std::array<char, 4> magic = MAGIC;
+    uint32_t version = VERSION;
+    uint64_t sourceHash = 0;
+
+    uint32_t modelCount = 0;
+    uint32_t instanceCount = 0;
+    uint32_t lightCount = 0;
+    uint32_t namesSize = 0;
+
+    // the models are stored as a null terminated name each, after the instances and lights
+    uint64_t instancesOffset = 0;
+    uint64_t lightsOffset = 0;
+    uint64_t namesOffset = 0;
+    uint64_t fileSize = 0;
+};
+
+struct Scene {
+    std::vector<std::string> models;
+    std::vector<Instance> instances;
+    std::vector<Light> lights;
+};
+
+// the binary form in the cache dir is used if it was made from the same json, otherwise the json is parsed and the binary form is written
+// returns false if the file doesnt exist, and throws if the json isnt a valid scene
+bool load(const std::string& path, const std::string& cacheDir, Scene& scene);
+
+// returns false if the file doesnt exist or wasnt made from a file with this hash
+bool loadBinary(const std::string& path, uint64_t sourceHash, Scene& scene);
+bool writeBinary(const std::string& path, uint64_t sourceHash, const Scene& scene);
+
+// throws if the text isnt a valid scene
+[[nodiscard]] Scene parse(const char* text, size_t size);
+}  // namespace scenefile
@@ -0,0 +1,467 @@
+#include "texcompress.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace texcompress {
+namespace {
+// interpolation weights of 4 bit bc7 indices, out of 64
+constexpr std::array<int, 16> BC7_WEIGHTS = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+class BitWriter {
+public:
+    explicit BitWriter(uint8_t* data) noexcept : m_data(data) { std::memset(m_data, 0, BLOCK_BYTES); }
+
+    void write(uint32_t value, uint32_t count) noexcept {
+        for (uint32_t i = 0; i < count; i++, m_pos++) {
+            if ((value >> i) & 1) m_data[m_pos >> 3] |= static_cast<uint8_t>(1 << (m_pos & 7));
+        }
+    }
+
+private:
+    uint8_t* m_data;
+    uint32_t m_pos = 0;
+};
+
+// the quantized endpoints and indices of a mode 6 block
+struct Mode6Block {
+    std::array<int, 4> q0{};  // 7 bits per channel
+    std::array<int, 4> q1{};
+    int p0 = 0;
+    int p1 = 0;
+
+    std::array<uint8_t, 16> indices{};
+    uint32_t error = std::numeric_limits<uint32_t>::max();
+};
+
+uint32_t texelError(const uint8_t* texel, const std::array<int, 4>& color) noexcept {
+    uint32_t error = 0;
+    for (int c = 0; c < 4; c++) {
+        int diff = static_cast<int>(texel[c]) - color[c];
+        error += static_cast<uint32_t>(diff * diff);
+    }
+
+    return error;
+}
+
+// quantizes the endpoints with the given p bits, and picks the best index of each texel
+Mode6Block evaluateMode6(const uint8_t* pixels, const std::array<float, 4>& e0, const std::array<float, 4>& e1, int p0, int p1) noexcept {
+    Mode6Block out{};
+    out.p0 = p0;
+    out.p1 = p1;
+
+    std::array<int, 4> a{};
+    std::array<int, 4> b{};
+
+    for (int c = 0; c < 4; c++) {
+        out.q0[c] = std::clamp(static_cast<int>((e0[c] - static_cast<float>(p0)) * 0.5f + 0.5f), 0, 127);
+        out.q1[c] = std::clamp(static_cast<int>((e1[c] - static_cast<float>(p1)) * 0.5f + 0.5f), 0, 127);
+
+        a[c] = (out.q0[c] << 1) | p0;
+        b[c] = (out.q1[c] << 1) | p1;
+    }
+
+    std::array<std::array<int, 4>, 16> palette{};
+    for (size_t i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            palette[i][c] = ((64 - BC7_WEIGHTS[i]) * a[c] + BC7_WEIGHTS[i] * b[c] + 32) >> 6;
+        }
+    }
+
+    int dd = 0;
+    std::array<int, 4> d{};
+    for (int c = 0; c < 4; c++) {
+        d[c] = b[c] - a[c];
+        dd += d[c] * d[c];
+    }
+
+    // the palette is a line, so project onto it and check the neighbouring indices
+    out.error = 0;
+    for (size_t i = 0; i < 16; i++) {
+        const uint8_t* texel = pixels + (i * 4);
+
+        int guess = 0;
+        if (dd > 0) {
+            int dot = 0;
+            for (int c = 0; c < 4; c++) dot += (static_cast<int>(texel[c]) - a[c]) * d[c];
+            guess = std::clamp(static_cast<int>(std::lround(static_cast<float>(dot) * 15.0f / static_cast<float>(dd))), 0, 15);
+        }
+
+        uint32_t bestError = std::numeric_limits<uint32_t>::max();
+        for (int j = std::max(guess - 1, 0); j <= std::min(guess + 1, 15); j++) {
+            uint32_t error = texelError(texel, palette[j]);
+            if (error < bestError) {
+                bestError = error;
+                out.indices[i] = static_cast<uint8_t>(j);
+            }
+        }
+
+        out.error += bestError;
+    }
+
+    return out;
+}
+
+// tries every combination of p bits, keeping the best block
+void tryEndpoints(const uint8_t* pixels, const std::array<float, 4>& e0, const std::array<float, 4>& e1, Mode6Block& best) noexcept {
+    for (int p = 0; p < 4; p++) {
+        Mode6Block block = evaluateMode6(pixels, e0, e1, p & 1, p >> 1);
+        if (block.error < best.error) best = block;
+    }
+}
+
+// least squares endpoints for the chosen indices
+bool refineEndpoints(const uint8_t* pixels, const Mode6Block& block, std::array<float, 4>& e0, std::array<float, 4>& e1) noexcept {
+    float aa = 0.0f;
+    float ab = 0.0f;
+    float bb = 0.0f;
+    std::array<float, 4> x0{};
+    std::array<float, 4> x1{};
+
+    for (size_t i = 0; i < 16; i++) {
+        float w = static_cast<float>(BC7_WEIGHTS[block.indices[i]]) / 64.0f;
+        float iw = 1.0f - w;
+
+        aa += iw * iw;
+        ab += iw * w;
+        bb += w * w;
+
+        for (int c = 0; c < 4; c++) {
+            float v = static_cast<float>(pixels[(i * 4) + c]);
+            x0[c] += iw * v;
+            x1[c] += w * v;
+        }
+    }
+
+    float det = (aa * bb) - (ab * ab);
+    if (std::abs(det) < 1e-6f) return false;
+
+    float invDet = 1.0f / det;
+    for (int c = 0; c < 4; c++) {
+        e0[c] = std::clamp((bb * x0[c] - ab * x1[c]) * invDet, 0.0f, 255.0f);
+        e1[c] = std::clamp((aa * x1[c] - ab * x0[c]) * invDet, 0.0f, 255.0f);
+    }
+
+    return true;
+}
+
+// the endpoints of the block's principal axis
+void findEndpoints(const uint8_t* pixels, std::array<float, 4>& e0, std::array<float, 4>& e1) noexcept {
+    std::array<float, 4> mean{};
+    std::array<float, 4> low{255.0f, 255.0f, 255.0f, 255.0f};
+    std::array<float, 4> high{};
+
+    for (size_t i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            float v = static_cast<float>(pixels[(i * 4) + c]);
+            mean[c] += v;
+            low[c] = std::min(low[c], v);
+            high[c] = std::max(high[c], v);
+        }
+    }
+
+    for (float& m : mean) m /= 16.0f;
+
+    std::array<std::array<float, 4>, 4> cov{};
+    for (size_t i = 0; i < 16; i++) {
+        std::array<float, 4> v{};
+        for (int c = 0; c < 4; c++) v[c] = static_cast<float>(pixels[(i * 4) + c]) - mean[c];
+
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++) cov[r][c] += v[r] * v[c];
+        }
+    }
+
+    // power iteration, starting from the diagonal of the bounding box
+    std::array<float, 4> axis{};
+    for (int c = 0; c < 4; c++) axis[c] = high[c] - low[c];
+
+    for (int iteration = 0; iteration < 8; iteration++) {
+        std::array<float, 4> next{};
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++) next[r] += cov[r][c] * axis[c];
+        }
+
+        float largest = 0.0f;
+        for (float v : next) largest = std::max(largest, std::abs(v));
+        if (largest < 1e-6f) break;
+
+        for (int c = 0; c < 4; c++) axis[c] = next[c] / largest;
+    }
+
+    float length = 0.0f;
+    for (float v : axis) length += v * v;
+    length = std::sqrt(length);
+
+    if (length < 1e-6f) {
+        e0 = mean;
+        e1 = mean;
+        return;
+    }
+
+    for (float& v : axis) v /= length;
+
+    float tMin = std::numeric_limits<float>::max();
+    float tMax = std::numeric_limits<float>::lowest();
+
+    for (size_t i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < 4; c++) t += (static_cast<float>(pixels[(i * 4) + c]) - mean[c]) * axis[c];
+
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+
+    for (int c = 0; c < 4; c++) {
+        e0[c] = std::clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f);
+        e1[c] = std::clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f);
+    }
+}
+
+// values are read with a stride of 4, so a single channel of rgba texels can be encoded
+void encodeBC4Block(const uint8_t* values, uint8_t* block) noexcept {
+    uint8_t low = 255;
+    uint8_t high = 0;
+
+    for (size_t i = 0; i < 16; i++) {
+        low = std::min(low, values[i * 4]);
+        high = std::max(high, values[i * 4]);
+    }
+
+    std::memset(block, 0, 8);
+    block[0] = high;
+    block[1] = low;
+
+    // a single value uses index 0 for every texel
+    if (high == low) return;
+
+    // high > low selects the 8 value mode
+    std::array<int, 8> palette{high, low};
+    for (int k = 2; k < 8; k++) {
+        palette[k] = ((8 - k) * high + (k - 1) * low + 3) / 7;
+    }
+
+    uint64_t bits = 0;
+    for (size_t i = 0; i < 16; i++) {
+        int value = values[i * 4];
+
+        uint64_t best = 0;
+        int bestError = std::numeric_limits<int>::max();
+
+        for (uint64_t j = 0; j < 8; j++) {
+            int error = std::abs(palette[j] - value);
+            if (error < bestError) {
+                bestError = error;
+                best = j;
+            }
+        }
+
+        bits |= best << (i * 3);
+    }
+
+    for (size_t i = 0; i < 6; i++) {
+        block[2 + i] = static_cast<uint8_t>(bits >> (i * 8));
+    }
+}
+
+const std::array<float, 256>& getSrgbTable() {
+    static const std::array<float, 256> table = []() {
+        std::array<float, 256> t{};
+        for (size_t i = 0; i < t.size(); i++) {
+            float c = static_cast<float>(i) / 255.0f;
+            t[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        return t;
+    }();
+
+    return table;
+}
+
+uint8_t linearToSrgb(float linear) {
+    float c = (linear <= 0.0031308f) ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+}
+}  // namespace
+
+uint32_t getMipLevelCount(uint32_t width, uint32_t height) noexcept {
+    return static_cast<uint32_t>(std::bit_width(std::max(width, height)));
+}
+
+size_t getLevelSize(uint32_t width, uint32_t height) noexcept {
+    size_t blocksX = (static_cast<size_t>(width) + 3) / 4;
+    size_t blocksY = (static_cast<size_t>(height) + 3) / 4;
+    return blocksX * blocksY * BLOCK_BYTES;
+}
+
+std::vector<uint8_t> downsample(const uint8_t* rgba, uint32_t width, uint32_t height, Format format) {
+    uint32_t outWidth = std::max(width / 2, 1u);
+    uint32_t outHeight = std::max(height / 2, 1u);
+    std::vector<uint8_t> out(static_cast<size_t>(outWidth) * outHeight * 4);
+
+    const std::array<float, 256>& srgbTable = getSrgbTable();
+
+    for (uint32_t y = 0; y < outHeight; y++) {
+        for (uint32_t x = 0; x < outWidth; x++) {
+            // odd dimensions reuse the last row or column
+            uint32_t x0 = std::min(x * 2, width - 1);
+            uint32_t x1 = std::min((x * 2) + 1, width - 1);
+            uint32_t y0 = std::min(y * 2, height - 1);
+            uint32_t y1 = std::min((y * 2) + 1, height - 1);
+
+            std::array<const uint8_t*, 4> texels = {
+                rgba + ((static_cast<size_t>(y0) * width + x0) * 4),
+                rgba + ((static_cast<size_t>(y0) * width + x1) * 4),
+                rgba + ((static_cast<size_t>(y1) * width + x0) * 4),
+                rgba + ((static_cast<size_t>(y1) * width + x1) * 4),
+            };
+
+            uint8_t* dst = out.data() + ((static_cast<size_t>(y) * outWidth + x) * 4);
+
+            uint32_t alpha = 2;
+            for (const uint8_t* t : texels) alpha += t[3];
+            dst[3] = static_cast<uint8_t>(alpha / 4);
+
+            if (format == Format::BC7_SRGB) {
+                for (int c = 0; c < 3; c++) {
+                    float sum = 0.0f;
+                    for (const uint8_t* t : texels) sum += srgbTable[t[c]];
+                    dst[c] = linearToSrgb(sum * 0.25f);
+                }
+            } else if (format == Format::BC5) {
+                std::array<float, 3> n{};
+                for (const uint8_t* t : texels) {
+                    for (int c = 0; c < 3; c++) n[c] += (static_cast<float>(t[c]) / 127.5f) - 1.0f;
+                }
+
+                float length = std::sqrt((n[0] * n[0]) + (n[1] * n[1]) + (n[2] * n[2]));
+                if (length > 1e-6f) {
+                    for (float& v : n) v /= length;
+                } else {
+                    n = {0.0f, 0.0f, 1.0f};
+                }
+
+                for (int c = 0; c < 3; c++) {
+                    dst[c] = static_cast<uint8_t>(std::clamp((n[c] + 1.0f) * 127.5f + 0.5f, 0.0f, 255.0f));
+                }
+            } else {
+                for (int c = 0; c < 3; c++) {
+                    uint32_t sum = 2;
+                    for (const uint8_t* t : texels) sum += t[c];
+                    dst[c] = static_cast<uint8_t>(sum / 4);
+                }
+            }
+        }
+    }
+
+    return out;
+}
+
+void encodeBC7Block(const uint8_t* pixels, uint8_t* block) noexcept {
+    std::array<float, 4> e0{};
+    std::array<float, 4> e1{};
+    findEndpoints(pixels, e0, e1);
+
+    Mode6Block best{};
+    tryEndpoints(pixels, e0, e1, best);
+
+    // one least squares pass over the chosen indices
+    if (best.error > 0 && refineEndpoints(pixels, best, e0, e1)) {
+        tryEndpoints(pixels, e0, e1, best);
+    }
+
+    // the msb of the first index is implied to be 0, so swap the endpoints if its set
+    // the weights are symmetric, so the indices just get flipped
+    if (best.indices[0] & 8) {
+        std::swap(best.q0, best.q1);
+        std::swap(best.p0, best.p1);
+        for (uint8_t& index : best.indices) index = static_cast<uint8_t>(15 - index);
+    }
+
+    BitWriter writer(block);
+    writer.write(1 << 6, 7);
+
+    for (int c = 0; c < 4; c++) {
+        writer.write(static_cast<uint32_t>(best.q0[c]), 7);
+        writer.write(static_cast<uint32_t>(best.q1[c]), 7);
+    }
+
+    writer.write(static_cast<uint32_t>(best.p0), 1);
+    writer.write(static_cast<uint32_t>(best.p1), 1);
+
+    writer.write(best.indices[0], 3);
+    for (size_t i = 1; i < 16; i++) {
+        writer.write(best.indices[i], 4);
+    }
+}
+
+void encodeBC5Block(const uint8_t* pixels, uint8_t* block) noexcept {
+    encodeBC4Block(pixels, block);
+    encodeBC4Block(pixels + 1, block + 8);
+}
+
+CompressedImage compress(const uint8_t* rgba, uint32_t width, uint32_t height, Format format) {
+    CompressedImage image{};
+    image.format = format;
+    image.width = width;
+    image.height = height;
+
+    uint32_t levelCount = getMipLevelCount(width, height);
+    image.levels.resize(levelCount);
+
+    size_t totalSize = 0;
+    for (uint32_t i = 0; i < levelCount; i++) {
+        Level& level = image.levels[i];
+        level.width = std::max(width >> i, 1u);
+        level.height = std::max(height >> i, 1u);
+        level.offset = totalSize;
+        level.size = getLevelSize(level.width, level.height);
+
+        totalSize += level.size;
+    }
+
+    image.data.resize(totalSize);
+
+    std::vector<uint8_t> mip;
+    const uint8_t* src = rgba;
+
+    for (uint32_t i = 0; i < levelCount; i++) {
+        const Level& level = image.levels[i];
+        uint32_t blocksX = (level.width + 3) / 4;
+        uint32_t blocksY = (level.height + 3) / 4;
+
+        uint8_t* dst = image.data.data() + level.offset;
+
+        for (uint32_t by = 0; by < blocksY; by++) {
+            for (uint32_t bx = 0; bx < blocksX; bx++) {
+                // texels past the edge of the level repeat the edge
+                std::array<uint8_t, 64> pixels{};
+                for (uint32_t j = 0; j < 16; j++) {
+                    uint32_t x = std::min((bx * 4) + (j % 4), level.width - 1);
+                    uint32_t y = std::min((by * 4) + (j / 4), level.height - 1);
+                    std::memcpy(pixels.data() + (j * 4), src + ((static_cast<size_t>(y) * level.width + x) * 4), 4);
+                }
+
+                uint8_t* block = dst + ((static_cast<size_t>(by) * blocksX + bx) * BLOCK_BYTES);
+                if (format == Format::BC5) {
+                    encodeBC5Block(pixels.data(), block);
+                } else {
+                    encodeBC7Block(pixels.data(), block);
+                }
+            }
+        }
+
+        if (i + 1 < levelCount) {
+            std::vector<uint8_t> next = downsample(src, level.width, level.height, format);
+            mip = std::move(next);
+            src = mip.data();
+        }
+    }
+
+    return image;
+}
+}  // namespace texcompress
@@ -0,0 +1,50 @@
+// Block compression of 8 bit RGBA images
+// Color is encoded as BC7 (mode 6 only), normal maps as BC5 (the xy of the normal)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace texcompress {
+// both formats use 16 bytes per 4x4 block
+constexpr size_t BLOCK_BYTES = 16;
+
+enum class Format : uint8_t {
+    BC7_SRGB,
+    BC7_UNORM,
+    BC5
+};
+
+struct Level {
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    size_t offset = 0;  // in bytes from the start of the image data
+    size_t size = 0;
+};
+
+struct CompressedImage {
+    Format format = Format::BC7_UNORM;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    std::vector<Level> levels{};
+    std::vector<uint8_t> data{};
+};
+
+[[nodiscard]] uint32_t getMipLevelCount(uint32_t width, uint32_t height) noexcept;
+[[nodiscard]] size_t getLevelSize(uint32_t width, uint32_t height) noexcept;
+
+// halves the image in each dimension
+// srgb images are filtered in linear space, normal maps are renormalized
+[[nodiscard]] std::vector<uint8_t> downsample(const uint8_t* rgba, uint32_t width, uint32_t height, Format format);
+
+// pixels is the 16 rgba texels of a block in row order
+void encodeBC7Block(const uint8_t* pixels, uint8_t* block) noexcept;
+void encodeBC5Block(const uint8_t* pixels, uint8_t* block) noexcept;
+
+// compresses the image along with its full mip chain
+[[nodiscard]] CompressedImage compress(const uint8_t* rgba, uint32_t width, uint32_t height, Format format);
+}  // namespace texcompress
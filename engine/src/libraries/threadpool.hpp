@@ -0,0 +1,58 @@
+// Fixed size pool of worker threads
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace threadpool {
+class ThreadPool {
+public:
+    // threadCount of 0 uses the number of hardware threads
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    // delete copying and moving
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    // queues a task, exceptions thrown by the task are rethrown from the future
+    template <typename Func>
+    [[nodiscard]] std::future<std::invoke_result_t<Func>> submit(Func&& func) {
+        using Result = std::invoke_result_t<Func>;
+
+        // packaged_task is move only, so it's shared to fit in a std::function
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+        std::future<Result> future = task->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.emplace([task]() { (*task)(); });
+        }
+
+        m_condition.notify_one();
+        return future;
+    }
+
+    [[nodiscard]] size_t getThreadCount() const noexcept { return m_workers.size(); }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping = false;
+
+    void workerLoop();
+};
+}  // namespace threadpool
@@ -3,6 +3,8 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <iostream>
 
@@ -61,4 +63,36 @@ template <typename Type>
 inline size_t combineHashes(const Type& hash1, const Type& hash2) {
     return hash1 ^ (hash2 + 0x9e3779b9 + (hash1 << 6) + (hash1 >> 2));
 }
+
+// 64 bit hash of a block of memory, reads 8 bytes at a time
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+    constexpr uint64_t prime1 = 0x9e3779b185ebca87ULL;
+    constexpr uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed ^ (size * prime1);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t k;
+        std::memcpy(&k, bytes + i, 8);
+
+        k *= prime2;
+        k = (k << 31) | (k >> 33);
+        hash ^= k * prime1;
+        hash = ((hash << 27) | (hash >> 37)) * prime1 + prime2;
+    }
+
+    // remaining bytes
+    for (; i < size; i++) {
+        hash ^= bytes[i] * prime1;
+        hash = ((hash << 11) | (hash >> 53)) * prime2;
+    }
+
+    // final mix
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    return hash;
+}
 };  // namespace utils
@@ -44,8 +44,14 @@ QueueFamilyIndices findQueueFamilyIndices(VkSurfaceKHR surface, VkPhysicalDevice
         if (family.queueFlags & VK_QUEUE_TRANSFER_BIT) indices.transferFamily = i;
 
         // check if the queue family supports presentation operations
+        // without a surface (headless) nothing is presented, so the graphics queue is used
         VkBool32 presSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presSupport);
+        if (surface != VK_NULL_HANDLE) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presSupport);
+        } else {
+            presSupport = (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        }
+
         if (presSupport) indices.presentFamily = i;
 
         if (indices.allComplete()) {
@@ -53,6 +59,15 @@ QueueFamilyIndices findQueueFamilyIndices(VkSurfaceKHR surface, VkPhysicalDevice
         }
     }
 
+    // prefer a family that only does transfers, so uploads can run alongside rendering
+    for (uint32_t i = 0; i < queueFamilyCount; i++) {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transferFamily = i;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -355,6 +370,23 @@ void createDeviceLocalBuffer(BufferObj& buffer, VkDeviceSize size, VkBufferUsage
     createBuffer(buffer, size, usage, memFlags, memAllocFlags);
 }
 
+void createMappedBuffer(BufferObj& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryAllocateFlags memAllocFlags) {
+    VkMemoryPropertyFlags memFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    // the gpu doesnt have to read device local memory over the bus
+    // the heap the cpu can write to is often small though, so host memory is used once its full
+    try {
+        createBuffer(buffer, size, usage, memFlags | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memAllocFlags);
+    } catch (const std::runtime_error&) {
+        createBuffer(buffer, size, usage, memFlags, memAllocFlags);
+    }
+
+    // freeing the memory unmaps it, so it never has to be unmapped
+    if (vkMapMemory(VkSingleton::v().gdevice(), buffer.mem.v(), 0, VK_WHOLE_SIZE, 0, &buffer.mapped) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map memory for buffer!");
+    }
+}
+
 VkFormat findDepthFormat() {
     // the formats that are supported
     std::vector<VkFormat> allowed = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT};
@@ -608,6 +640,25 @@ void createImageView(Texture& tex, VkFormat format) {
     }
 }
 
+void createMipView(VkhImageView& view, const Texture& tex, VkFormat format, uint32_t mip) {
+    view.reset();
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = tex.image.v();
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = mip;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(VkSingleton::v().gdevice(), &viewInfo, nullptr, view.p()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create mip image view!");
+    }
+}
+
 void createTexture(Texture& tex, TextureType textureType, VkImageUsageFlags usage, uint32_t width, uint32_t height) {
     bool cubemap = (textureType == CUBEMAP);
 
@@ -631,12 +682,18 @@ VkFormat getTextureFormat(TextureType textureType) {
         case DEPTH:
             return findDepthFormat();
         case SFLOAT16:
+        case CUBEMAP:
             return VK_FORMAT_R16G16B16A16_SFLOAT;
         case SFLOAT32:
-        case CUBEMAP:
             return VK_FORMAT_R32G32B32A32_SFLOAT;
         case ALPHA:
             return VK_FORMAT_R32_SFLOAT;
+        case BC7_SRGB:
+            return VK_FORMAT_BC7_SRGB_BLOCK;
+        case BC7_UNORM:
+            return VK_FORMAT_BC7_UNORM_BLOCK;
+        case BC5:
+            return VK_FORMAT_BC5_UNORM_BLOCK;
         default:
             return VK_FORMAT_UNDEFINED;
     }
@@ -650,7 +707,8 @@ void createDSLayout(VkhDescriptorSetLayout& layout, const VkDescriptorSetLayoutB
     std::vector<VkDescriptorBindingFlags> bindingFlags(count);
     if (variableDescriptorCount) {
         // set the last element to be variable descriptor count
-        bindingFlags.back() |= VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+        // it doesnt have to be fully written, and descriptors that arent in use can be written while the set is
+        bindingFlags.back() |= VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
     }
 
     VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
@@ -738,11 +796,11 @@ VkDescriptorPoolSize createDSPoolSize(size_t count, VkDescriptorType type) {
     return poolSize;
 }
 
-VkhShaderModule createShaderModule(const std::vector<char>& code) {
+VkhShaderModule createShaderModule(std::span<const uint8_t> code) {
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());  // convert the char array to uint32_t array
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());  // convert the byte array to uint32_t array
 
     VkhShaderModule shaderModule;
     if (vkCreateShaderModule(VkSingleton::v().gdevice(), &createInfo, nullptr, shaderModule.p()) != VK_SUCCESS) {
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <vector>
 
@@ -59,7 +60,7 @@ private:
     VkSingleton& operator=(VkSingleton&&) = delete;
 
     void cleanup() const {
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        if (surface != VK_NULL_HANDLE) vkDestroySurfaceKHR(instance, surface, nullptr);
         vkDestroyDevice(device, nullptr);
         vkDestroyInstance(instance, nullptr);
     }
@@ -285,16 +286,21 @@ typedef enum {
     SFLOAT16,
     SFLOAT32,
     CUBEMAP,
-    ALPHA
+    ALPHA,
+    BC7_SRGB,
+    BC7_UNORM,
+    BC5
 } TextureType;
 
 struct BufferObj {
     VkhBuffer buf{};
     VkhDeviceMemory mem{};
+    void* mapped = nullptr;  // set if the memory stays mapped for as long as it exists
 
     void reset() {
         buf.reset();
         mem.reset();
+        mapped = nullptr;
     }
 };
 
@@ -322,8 +328,13 @@ struct Texture {
 struct BufData {
     uint32_t vertexOffset = 0;
     uint32_t vertexCount = 0;
-    uint32_t indexOffset = 0;
+    uint32_t indexOffset = 0;  // relative to the start of the index type's section
     uint32_t indexCount = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t meshletOffset = 0;
+    uint32_t meshletCount = 0;
+
+    [[nodiscard]] VkDeviceSize indexSize() const noexcept { return (indexType == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t); }
 };
 
 struct QueueFamilyIndices {
@@ -411,6 +422,9 @@ void createHostVisibleBuffer(BufferObj& buffer, VkDeviceSize size, VkBufferUsage
 
 void createDeviceLocalBuffer(BufferObj& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryAllocateFlags memAllocFlags = 0);
 
+// host visible memory thats mapped once, and is device local too when the device has memory thats both
+void createMappedBuffer(BufferObj& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryAllocateFlags memAllocFlags = 0);
+
 // -------------------- IMAGES -------------------- //
 VkFormat findDepthFormat();
 
@@ -428,6 +442,9 @@ void createSampler(VkhSampler& sampler, uint32_t mipLevels, TextureType type);
 void createImageView(Texture& tex, TextureType type);
 void createImageView(Texture& tex, VkFormat format);
 
+// a view of a single level, for writing to the levels of an image one at a time
+void createMipView(VkhImageView& view, const Texture& tex, VkFormat format, uint32_t mip);
+
 void createTexture(Texture& tex, TextureType textureType, VkImageUsageFlags usage, uint32_t width, uint32_t height);
 
 void createSwapTexture(Texture& tex, VkFormat format, VkImageUsageFlags usage, uint32_t width, uint32_t height);
@@ -448,7 +465,7 @@ VkDescriptorSetLayoutBinding createDSLayoutBinding(uint32_t binding, size_t coun
 VkDescriptorPoolSize createDSPoolSize(size_t count, VkDescriptorType type);
 
 // -------------------- PIPELINES -------------------- //
-VkhShaderModule createShaderModule(const std::vector<char>& code);
+VkhShaderModule createShaderModule(std::span<const uint8_t> code);
 
 VkPipelineShaderStageCreateInfo createShaderStage(VkShaderStageFlagBits stage, const VkhShaderModule& shaderModule);
 
@@ -460,15 +477,16 @@ VkPipelineVertexInputStateCreateInfo vertInputInfo(const VkVertexInputBindingDes
 
 // -------------------- TEMPLATES -------------------- //
 
+// the offset is where in the buffer the object is written to
 template <typename ObjectT>
-void writeBuffer(const VkhDeviceMemory& bufferMem, const ObjectT* object, VkDeviceSize size) {
+void writeBuffer(const VkhDeviceMemory& bufferMem, const ObjectT* object, VkDeviceSize size, VkDeviceSize offset = 0) {
     if (object == nullptr) throw std::invalid_argument("Object is null!");
     if (size == 0) throw std::invalid_argument("Buffer size is 0!");
 
     VkDevice device = VkSingleton::v().gdevice();
 
     void* data = nullptr;
-    if (vkMapMemory(device, bufferMem.v(), 0, size, 0, &data) != VK_SUCCESS) {
+    if (vkMapMemory(device, bufferMem.v(), offset, size, 0, &data) != VK_SUCCESS) {
         throw std::runtime_error("Failed to map memory for buffer!");
     }
 
@@ -480,6 +498,20 @@ void writeBuffer(const VkhDeviceMemory& bufferMem, const ObjectT* object, VkDevi
     vkUnmapMemory(device, bufferMem.v());
 }
 
+// writes straight through the mapping if the buffer has one
+template <typename ObjectT>
+void writeBuffer(const BufferObj& buffer, const ObjectT* object, VkDeviceSize size, VkDeviceSize offset = 0) {
+    if (buffer.mapped == nullptr) {
+        writeBuffer(buffer.mem, object, size, offset);
+        return;
+    }
+
+    if (object == nullptr) throw std::invalid_argument("Object is null!");
+    if (size == 0) throw std::invalid_argument("Buffer size is 0!");
+
+    std::memcpy(static_cast<char*>(buffer.mapped) + offset, object, static_cast<size_t>(size));
+}
+
 template <typename ObjectT>
 void createAndWriteLocalBuffer(BufferObj& buffer, const ObjectT* data, VkDeviceSize size, const VkhCommandPool& commandPool, VkQueue queue, VkBufferUsageFlags usage, VkMemoryAllocateFlags memAllocFlags = 0) {
     createDeviceLocalBuffer(buffer, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memAllocFlags);
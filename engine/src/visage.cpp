@@ -1,8 +1,11 @@
 #include "visage.hpp"
 
+#include <chrono>
 #include <stdexcept>
 
 #include "config.hpp"
+#include "libraries/packfile.hpp"
+#include "libraries/scenefile.hpp"
 
 namespace visage {
 void Visage::loadModel(const std::string& file, const dml::vec3& pos, const dml::vec3& scale, const dml::vec4& quat) {
@@ -29,8 +32,68 @@ void Visage::loadModel(const std::string& file, const dml::vec3& pos, float scal
     loadModel(file, pos, {scale, scale, scale}, {0.0f, 0.0f, 0.0f, 1.0f});
 }
 
+void Visage::loadModelAsync(const std::string& file, const dml::vec3& pos, const dml::vec3& scale, const dml::vec4& quat) {
+    if (!m_engineInitialized) {
+        loadModel(file, pos, scale, quat);
+        return;
+    }
+
+    // check if the model has already been loaded, or is still loading
+    for (const scene::ModelData& m : m_modelData) {
+        if (m.file == file) {
+            utils::logWarning("Model: " + file + " has already been loaded!");
+            return;
+        }
+    }
+
+    for (const AsyncModel& m : m_asyncModels) {
+        if (m.data.file == file) {
+            utils::logWarning("Model: " + file + " is already being loaded!");
+            return;
+        }
+    }
+
+    // only registered once its in the scene, so a model that fails to load can be loaded again
+    scene::ModelData data{file, pos, scale, quat};
+
+    // parsing, geometry processing, and image decoding are all done off the main thread
+    // the images are decoded and the primitives loaded on the scene's workers
+    AsyncModel& asyncModel = m_asyncModels.emplace_back();
+    asyncModel.data = data;
+    asyncModel.future = std::async(std::launch::async, [this, data]() {
+        AsyncLoad load{};
+        load.model = m_scene.loadModelFile(data);
+
+        if (load.model) {
+            const scene::LoadedModel& model = *load.model;
+            load.textures = m_textures.stageModelTextures(model.model.get(), model.sourceHash, model.images);
+        }
+
+        return load;
+    });
+}
+
+void Visage::loadModelAsync(const std::string& file, const dml::vec3& pos, const dml::vec3& scale) {
+    loadModelAsync(file, pos, scale, {0.0f, 0.0f, 0.0f, 1.0f});
+}
+
+void Visage::loadModelAsync(const std::string& file, const dml::vec3& pos, float scale) {
+    loadModelAsync(file, pos, {scale, scale, scale}, {0.0f, 0.0f, 0.0f, 1.0f});
+}
+
 void Visage::initialize() {
-    initGLFW();
+    if (!m_pack.empty() && !packfile::mount(cfg::PACK_DIR + m_pack, cfg::SOURCE_DIR)) {
+        throw std::runtime_error("Failed to load pack: " + m_pack);
+    }
+
+    if (!m_sceneFile.empty()) loadSceneFile();
+
+    if (m_headless) {
+        // imgui needs a window, so debug info isnt available
+        m_showDebugInfo = false;
+    } else {
+        initGLFW();
+    }
 
     // init Vulkan components
     auto now = utils::now();
@@ -39,22 +102,33 @@ void Visage::initialize() {
     m_vulkanCore = m_setup.init(m_window);
     m_rtEnabled &= m_setup.isRaytracingSupported();
 
+    // meshlets are only culled for rasterization, and the culled draws need draw indirect count
+    m_meshletCulling &= !m_rtEnabled && m_setup.isDrawIndirectCountSupported();
+
     // disable triple buffering if raytracing is enabled
     m_maxFrames = m_rtEnabled ? 1 : 3;
 
-    // create swapchain
-    m_swap.createSwap(m_vulkanCore, m_setup.getGraphicsFamily());
+    // create swapchain, or an offscreen image per frame in flight if headless
+    if (m_headless) {
+        m_swap.createOffscreen(m_maxFrames);
+    } else {
+        m_swap.createSwap(m_vulkanCore, m_setup.getGraphicsFamily());
+    }
 
     // init renderer
-    m_renderer.init(m_rtEnabled, m_maxFrames, m_showDebugInfo, m_vulkanCore.device, &m_setup, &m_swap, &m_textures, &m_scene, &m_buffers, &m_descs, &m_pipe, &m_raytracing);
+    m_renderer.init(m_rtEnabled, m_meshletCulling, m_maxFrames, m_showDebugInfo, m_vulkanCore.device, &m_setup, &m_swap, &m_textures, &m_scene, &m_buffers, &m_descs, &m_pipe, &m_raytracing, &m_uploads);
     VkhCommandPool commandPool = m_renderer.getCommandPool();
 
+    // models loaded later are uploaded through the transfer queue
+    m_uploads.init(m_maxFrames, m_vulkanCore.device, m_setup.getTransferFamily(), m_setup.getGraphicsFamily(), m_setup.tQueue(), m_setup.gQueue());
+
     // load scene data
-    m_scene.init(m_rtEnabled, m_vulkanCore.device, commandPool, m_setup.gQueue());
+    m_scene.init(m_rtEnabled, !m_rtEnabled && !m_meshletCulling, m_vulkanCore.device, commandPool, m_setup.gQueue());
     m_scene.loadScene(m_modelData);
+    if (!m_instanceData.empty()) m_scene.addInstances(m_instanceData);
 
     // init textures
-    m_textures.init(m_maxFrames, commandPool, m_setup.gQueue(), &m_swap, &m_scene);
+    m_textures.init(m_maxFrames, m_setup.isTextureCompressionBCSupported(), m_meshletCulling, commandPool, m_setup.gQueue(), &m_swap, &m_scene);
     m_textures.loadMeshTextures();
     m_textures.createRenderTextures(m_rtEnabled, true);
 
@@ -66,7 +140,7 @@ void Visage::initialize() {
 
     // setup acceleration structures if raytracing is enabled
     if (m_rtEnabled) {
-        m_raytracing.init(m_maxFrames, commandPool, m_setup.gQueue(), m_vulkanCore.device, &m_scene, &m_textures);
+        m_raytracing.init(m_maxFrames, commandPool, m_setup.gQueue(), m_vulkanCore.device, &m_scene, &m_textures, &m_uploads);
         m_raytracing.createAccelStructures();
     }
 
@@ -74,7 +148,7 @@ void Visage::initialize() {
     m_scene.initSceneData(0.0f, 0.0f, m_swap.getWidth(), m_swap.getHeight());
 
     // create buffers from scene data
-    m_buffers.init(commandPool, m_setup.gQueue(), m_rtEnabled, m_maxFrames, &m_scene);
+    m_buffers.init(m_rtEnabled, m_meshletCulling, m_maxFrames, &m_scene, &m_uploads);
     m_buffers.createBuffers(m_currentFrame);
 
     // init the descriptorsets
@@ -90,7 +164,7 @@ void Visage::initialize() {
     }
 
     // setup imgui
-    imguiSetup();
+    if (!m_headless) imguiSetup();
 
     // setup the framebuffers and command buffers
     m_renderer.createFrameBuffers(true);
@@ -117,13 +191,17 @@ void Visage::render() {
     }
 
     calcFps();
-    glfwPollEvents();
+    if (!m_headless) glfwPollEvents();
     drawFrame();
 
+    m_framesRendered++;
+
     m_sceneChanged = false;
 }
 
 void Visage::lockMouse(bool locked) {
+    if (m_headless) return;
+
     MouseObject* mouse = MouseSingleton::v().getMouse();
     mouse->locked = locked;
 
@@ -170,18 +248,52 @@ void Visage::copyModel(const std::string& fileName) {
     const dml::mat4& view = m_scene.getCamMatrices()->view;
     dml::vec3 pos = dml::getCamWorldPos(view);
 
-    bool copied = m_scene.copyModel(pos, fileName, {0.4f, 0.4f, 0.4f}, {0.0f, 0.0f, 0.0f, 1.0f});
+    m_scene.copyModel(pos, fileName, {0.4f, 0.4f, 0.4f}, {0.0f, 0.0f, 0.0f, 1.0f});
+    m_buffers.updateDrawBuffers();
+    rebuildTLAS();
 
-    if (copied) {
-        m_buffers.updateSceneIndirectCommandsBuffer();
+    m_scene.calcTexIndices();
+}
 
-        if (m_rtEnabled) {
-            m_raytracing.updateTLAS(m_currentFrame, true);
-        }
+std::vector<instancing::InstanceHandle> Visage::spawnInstances(std::span<const scene::ModelData> instances) {
+    if (!m_engineInitialized) {
+        throw std::runtime_error("Cannot spawn instances before the engine has been started!");
+    }
+
+    m_sceneChanged = true;
+    std::vector<instancing::InstanceHandle> handles = m_scene.spawnInstances(instances);
 
-        m_scene.calcTexIndices();
-        m_buffers.createTexIndicesBuffer();
+    if (!handles.empty()) {
+        m_buffers.updateDrawBuffers();
+        rebuildTLAS();
     }
+
+    return handles;
+}
+
+void Visage::destroyInstance(instancing::InstanceHandle handle) {
+    if (!m_scene.instanceExists(handle)) return;
+    m_sceneChanged = true;
+
+    m_scene.destroyInstances({&handle, 1});
+    m_buffers.updateDrawBuffers();
+    rebuildTLAS();
+}
+
+void Visage::setInstanceTransform(instancing::InstanceHandle handle, const dml::vec3& pos, const dml::vec3& scale, const dml::vec4& quat) {
+    if (!m_scene.instanceExists(handle)) return;
+    m_sceneChanged = true;
+
+    // the instances are written to their slots with the rest of the scene data, and the tlas is refit with them
+    m_scene.setInstanceTransform(handle, dvl::calcPlacementMatrix(pos, quat, scale));
+}
+
+void Visage::setNodeTransform(const std::string& fileName, const std::string& nodeName, const dml::vec3& pos, const dml::vec3& scale, const dml::vec4& quat) {
+    m_sceneChanged = true;
+
+    // the world matrices are updated with the rest of the scene data, and the tlas is updated every frame
+    dml::mat4 localMatrix = dml::translate(pos) * dml::rotateQuat(quat) * dml::scale(scale);
+    m_scene.setNodeTransform(fileName, nodeName, localMatrix);
 }
 
 void Visage::createLight(const dml::vec3& pos, const dml::vec3& target, float range) {
@@ -190,8 +302,8 @@ void Visage::createLight(const dml::vec3& pos, const dml::vec3& target, float ra
     size_t batchCount = m_scene.getShadowBatchCount();
     size_t newLightCount = currentLightCount + 1;
 
-    // limit lights spawned
-    if (newLightCount > cfg::MAX_LIGHTS) return;
+    // the light buffers grow with the lights, but the shadow maps have a fixed number of descriptors
+    if (!m_rtEnabled && newLightCount > cfg::MAX_LIGHTS) return;
 
     m_scene.createLight(pos, target, range);
 
@@ -241,10 +353,41 @@ void Visage::resetScene() {
     // reset objects
     m_scene.resetObjects();
     m_scene.calcTexIndices();
-    m_buffers.createTexIndicesBuffer();
-    m_buffers.updateSceneIndirectCommandsBuffer();
-    if (m_rtEnabled) {
-        m_raytracing.updateTLAS(m_currentFrame, true);
+    m_buffers.updateDrawBuffers();
+    rebuildTLAS();
+}
+
+void Visage::loadSceneFile() {
+    scenefile::Scene scene{};
+    if (!scenefile::load(cfg::SCENE_DIR + m_sceneFile, cfg::CACHE_DIR, scene)) {
+        throw std::runtime_error("Failed to load scene: " + m_sceneFile);
+    }
+
+    // the first instance of each model is where the model is loaded, the rest are placed once theyre all loaded
+    std::vector<bool> modelLoaded(scene.models.size());
+    m_instanceData.reserve(m_instanceData.size() + scene.instances.size());
+
+    for (const scenefile::Instance& instance : scene.instances) {
+        scene::ModelData data{};
+        data.file = scene.models[instance.model];
+        data.pos = {instance.pos[0], instance.pos[1], instance.pos[2]};
+        data.scale = {instance.scale[0], instance.scale[1], instance.scale[2]};
+        data.quat = {instance.rotation[0], instance.rotation[1], instance.rotation[2], instance.rotation[3]};
+
+        if (modelLoaded[instance.model]) {
+            m_instanceData.push_back(std::move(data));
+        } else {
+            m_modelData.push_back(std::move(data));
+            modelLoaded[instance.model] = true;
+        }
+    }
+
+    for (size_t i = 0; i < scene.models.size(); i++) {
+        utils::logWarning(scene.models[i] + " has no instances in " + m_sceneFile, !modelLoaded[i]);
+    }
+
+    for (const scenefile::Light& light : scene.lights) {
+        createLight({light.pos[0], light.pos[1], light.pos[2]}, {light.target[0], light.target[1], light.target[2]}, light.range);
     }
 }
 
@@ -305,7 +448,14 @@ void Visage::imguiCheckResult(VkResult err) {
 
 void Visage::imguiSetup() {
     std::string path = cfg::FONT_DIR + std::string("OpenSans/OpenSans-VariableFont_wdth,wght.ttf");
-    ImGui::GetIO().Fonts->AddFontFromFileTTF(path.c_str(), 50.0f);
+    if (!packfile::openMapped(m_fontFile, path)) {
+        throw std::runtime_error("Failed to open font: " + path);
+    }
+
+    // the font is read straight from the mapping, so the atlas cant own it
+    ImFontConfig fontConfig{};
+    fontConfig.FontDataOwnedByAtlas = false;
+    ImGui::GetIO().Fonts->AddFontFromMemoryTTF(const_cast<uint8_t*>(m_fontFile.data()), static_cast<int>(m_fontFile.size()), 50.0f, &fontConfig);
 
     // descriptor set creation for imgui
     imguiDSLayout();
@@ -387,6 +537,77 @@ void Visage::recreateSwap() {
     m_renderer.createFrameBuffers(false);
 }
 
+void Visage::processAsyncModels() {
+    // anything replaced by an earlier upload is freed once the frames that used it are done
+    m_uploads.collect();
+
+    // the models are added one at a time, since each one copies the buffers created by the last
+    if (m_asyncModels.empty()) return;
+    AsyncModel& asyncModel = m_asyncModels.front();
+    AsyncLoad& load = asyncModel.load;
+
+    if (!asyncModel.batch) {
+        if (asyncModel.future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+        try {
+            load = asyncModel.future.get();
+        } catch (const std::exception& e) {
+            utils::logWarning(e.what());
+            m_asyncModels.pop_front();
+            return;
+        }
+
+        // the reason was logged when it failed to load
+        if (!load.model) {
+            m_asyncModels.pop_front();
+            return;
+        }
+
+        const std::string& file = load.model->data.file;
+        if (m_textures.getMeshTexCount() + load.textures.textures.size() > m_descs.getTextureCapacity()) {
+            utils::logWarning("Model: " + file + " has too many textures to be added to the scene!");
+            m_asyncModels.pop_front();
+            return;
+        }
+
+        asyncModel.batch = m_uploads.begin();
+        m_scene.recordModelUpload(m_uploads, *asyncModel.batch, *load.model);
+        m_textures.recordTextureUpload(m_uploads, *asyncModel.batch, load.textures);
+        m_uploads.submit(*asyncModel.batch);
+        return;
+    }
+
+    if (!m_uploads.isComplete(*asyncModel.batch)) return;
+
+    // the copies are done, so the model is merged into the scene
+    size_t firstTexture = m_textures.getMeshTexCount();
+    m_textures.addTextures(load.textures);
+    m_descs.addMeshTextures(firstTexture);
+
+    m_scene.addModel(m_uploads, *load.model, firstTexture);
+    m_modelData.push_back(asyncModel.data);
+    m_buffers.updateDrawBuffers();
+
+    // each frame in flight has its own tex indices, which are written or grown when the frame comes around
+    m_scene.calcTexIndices();
+
+    // the blas are built on the graphics queue along with the rest of the batch
+    if (m_rtEnabled) m_raytracing.recordNewBLAS(*asyncModel.batch);
+
+    // submitted before this frame, so the frame sees everything that was added
+    m_uploads.finish(std::move(asyncModel.batch));
+    rebuildTLAS();
+
+    m_sceneChanged = true;
+    m_asyncModels.pop_front();
+}
+
+void Visage::rebuildTLAS() {
+    if (!m_rtEnabled) return;
+
+    m_raytracing.updateTLAS(m_currentFrame, true);
+}
+
 void Visage::drawFrame() {
     // get next frame
     m_currentFrame = (m_maxFrames == 1) ? 0 : (m_currentFrame + 1) % m_maxFrames;
@@ -395,21 +616,35 @@ void Visage::drawFrame() {
     vkWaitForFences(m_vulkanCore.device, 1, m_renderer.getFence(m_currentFrame), VK_TRUE, UINT64_MAX);
     vkResetFences(m_vulkanCore.device, 1, m_renderer.getFence(m_currentFrame));
 
+    // merge in any models that have finished loading
+    processAsyncModels();
+
     // acquire the next image from the swapchain
-    VkResult acquireNextImageResult = vkAcquireNextImageKHR(m_vulkanCore.device, m_swap.getSwap(), UINT64_MAX, m_renderer.getImageAvailableSemaphore(m_currentFrame), VK_NULL_HANDLE, m_swap.getImageIndexP());
-    if (acquireNextImageResult != VK_SUCCESS && acquireNextImageResult != VK_SUBOPTIMAL_KHR) {
-        throw std::runtime_error("failed to acquire swap chain image!");
+    // offscreen images are tied to the frame in flight, so nothing needs to be acquired
+    if (m_headless) {
+        *m_swap.getImageIndexP() = m_currentFrame;
+    } else {
+        VkResult acquireNextImageResult = vkAcquireNextImageKHR(m_vulkanCore.device, m_swap.getSwap(), UINT64_MAX, m_renderer.getImageAvailableSemaphore(m_currentFrame), VK_NULL_HANDLE, m_swap.getImageIndexP());
+        if (acquireNextImageResult != VK_SUCCESS && acquireNextImageResult != VK_SUBOPTIMAL_KHR) {
+            throw std::runtime_error("failed to acquire swap chain image!");
+        }
     }
 
     // update buffers
     m_scene.updateSceneData(m_mouseUp, m_mouseRight, m_swap.getWidth(), m_swap.getHeight());
-    m_buffers.update(m_currentFrame);
+    if (m_buffers.update(m_currentFrame)) {
+        m_descs.updateLightBuffer(m_currentFrame);
+        m_descs.updateTexIndices(m_currentFrame);
+    }
 
     // update TLAS if raytracing is enabled
-    if (m_rtEnabled) {
-        m_raytracing.updateTLAS(m_currentFrame, false);
+    if (m_rtEnabled && m_raytracing.updateTLAS(m_currentFrame, false)) {
+        m_descs.updateTLAS(m_currentFrame, m_raytracing.tlasData(m_rtEnabled));
     }
 
+    // every copy of the instances has been told what changed
+    m_scene.clearDirtyInstanceRanges();
+
     // record command buffers and draw the frame
     VkResult drawFrameResult = m_renderer.drawFrame(m_currentFrame, static_cast<float>(m_fps), m_sceneChanged);
 
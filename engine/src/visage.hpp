@@ -6,6 +6,11 @@
 #include <imgui_impl_vulkan.h>
 #include <vulkan/vulkan.h>
 
+#include <deque>
+#include <future>
+#include <memory>
+#include <span>
+
 #include "internal/vk-buffers.hpp"
 #include "internal/vk-descriptorsets.hpp"
 #include "internal/vk-pipelines.hpp"
@@ -15,6 +20,8 @@
 #include "internal/vk-setup.hpp"
 #include "internal/vk-swapchain.hpp"
 #include "internal/vk-textures.hpp"
+#include "internal/vk-uploads.hpp"
+#include "libraries/mappedfile.hpp"
 #include "mouse.hpp"
 
 namespace visage {
@@ -28,7 +35,7 @@ public:
 
     ~Visage() {
         vkDeviceWaitIdle(m_vulkanCore.device);
-        imguiCleanup();
+        if (!m_headless) imguiCleanup();
     }
 
     // asset loading
@@ -36,11 +43,29 @@ public:
     void loadModel(const std::string& file, const dml::vec3& pos, const dml::vec3& scale);
     void loadModel(const std::string& file, const dml::vec3& pos, float scale);
 
+    // once the engine has been started, the model is loaded in the background and added to the scene when it's ready
+    // before then it's the same as loadModel
+    void loadModelAsync(const std::string& file, const dml::vec3& pos, const dml::vec3& scale, const dml::vec4& quat);
+    void loadModelAsync(const std::string& file, const dml::vec3& pos, const dml::vec3& scale);
+    void loadModelAsync(const std::string& file, const dml::vec3& pos, float scale);
+    [[nodiscard]] size_t getPendingModelCount() const noexcept { return m_asyncModels.size(); }
+
     void loadSkybox(const std::string& file) noexcept { m_skybox = file; }
 
+    // the models, instances and lights of a scene file are loaded with the engine in one batch
+    // has to be set before the engine is initialized
+    void loadScene(const std::string& file) noexcept { m_sceneFile = file; }
+
+    // assets are read from the pack instead of from disk when it has them
+    // packs are made with visage-pack, and have to be set before the engine is initialized
+    void loadPack(const std::string& file) noexcept { m_pack = file; }
+
     // core
     void initialize();
-    [[nodiscard]] bool isRunning() noexcept { return !glfwWindowShouldClose(m_window); }
+    [[nodiscard]] bool isRunning() noexcept {
+        if (m_headless) return m_framesRendered < m_headlessFrameCount;
+        return !glfwWindowShouldClose(m_window);
+    }
     void render();
 
     // camera
@@ -52,6 +77,17 @@ public:
     // scene modification
     void copyModel(const std::string& fileName);
 
+    // places instances of loaded models in one batch, and returns a handle for each one
+    // theyre kept when the scene is reset, and are only removed when theyre destroyed
+    std::vector<instancing::InstanceHandle> spawnInstances(std::span<const scene::ModelData> instances);
+    void destroyInstance(instancing::InstanceHandle handle);
+
+    // moves every mesh of a spawned instance, only the ones that moved are uploaded again
+    void setInstanceTransform(instancing::InstanceHandle handle, const dml::vec3& pos, const dml::vec3& scale, const dml::vec4& quat);
+
+    // moves a node of a loaded model relative to its parent, along with every node under it
+    void setNodeTransform(const std::string& fileName, const std::string& nodeName, const dml::vec3& pos, const dml::vec3& scale, const dml::vec4& quat);
+
     void createLight(const dml::vec3& pos, const dml::vec3& target, float range);
     void createLightAtCamera(float range);
     void createPlayerLight(float range);
@@ -63,7 +99,7 @@ public:
     [[nodiscard]] uint32_t getScreenHeight() const noexcept { return m_swap.getHeight(); }
 
     // keyboard
-    [[nodiscard]] bool isKeyHeld(int key) const { return glfwGetKey(m_window, key) == GLFW_PRESS; }
+    [[nodiscard]] bool isKeyHeld(int key) const { return !m_headless && glfwGetKey(m_window, key) == GLFW_PRESS; }
     [[nodiscard]] bool isKeyReleased(int key) {
         bool held = isKeyHeld(key);
         bool released = m_prevKeyStates[key] == GLFW_PRESS && !held;
@@ -73,7 +109,9 @@ public:
     }
 
     // setters
-    void setCursorPos(float x, float y) { glfwSetCursorPos(m_window, x, y); }
+    void setCursorPos(float x, float y) {
+        if (!m_headless) glfwSetCursorPos(m_window, x, y);
+    }
 
     void setMouseSensitivity(float sensitivity) noexcept {
         MouseObject* mouse = MouseSingleton::v().getMouse();
@@ -83,6 +121,29 @@ public:
     void enableRaytracing() noexcept { m_rtEnabled = true; }
     void showDebugInfo() noexcept { m_showDebugInfo = true; }
 
+    // draw whole objects instead of gpu culled meshlets
+    void disableMeshletCulling() noexcept { m_meshletCulling = false; }
+
+    // render frameCount frames into offscreen images without creating a window
+    void enableHeadless(uint32_t frameCount) noexcept {
+        m_headless = true;
+        m_headlessFrameCount = frameCount;
+    }
+
+private:
+    // a model loaded after the engine was started, with its textures
+    struct AsyncLoad {
+        std::unique_ptr<scene::LoadedModel> model{};
+        textures::StagedTextures textures{};
+    };
+
+    struct AsyncModel {
+        scene::ModelData data{};
+        std::future<AsyncLoad> future{};
+        AsyncLoad load{};
+        std::unique_ptr<uploads::Batch> batch{};  // the upload, once the model has loaded
+    };
+
 private:
     core::VkCore m_vulkanCore{};
     bool m_engineInitialized = false;
@@ -96,6 +157,10 @@ private:
     pipelines::VkPipelines m_pipe{};
     raytracing::VkRaytracing m_raytracing{};
     renderer::VkRenderer m_renderer{};
+    uploads::VkUploads m_uploads{};
+
+    // declared after everything the loads use, so theyre finished before anything they read from is destroyed
+    std::deque<AsyncModel> m_asyncModels;
 
     // frame data
     uint32_t m_currentFrame = 0;
@@ -105,14 +170,24 @@ private:
     // descriptor sets and pools
     VkhDescriptorPool m_imguiDescriptorPool{};
     VkhDescriptorSetLayout m_imguiDescriptorSetLayout{};
+    mappedfile::MappedFile m_fontFile{};
 
     // engine data
     std::vector<scene::ModelData> m_modelData;
+    std::vector<scene::ModelData> m_instanceData;
     std::string m_skybox{};
+    std::string m_pack{};
+    std::string m_sceneFile{};
     bool m_rtEnabled = false;
+    bool m_meshletCulling = true;
     bool m_sceneChanged = false;
     bool m_showDebugInfo = false;
 
+    // headless
+    bool m_headless = false;
+    uint32_t m_headlessFrameCount = 0;
+    uint32_t m_framesRendered = 0;
+
     // glfw
     GLFWwindow* m_window = nullptr;
     float m_mouseUp = 0.0f;
@@ -121,6 +196,7 @@ private:
 
 private:
     void initGLFW();
+    void loadSceneFile();
 
     // imgui
     void imguiDSLayout();
@@ -131,6 +207,8 @@ private:
 
     void calcFps();
     void recreateSwap();
+    void processAsyncModels();
+    void rebuildTLAS();
     void drawFrame();
 };
 }  // namespace visage
@@ -0,0 +1,116 @@
+// Times the cpu instance cull from 10k to 100k instances, on the calling thread alone and split across a thread pool
+// Usage: visage-cullbench [max threads] [runs]
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "libraries/frustumcull.hpp"
+
+namespace {
+// random spheres in a cube around the camera, roughly a tenth of them end up in the camera frustum
+frustumcull::Spheres makeSpheres(size_t count) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> radius(0.5f, 5.0f);
+
+    frustumcull::Spheres spheres;
+    spheres.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        spheres.set(i, dml::vec3(position(rng), position(rng), position(rng)), radius(rng));
+    }
+
+    return spheres;
+}
+
+frustumcull::Frustum makeFrustum(float right, float up) {
+    dml::mat4 view = dml::viewMatrix(dml::vec3(0.0f, 0.0f, 0.0f), right, up);
+    dml::mat4 proj = dml::projection(60.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+    return frustumcull::extractFrustum(proj * view);
+}
+
+// runs the cull the given number of times and returns the fastest run in microseconds
+// threadCount of 1 tests every sphere on the calling thread, otherwise a pool of threadCount - 1 workers helps
+double timeCull(const frustumcull::Spheres& spheres, std::span<const frustumcull::Frustum> frusta, size_t threadCount, size_t runs, std::vector<uint8_t>& visible) {
+    std::unique_ptr<threadpool::ThreadPool> pool;
+    if (threadCount > 1) pool = std::make_unique<threadpool::ThreadPool>(threadCount - 1);
+
+    visible.assign(spheres.size(), 0);
+    double best = 0.0;
+
+    for (size_t i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        if (pool) {
+            frustumcull::testSpheres(*pool, spheres, frusta, visible.data());
+        } else {
+            frustumcull::testSpheres(spheres, frusta, 0, spheres.size(), visible.data());
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double us = std::chrono::duration<double, std::micro>(end - start).count();
+        if (i == 0 || us < best) best = us;
+    }
+
+    return best;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    size_t runs = 50;
+
+    try {
+        if (argc > 1) maxThreads = std::stoul(argv[1]);
+        if (argc > 2) runs = std::stoul(argv[2]);
+    } catch (const std::exception&) {
+        std::cerr << "Usage: visage-cullbench [max threads] [runs]\n";
+        return 1;
+    }
+
+    if (maxThreads == 0 || runs == 0) {
+        std::cerr << "Max threads and runs must be at least 1\n";
+        return 1;
+    }
+
+    // the camera view is tested against one frustum, the shadow view against one per light
+    std::vector<frustumcull::Frustum> cameraFrusta = {makeFrustum(0.0f, 0.0f)};
+    std::vector<frustumcull::Frustum> lightFrusta = {makeFrustum(0.3f, 0.0f), makeFrustum(-0.3f, 1.5f), makeFrustum(0.1f, 3.1f), makeFrustum(-0.5f, 4.6f)};
+
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << ", runs: " << runs << ", times are the fastest run in us\n";
+    std::cout << std::setw(10) << "instances" << std::setw(9) << "threads" << std::setw(10) << "visible" << std::setw(12) << "camera" << std::setw(12) << "4 lights" << "\n";
+
+    for (size_t count : {10000, 25000, 50000, 100000}) {
+        frustumcull::Spheres spheres = makeSpheres(count);
+
+        std::vector<uint8_t> expectedCamera;
+        std::vector<uint8_t> expectedLights;
+
+        for (size_t threads = 1; threads <= maxThreads; threads++) {
+            std::vector<uint8_t> visibleCamera;
+            std::vector<uint8_t> visibleLights;
+            double cameraUs = timeCull(spheres, cameraFrusta, threads, runs, visibleCamera);
+            double lightsUs = timeCull(spheres, lightFrusta, threads, runs, visibleLights);
+
+            // every split has to give the same result as the calling thread alone
+            if (threads == 1) {
+                expectedCamera = visibleCamera;
+                expectedLights = visibleLights;
+            } else if (visibleCamera != expectedCamera || visibleLights != expectedLights) {
+                std::cerr << "Visibility differs with " << threads << " threads!\n";
+                return 1;
+            }
+
+            double visiblePercent = 100.0 * static_cast<double>(std::count(visibleCamera.begin(), visibleCamera.end(), 1)) / static_cast<double>(count);
+
+            std::cout << std::fixed << std::setprecision(1);
+            std::cout << std::setw(10) << count << std::setw(9) << threads << std::setw(9) << visiblePercent << "%" << std::setw(12) << cameraUs << std::setw(12) << lightsUs << "\n";
+        }
+    }
+
+    return 0;
+}
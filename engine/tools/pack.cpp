@@ -0,0 +1,149 @@
+// Bakes the assets a scene loads into a single pack
+// Models have to be loaded by the engine once first, so their mesh and texture caches exist
+
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <unordered_set>
+
+#include "config.hpp"
+#include "libraries/mappedfile.hpp"
+#include "libraries/packfile.hpp"
+#include "libraries/scenefile.hpp"
+#include "libraries/utils.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+void addEntry(std::vector<packfile::PackEntry>& entries, const fs::path& path) {
+    std::string name = path.lexically_normal().lexically_relative(cfg::SOURCE_DIR).generic_string();
+    entries.push_back({name, path.string()});
+}
+
+// every file in a directory, sorted so packs are reproducible
+std::vector<fs::path> listFiles(const fs::path& dir, const std::string& extension) {
+    std::vector<fs::path> files;
+
+    std::error_code ec;
+    for (const auto& entry : fs::recursive_directory_iterator(dir, ec)) {
+        if (entry.is_regular_file() && (extension.empty() || entry.path().extension() == extension)) {
+            files.push_back(entry.path());
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// caches are named after the hash of their source file
+std::string getHashName(const mappedfile::MappedFile& source) {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << utils::hashBytes(source.data(), source.size());
+    return name.str();
+}
+
+bool addModel(std::vector<packfile::PackEntry>& entries, const std::string& file) {
+    fs::path path = cfg::MODEL_DIR + file;
+
+    mappedfile::MappedFile source;
+    if (!source.open(path.string())) {
+        utils::logWarning("Failed to open model: " + path.string());
+        return false;
+    }
+
+    addEntry(entries, path);
+
+    std::string hash = getHashName(source);
+
+    size_t cacheCount = 0;
+    for (const fs::path& cache : listFiles(cfg::CACHE_DIR, "")) {
+        std::string name = cache.filename().string();
+        if (name.starts_with(hash) && (cache.extension() == ".vmesh" || cache.extension() == ".ktx2")) {
+            addEntry(entries, cache);
+            cacheCount++;
+        }
+    }
+
+    utils::logWarning("No caches found for " + file + ", it will be processed on load", cacheCount == 0);
+    return true;
+}
+
+bool addSkybox(std::vector<packfile::PackEntry>& entries, const std::string& file) {
+    fs::path path = cfg::SKYBOX_DIR + file;
+
+    mappedfile::MappedFile source;
+    if (!source.open(path.string())) {
+        utils::logWarning("Failed to open skybox: " + path.string());
+        return false;
+    }
+
+    addEntry(entries, path);
+
+    // the converted cubemap is loaded instead of the atlas when it exists
+    fs::path cache = cfg::CACHE_DIR + getHashName(source) + "-sky.ktx2";
+    if (fs::exists(cache)) {
+        addEntry(entries, cache);
+    } else {
+        utils::logWarning("No cache found for " + file + ", it will be converted on load");
+    }
+
+    return true;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: visage-pack <pack> <skybox> <model or scene.json>...\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<packfile::PackEntry> entries;
+
+    // scenes are loaded first, then the models they use
+    std::vector<std::string> models;
+    for (int i = 3; i < argc; i++) {
+        std::string file = argv[i];
+        if (!file.ends_with(".json")) {
+            models.push_back(file);
+            continue;
+        }
+
+        // loading the scene writes its binary form if it doesnt exist yet
+        scenefile::Scene scene{};
+        fs::path path = cfg::SCENE_DIR + file;
+        if (!scenefile::load(path.string(), cfg::CACHE_DIR, scene)) {
+            utils::logWarning("Failed to open scene: " + path.string());
+            return EXIT_FAILURE;
+        }
+
+        mappedfile::MappedFile source;
+        source.open(path.string());
+
+        addEntry(entries, path);
+        addEntry(entries, cfg::CACHE_DIR + getHashName(source) + ".vscene");
+        models.insert(models.end(), scene.models.begin(), scene.models.end());
+    }
+
+    // entries are in the order the engine loads them, so startup reads the pack front to back
+    std::unordered_set<std::string> added;
+    for (const std::string& model : models) {
+        if (added.insert(model).second && !addModel(entries, model)) return EXIT_FAILURE;
+    }
+
+    if (!addSkybox(entries, argv[2])) return EXIT_FAILURE;
+
+    for (const fs::path& shader : listFiles(cfg::SHADER_DIR, ".spv")) {
+        addEntry(entries, shader);
+    }
+
+    for (const fs::path& font : listFiles(cfg::FONT_DIR, ".ttf")) {
+        addEntry(entries, font);
+    }
+
+    std::string path = cfg::PACK_DIR + argv[1];
+    if (!packfile::write(path, entries)) return EXIT_FAILURE;
+
+    std::cout << "Packed " << entries.size() << " files into " << path << "\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+// Times the vertex welding in dvl::loadMesh against the std::unordered_map path it replaced
+// Usage: visage-weldbench [grid size] [runs]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "libraries/dvl.hpp"
+#include "libraries/utils.hpp"
+
+namespace {
+struct WeldResult {
+    std::vector<dvl::Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// the hash loadMesh used before VertexWelder
+struct VertHash {
+    size_t operator()(const dvl::Vertex& vertex) const {
+        size_t seed = 0;
+
+        utils::combineHash(seed, vertex.pos.x);
+        utils::combineHash(seed, vertex.pos.y);
+        utils::combineHash(seed, vertex.pos.z);
+
+        utils::combineHash(seed, vertex.tex.x);
+        utils::combineHash(seed, vertex.tex.y);
+
+        utils::combineHash(seed, vertex.normal.x);
+        utils::combineHash(seed, vertex.normal.y);
+        utils::combineHash(seed, vertex.normal.z);
+
+        utils::combineHash(seed, vertex.tangent.x);
+        utils::combineHash(seed, vertex.tangent.y);
+        utils::combineHash(seed, vertex.tangent.z);
+
+        return seed;
+    }
+};
+
+// an unindexed grid, the same as loadMesh sees before welding
+// a grid of size * size vertices has 2 * (size - 1)^2 triangles
+std::vector<dvl::Vertex> makeGrid(size_t size) {
+    std::vector<dvl::Vertex> grid(size * size);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            dvl::Vertex& vertex = grid[y * size + x];
+            float u = static_cast<float>(x) / static_cast<float>(size - 1);
+            float v = static_cast<float>(y) / static_cast<float>(size - 1);
+
+            vertex.pos = {u * 100.0f, std::sin(u * 20.0f) * std::cos(v * 20.0f), v * 100.0f};
+            vertex.tex = {u, v};
+            vertex.normal = {0.0f, 1.0f, 0.0f};
+            vertex.tangent = {1.0f, 0.0f, 0.0f};
+        }
+    }
+
+    std::vector<dvl::Vertex> stream;
+    stream.reserve((size - 1) * (size - 1) * 6);
+
+    for (size_t y = 0; y + 1 < size; y++) {
+        for (size_t x = 0; x + 1 < size; x++) {
+            size_t i = y * size + x;
+            for (size_t corner : {i, i + size, i + 1, i + 1, i + size, i + size + 1}) {
+                stream.push_back(grid[corner]);
+            }
+        }
+    }
+
+    return stream;
+}
+
+WeldResult weldUnorderedMap(const std::vector<dvl::Vertex>& stream) {
+    WeldResult result;
+    std::unordered_map<dvl::Vertex, uint32_t, VertHash> uniqueVertices;
+
+    for (const dvl::Vertex& vertex : stream) {
+        if (uniqueVertices.count(vertex) == 0) {
+            uniqueVertices[vertex] = static_cast<uint32_t>(result.vertices.size());
+            result.vertices.push_back(vertex);
+        }
+        result.indices.push_back(uniqueVertices[vertex]);
+    }
+
+    return result;
+}
+
+// the table is sized from the stream length, like loadMesh sizes it from the accessor count
+WeldResult weldVertexWelder(const std::vector<dvl::Vertex>& stream) {
+    WeldResult result;
+    dvl::VertexWelder welder(stream.size());
+    result.indices.reserve(stream.size());
+
+    for (const dvl::Vertex& vertex : stream) {
+        result.indices.push_back(welder.weld(vertex));
+    }
+
+    result.vertices = std::move(welder.getVertices());
+    return result;
+}
+
+// runs the weld the given number of times and returns the fastest run in milliseconds
+template <typename Func>
+double timeWeld(Func&& weld, const std::vector<dvl::Vertex>& stream, size_t runs, WeldResult& result) {
+    double best = 0.0;
+    for (size_t i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        result = weld(stream);
+        auto end = std::chrono::steady_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (i == 0 || ms < best) best = ms;
+    }
+
+    return best;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t size = 708;
+    size_t runs = 5;
+
+    try {
+        if (argc > 1) size = std::stoul(argv[1]);
+        if (argc > 2) runs = std::stoul(argv[2]);
+    } catch (const std::exception&) {
+        std::cerr << "Usage: visage-weldbench [grid size] [runs]\n";
+        return 1;
+    }
+
+    if (size < 2 || runs == 0) {
+        std::cerr << "Grid size must be at least 2 and runs at least 1\n";
+        return 1;
+    }
+
+    std::vector<dvl::Vertex> stream = makeGrid(size);
+    std::cout << "Triangles: " << stream.size() / 3 << ", unique vertices: " << size * size << ", runs: " << runs << "\n";
+
+    WeldResult mapResult;
+    WeldResult welderResult;
+    double mapMs = timeWeld(weldUnorderedMap, stream, runs, mapResult);
+    double welderMs = timeWeld(weldVertexWelder, stream, runs, welderResult);
+
+    // both paths have to produce the same buffers for the timings to mean anything
+    if (mapResult.indices != welderResult.indices || !std::equal(mapResult.vertices.begin(), mapResult.vertices.end(), welderResult.vertices.begin(), welderResult.vertices.end())) {
+        std::cerr << "Welded buffers differ!\n";
+        return 1;
+    }
+
+    std::cout << "unordered_map: " << mapMs << " ms\n";
+    std::cout << "VertexWelder:  " << welderMs << " ms (" << mapMs / welderMs << "x)\n";
+    return 0;
+}